@@ -12,6 +12,19 @@ CONFIG += pillow_ssl
 #CONFIG += pillow_zlib
 #PILLOW_ZLIB_LIBS = -lz
 
+# Uncomment the following line to let HttpsServer clients resume their TLS sessions (session cache and session tickets).
+# This links OpenSSL directly and reaches into the OpenSSL backend of Qt 5 through its private headers: both must use the same OpenSSL.
+#CONFIG += pillow_openssl
+
+# Uncomment the following line to parse request headers with the line oriented parser (parser/fastparser.c) instead of the Ragel generated one.
+#CONFIG += pillow_fast_parser
+
+# Uncomment the following line to build in C++20 mode, enabling the coroutine handlers of HttpCoroutine.h (needs Qt 5.12 or later).
+#CONFIG += pillow_coroutines
+
+# Uncomment the following line to leave out the static tracepoints (see pillowcore/private/Trace.h). They are otherwise compiled in when <sys/sdt.h> is available.
+#CONFIG += pillow_no_tracing
+
 #
 # Project Setup (not configurable)
 #
@@ -23,6 +36,21 @@ pillow_no_ssl: DEFINES += PILLOW_NO_SSL
 
 pillow_zlib: DEFINES += PILLOW_ZLIB
 
+pillow_openssl:!pillow_no_ssl {
+	!equals(QT_MAJOR_VERSION, 5): error("CONFIG += pillow_openssl needs Qt 5.")
+	DEFINES += PILLOW_OPENSSL
+}
+
+pillow_fast_parser: DEFINES += PILLOW_FAST_PARSER
+
+pillow_no_tracing: DEFINES += PILLOW_NO_TRACING
+
+pillow_coroutines {
+	CONFIG += c++2a
+	*-g++*:equals(QMAKE_GCC_MAJOR_VERSION, 10): QMAKE_CXXFLAGS += -fcoroutines # Later versions enable them with C++20.
+	DEFINES += PILLOW_ENABLE_COROUTINES
+}
+
 PILLOWCORE_LIB_NAME = pillowcore
 CONFIG(debug, debug|release) {
 	TARGET = $${TARGET}d # Append a "d" suffix on debug libs.
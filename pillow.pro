@@ -1,9 +1,10 @@
 include(config.pri)
 
 TEMPLATE = subdirs
-SUBDIRS = pillowcore tests examples
+SUBDIRS = pillowcore tests examples tools
 
 tests.depends = pillowcore
 examples.depends = pillowcore
+tools.depends = pillowcore
 
 OTHER_FILES += README pillow.qbs
@@ -10,6 +10,22 @@
 #ifndef QSTRINGBUILDER_H
 #include <QtCore/QStringBuilder>
 #endif // QSTRINGBUILDER_H
+#ifndef QVARLENGTHARRAY_H
+#include <QtCore/QVarLengthArray>
+#endif // QVARLENGTHARRAY_H
+#include <string.h>
+
+// Vectorized helpers are selected at compile time: SSE2 is part of the x86-64 baseline, and NEON of AArch64's.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PILLOW_SSE2
+#include <emmintrin.h>
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && defined(__aarch64__)
+#define PILLOW_NEON
+#include <arm_neon.h>
+#endif
+#if defined(Q_CC_MSVC)
+#include <intrin.h>
+#endif
 
 namespace Pillow
 {
@@ -131,65 +147,173 @@ namespace Pillow
 			}
 		}
 
-		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const QByteArray& second)
+		//
+		// Scalar reference implementations of the functions below. Used for the tails that are too short
+		// for vector registers, and kept around to test and benchmark the vectorized versions against.
+		//
+		namespace Scalar
 		{
-			if (first.size() != second.size()) return false;
-			for (register int i = 0; i < first.size(); ++i)
+			inline bool asciiEqualsCaseInsensitive(const char* first, const char* second, int size)
 			{
-				register char f = first.at(i), s = second.at(i);
-				bool good = (f == s) || ((f - s) == 32 && f >= 'a' && f <= 'z') || ((f - s) == -32 && f >= 'A' && f <= 'Z');
-				if (!good) return false;
+				for (int i = 0; i < size; ++i)
+				{
+					char f = first[i], s = second[i];
+					bool good = (f == s) || ((f - s) == 32 && f >= 'a' && f <= 'z') || ((f - s) == -32 && f >= 'A' && f <= 'Z');
+					if (!good) return false;
+				}
+				return true;
+			}
+
+			inline int indexOfEither(const char* data, int size, char first, char second)
+			{
+				for (int i = 0; i < size; ++i)
+					if (data[i] == first || data[i] == second) return i;
+				return -1;
 			}
-			return true;
 		}
 
-		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const QLatin1Literal& second)
+		namespace Internal
 		{
-			if (first.size() != second.size()) return false;
-			const char* sec = second.data();
-			for (register int i = 0; i < first.size(); ++i)
+			inline int countTrailingZeros(uint value)
 			{
-				register char f = first.at(i), s = sec[i];
-				bool good = (f == s) || ((f - s) == 32 && f >= 'a' && f <= 'z') || ((f - s) == -32 && f >= 'A' && f <= 'Z');
-				if (!good) return false;
+#if defined(Q_CC_GNU) || defined(Q_CC_CLANG)
+				return __builtin_ctz(value);
+#elif defined(Q_CC_MSVC)
+				unsigned long result; _BitScanForward(&result, value); return int(result);
+#else
+				int result = 0; while ((value & 1) == 0) { value >>= 1; ++result; } return result;
+#endif
+			}
+
+			// Sets bit 0x20 (lowercase) on the ASCII uppercase letters of 8 packed bytes, leaving all other bytes alone.
+			inline quint64 toLower8(quint64 x)
+			{
+				const quint64 heptets = x & Q_UINT64_C(0x7f7f7f7f7f7f7f7f);
+				const quint64 aboveZ = heptets + Q_UINT64_C(0x2525252525252525); // High bit set for bytes > 'Z'.
+				const quint64 atLeastA = heptets + Q_UINT64_C(0x3f3f3f3f3f3f3f3f); // High bit set for bytes >= 'A'.
+				const quint64 upper = ~x & (aboveZ ^ atLeastA) & Q_UINT64_C(0x8080808080808080);
+				return x | (upper >> 2);
+			}
+
+#if defined(PILLOW_SSE2)
+			inline __m128i toLower16(__m128i x)
+			{
+				// ASCII letters are positive as signed bytes, so signed comparisons leave bytes >= 0x80 alone.
+				const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(x, _mm_set1_epi8('Z' + 1)));
+				return _mm_or_si128(x, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
 			}
-			return true;
+#elif defined(PILLOW_NEON)
+			inline uint8x16_t toLower16(uint8x16_t x)
+			{
+				const uint8x16_t upper = vandq_u8(vcgeq_u8(x, vdupq_n_u8('A')), vcleq_u8(x, vdupq_n_u8('Z')));
+				return vorrq_u8(x, vandq_u8(upper, vdupq_n_u8(0x20)));
+			}
+#endif
 		}
 
-		inline bool asciiEqualsCaseInsensitive(const char* first, int firstSize, const char* second, int secondSize)
+		// Case insensitive (for ASCII letters only) comparison of two buffers of the same size.
+		// Compares 16 bytes at a time with SSE2 or NEON when available, then 8 bytes at a time.
+		inline bool asciiEqualsCaseInsensitive(const char* first, const char* second, int size)
 		{
-			if (firstSize != secondSize) return false;
-			for (register int i = 0; i < firstSize; ++i)
+			int i = 0;
+#if defined(PILLOW_SSE2)
+			for (; i + 16 <= size; i += 16)
+			{
+				const __m128i f = Internal::toLower16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first + i)));
+				const __m128i s = Internal::toLower16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(second + i)));
+				if (_mm_movemask_epi8(_mm_cmpeq_epi8(f, s)) != 0xffff) return false;
+			}
+#elif defined(PILLOW_NEON)
+			for (; i + 16 <= size; i += 16)
+			{
+				const uint8x16_t f = Internal::toLower16(vld1q_u8(reinterpret_cast<const uint8_t*>(first + i)));
+				const uint8x16_t s = Internal::toLower16(vld1q_u8(reinterpret_cast<const uint8_t*>(second + i)));
+				if (vminvq_u8(vceqq_u8(f, s)) != 0xff) return false;
+			}
+#endif
+			for (; i + 8 <= size; i += 8)
 			{
-				register char f = first[i], s = second[i];
-				bool good = (f == s) || ((f - s) == 32 && f >= 'a' && f <= 'z') || ((f - s) == -32 && f >= 'A' && f <= 'Z');
-				if (!good) return false;
+				quint64 f, s; memcpy(&f, first + i, 8); memcpy(&s, second + i, 8);
+				if (f != s && Internal::toLower8(f) != Internal::toLower8(s)) return false;
 			}
-			return true;
+			return Scalar::asciiEqualsCaseInsensitive(first + i, second + i, size - i);
+		}
+
+		inline bool asciiEqualsCaseInsensitive(const char* first, int firstSize, const char* second, int secondSize)
+		{
+			return firstSize == secondSize && asciiEqualsCaseInsensitive(first, second, firstSize);
+		}
+
+		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const QByteArray& second)
+		{
+			return first.size() == second.size() && asciiEqualsCaseInsensitive(first.constData(), second.constData(), first.size());
+		}
+
+		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const QLatin1Literal& second)
+		{
+			return first.size() == second.size() && asciiEqualsCaseInsensitive(first.constData(), second.data(), first.size());
 		}
 
 		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const Pillow::Token& second)
 		{
-			if (first.size() != second.size()) return false;
-			for (register int i = 0; i < first.size(); ++i)
+			return first.size() == second.size() && asciiEqualsCaseInsensitive(first.constData(), second.data(), first.size());
+		}
+
+		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const Pillow::LowerCaseToken& second)
+		{
+			return first.size() == second.size() && asciiEqualsCaseInsensitive(first.constData(), second.data(), first.size());
+		}
+
+		// Returns the index of the first occurrence of the specified character, or -1.
+		inline int indexOf(const char* data, int size, char c)
+		{
+			const void* found = size > 0 ? memchr(data, c, size) : 0; // The C library's memchr is already vectorized.
+			return found == 0 ? -1 : static_cast<const char*>(found) - data;
+		}
+
+		// Returns the index of the first occurrence of either of the specified characters, or -1.
+		inline int indexOfEither(const char* data, int size, char first, char second)
+		{
+			int i = 0;
+#if defined(PILLOW_SSE2)
+			const __m128i f = _mm_set1_epi8(first), s = _mm_set1_epi8(second);
+			for (; i + 16 <= size; i += 16)
+			{
+				const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, f), _mm_cmpeq_epi8(chunk, s)));
+				if (mask != 0) return i + Internal::countTrailingZeros(mask);
+			}
+#elif defined(PILLOW_NEON)
+			const uint8x16_t f = vdupq_n_u8(first), s = vdupq_n_u8(second);
+			for (; i + 16 <= size; i += 16)
 			{
-				register char f = first.at(i), s = second.at(i);
-				bool good = (f == s) || ((f - s) == 32 && f >= 'a' && f <= 'z') || ((f - s) == -32 && f >= 'A' && f <= 'Z');
-				if (!good) return false;
+				const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(data + i));
+				if (vmaxvq_u8(vorrq_u8(vceqq_u8(chunk, f), vceqq_u8(chunk, s))) != 0)
+					return i + Scalar::indexOfEither(data + i, 16, first, second);
 			}
-			return true;
+#endif
+			const int index = Scalar::indexOfEither(data + i, size - i, first, second);
+			return index == -1 ? -1 : i + index;
 		}
 
-		inline bool asciiEqualsCaseInsensitive(const QByteArray& first, const Pillow::LowerCaseToken& second)
+		// Returns the index of the first CRLF sequence, or -1.
+		inline int indexOfCrLf(const char* data, int size)
 		{
-			if (first.size() != second.size()) return false;
-			for (register int i = 0; i < first.size(); ++i)
+			for (int from = 0; from < size - 1;)
 			{
-				register char f = first.at(i), s = second.at(i);
-				bool good = (f == s) || ((f - s) == -32 && f >= 'A' && f <= 'Z');
-				if (!good) return false;
+				int i = indexOf(data + from, size - 1 - from, '\r');
+				if (i == -1) return -1;
+				i += from;
+				if (data[i + 1] == '\n') return i;
+				from = i + 1;
 			}
-			return true;
+			return -1;
+		}
+
+		// Returns whether the data contains percent-encoded sequences.
+		inline bool containsPercent(const char* data, int size)
+		{
+			return indexOf(data, size, '%') != -1;
 		}
 
 		inline char unhex(const char c)
@@ -222,37 +346,108 @@ namespace Pillow
 			return size;
 		}
 
-		inline QString percentDecode(const QByteArray& byteArray)
+		namespace Scalar
 		{
-			if (byteArray.isEmpty()) return QString();
-
-			if (byteArray.size() < 1024)
+			// Decodes a copy of the data in place, then converts it from UTF-8.
+			inline QString percentDecode(const char* data, int size, bool plusAsSpace = false)
 			{
-				char buffer[1024];
-				memcpy(buffer, byteArray.constData(), byteArray.size());
-				return QString::fromUtf8(buffer, percentDecodeInPlace(buffer, byteArray.size()));
+				if (size == 0 || data == 0) return QString();
+				QVarLengthArray<char, 1024> buffer(size);
+				memcpy(buffer.data(), data, size);
+				if (plusAsSpace) for (char* c = buffer.data(), *cE = c + size; c < cE; ++c) if (*c == '+') *c = ' ';
+				return QString::fromUtf8(buffer.constData(), percentDecodeInPlace(buffer.data(), size));
 			}
-			else
+		}
+
+		namespace Internal
+		{
+			// Decodes straight into the QString's characters as long as the decoded data is ASCII, handing
+			// over to the scalar version (which does the UTF-8 decoding) as soon as it is not. Clean 16 bytes
+			// blocks are widened to QChars as a whole.
+			inline QString percentDecode(const char* data, int size, bool plusAsSpace)
 			{
-				QByteArray temp = byteArray; temp.detach();
-				return QString::fromUtf8(temp.constData(), percentDecodeInPlace(temp.data(), byteArray.size()));
+				QString result; result.resize(size);
+				ushort* out = reinterpret_cast<ushort*>(result.data());
+				ushort* const outBegin = out;
+				const char* p = data, *const end = data + size;
+
+				while (p < end)
+				{
+#if defined(PILLOW_SSE2)
+					const __m128i zero = _mm_setzero_si128(), percent = _mm_set1_epi8('%'), plus = _mm_set1_epi8(plusAsSpace ? '+' : '%');
+					while (end - p >= 16)
+					{
+						const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+						const int mask = _mm_movemask_epi8(chunk) | _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, percent), _mm_cmpeq_epi8(chunk, plus)));
+						if (mask == 0)
+						{
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_unpacklo_epi8(chunk, zero));
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 8), _mm_unpackhi_epi8(chunk, zero));
+							p += 16; out += 16;
+							continue;
+						}
+						for (const char* pE = p + Internal::countTrailingZeros(mask); p < pE; ++p) *out++ = static_cast<uchar>(*p);
+						break;
+					}
+#elif defined(PILLOW_NEON)
+					const uint8x16_t percent = vdupq_n_u8('%'), plus = vdupq_n_u8(plusAsSpace ? '+' : '%'), high = vdupq_n_u8(0x80);
+					while (end - p >= 16)
+					{
+						const uint8x16_t chunk = vld1q_u8(reinterpret_cast<const uint8_t*>(p));
+						if (vmaxvq_u8(vorrq_u8(vorrq_u8(vceqq_u8(chunk, percent), vceqq_u8(chunk, plus)), vcgeq_u8(chunk, high))) != 0) break;
+						vst1q_u16(out, vmovl_u8(vget_low_u8(chunk)));
+						vst1q_u16(out + 8, vmovl_high_u8(chunk));
+						p += 16; out += 16;
+					}
+#endif
+					if (p == end) break;
+
+					const char c = *p;
+					if (c == '%' && p + 2 < end)
+					{
+						const uchar decoded = static_cast<uchar>(unhex(p[1]) << 4 | unhex(p[2]));
+						if (decoded >= 0x80) return Scalar::percentDecode(data, size, plusAsSpace);
+						*out++ = decoded; p += 3;
+					}
+					else if (c == '+' && plusAsSpace)
+					{
+						*out++ = ' '; ++p;
+					}
+					else if (static_cast<uchar>(c) >= 0x80)
+					{
+						return Scalar::percentDecode(data, size, plusAsSpace);
+					}
+					else
+					{
+						*out++ = static_cast<uchar>(c); ++p;
+					}
+				}
+
+				result.resize(out - outBegin);
+				return result;
 			}
 		}
 
+		// Percent-decodes the data and converts it from UTF-8. Data without escapes is converted directly,
+		// without an intermediate copy.
 		inline QString percentDecode(const char* data, int size)
 		{
 			if (size == 0 || data == 0) return QString();
-			if (size < 1024)
-			{
-				char buffer[1024];
-				memcpy(buffer, data, size);
-				return QString::fromUtf8(buffer, percentDecodeInPlace(buffer, size));
-			}
-			else
-			{
-				QByteArray temp(data, size);
-				return QString::fromUtf8(temp.constData(), percentDecodeInPlace(temp.data(), size));
-			}
+			if (!containsPercent(data, size)) return QString::fromUtf8(data, size);
+			return Internal::percentDecode(data, size, false);
+		}
+
+		inline QString percentDecode(const QByteArray& byteArray)
+		{
+			return percentDecode(byteArray.constData(), byteArray.size());
+		}
+
+		// As percentDecode, for application/x-www-form-urlencoded data where "+" stands for a space.
+		inline QString formDecode(const char* data, int size)
+		{
+			if (size == 0 || data == 0) return QString();
+			if (indexOfEither(data, size, '%', '+') == -1) return QString::fromUtf8(data, size);
+			return Internal::percentDecode(data, size, true);
 		}
 
 	}
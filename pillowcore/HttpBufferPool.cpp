@@ -0,0 +1,110 @@
+#include "HttpBufferPool.h"
+#include <QtCore/QThreadStorage>
+#include <QtCore/QDebug>
+
+namespace
+{
+	QThreadStorage<Pillow::HttpBufferPool*> threadPools;
+}
+
+Pillow::HttpBufferPool::HttpBufferPool()
+	: _maximumPooledBytes(DefaultMaximumPooledBytes), _pooledBytes(0)
+{
+	setSizeClasses(QList<int>() << 1024 << 4 * 1024 << 16 * 1024 << 32 * 1024);
+}
+
+Pillow::HttpBufferPool* Pillow::HttpBufferPool::instance()
+{
+	if (!threadPools.hasLocalData())
+		threadPools.setLocalData(new HttpBufferPool());
+	return threadPools.localData();
+}
+
+QList<int> Pillow::HttpBufferPool::sizeClasses() const
+{
+	QList<int> result;
+	for (int i = 0; i < _classes.size(); ++i) result << _classes.at(i).capacity;
+	return result;
+}
+
+void Pillow::HttpBufferPool::setSizeClasses(const QList<int> &sizeClasses)
+{
+	for (int i = 0; i < sizeClasses.size(); ++i)
+	{
+		if (sizeClasses.at(i) <= 0 || (i > 0 && sizeClasses.at(i) <= sizeClasses.at(i - 1)))
+		{
+			qWarning() << "HttpBufferPool::setSizeClasses: size classes must be positive and in ascending order.";
+			return;
+		}
+	}
+
+	clear();
+	_classes.resize(sizeClasses.size());
+	for (int i = 0; i < sizeClasses.size(); ++i)
+		_classes[i].capacity = sizeClasses.at(i);
+}
+
+void Pillow::HttpBufferPool::setMaximumPooledBytes(qint64 bytes)
+{
+	_maximumPooledBytes = bytes;
+	if (_pooledBytes > _maximumPooledBytes) clear();
+}
+
+int Pillow::HttpBufferPool::pooledCount() const
+{
+	int count = 0;
+	for (int i = 0; i < _classes.size(); ++i) count += _classes.at(i).buffers.size();
+	return count;
+}
+
+QByteArray Pillow::HttpBufferPool::take(int minimumCapacity)
+{
+	QByteArray buffer;
+	for (int i = 0; i < _classes.size(); ++i)
+	{
+		SizeClass& sizeClass = _classes[i];
+		if (sizeClass.capacity < minimumCapacity) continue;
+
+		if (sizeClass.buffers.isEmpty())
+		{
+			buffer.reserve(sizeClass.capacity);
+		}
+		else
+		{
+			buffer.swap(sizeClass.buffers.last());
+			sizeClass.buffers.pop_back();
+			_pooledBytes -= buffer.capacity();
+		}
+		return buffer;
+	}
+
+	buffer.reserve(minimumCapacity); // Too large to come from the pool.
+	return buffer;
+}
+
+void Pillow::HttpBufferPool::give(QByteArray &buffer)
+{
+	QByteArray taken; taken.swap(buffer);
+	if (!taken.isDetached() || taken.capacity() == 0) return;
+
+	// Pool the buffer in the largest class it can serve, unless it is much larger than that.
+	for (int i = _classes.size() - 1; i >= 0; --i)
+	{
+		SizeClass& sizeClass = _classes[i];
+		if (taken.capacity() < sizeClass.capacity) continue;
+		if (i == _classes.size() - 1 && taken.capacity() > sizeClass.capacity * 2) return;
+		if (_pooledBytes + taken.capacity() > _maximumPooledBytes) return;
+
+		taken.data_ptr()->size = 0; // Keep the storage; clear() and resize(0) would free it.
+		_pooledBytes += taken.capacity();
+		sizeClass.buffers.append(QByteArray());
+		sizeClass.buffers.last().swap(taken);
+		return;
+	}
+}
+
+void Pillow::HttpBufferPool::clear()
+{
+	for (int i = 0; i < _classes.size(); ++i) _classes[i].buffers.clear();
+	_pooledBytes = 0;
+}
@@ -0,0 +1,67 @@
+#ifndef PILLOW_HTTPBUFFERPOOL_H
+#define PILLOW_HTTPBUFFERPOOL_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef QBYTEARRAY_H
+#include <QtCore/QByteArray>
+#endif // QBYTEARRAY_H
+#ifndef QLIST_H
+#include <QtCore/QList>
+#endif // QLIST_H
+#ifndef QVECTOR_H
+#include <QtCore/QVector>
+#endif // QVECTOR_H
+
+namespace Pillow
+{
+	//
+	// HttpBufferPool: a per-thread pool of byte array buffers, sorted in size classes.
+	//
+	// HttpConnections give their request and response buffers back to the pool of their thread when they
+	// become idle between keep-alive requests, and take buffers again when the next request arrives, so
+	// memory tracks active requests rather than open connections. Buffers larger than the largest size class
+	// are freed rather than pooled.
+	//
+
+	class PILLOWCORE_EXPORT HttpBufferPool
+	{
+		Q_DISABLE_COPY(HttpBufferPool)
+
+	public:
+		HttpBufferPool();
+
+		static HttpBufferPool* instance(); // The calling thread's pool.
+
+		enum { DefaultMaximumPooledBytes = 64 * 1024 * 1024 };
+
+		// Buffer capacities, in ascending order. Defaults to 1, 4, 16 and 32 KB.
+		QList<int> sizeClasses() const;
+		void setSizeClasses(const QList<int>& sizeClasses);
+
+		// Pooled buffers are freed instead of pooled once this many bytes are held.
+		qint64 maximumPooledBytes() const { return _maximumPooledBytes; }
+		void setMaximumPooledBytes(qint64 bytes);
+
+		int pooledCount() const;
+		qint64 pooledBytes() const { return _pooledBytes; }
+
+	public:
+		// Returns an empty, unshared buffer with a capacity of at least minimumCapacity, rounded up to a size class.
+		QByteArray take(int minimumCapacity);
+
+		// Takes ownership of the buffer's storage and leaves it null. Shared buffers are simply released.
+		void give(QByteArray& buffer);
+
+		void clear();
+
+	private:
+		struct SizeClass { int capacity; QVector<QByteArray> buffers; };
+		QVector<SizeClass> _classes;
+		qint64 _maximumPooledBytes;
+		qint64 _pooledBytes;
+	};
+}
+
+#endif // PILLOW_HTTPBUFFERPOOL_H
@@ -1,15 +1,20 @@
 #include "HttpClient.h"
+#include "HttpClientPool.h"
+#include "HttpHostCache.h"
 #include "ByteArrayHelpers.h"
 #include <QtCore/QIODevice>
 #include <QtCore/QUrl>
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
+#include <QtCore/QPointer>
 #include <QtNetwork/QTcpSocket>
+#include <QtNetwork/QNetworkProxy>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkCookie>
 #include <QtNetwork/QNetworkCookieJar>
 #include <QtCore/QTimer>
 #include "private/zlib.h"
+#include "private/Trace.h"
 
 namespace Pillow
 {
@@ -24,7 +29,12 @@ namespace Pillow
 		const QByteArray colonSpaceToken(": ");
 		const QByteArray httpOneOneCrlfToken(" HTTP/1.1\r\n");
 		const QByteArray contentLengthColonSpaceToken("Content-Length: ");
+		const QByteArray transferEncodingChunkedToken("Transfer-Encoding: chunked");
+		const QByteArray lastChunkToken("0\r\n\r\n");
 		const QByteArray hostToken("Host");
+		const QByteArray optionsMethodToken("OPTIONS");
+		const QByteArray traceMethodToken("TRACE");
+		const qint64 uploadBufferSize = 64 * 1024; // Streamed request content waiting in the socket, at most.
 	}
 
 	class ContentTransformer
@@ -101,7 +111,7 @@ namespace Pillow
 //
 
 Pillow::HttpRequestWriter::HttpRequestWriter()
-	: _device(0)
+	: _device(0), _chunked(false)
 {
 }
 
@@ -138,13 +148,7 @@ void Pillow::HttpRequestWriter::write(const QByteArray &method, const QByteArray
 		return;
 	}
 
-	if (_builder.capacity() < 8192)
-		_builder.reserve(8192);
-
-	_builder.append(method).append(' ').append(path).append(Pillow::HttpClientTokens::httpOneOneCrlfToken);
-
-	for (const Pillow::HttpHeader *h = headers.constBegin(), *hE = headers.constEnd(); h < hE; ++h)
-		_builder.append(h->first).append(Pillow::HttpClientTokens::colonSpaceToken).append(h->second).append(Pillow::HttpClientTokens::crlfToken);
+	appendHead(method, path, headers);
 
 	if (!data.isEmpty())
 	{
@@ -173,6 +177,71 @@ void Pillow::HttpRequestWriter::write(const QByteArray &method, const QByteArray
 		}
 	}
 
+	flushBuilder();
+}
+
+void Pillow::HttpRequestWriter::writeHeaders(const QByteArray &method, const QByteArray &path, const Pillow::HttpHeaderCollection &headers, qint64 contentLength)
+{
+	if (_device == 0)
+	{
+		qWarning() << "Pillow::HttpRequestWriter::writeHeaders: called while device is not set. Not proceeding.";
+		return;
+	}
+
+	appendHead(method, path, headers);
+
+	_chunked = contentLength < 0;
+	if (_chunked)
+		_builder.append(Pillow::HttpClientTokens::transferEncodingChunkedToken).append(Pillow::HttpClientTokens::crlfToken);
+	else
+	{
+		_builder.append(Pillow::HttpClientTokens::contentLengthColonSpaceToken);
+		Pillow::ByteArrayHelpers::appendNumber<qint64, 10>(_builder, contentLength);
+		_builder.append(Pillow::HttpClientTokens::crlfToken);
+	}
+
+	_builder.append(Pillow::HttpClientTokens::crlfToken);
+	_device->write(_builder);
+	flushBuilder();
+}
+
+void Pillow::HttpRequestWriter::writeContent(const QByteArray &data)
+{
+	if (_device == 0 || data.isEmpty()) return;
+
+	if (_chunked)
+	{
+		Pillow::ByteArrayHelpers::appendNumber<int, 16>(_builder, data.size());
+		_builder.append(Pillow::HttpClientTokens::crlfToken);
+		_device->write(_builder);
+		_device->write(data);
+		_device->write(Pillow::HttpClientTokens::crlfToken);
+		flushBuilder();
+	}
+	else
+		_device->write(data);
+}
+
+void Pillow::HttpRequestWriter::endContent()
+{
+	if (_device == 0 || !_chunked) return;
+	_device->write(Pillow::HttpClientTokens::lastChunkToken);
+	_chunked = false;
+}
+
+void Pillow::HttpRequestWriter::appendHead(const QByteArray &method, const QByteArray &path, const Pillow::HttpHeaderCollection &headers)
+{
+	if (_builder.capacity() < 8192)
+		_builder.reserve(8192);
+
+	_builder.append(method).append(' ').append(path).append(Pillow::HttpClientTokens::httpOneOneCrlfToken);
+
+	for (const Pillow::HttpHeader *h = headers.constBegin(), *hE = headers.constEnd(); h < hE; ++h)
+		_builder.append(h->first).append(Pillow::HttpClientTokens::colonSpaceToken).append(h->second).append(Pillow::HttpClientTokens::crlfToken);
+}
+
+void Pillow::HttpRequestWriter::flushBuilder()
+{
 	if (_builder.size() > 16384)
 		_builder.clear();
 	else
@@ -341,12 +410,15 @@ inline void Pillow::HttpResponseParser::pushHeader()
 //
 
 Pillow::HttpClient::HttpClient(QObject *parent)
-	: QObject(parent), _responsePending(false), _error(NoError), _keepAliveTimeout(-1), _contentDecoder(0)
+	: QObject(parent), _responsePending(false), _error(NoError), _keepAliveTimeout(-1), _contentDecoder(0),
+	  _writtenAheadCount(0), _maximumPipelinedRequests(1), _hostCache(Pillow::HttpHostCache::instance()),
+	  _uploading(false), _uploadSourceFinished(false), _uploadRemaining(0), _uploadStart(-1), _uploadMapping(0), _uploadMappingPosition(0)
 {
 	_device = new QTcpSocket(this);
 	connect(_device, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(device_error(QAbstractSocket::SocketError)));
 	connect(_device, SIGNAL(connected()), this, SLOT(device_connected()));
 	connect(_device, SIGNAL(readyRead()), this, SLOT(device_readyRead()));
+	connect(_device, SIGNAL(bytesWritten(qint64)), this, SLOT(device_bytesWritten()));
 	_requestWriter.setDevice(_device);
 	_keepAliveTimeoutTimer.invalidate();
 }
@@ -361,6 +433,38 @@ void Pillow::HttpClient::setKeepAliveTimeout(int timeout)
 	_keepAliveTimeout = timeout;
 }
 
+int Pillow::HttpClient::maximumPipelinedRequests() const
+{
+	return _maximumPipelinedRequests;
+}
+
+void Pillow::HttpClient::setMaximumPipelinedRequests(int count)
+{
+	_maximumPipelinedRequests = qMax(1, count);
+}
+
+int Pillow::HttpClient::queuedRequestCount() const
+{
+	return _queuedRequests.size();
+}
+
+Pillow::HttpHostCache *Pillow::HttpClient::hostCache() const
+{
+	return _hostCache;
+}
+
+void Pillow::HttpClient::setHostCache(Pillow::HttpHostCache *cache)
+{
+	const bool resolving = !_resolvingHost.isEmpty();
+	if (resolving)
+	{
+		if (_hostCache) disconnect(_hostCache, 0, this, 0);
+		_resolvingHost.clear();
+	}
+	_hostCache = cache;
+	if (resolving) openConnection();
+}
+
 qint64 Pillow::HttpClient::readBufferSize() const
 {
 	return _device->readBufferSize();
@@ -443,6 +547,16 @@ void Pillow::HttpClient::deleteResource(const QUrl &url, const Pillow::HttpHeade
 	request(Pillow::HttpClientTokens::deleteMethodToken, url, headers);
 }
 
+void Pillow::HttpClient::post(const QUrl &url, const Pillow::HttpHeaderCollection &headers, QIODevice *device)
+{
+	request(Pillow::HttpClientTokens::postMethodToken, url, headers, device);
+}
+
+void Pillow::HttpClient::put(const QUrl &url, const Pillow::HttpHeaderCollection &headers, QIODevice *device)
+{
+	request(Pillow::HttpClientTokens::putMethodToken, url, headers, device);
+}
+
 void Pillow::HttpClient::request(const QByteArray &method, const QUrl &url, const Pillow::HttpHeaderCollection &headers, const QByteArray &data)
 {
 	Pillow::HttpClientRequest newRequest;
@@ -453,8 +567,30 @@ void Pillow::HttpClient::request(const QByteArray &method, const QUrl &url, cons
 	request(newRequest);
 }
 
+void Pillow::HttpClient::request(const QByteArray &method, const QUrl &url, const Pillow::HttpHeaderCollection &headers, QIODevice *device)
+{
+	Pillow::HttpClientRequest newRequest;
+	newRequest.method = method;
+	newRequest.url = url;
+	newRequest.headers = headers;
+	newRequest.device = device;
+	request(newRequest);
+}
+
 void Pillow::HttpClient::request(const Pillow::HttpClientRequest &request)
 {
+	if (_maximumPipelinedRequests > 1 && (_responsePending || Pillow::HttpResponseParser::isParsing() || !_queuedRequests.isEmpty()))
+	{
+		// Pipelined mode: wait in line behind the pending request, and go out right away if possible.
+		_queuedRequests << request;
+		if (!Pillow::HttpResponseParser::isParsing())
+		{
+			if (_responsePending) fillPipeline();
+			else startQueuedRequest();
+		}
+		return;
+	}
+
 	if (_responsePending)
 	{
 		qWarning("Pillow::HttpClient::request: cannot send new request while another one is under way. Request pipelining is not supported.");
@@ -470,6 +606,11 @@ void Pillow::HttpClient::request(const Pillow::HttpClientRequest &request)
 		return;
 	}
 
+	startRequest(request);
+}
+
+void Pillow::HttpClient::startRequest(const Pillow::HttpClientRequest &request)
+{
 	// We can reuse an active connection if the request is for the same host and port, so make note of those parameters before they are overwritten.
 	const QString previousHost = _request.url.host();
 	const int previousPort = _request.url.port();
@@ -498,19 +639,129 @@ void Pillow::HttpClient::request(const Pillow::HttpClientRequest &request)
 
 		if (_device->state() != QAbstractSocket::UnconnectedState)
 			_device->disconnectFromHost();
-		_device->connectToHost(_request.url.host(), _request.url.port(80));
+		PILLOW_TRACE3(client_connect, this, _request.url.encodedHost().constData(), _request.url.port(80));
+		openConnection();
+	}
+}
+
+void Pillow::HttpClient::connectToServer(const QUrl &url)
+{
+	if (_responsePending || Pillow::HttpResponseParser::isParsing())
+	{
+		qWarning("Pillow::HttpClient::connectToServer: cannot connect while a request is under way.");
+		return;
+	}
+
+	const bool sameServer = url.host() == _request.url.host() && url.port() == _request.url.port();
+	if (sameServer && _device->state() != QAbstractSocket::UnconnectedState && _device->state() != QAbstractSocket::ClosingState)
+		return; // Already connected or connecting.
+
+	// Remember the server so that the next request to it reuses the connection. device_connected() has nothing to send.
+	_request = Pillow::HttpClientRequest();
+	_request.url = url;
+	if (_hostHeaderValue.isDetached())
+		_hostHeaderValue.data_ptr()->size = 0;
+	else
+		_hostHeaderValue.clear();
+
+	if (_device->state() != QAbstractSocket::UnconnectedState)
+		_device->abort();
+	PILLOW_TRACE3(client_connect, this, url.encodedHost().constData(), url.port(80));
+	openConnection();
+	_keepAliveTimeoutTimer.start();
+}
+
+namespace
+{
+	// Proxies resolve the server's name themselves, and may be the only ones able to.
+	inline bool connectsThroughProxy(const QTcpSocket* socket)
+	{
+#ifndef QT_NO_NETWORKPROXY
+		QNetworkProxy proxy = socket->proxy();
+		if (proxy.type() == QNetworkProxy::DefaultProxy) proxy = QNetworkProxy::applicationProxy();
+		return proxy.type() != QNetworkProxy::NoProxy && proxy.type() != QNetworkProxy::DefaultProxy;
+#else
+		Q_UNUSED(socket);
+		return false;
+#endif // QT_NO_NETWORKPROXY
 	}
 }
 
+void Pillow::HttpClient::openConnection()
+{
+	const QString host = _request.url.host();
+	const quint16 port = _request.url.port(80);
+
+	_connectAddresses.clear();
+	if (!_resolvingHost.isEmpty())
+	{
+		if (_hostCache) disconnect(_hostCache, 0, this, 0);
+		_resolvingHost.clear();
+	}
+
+	if (_hostCache.isNull() || !QHostAddress(host).isNull() || connectsThroughProxy(_device))
+	{
+		_device->connectToHost(host, port); // Nothing to cache for addresses, and proxies are given the name.
+		return;
+	}
+
+	switch (_hostCache->lookup(host, &_connectAddresses))
+	{
+	case Pillow::HttpHostCache::Resolved:
+		_device->connectToHost(_connectAddresses.takeFirst(), port);
+		break;
+	case Pillow::HttpHostCache::NotFound:
+		_resolvingHost = host;
+		QMetaObject::invokeMethod(this, "hostCache_lookupFailed", Qt::QueuedConnection); // Fail like the socket would: asynchronously.
+		break;
+	case Pillow::HttpHostCache::LookupPending:
+		_resolvingHost = host;
+		connect(_hostCache, SIGNAL(hostResolved(QString)), this, SLOT(hostCache_hostResolved(QString)));
+		connect(_hostCache, SIGNAL(destroyed()), this, SLOT(hostCache_destroyed()));
+		break;
+	}
+}
+
+void Pillow::HttpClient::hostCache_hostResolved(const QString &hostName)
+{
+	if (_resolvingHost.isEmpty() || hostName.compare(_resolvingHost, Qt::CaseInsensitive) != 0) return;
+	openConnection();
+}
+
+void Pillow::HttpClient::hostCache_destroyed()
+{
+	// The lookup will never complete: let the socket resolve the name instead.
+	if (_resolvingHost.isEmpty()) return;
+	_resolvingHost.clear();
+	openConnection();
+}
+
+void Pillow::HttpClient::hostCache_lookupFailed()
+{
+	if (_resolvingHost.isEmpty()) return;
+	_resolvingHost.clear();
+	device_error(QAbstractSocket::HostNotFoundError);
+}
+
 void Pillow::HttpClient::abort()
 {
+	finishUpload(false);
 	if (_device) _device->abort();
+	_connectAddresses.clear();
+	if (!_resolvingHost.isEmpty())
+	{
+		if (_hostCache) disconnect(_hostCache, 0, this, 0);
+		_resolvingHost.clear();
+	}
+	_queuedRequests.clear();
+	_writtenAheadCount = 0;
 
 	if (_responsePending)
 	{
 		Pillow::HttpResponseParser::pause();
 		_error = AbortedError;
 		_responsePending = false;
+		PILLOW_TRACE4(client_finished, this, statusCode(), static_cast<int>(_error), content().size());
 		emit finished();
 	}
 }
@@ -525,11 +776,28 @@ void Pillow::HttpClient::followRedirection()
 
 	Pillow::HttpClientRequest newRequest = _request;
 	newRequest.url = QUrl::fromEncoded(redirectionLocation());
+
+	if (newRequest.device != 0 && (_uploadStart < 0 || !newRequest.device->seek(_uploadStart)))
+	{
+		qWarning("Pillow::HttpClient::followRedirection(): the request content device can not be read again.");
+		return;
+	}
+
 	request(newRequest);
 }
 
 void Pillow::HttpClient::device_error(QAbstractSocket::SocketError error)
 {
+	if (!_connectAddresses.isEmpty())
+	{
+		// Could not connect to this address of the server, try its next one.
+		_device->abort();
+		_device->connectToHost(_connectAddresses.takeFirst(), _request.url.port(80));
+		return;
+	}
+
+	finishUpload(false);
+
 	if (!_responsePending)
 	{
 		// Errors that happen while we are not waiting for a response are ok. We'll try to
@@ -548,11 +816,16 @@ void Pillow::HttpClient::device_error(QAbstractSocket::SocketError error)
 
 	_device->close();
 	_responsePending = false;
+	PILLOW_TRACE4(client_finished, this, statusCode(), static_cast<int>(_error), content().size());
 	emit finished();
+
+	// Requests written ahead on the broken connection go out again on a new one.
+	startQueuedRequest();
 }
 
 void Pillow::HttpClient::device_connected()
 {
+	_connectAddresses.clear();
 	sendRequest();
 }
 
@@ -585,41 +858,51 @@ void Pillow::HttpClient::device_readyRead()
 	qint64 bytesRead = _device->read(_buffer.data() + _buffer.size(), bytesAvailable);
 	_buffer.data_ptr()->size += bytesRead;
 
-	int consumed = inject(_buffer);
-
-	if (responsePending())
+	int offset = 0;
+	forever
 	{
-		// Response is still pending. One of the following:
-		// 1. Got a parser error. (where hasError)
-		// 2. Waiting for more data to complete the current request. (where _pendingRequest is null and consumed == buffer.size)
-		// 3. Waiting for the real response after a 100-continue response. (where _pendingRequest is null and consumed < buffer.size, because parser will stop consuming after the 100-continue).
+		int consumed = inject(_buffer.constData() + offset, _buffer.size() - offset);
 
-		if (!hasError())
+		if (responsePending())
 		{
-			if (consumed < _buffer.size())
-			{
-				// We had multiple responses in the buffer?
-				// It was a 100 Continue since we are still response pending.
-				consumed += inject(_buffer.constData() + consumed, _buffer.size() - consumed);
+			// Response is still pending. One of the following:
+			// 1. Got a parser error. (where hasError)
+			// 2. Waiting for more data to complete the current request. (where _pendingRequest is null and consumed == buffer.size)
+			// 3. Waiting for the real response after a 100-continue response. (where _pendingRequest is null and consumed < buffer.size, because parser will stop consuming after the 100-continue).
 
-				if (consumed < _buffer.size())
+			if (!hasError())
+			{
+				if (offset + consumed < _buffer.size())
+				{
+					// We had multiple responses in the buffer?
+					// It was a 100 Continue since we are still response pending.
+					consumed += inject(_buffer.constData() + offset + consumed, _buffer.size() - offset - consumed);
+
+					if (offset + consumed < _buffer.size())
+					{
+						qWarning() << "Left some unconsumed data in the buffer:" << (_buffer.size() - offset - consumed);
+					}
+				}
+				else
 				{
-					qWarning() << "Left some unconsumed data in the buffer:" << (_buffer.size() - consumed);
+					// Just waiting for more data to consume.
 				}
 			}
-			else
+
+			if (hasError()) // Re-check for error in case we injected again in the 100 Continue case above.
 			{
-				// Just waiting for more data to consume.
+				_error = ResponseInvalidError;
+				_device->close();
+				_responsePending = false;
+				PILLOW_TRACE4(client_finished, this, statusCode(), static_cast<int>(_error), content().size());
+				emit finished();
 			}
 		}
 
-		if (hasError()) // Re-check for error in case we injected again in the 100 Continue case above.
-		{
-			_error = ResponseInvalidError;
-			_device->close();
-			_responsePending = false;
-			emit finished();
-		}
+		// Pipelined mode: the rest of the buffer is the response to the next request, already written ahead.
+		offset += consumed;
+		if (responsePending() || offset >= _buffer.size() || !takeWrittenAheadRequest())
+			break;
 	}
 
 	// Reuse the read buffer if it is not overly large.
@@ -637,33 +920,230 @@ void Pillow::HttpClient::device_readyRead()
 		request(r);
 	}
 
+	startQueuedRequest();
 }
 
 void Pillow::HttpClient::sendRequest()
 {
 	if (!responsePending()) return;
+	writeRequest(_request);
+	fillPipeline();
+}
 
+void Pillow::HttpClient::writeRequest(const Pillow::HttpClientRequest &request)
+{
 	if (_hostHeaderValue.isEmpty())
 	{
-        _hostHeaderValue = _request.url.encodedHost();
-		if (_request.url.port(80) != 80)
+        _hostHeaderValue = request.url.encodedHost();
+		if (request.url.port(80) != 80)
 		{
 			_hostHeaderValue.append(':');
-			Pillow::ByteArrayHelpers::appendNumber<int, 10>(_hostHeaderValue, _request.url.port(80));
+			Pillow::ByteArrayHelpers::appendNumber<int, 10>(_hostHeaderValue, request.url.port(80));
 		}
 	}
 
-	QByteArray uri = _request.url.encodedPath();
-	const QByteArray query = _request.url.encodedQuery();
+	QByteArray uri = request.url.encodedPath();
+	const QByteArray query = request.url.encodedQuery();
 	if (!query.isEmpty()) uri.append('?').append(query);
 
 	Pillow::HttpHeaderCollection headers;
-	headers.reserve(_request.headers.size() + 1);
+	headers.reserve(request.headers.size() + 1);
 	headers << Pillow::HttpHeader(Pillow::HttpClientTokens::hostToken, _hostHeaderValue);
-	for (int i = 0, iE = _request.headers.size(); i < iE; ++i)
-		headers << _request.headers.at(i);
+	for (int i = 0, iE = request.headers.size(); i < iE; ++i)
+		headers << request.headers.at(i);
+
+	if (request.device != 0)
+		startUpload(request, uri, headers);
+	else
+	{
+		PILLOW_TRACE3(client_request, this, request.method.constData(), qint64(request.data.size()));
+		_requestWriter.write(request.method, uri, headers, request.data);
+	}
+}
+
+void Pillow::HttpClient::startUpload(const Pillow::HttpClientRequest &request, const QByteArray &uri, const Pillow::HttpHeaderCollection &headers)
+{
+	QIODevice* device = request.device;
+	qint64 contentLength = device->isSequential() ? -1 : qMax<qint64>(0, device->size() - device->pos());
+
+	// A Content-Length given with the request wins, sequential devices are then not sent chunked.
+	Pillow::HttpHeaderCollection writtenHeaders;
+	writtenHeaders.reserve(headers.size());
+	for (int i = 0, iE = headers.size(); i < iE; ++i)
+	{
+		if (Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(headers.at(i).first, Pillow::LowerCaseToken("content-length")))
+			contentLength = headers.at(i).second.trimmed().toLongLong();
+		else
+			writtenHeaders << headers.at(i);
+	}
+
+	PILLOW_TRACE3(client_request, this, request.method.constData(), contentLength);
+
+	_uploadDevice = device;
+	_uploading = true;
+	_uploadSourceFinished = false;
+	_uploadRemaining = contentLength;
+	_uploadStart = device->isSequential() ? -1 : device->pos();
+	_uploadMapping = 0;
+	_uploadMappingPosition = 0;
+
+	// Files are sent straight out of a memory mapping, rather than read into a buffer first.
+	QFile* file = qobject_cast<QFile*>(device);
+	if (file != 0 && !file->isSequential() && contentLength > 0 && file->pos() + contentLength <= file->size())
+		_uploadMapping = file->map(file->pos(), contentLength);
+
+	connect(device, SIGNAL(readyRead()), this, SLOT(uploadDevice_readyRead()));
+	connect(device, SIGNAL(readChannelFinished()), this, SLOT(uploadDevice_readChannelFinished()));
+	connect(device, SIGNAL(aboutToClose()), this, SLOT(uploadDevice_readChannelFinished()));
+
+	_requestWriter.writeHeaders(request.method, uri, writtenHeaders, contentLength);
+	writeUploadContent();
+}
+
+void Pillow::HttpClient::writeUploadContent()
+{
+	if (!_uploading) return;
+
+	if (_uploadDevice == 0)
+	{
+		qWarning("Pillow::HttpClient: the request content device was destroyed while being sent, closing the connection.");
+		finishUpload(false);
+		_device->abort();
+		device_error(QAbstractSocket::UnknownSocketError);
+		return;
+	}
+
+	qint64 budget = Pillow::HttpClientTokens::uploadBufferSize - _device->bytesToWrite();
+	while (budget > 0 && _uploadRemaining != 0)
+	{
+		const qint64 payloadSize = _uploadRemaining < 0 ? budget : qMin(budget, _uploadRemaining);
+		QByteArray payload;
+		if (_uploadMapping)
+			payload = QByteArray::fromRawData(reinterpret_cast<const char*>(_uploadMapping) + _uploadMappingPosition, int(payloadSize));
+		else
+			payload = _uploadDevice->read(payloadSize);
+
+		if (payload.isEmpty())
+		{
+			const bool sourceEnded = _uploadSourceFinished || !_uploadDevice->isOpen() || !_uploadDevice->isSequential();
+			if (!sourceEnded) return; // Wait for readyRead().
+
+			if (_uploadRemaining > 0)
+			{
+				// The announced content length can't be honored.
+				qWarning("Pillow::HttpClient: the request content device ended before the announced content length, closing the connection.");
+				finishUpload(false);
+				_device->abort();
+				device_error(QAbstractSocket::UnknownSocketError);
+				return;
+			}
+
+			_uploadRemaining = 0; // End of chunked content.
+			break;
+		}
+
+		// The socket copies the data right away, raw data from the mapping is fine.
+		_requestWriter.writeContent(payload);
+		budget -= payload.size();
+		if (_uploadMapping) _uploadMappingPosition += payload.size();
+		if (_uploadRemaining > 0) _uploadRemaining -= payload.size();
+	}
+
+	if (_uploadRemaining == 0)
+		finishUpload(true);
+}
+
+void Pillow::HttpClient::finishUpload(bool completed)
+{
+	if (!_uploading) return;
+	_uploading = false;
+
+	if (_uploadDevice)
+	{
+		disconnect(_uploadDevice, 0, this, 0);
+		if (_uploadMapping)
+		{
+			QFile* file = static_cast<QFile*>(_uploadDevice.data());
+			file->seek(file->pos() + _uploadMappingPosition); // Leave the file where reading it would have.
+			file->unmap(_uploadMapping);
+		}
+	}
+	_uploadDevice = 0;
+	_uploadMapping = 0;
+
+	if (completed)
+	{
+		_requestWriter.endContent();
+		fillPipeline(); // Requests could not be written ahead during the upload.
+	}
+}
+
+void Pillow::HttpClient::device_bytesWritten()
+{
+	writeUploadContent();
+}
+
+void Pillow::HttpClient::uploadDevice_readyRead()
+{
+	writeUploadContent();
+}
+
+void Pillow::HttpClient::uploadDevice_readChannelFinished()
+{
+	_uploadSourceFinished = true;
+	writeUploadContent();
+}
+
+namespace
+{
+	// Requests that can safely be sent again when the connection breaks before their response arrives.
+	inline bool isIdempotent(const QByteArray& method)
+	{
+		using namespace Pillow::HttpClientTokens;
+		return method == getMethodToken || method == headMethodToken || method == putMethodToken
+			|| method == deleteMethodToken || method == optionsMethodToken || method == traceMethodToken;
+	}
+}
+
+void Pillow::HttpClient::fillPipeline()
+{
+	if (_maximumPipelinedRequests <= 1 || _keepAliveTimeout == 0 || !_responsePending || _uploading) return;
+	if (_device->state() != QAbstractSocket::ConnectedState || !isIdempotent(_request.method)) return;
 
-	_requestWriter.write(_request.method, uri, headers, _request.data);
+	// Only idempotent requests to the same server are written ahead, so that all of them can be replayed
+	// in order on a new connection if the server closes this one mid-pipeline.
+	while (_writtenAheadCount < _queuedRequests.size() && _writtenAheadCount + 1 < _maximumPipelinedRequests)
+	{
+		const Pillow::HttpClientRequest& next = _queuedRequests.at(_writtenAheadCount);
+		if (!isIdempotent(next.method) || next.device != 0 || next.url.host() != _request.url.host() || next.url.port() != _request.url.port())
+			break; // Streamed content can't be sent again either.
+		writeRequest(next);
+		++_writtenAheadCount;
+	}
+}
+
+bool Pillow::HttpClient::takeWrittenAheadRequest()
+{
+	if (_responsePending || _writtenAheadCount == 0 || _device->state() != QAbstractSocket::ConnectedState)
+		return false;
+
+	_request = _queuedRequests.takeFirst();
+	--_writtenAheadCount;
+	_responsePending = true;
+	_error = NoError;
+	clear();
+	fillPipeline();
+	return true;
+}
+
+void Pillow::HttpClient::startQueuedRequest()
+{
+	if (_responsePending || Pillow::HttpResponseParser::isParsing() || _queuedRequests.isEmpty()) return;
+	if (takeWrittenAheadRequest()) return; // Its response is already on its way.
+
+	// The connection is gone, or nothing was written ahead: start over with the first request in line.
+	_writtenAheadCount = 0;
+	startRequest(_queuedRequests.takeFirst());
 }
 
 void Pillow::HttpClient::messageBegin()
@@ -729,6 +1209,13 @@ void Pillow::HttpClient::messageComplete()
 		Pillow::HttpResponseParser::messageComplete();
 		_responsePending = false;
 
+		if (_uploading)
+		{
+			// The server answered before getting all of the content: the connection can't be used for another request.
+			finishUpload(false);
+			_device->close();
+		}
+
 		if (_keepAliveTimeout == 0)
 			_device->close();
 		else
@@ -739,6 +1226,7 @@ void Pillow::HttpClient::messageComplete()
 			_keepAliveTimeoutTimer.start();
 		}
 
+		PILLOW_TRACE4(client_finished, this, statusCode(), static_cast<int>(_error), content().size());
 		emit finished();
 	}
 }
@@ -754,25 +1242,39 @@ namespace Pillow
 		Q_OBJECT
 
 	public:
-		NetworkReply(Pillow::HttpClient *client, QNetworkAccessManager::Operation op, const QNetworkRequest& request)
-			:_client(client), _contentPos(0)
+		NetworkReply(Pillow::HttpClientPool *pool, QNetworkAccessManager::Operation op, const QNetworkRequest& request, const Pillow::HttpClientRequest& clientRequest)
+			: _pool(pool), _client(0), _clientRequest(clientRequest), _contentPos(0)
 		{
-			connect(client, SIGNAL(headersCompleted()), this, SLOT(client_headersCompleted()));
-			connect(client, SIGNAL(contentReadyRead()), this, SLOT(client_contentReadyRead()));
-			connect(client, SIGNAL(finished()), this, SLOT(client_finished()));
-
 			setOperation(op);
 			setRequest(request);
 			setUrl(request.url());
 		}
 
 		~NetworkReply()
-		{}
+		{
+			if (_pool) _pool->cancel(this);
+			if (_client)
+			{
+				// Destroyed mid-response: the pool aborts the request and drops the client.
+				disconnect(_client, 0, this, 0);
+				if (_pool) _pool->release(_client);
+			}
+		}
 
 	public:
 		void abort()
 		{
-			if (_client) _client->abort();
+			if (_client)
+				_client->abort();
+			else if (!isFinished())
+			{
+				// Still waiting for a client.
+				if (_pool) _pool->cancel(this);
+				setError(QNetworkReply::OperationCanceledError, QLatin1String("Operation canceled"));
+				emit this->error(QNetworkReply::OperationCanceledError);
+				setFinished(true);
+				emit finished();
+			}
 		}
 
 		qint64 bytesAvailable() const
@@ -780,6 +1282,18 @@ namespace Pillow
 			return QNetworkReply::bytesAvailable() + _content.size() - _contentPos;
 		}
 
+	public slots:
+		void start(Pillow::HttpClient *client)
+		{
+			// Called by the pool once a client is available for the server.
+			_client = client;
+			connect(client, SIGNAL(headersCompleted()), this, SLOT(client_headersCompleted()));
+			connect(client, SIGNAL(contentReadyRead()), this, SLOT(client_contentReadyRead()));
+			connect(client, SIGNAL(finished()), this, SLOT(client_finished()));
+			client->request(_clientRequest);
+			_clientRequest = Pillow::HttpClientRequest();
+		}
+
 	private slots:
 		void client_headersCompleted()
 		{
@@ -849,7 +1363,11 @@ namespace Pillow
 				emit this->error(error);
 			}
 
+			// Give the client back right away, so that a request made from our finished() signal can reuse it.
+			Pillow::HttpClient *client = _client;
 			_client = 0;
+			if (_pool) _pool->release(client);
+
 			setFinished(true);
 			emit finished();
 		}
@@ -865,7 +1383,9 @@ namespace Pillow
 		}
 
 	private:
+		QPointer<Pillow::HttpClientPool> _pool;
 		Pillow::HttpClient *_client;
+		Pillow::HttpClientRequest _clientRequest;
 		QByteArray _content;
 		int _contentPos;
 	};
@@ -878,12 +1398,29 @@ namespace Pillow
 Pillow::NetworkAccessManager::NetworkAccessManager(QObject *parent)
 	: QNetworkAccessManager(parent)
 {
+	_clientPool = new Pillow::HttpClientPool(this);
+	_clientPool->setMaximumConnectionsPerHost(0);
 }
 
 Pillow::NetworkAccessManager::~NetworkAccessManager()
 {
 }
 
+Pillow::HttpClientPool *Pillow::NetworkAccessManager::clientPool() const
+{
+	return _clientPool;
+}
+
+void Pillow::NetworkAccessManager::setClientPool(Pillow::HttpClientPool *pool)
+{
+	if (pool == 0)
+	{
+		qWarning("Pillow::NetworkAccessManager::setClientPool: a client pool is required.");
+		return;
+	}
+	_clientPool = pool;
+}
+
 QNetworkReply *Pillow::NetworkAccessManager::createRequest(QNetworkAccessManager::Operation op, const QNetworkRequest &request, QIODevice *outgoingData)
 {
 	if (request.url().scheme().compare(QLatin1String("http"), Qt::CaseInsensitive) != 0)
@@ -892,29 +1429,13 @@ QNetworkReply *Pillow::NetworkAccessManager::createRequest(QNetworkAccessManager
 		return QNetworkAccessManager::createRequest(op, request, outgoingData);
 	}
 
-	const QString urlAuthority = request.url().authority();
-
-	UrlClientsMap::Iterator it = _urlToClientsMap.find(urlAuthority);
-	Pillow::HttpClient *client = 0;
-	if (it != _urlToClientsMap.end())
-	{
-		client = it.value();
-		_urlToClientsMap.erase(it);
-	}
-	if (client == 0)
-	{
-		client = new Pillow::HttpClient(this);
-		_clientToUrlMap.insert(client, urlAuthority);
-		connect(client, SIGNAL(finished()), this, SLOT(client_finished()), Qt::DirectConnection);
-	}
+	Pillow::HttpClientRequest clientRequest;
+	clientRequest.url = request.url();
 
-	Pillow::NetworkReply *reply = new Pillow::NetworkReply(client, op, request);
-
-	Pillow::HttpHeaderCollection headers;
 	foreach (const QByteArray &headerName, request.rawHeaderList())
-		headers << Pillow::HttpHeader(headerName, request.rawHeader(headerName));
+		clientRequest.headers << Pillow::HttpHeader(headerName, request.rawHeader(headerName));
 
-//	headers << Pillow::HttpHeader("Accept-Encoding", "gzip");
+//	clientRequest.headers << Pillow::HttpHeader("Accept-Encoding", "gzip");
 
 	QNetworkCookieJar *jar = cookieJar();
 	if (jar)
@@ -927,46 +1448,42 @@ QNetworkReply *Pillow::NetworkAccessManager::createRequest(QNetworkAccessManager
 			cookieHeaderValue.append(cookies.at(i).toRawForm(QNetworkCookie::NameAndValueOnly));
 		}
 		if (!cookieHeaderValue.isEmpty())
-			headers << Pillow::HttpHeader("Cookie", cookieHeaderValue);
+			clientRequest.headers << Pillow::HttpHeader("Cookie", cookieHeaderValue);
 	}
 
 	switch (op)
 	{
 	case QNetworkAccessManager::HeadOperation:
-		client->head(request.url(), headers);
+		clientRequest.method = Pillow::HttpClientTokens::headMethodToken;
 		break;
 	case QNetworkAccessManager::GetOperation:
-		client->get(request.url(), headers);
+		clientRequest.method = Pillow::HttpClientTokens::getMethodToken;
 		break;
 	case QNetworkAccessManager::PutOperation:
-		client->put(request.url(), headers, outgoingData ? outgoingData->readAll() : QByteArray());
+		clientRequest.method = Pillow::HttpClientTokens::putMethodToken;
+		clientRequest.device = outgoingData;
 		break;
 	case QNetworkAccessManager::PostOperation:
-		client->post(request.url(), headers, outgoingData ? outgoingData->readAll() : QByteArray());
+		clientRequest.method = Pillow::HttpClientTokens::postMethodToken;
+		clientRequest.device = outgoingData;
 		break;
 	case QNetworkAccessManager::DeleteOperation:
-		client->deleteResource(request.url(), headers);
+		clientRequest.method = Pillow::HttpClientTokens::deleteMethodToken;
 		break;
 	case QNetworkAccessManager::CustomOperation:
-		client->request(request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray(), request.url(), headers, outgoingData ? outgoingData->readAll() : QByteArray());
+		clientRequest.method = request.attribute(QNetworkRequest::CustomVerbAttribute).toByteArray();
+		clientRequest.device = outgoingData;
 		break;
 
 	case QNetworkAccessManager::UnknownOperation:
 		break;
 	}
 
-	return reply;
-}
-
-void Pillow::NetworkAccessManager::client_finished()
-{
-	Pillow::HttpClient *client = static_cast<Pillow::HttpClient*>(sender());
-	const QString urlAuthority = _clientToUrlMap.value(client);
+	Pillow::NetworkReply *reply = new Pillow::NetworkReply(_clientPool, op, request, clientRequest);
+	if (op != QNetworkAccessManager::UnknownOperation)
+		_clientPool->acquire(request.url(), reply, "start");
 
-	if (urlAuthority.isEmpty())
-		client->deleteLater();
-	else
-		_urlToClientsMap.insert(urlAuthority, client);
+	return reply;
 }
 
 #include "HttpClient.moc"
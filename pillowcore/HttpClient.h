@@ -10,6 +10,9 @@
 #ifndef QURL_H
 #include <QtCore/QUrl>
 #endif // QURL_H
+#ifndef QPOINTER_H
+#include <QtCore/QPointer>
+#endif // QPOINTER_H
 #ifndef QTIMESTAMP_H
 #include <QtCore/QElapsedTimer>
 #endif // QTIMESTAMP_H
@@ -25,7 +28,7 @@
 
 class QIODevice;
 class QTcpSocket;
-namespace Pillow { class ContentTransformer; }
+namespace Pillow { class ContentTransformer; class HttpClientPool; class HttpHostCache; }
 
 namespace Pillow
 {
@@ -53,9 +56,20 @@ namespace Pillow
 
 		void write(const QByteArray& method, const QByteArray& path, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection(), const QByteArray& data = QByteArray());
 
+		// Streamed content: write the request line and headers, then the content in as many writeContent() calls
+		// as needed. A contentLength of -1 sends the content chunked, which must then be ended with endContent().
+		void writeHeaders(const QByteArray& method, const QByteArray& path, const Pillow::HttpHeaderCollection& headers, qint64 contentLength);
+		void writeContent(const QByteArray& data);
+		void endContent();
+
+	private:
+		void appendHead(const QByteArray& method, const QByteArray& path, const Pillow::HttpHeaderCollection& headers);
+		void flushBuilder();
+
 	private:
 		QIODevice* _device;
 		QByteArray _builder;
+		bool _chunked;
 	};
 
 	//
@@ -146,6 +160,9 @@ namespace Pillow
 		QUrl url;
 		Pillow::HttpHeaderCollection headers;
 		QByteArray data;
+		QIODevice* device; // Content streamed from an open device instead of "data", from its current position. Not owned.
+
+		HttpClientRequest() : device(0) {}
 	};
 
 	//
@@ -189,6 +206,25 @@ namespace Pillow
 		qint64 readBufferSize() const;
 		void setReadBufferSize(qint64 size);
 
+		// maximumPipelinedRequests: Maximum number of requests sent on the connection before their responses are received.
+		//                           Above 1, request() can be called while a response is pending: the new request is queued
+		//                           and, if it is idempotent (GET, HEAD, PUT, DELETE, ...) and for the same server, written
+		//                           right away behind the pending ones. finished() is emitted once per request, in the order
+		//                           the requests were made. If the server closes the connection mid-pipeline, the pending
+		//                           request fails as usual and the requests written after it are sent again on a new connection.
+		//                           abort() also drops the queued requests.
+		//                           Defaults to 1 (no pipelining).
+		int maximumPipelinedRequests() const;
+		void setMaximumPipelinedRequests(int count);
+		int queuedRequestCount() const; // Requests made while a response is pending, not counting the pending one.
+
+		// hostCache: Where host names are resolved when connecting. Not owned, and forgotten if destroyed.
+		//            Use 0 to have the socket resolve the name on every connection.
+		//            Not used when connecting through a proxy, which resolves the name itself.
+		//            Defaults to HttpHostCache::instance(), shared by all clients.
+		Pillow::HttpHostCache* hostCache() const;
+		void setHostCache(Pillow::HttpHostCache* cache);
+
 	public:
 		// Request members.
 		void get(const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection());
@@ -197,9 +233,19 @@ namespace Pillow
 		void put(const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection(), const QByteArray& data = QByteArray());
 		void deleteResource(const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection());
 
+		// Streamed content: "device" must stay open until finished(). It is read as the connection drains, so that no more
+		// than a small buffer of it is held in memory. Content from random access devices is sent with their remaining size as
+		// Content-Length, straight out of a memory mapping for files; content from sequential devices is sent chunked until
+		// they close or emit readChannelFinished(), unless a Content-Length header is given.
+		void post(const QUrl& url, const Pillow::HttpHeaderCollection& headers, QIODevice* device);
+		void put(const QUrl& url, const Pillow::HttpHeaderCollection& headers, QIODevice* device);
+
 		void request(const QByteArray& method, const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection(), const QByteArray& data = QByteArray());
+		void request(const QByteArray& method, const QUrl& url, const Pillow::HttpHeaderCollection& headers, QIODevice* device);
 		void request(const Pillow::HttpClientRequest& request);
 
+		void connectToServer(const QUrl& url); // Open a connection to the server of "url" ahead of time, without sending a request. The next request to that server uses it.
+
 		void abort(); // Stop any active request and break current server connection. If there was an active request, finished() will be emitted and the error will be set to AbortedError.
 
 		void followRedirection(); // Follow previous request's redirection. Only effective if redirected() is true.
@@ -227,9 +273,24 @@ namespace Pillow
 		void device_error(QAbstractSocket::SocketError error);
 		void device_connected();
 		void device_readyRead();
+		void device_bytesWritten();
+		void uploadDevice_readyRead();
+		void uploadDevice_readChannelFinished();
+		void hostCache_hostResolved(const QString& hostName);
+		void hostCache_lookupFailed();
+		void hostCache_destroyed();
 
 	private:
+		void openConnection();
+		void startRequest(const Pillow::HttpClientRequest& request);
 		void sendRequest();
+		void writeRequest(const Pillow::HttpClientRequest& request);
+		void fillPipeline();
+		bool takeWrittenAheadRequest();
+		void startQueuedRequest();
+		void startUpload(const Pillow::HttpClientRequest& request, const QByteArray& uri, const Pillow::HttpHeaderCollection& headers);
+		void writeUploadContent();
+		void finishUpload(bool completed);
 
 	protected:
 		void messageBegin();
@@ -250,6 +311,18 @@ namespace Pillow
 		QElapsedTimer _keepAliveTimeoutTimer;
 		QByteArray _hostHeaderValue;
 		Pillow::ContentTransformer* _contentDecoder;
+		QList<Pillow::HttpClientRequest> _queuedRequests; // Pipelined mode: the first _writtenAheadCount of them are already sent.
+		int _writtenAheadCount;
+		int _maximumPipelinedRequests;
+		QPointer<Pillow::HttpHostCache> _hostCache;
+		QString _resolvingHost; // Set while waiting on the host cache.
+		QList<QHostAddress> _connectAddresses; // The server's addresses left to try if connecting fails.
+		QPointer<QIODevice> _uploadDevice;
+		bool _uploading, _uploadSourceFinished;
+		qint64 _uploadRemaining; // -1 when chunked.
+		qint64 _uploadStart;     // Where the content starts in the device, to send it again on redirections. -1 if sequential.
+		uchar* _uploadMapping;
+		qint64 _uploadMappingPosition;
 	};
 
 	//
@@ -259,6 +332,10 @@ namespace Pillow
 	// per host for http instead of the 6 connections-per-host limit that QNetworkAccessManager normally
 	// applies.
 	//
+	// The clients are leased from clientPool(). By default the manager has a pool of its own, without
+	// a connection limit. Share an HttpClientPool between managers (or with other users) to bound the
+	// connections they open together; replies then wait for a free client when a server is at its limit.
+	//
 	// Reentrant. Not thread safe.
 	//
 	class PILLOWCORE_EXPORT NetworkAccessManager : public QNetworkAccessManager
@@ -269,17 +346,14 @@ namespace Pillow
 		NetworkAccessManager(QObject *parent = 0);
 		~NetworkAccessManager();
 
+		Pillow::HttpClientPool* clientPool() const;
+		void setClientPool(Pillow::HttpClientPool* pool); // Not owned. Only affects the requests created afterwards.
+
 	protected:
 		QNetworkReply *createRequest(Operation op, const QNetworkRequest &request, QIODevice *outgoingData = 0);
 
-	private slots:
-		void client_finished();
-
 	private:
-		typedef QMultiHash<QString, Pillow::HttpClient*> UrlClientsMap;
-		UrlClientsMap _urlToClientsMap;
-		typedef QHash<Pillow::HttpClient*, QString> ClientUrlMap;
-		ClientUrlMap _clientToUrlMap;
+		Pillow::HttpClientPool* _clientPool;
 	};
 
 } // namespace Pillow
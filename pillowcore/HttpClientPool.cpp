@@ -0,0 +1,362 @@
+#include "HttpClientPool.h"
+#include "HttpClient.h"
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QPointer>
+#include <QtCore/QTimer>
+#include <QtCore/QDebug>
+using namespace Pillow;
+
+namespace Pillow
+{
+	//
+	// HttpClientPoolPrivate
+	//
+
+	struct HttpPooledClient
+	{
+		HttpClient* client;
+		QElapsedTimer idleTimer;
+	};
+
+	struct HttpPoolWaiter
+	{
+		QPointer<QObject> receiver;
+		QByteArray method;
+	};
+
+	struct HttpPoolHost
+	{
+		int count;                    // Clients for this server, leased and idle.
+		QList<HttpPooledClient> idle; // The most recently returned one last.
+		QList<HttpPoolWaiter> waiters;
+
+		HttpPoolHost() : count(0) {}
+	};
+
+	class HttpClientPoolPrivate
+	{
+	public:
+		HttpClientPool* q_ptr;
+		int maximumConnectionsPerHost;
+		int idleTimeout;
+		QHash<QString, HttpPoolHost> hosts;
+		QHash<QObject*, QString> clientKeys;
+		QHash<QObject*, QPointer<QObject> > lessees; // The receiver each leased client was handed to, if any.
+		QTimer evictionTimer;
+		quint64 createdCount, reusedCount;
+
+	public:
+		HttpClientPoolPrivate(HttpClientPool* q)
+			: q_ptr(q), maximumConnectionsPerHost(HttpClientPool::DefaultMaximumConnectionsPerHost),
+			  idleTimeout(HttpClientPool::DefaultIdleTimeout), createdCount(0), reusedCount(0)
+		{}
+
+		static QString keyFor(const QUrl& url)
+		{
+			const QString scheme = url.scheme().toLower();
+			const int defaultPort = scheme == QLatin1String("https") ? 443 : 80;
+			return scheme + QLatin1String("://") + url.host().toLower() + QLatin1Char(':') + QString::number(url.port(defaultPort));
+		}
+
+		inline bool isUnderLimit(const HttpPoolHost& host) const
+		{
+			return maximumConnectionsPerHost <= 0 || host.count < maximumConnectionsPerHost;
+		}
+
+		HttpClient* create(const QString& key, HttpPoolHost& host)
+		{
+			HttpClient* client = new HttpClient(q_ptr);
+			QObject::connect(client, SIGNAL(destroyed(QObject*)), q_ptr, SLOT(client_destroyed(QObject*)));
+			clientKeys.insert(client, key);
+			++host.count;
+			++createdCount;
+			return client;
+		}
+
+		HttpClient* take(const QString& key)
+		{
+			HttpPoolHost& host = hosts[key];
+			if (!host.idle.isEmpty())
+			{
+				++reusedCount;
+				return host.idle.takeLast().client; // The warmest connection.
+			}
+			return isUnderLimit(host) ? create(key, host) : 0;
+		}
+
+		void putIdle(HttpClient* client, HttpPoolHost& host)
+		{
+			HttpPooledClient pooled;
+			pooled.client = client;
+			pooled.idleTimer.start();
+			host.idle << pooled;
+			if (idleTimeout > 0 && !evictionTimer.isActive())
+				evictionTimer.start(qMax(100, idleTimeout / 4));
+		}
+
+		void discard(HttpClient* client, HttpPoolHost& host)
+		{
+			clientKeys.remove(client);
+			lessees.remove(client);
+			--host.count;
+			QObject::disconnect(client, 0, q_ptr, 0);
+			client->deleteLater();
+		}
+
+		bool invoke(const HttpPoolWaiter& waiter, HttpClient* client)
+		{
+			lessees.insert(client, waiter.receiver);
+			if (QMetaObject::invokeMethod(waiter.receiver, waiter.method.constData(), Qt::DirectConnection, Q_ARG(Pillow::HttpClient*, client)))
+				return true;
+			lessees.remove(client);
+			qWarning() << "Pillow::HttpClientPool: could not invoke" << waiter.method << "on" << waiter.receiver.data() << ".";
+			return false;
+		}
+
+		// Hands "client" to the first waiter still around. Returns false if there was none.
+		bool serveWaiter(const QString& key, HttpClient* client)
+		{
+			forever
+			{
+				// The invoked method may acquire or release other clients: look the server up again every time.
+				QList<HttpPoolWaiter>& waiters = hosts[key].waiters;
+				if (waiters.isEmpty()) return false;
+				const HttpPoolWaiter waiter = waiters.takeFirst();
+				if (!waiter.receiver.isNull() && invoke(waiter, client)) return true;
+			}
+		}
+
+		// A place was freed for the server: let the next waiter have it.
+		void serveWaiters(const QString& key)
+		{
+			while (!hosts[key].waiters.isEmpty())
+			{
+				HttpClient* client = take(key);
+				if (client == 0) return;
+				if (!serveWaiter(key, client))
+				{
+					putIdle(client, hosts[key]);
+					return;
+				}
+			}
+		}
+	};
+}
+
+//
+// Pillow::HttpClientPool
+//
+
+HttpClientPool::HttpClientPool(QObject *parent)
+	: QObject(parent), d_ptr(new HttpClientPoolPrivate(this))
+{
+	connect(&d_ptr->evictionTimer, SIGNAL(timeout()), this, SLOT(evictIdleClients()));
+}
+
+HttpClientPool::~HttpClientPool()
+{
+	// The clients are children of the pool and get deleted along with it, leased ones included.
+	foreach (QObject* client, d_ptr->clientKeys.keys())
+		disconnect(client, 0, this, 0);
+	delete d_ptr;
+}
+
+int HttpClientPool::maximumConnectionsPerHost() const
+{
+	return d_ptr->maximumConnectionsPerHost;
+}
+
+void HttpClientPool::setMaximumConnectionsPerHost(int count)
+{
+	Q_D(HttpClientPool);
+	d->maximumConnectionsPerHost = qMax(0, count);
+	foreach (const QString& key, d->hosts.keys())
+		d->serveWaiters(key);
+}
+
+int HttpClientPool::idleTimeout() const
+{
+	return d_ptr->idleTimeout;
+}
+
+void HttpClientPool::setIdleTimeout(int timeout)
+{
+	Q_D(HttpClientPool);
+	d->idleTimeout = qMax(-1, timeout);
+	if (d->idleTimeout == 0)
+		clear();
+	else if (d->idleTimeout < 0)
+		d->evictionTimer.stop();
+	else if (d->evictionTimer.isActive())
+		d->evictionTimer.start(qMax(100, d->idleTimeout / 4));
+}
+
+HttpClient *HttpClientPool::tryAcquire(const QUrl &url, QObject *lessee)
+{
+	HttpClient* client = d_ptr->take(HttpClientPoolPrivate::keyFor(url));
+	if (client != 0 && lessee != 0) d_ptr->lessees.insert(client, lessee);
+	return client;
+}
+
+void HttpClientPool::acquire(const QUrl &url, QObject *receiver, const char *method)
+{
+	Q_D(HttpClientPool);
+	if (receiver == 0 || method == 0) return;
+
+	HttpPoolWaiter waiter;
+	waiter.receiver = receiver;
+	waiter.method = method;
+
+	const QString key = HttpClientPoolPrivate::keyFor(url);
+	if (d->hosts.value(key).waiters.isEmpty())
+	{
+		if (HttpClient* client = d->take(key))
+		{
+			if (!d->invoke(waiter, client)) release(client);
+			return;
+		}
+	}
+
+	d->hosts[key].waiters << waiter;
+}
+
+void HttpClientPool::cancel(QObject *receiver)
+{
+	Q_D(HttpClientPool);
+	for (QHash<QString, HttpPoolHost>::Iterator it = d->hosts.begin(), itE = d->hosts.end(); it != itE; ++it)
+	{
+		QList<HttpPoolWaiter>& waiters = it.value().waiters;
+		for (int i = waiters.size() - 1; i >= 0; --i)
+		{
+			if (waiters.at(i).receiver == receiver) waiters.removeAt(i);
+		}
+	}
+}
+
+void HttpClientPool::release(HttpClient *client)
+{
+	Q_D(HttpClientPool);
+	if (client == 0) return;
+
+	const QString key = d->clientKeys.value(client);
+	if (key.isEmpty())
+	{
+		qWarning() << "Pillow::HttpClientPool::release: the client does not belong to this pool.";
+		return;
+	}
+
+	// The next lessee starts with a clean slate. Connections made by anyone else are theirs to drop.
+	const QPointer<QObject> lessee = d->lessees.take(client);
+	if (!lessee.isNull()) disconnect(client, 0, lessee.data(), 0);
+
+	if (client->responsePending())
+	{
+		client->abort();
+		d->discard(client, d->hosts[key]);
+		d->serveWaiters(key);
+		return;
+	}
+
+	if (d->serveWaiter(key, client)) return;
+
+	if (d->idleTimeout == 0)
+		d->discard(client, d->hosts[key]);
+	else
+		d->putIdle(client, d->hosts[key]);
+}
+
+void HttpClientPool::prewarm(const QUrl &url, int count)
+{
+	Q_D(HttpClientPool);
+	const QString key = HttpClientPoolPrivate::keyFor(url);
+	HttpPoolHost& host = d->hosts[key];
+	while (host.idle.size() < count && d->isUnderLimit(host))
+	{
+		HttpClient* client = d->create(key, host);
+		client->connectToServer(url);
+		d->putIdle(client, host);
+	}
+}
+
+void HttpClientPool::clear()
+{
+	Q_D(HttpClientPool);
+	for (QHash<QString, HttpPoolHost>::Iterator it = d->hosts.begin(), itE = d->hosts.end(); it != itE; ++it)
+	{
+		HttpPoolHost& host = it.value();
+		while (!host.idle.isEmpty())
+			d->discard(host.idle.takeLast().client, host);
+	}
+	d->evictionTimer.stop();
+}
+
+int HttpClientPool::connectionCount(const QUrl &url) const
+{
+	return d_ptr->hosts.value(HttpClientPoolPrivate::keyFor(url)).count;
+}
+
+int HttpClientPool::idleConnectionCount(const QUrl &url) const
+{
+	return d_ptr->hosts.value(HttpClientPoolPrivate::keyFor(url)).idle.size();
+}
+
+int HttpClientPool::waitingCount(const QUrl &url) const
+{
+	return d_ptr->hosts.value(HttpClientPoolPrivate::keyFor(url)).waiters.size();
+}
+
+quint64 HttpClientPool::createdCount() const
+{
+	return d_ptr->createdCount;
+}
+
+quint64 HttpClientPool::reusedCount() const
+{
+	return d_ptr->reusedCount;
+}
+
+void HttpClientPool::client_destroyed(QObject *client)
+{
+	Q_D(HttpClientPool);
+	const QString key = d->clientKeys.take(client);
+	if (key.isEmpty()) return;
+	d->lessees.remove(client);
+
+	HttpPoolHost& host = d->hosts[key];
+	--host.count;
+	for (int i = 0; i < host.idle.size(); ++i)
+	{
+		if (static_cast<QObject*>(host.idle.at(i).client) == client)
+		{
+			host.idle.removeAt(i);
+			break;
+		}
+	}
+
+	d->serveWaiters(key);
+}
+
+void HttpClientPool::evictIdleClients()
+{
+	Q_D(HttpClientPool);
+	bool hasIdleClients = false;
+
+	QHash<QString, HttpPoolHost>::Iterator it = d->hosts.begin();
+	while (it != d->hosts.end())
+	{
+		// The oldest clients come first.
+		HttpPoolHost& host = it.value();
+		while (!host.idle.isEmpty() && host.idle.first().idleTimer.hasExpired(d->idleTimeout))
+			d->discard(host.idle.takeFirst().client, host);
+
+		hasIdleClients = hasIdleClients || !host.idle.isEmpty();
+		if (host.count == 0 && host.waiters.isEmpty())
+			it = d->hosts.erase(it);
+		else
+			++it;
+	}
+
+	if (!hasIdleClients) d->evictionTimer.stop();
+}
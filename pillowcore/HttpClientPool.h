@@ -0,0 +1,95 @@
+#ifndef PILLOW_HTTPCLIENTPOOL_H
+#define PILLOW_HTTPCLIENTPOOL_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef QOBJECT_H
+#include <QtCore/QObject>
+#endif // QOBJECT_H
+#ifndef QURL_H
+#include <QtCore/QUrl>
+#endif // QURL_H
+
+namespace Pillow
+{
+	class HttpClient;
+	class HttpClientPoolPrivate;
+
+	//
+	// Pillow::HttpClientPool
+	//
+	// Shared connections, per server. Each HttpClient holds one connection, so the pool lends out whole clients,
+	// keyed by the scheme, host and port of the url they are for. At most maximumConnectionsPerHost clients exist
+	// for a server at a time; once that many are leased, acquire() puts the caller in line until one comes back.
+	// Returned clients keep their connection open and the most recently returned one is lent out first, so that
+	// connections stay warm and the extra ones of a burst time out. Clients idle for longer than idleTimeout are
+	// deleted.
+	//
+	// A leased client must be given back with release() once its response has finished; the pool then drops the
+	// connections from the client to its lessee, the receiver given to acquire() or tryAcquire(). Other objects
+	// connected to a leased client must disconnect themselves. Deleting a leased client is allowed and frees its place.
+	//
+	// Reentrant. Not thread safe.
+	//
+
+	class PILLOWCORE_EXPORT HttpClientPool : public QObject
+	{
+		Q_OBJECT
+		Q_PROPERTY(int maximumConnectionsPerHost READ maximumConnectionsPerHost WRITE setMaximumConnectionsPerHost)
+		Q_PROPERTY(int idleTimeout READ idleTimeout WRITE setIdleTimeout)
+
+	public:
+		enum { DefaultMaximumConnectionsPerHost = 8 };
+		enum { DefaultIdleTimeout = 30000 }; // Milliseconds.
+
+	public:
+		HttpClientPool(QObject* parent = 0);
+		~HttpClientPool();
+
+		// maximumConnectionsPerHost: Use 0 for no limit. Lowering it does not take back leased clients.
+		int maximumConnectionsPerHost() const;
+		void setMaximumConnectionsPerHost(int count);
+
+		// idleTimeout: Milliseconds a returned client is kept for reuse. Use -1 to keep idle clients forever, and
+		//              0 to delete them as soon as they are returned.
+		int idleTimeout() const;
+		void setIdleTimeout(int timeout);
+
+	public:
+		// An idle client for the server of "url", or a new one when the server is under its limit. Returns 0 at the limit.
+		// The client's signals are disconnected from "lessee", if given, when it is released.
+		Pillow::HttpClient* tryAcquire(const QUrl& url, QObject* lessee = 0);
+
+		// Same as tryAcquire(), but waits in line at the limit. "method" is the name of a slot or invokable method of
+		// "receiver" taking a Pillow::HttpClient*. It is called right away when a client is available, otherwise as
+		// soon as one is released for that server. Waiting receivers that are destroyed simply leave the line.
+		void acquire(const QUrl& url, QObject* receiver, const char* method);
+		void cancel(QObject* receiver); // Takes "receiver" out of every line it waits in.
+
+		void release(Pillow::HttpClient* client); // A client still waiting for a response is aborted and deleted instead of reused.
+
+		// Open connections to the server of "url" ahead of time, until "count" clients are idle for it or the limit is reached.
+		void prewarm(const QUrl& url, int count = 1);
+
+		void clear(); // Delete the idle clients.
+
+	public:
+		int connectionCount(const QUrl& url) const; // Clients for the server of "url", leased or idle.
+		int idleConnectionCount(const QUrl& url) const;
+		int waitingCount(const QUrl& url) const;
+
+		quint64 createdCount() const; // Clients created since the pool was.
+		quint64 reusedCount() const;  // Leases served by an idle client.
+
+	private slots:
+		void client_destroyed(QObject* client);
+		void evictIdleClients();
+
+	private:
+		Q_DECLARE_PRIVATE(HttpClientPool)
+		HttpClientPoolPrivate* d_ptr;
+	};
+}
+
+#endif // PILLOW_HTTPCLIENTPOOL_H
@@ -1,9 +1,14 @@
 #include "HttpConnection.h"
 #include "HttpHelpers.h"
+#include "HttpBufferPool.h"
 #include "private/ByteArray.h"
+#define PILLOW_TRACE_DEFINE_SEMAPHORES
+#include "private/Trace.h"
 #include "parser/parser.h"
+#include "parser/fastparser.h"
 #include <QtCore/QIODevice>
 #include <QtCore/QTimer>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QUrl>
 #include <QtCore/QStringBuilder>
 #include <QtNetwork/QTcpSocket>
@@ -16,6 +21,22 @@
 
 namespace Pillow
 {
+	namespace Parser
+	{
+		// Both request parsers fill the same http_parser structure; "pillow_fast_parser" in config.pri selects the line oriented one.
+#ifdef PILLOW_FAST_PARSER
+		inline void init(http_parser* parser) { fast_http_parser_init(parser); }
+		inline void execute(http_parser* parser, const char* data, size_t len, size_t off) { fast_http_parser_execute(parser, data, len, off); }
+		inline bool hasError(http_parser* parser) { return fast_http_parser_has_error(parser); }
+		inline bool isFinished(http_parser* parser) { return fast_http_parser_is_finished(parser); }
+#else
+		inline void init(http_parser* parser) { thin_http_parser_init(parser); }
+		inline void execute(http_parser* parser, const char* data, size_t len, size_t off) { thin_http_parser_execute(parser, data, len, off); }
+		inline bool hasError(http_parser* parser) { return thin_http_parser_has_error(parser); }
+		inline bool isFinished(http_parser* parser) { return thin_http_parser_is_finished(parser); }
+#endif
+	}
+
 	namespace Tokens
 	{
 		#define DEFINE_TOKEN(tokenName, tokenValue) static const Pillow::Token tokenName##Token(tokenValue)
@@ -31,12 +52,12 @@ namespace Pillow
 		DEFINE_LOWERCASE_TOKEN(connection, "connection");
 		DEFINE_LOWERCASE_TOKEN(contentLength, "content-length");
 		DEFINE_LOWERCASE_TOKEN(contentType, "content-type");
-		DEFINE_LOWERCASE_TOKEN(expect, "expect");
 		DEFINE_LOWERCASE_TOKEN(hundredDashContinue, "100-continue");
 		DEFINE_LOWERCASE_TOKEN(keepAlive, "keep-alive");
 		DEFINE_LOWERCASE_TOKEN(close, "close");
 		DEFINE_LOWERCASE_TOKEN(transferEncoding, "transfer-encoding");
 		DEFINE_LOWERCASE_TOKEN(chunked, "chunked");
+		DEFINE_LOWERCASE_TOKEN(formUrlEncoded, "application/x-www-form-urlencoded");
 		#undef DEFINE_TOKEN
 		#undef DEFINE_LOWERCASE_TOKEN
 	}
@@ -48,8 +69,51 @@ namespace Pillow
 			: fieldPos(fieldPos), fieldLength(fieldLength), valuePos(valuePos), valueLength(valueLength) {}
 		inline HttpHeaderRef() {}
 	};
+
+	struct HttpParamRef
+	{
+		int keyPos, keyLength, valuePos, valueLength; // Relative to the query string, or to the content for form params.
+		quint32 keyHash; // Of the decoded key, ASCII lowercased.
+		bool fromContent, keyEncoded, hasValue;
+	};
+
+	namespace
+	{
+		// Decodes a param key or value; in form content, "+" stands for a space.
+		inline int decodeParamInPlace(char* data, int size, bool form)
+		{
+			if (form) for (char* c = data, *cE = data + size; c < cE; ++c) if (*c == '+') *c = ' ';
+			return Pillow::ByteArrayHelpers::percentDecodeInPlace(data, size);
+		}
+
+		inline QString decodeParam(const char* data, int size, bool form)
+		{
+			return form ? Pillow::ByteArrayHelpers::formDecode(data, size) : Pillow::ByteArrayHelpers::percentDecode(data, size);
+		}
+
+		inline quint32 hashParamKey(const char* data, int size)
+		{
+			// 32 bits FNV-1a over the ASCII lowercased key.
+			quint32 hash = 2166136261u;
+			for (const char* c = data, *cE = data + size; c < cE; ++c)
+			{
+				char ch = *c;
+				if (ch >= 'A' && ch <= 'Z') ch += 'a' - 'A';
+				hash = (hash ^ static_cast<uchar>(ch)) * 16777619u;
+			}
+			return hash;
+		}
+
+		// Replaces a view into a buffer by a copy of its data.
+		inline void detachFromBuffer(QByteArray& view)
+		{
+			if (view.isEmpty()) Pillow::ByteArrayHelpers::setFromRawData(view, "", 0, 0);
+			else view = QByteArray(view.constData(), view.size());
+		}
+	}
 }
 Q_DECLARE_TYPEINFO(Pillow::HttpHeaderRef, Q_PRIMITIVE_TYPE);
+Q_DECLARE_TYPEINFO(Pillow::HttpParamRef, Q_PRIMITIVE_TYPE);
 
 using namespace Pillow::Tokens;
 using namespace Pillow::ByteArrayHelpers;
@@ -89,10 +153,18 @@ namespace Pillow
 		PERCENT_DECODABLE(requestPath)
 		PERCENT_DECODABLE(requestQueryString)
 		QVarLengthArray<Pillow::HttpHeaderRef, 32> _requestHeadersRef;
-		Pillow::HttpHeaderCollection _requestHeaders;
-		int _requestContentLength; int _requestContentLengthHeaderIndex;
+		short _requestKnownHeaders[Pillow::HttpKnownHeaders::Count]; // Index of the first header of each known field in _requestHeadersRef, or -1.
+		Pillow::HttpHeaderCollection _requestHeaders; // Built from _requestHeadersRef on first access only.
+		bool _requestHeadersReady;
+		QByteArray _requestKnownHeaderValues[Pillow::HttpKnownHeaders::Count]; // Values handed out by requestHeaderValue(Field) before _requestHeaders is built.
+		quint64 _requestKnownHeaderValuesReady; // Bit mask over HttpKnownHeaders::Field.
+		int _requestContentLength;
 		bool _requestHttp11;
-		Pillow::HttpParamCollection _requestParams;
+		QVarLengthArray<Pillow::HttpParamRef, 16> _requestParamsRef; // Query string params, then form content params.
+		QVarLengthArray<int, 32> _requestParamBuckets; // Open addressing on keyHash, index in _requestParamsRef + 1 (0 for empty buckets).
+		bool _requestParamsIndexed;
+		Pillow::HttpParamCollection _requestParams; // Decoded from _requestParamsRef on first access only, then authoritative.
+		bool _requestParamsDecoded;
 
 		// Response fields.
 		Pillow::ByteArray _responseHeadersBuffer;
@@ -100,11 +172,28 @@ namespace Pillow
 		qint64 _responseContentLength, _responseContentBytesSent;
 		bool _responseConnectionKeepAlive;
 		bool _responseChunkedTransferEncoding;
+		bool _closeWhenIdle;
+
+		// Timing and connection reuse.
+		qint64 _requestTimestamps[Pillow::HttpConnection::TimestampCount];
+		int _requestCount;
 
 	public:
 		void initialize();
 		void processInput();
 		void setupRequestHeaders();
+		void invalidateRequestHeaders();
+		const Pillow::HttpHeaderCollection& requestHeaders();
+		const QByteArray& requestHeaderValue(Pillow::HttpKnownHeaders::Field field);
+		bool requestHeaderEquals(Pillow::HttpKnownHeaders::Field field, const Pillow::LowerCaseToken& token) const;
+		void clearRequestParams();
+		void indexRequestParams();
+		void appendRequestParamRefs(const char* data, int size, bool fromContent);
+		int findRequestParam(const QString& name) const;
+		const Pillow::HttpParamCollection& requestParams();
+		QString requestParamValue(const QString& name);
+		void detachRequestFields();
+		void releaseBuffers();
 		void transitionToReceivingHeaders();
 		void transitionToReceivingContent();
 		void transitionToSendingHeaders();
@@ -125,15 +214,20 @@ namespace Pillow
 		void writeContent(const QByteArray& content);
 		void endContent();
 		void close();
+		void closeGracefully();
 	};
 }
 
 Pillow::HttpConnectionPrivate::HttpConnectionPrivate(HttpConnection *connection)
-	: q_ptr(connection), _state(Pillow::HttpConnection::Uninitialized), _inputDevice(0), _outputDevice(0)
+	: q_ptr(connection), _state(Pillow::HttpConnection::Uninitialized), _inputDevice(0), _outputDevice(0), _closeWhenIdle(false)
 {
 	// Detach bytearrays we're going to write to from global shared null as we'll be thinkering with their internal data with the assumption that they are never shared.
-	_requestBuffer.detach();
+	// The request and response headers buffers are instead taken from the thread's HttpBufferPool when needed.
 	_requestContent.detach();
+	invalidateRequestHeaders();
+	_requestParamsIndexed = _requestParamsDecoded = false;
+	memset(_requestTimestamps, 0, sizeof(_requestTimestamps));
+	_requestCount = 0;
 }
 
 inline void Pillow::HttpConnectionPrivate::initialize()
@@ -141,13 +235,12 @@ inline void Pillow::HttpConnectionPrivate::initialize()
 	memset(&_parser, 0, sizeof(http_parser));
 	_parser.data = this;
 	_parser.http_field = &HttpConnectionPrivate::parser_http_field;
+	_closeWhenIdle = false;
+	_requestCount = 0;
+	memset(_requestTimestamps, 0, sizeof(_requestTimestamps));
 
 	// Clear any leftover data from a previous potentially failed request (that would not have gone though "transitionToCompleted")
-	if (_requestBuffer.capacity() <= Pillow::HttpConnection::MaximumRequestHeaderLength) _requestBuffer.data_ptr()->size = 0;
-	else _requestBuffer.clear();
-	_requestHeadersRef.clear();
-	if (_requestParams.capacity() > 16) _requestParams.clear();
-	else while(!_requestParams.isEmpty()) _requestParams.pop_back();
+	releaseBuffers();
 
 	// Enter the initial working state and schedule processing of any data already available on the device.
 	transitionToReceivingHeaders();
@@ -161,6 +254,8 @@ inline void Pillow::HttpConnectionPrivate::processInput()
 	qint64 bytesAvailable = _inputDevice->bytesAvailable();
 	if (bytesAvailable > 0)
 	{
+		if (_requestBuffer.capacity() == 0)
+			_requestBuffer = HttpBufferPool::instance()->take(int(qMin<qint64>(bytesAvailable, Pillow::HttpConnection::MaximumRequestHeaderLength)) + 1);
 		if (_requestBuffer.capacity() < (_requestBuffer.size() + bytesAvailable + 1))
 			_requestBuffer.reserve(_requestBuffer.size() + bytesAvailable + 1);
 		const qint64 bytesRead = _inputDevice->read(_requestBuffer.data() + _requestBuffer.size(), bytesAvailable);
@@ -170,12 +265,18 @@ inline void Pillow::HttpConnectionPrivate::processInput()
 
 	if (_state == Pillow::HttpConnection::ReceivingHeaders)
 	{
+		// The previous request's timestamps stay readable until the next one starts arriving.
+		if (!_requestBuffer.isEmpty() && (_requestTimestamps[Pillow::HttpConnection::RequestStarted] == 0 || _requestTimestamps[Pillow::HttpConnection::ResponseCompleted] != 0))
+		{
+			memset(_requestTimestamps, 0, sizeof(_requestTimestamps));
+			_requestTimestamps[Pillow::HttpConnection::RequestStarted] = Pillow::HttpConnection::currentTimestamp();
+		}
 		if (!_requestBuffer.isEmpty())
-			thin_http_parser_execute(&_parser, _requestBuffer.constData(), _requestBuffer.size(), _parser.nread);
+			Pillow::Parser::execute(&_parser, _requestBuffer.constData(), _requestBuffer.size(), _parser.nread);
 
-		if (_parser.nread > Pillow::HttpConnection::MaximumRequestHeaderLength || thin_http_parser_has_error(&_parser))
+		if (_parser.nread > Pillow::HttpConnection::MaximumRequestHeaderLength || Pillow::Parser::hasError(&_parser))
 			return writeRequestErrorResponse(400); // Bad client Request!
-		else if (thin_http_parser_is_finished(&_parser))
+		else if (Pillow::Parser::isFinished(&_parser))
 			transitionToReceivingContent();
 	}
 	else if (_state == Pillow::HttpConnection::ReceivingContent)
@@ -190,10 +291,12 @@ inline void Pillow::HttpConnectionPrivate::transitionToReceivingHeaders()
 	if (_state == Pillow::HttpConnection::ReceivingHeaders) return;
 	_state = Pillow::HttpConnection::ReceivingHeaders;
 
-	thin_http_parser_init(&_parser);
+	Pillow::Parser::init(&_parser);
 	_requestContentLength = 0;
-	_requestContentLengthHeaderIndex = -1;
+	memset(_requestKnownHeaders, -1, sizeof(_requestKnownHeaders));
+	invalidateRequestHeaders();
 	_requestHttp11 = false;
+	PILLOW_TRACE2(connection_receiving_headers, q_ptr, _requestCount);
 }
 
 inline void Pillow::HttpConnectionPrivate::setupRequestHeaders()
@@ -210,18 +313,60 @@ inline void Pillow::HttpConnectionPrivate::setupRequestHeaders()
 		setFromRawDataAndNullterm(header->first, data, ref->fieldPos, ref->fieldLength);
 		setFromRawDataAndNullterm(header->second, data, ref->valuePos, ref->valueLength);
 	}
+	_requestHeadersReady = true;
+}
+
+inline void Pillow::HttpConnectionPrivate::invalidateRequestHeaders()
+{
+	// Only flags are reset here; the QByteArrays are pointed at the request buffer again when next accessed.
+	_requestHeadersReady = false;
+	_requestKnownHeaderValuesReady = 0;
+}
+
+inline const Pillow::HttpHeaderCollection& Pillow::HttpConnectionPrivate::requestHeaders()
+{
+	if (!_requestHeadersReady) setupRequestHeaders();
+	return _requestHeaders;
+}
+
+inline const QByteArray& Pillow::HttpConnectionPrivate::requestHeaderValue(Pillow::HttpKnownHeaders::Field field)
+{
+	static const QByteArray nullValue;
+	if (field < 0 || field >= HttpKnownHeaders::Count) return nullValue;
+	int index = _requestKnownHeaders[field];
+	if (index < 0 || index >= _requestHeadersRef.size()) return nullValue;
+	if (_requestHeadersReady) return _requestHeaders.at(index).second;
+
+	QByteArray& value = _requestKnownHeaderValues[field];
+	if ((_requestKnownHeaderValuesReady & (Q_UINT64_C(1) << field)) == 0)
+	{
+		const HttpHeaderRef& ref = _requestHeadersRef.at(index);
+		setFromRawDataAndNullterm(value, _requestBuffer.data(), ref.valuePos, ref.valueLength);
+		_requestKnownHeaderValuesReady |= Q_UINT64_C(1) << field;
+	}
+	return value;
+}
+
+inline bool Pillow::HttpConnectionPrivate::requestHeaderEquals(Pillow::HttpKnownHeaders::Field field, const Pillow::LowerCaseToken& token) const
+{
+	int index = _requestKnownHeaders[field];
+	if (index < 0) return false;
+	const HttpHeaderRef& ref = _requestHeadersRef.at(index);
+	return asciiEqualsCaseInsensitive(_requestBuffer.constData() + ref.valuePos, ref.valueLength, token.data(), token.size());
 }
 
 inline void Pillow::HttpConnectionPrivate::transitionToReceivingContent()
 {
 	if (_state == Pillow::HttpConnection::ReceivingContent) return;
 	_state = Pillow::HttpConnection::ReceivingContent;
-
-	setupRequestHeaders();
+	_requestTimestamps[Pillow::HttpConnection::HeadersReceived] = Pillow::HttpConnection::currentTimestamp();
 
 	bool contentLengthParseOk = true;
-	if (_requestContentLengthHeaderIndex >= 0)
-		_requestContentLength = _requestHeaders.at(_requestContentLengthHeaderIndex).second.toInt(&contentLengthParseOk);
+	if (_requestKnownHeaders[HttpKnownHeaders::ContentLength] >= 0)
+	{
+		const HttpHeaderRef& ref = _requestHeadersRef.at(_requestKnownHeaders[HttpKnownHeaders::ContentLength]);
+		_requestContentLength = QByteArray::fromRawData(_requestBuffer.constData() + ref.valuePos, ref.valueLength).toInt(&contentLengthParseOk);
+	}
 
 	// Exit early if the client sent an incorrect or unacceptable content-length.
 	if (_requestContentLength < 0)
@@ -231,16 +376,15 @@ inline void Pillow::HttpConnectionPrivate::transitionToReceivingContent()
 
 	if (_requestContentLength > 0)
 	{
-		if (asciiEqualsCaseInsensitive(_requestHeaders.getFieldValue(expectToken), hundredDashContinueToken))
+		if (requestHeaderEquals(HttpKnownHeaders::Expect, hundredDashContinueToken))
 			_outputDevice->write("HTTP/1.1 100 Continue\r\n\r\n");// The client politely wanted to know if it could proceed with his payload. All clear!
 
 		// Resize the request buffer right away to avoid too many reallocs later.
-		// NOTE: This invalidates the request headers QByteArrays if the reallocation
-		// changes the buffer's address (very likely unless the content-length is tiny).
+		// NOTE: This invalidates any request header QByteArray handed out so far if the reallocation
+		// changes the buffer's address. The header refs are offsets and remain valid.
+		const char* previousData = _requestBuffer.constData();
 		_requestBuffer.reserve(int(_parser.body_start + _requestContentLength + 1));
-
-		// So do invalidate the request headers.
-		if (_requestHeaders.size() > 0) _requestHeaders.pop_back();
+		if (_requestBuffer.constData() != previousData) invalidateRequestHeaders();
 
 		// Pump; the content may already be sitting in the buffers.
 		processInput();
@@ -256,11 +400,7 @@ inline void Pillow::HttpConnectionPrivate::transitionToSendingHeaders()
 	if (_state == Pillow::HttpConnection::SendingHeaders) return;
 	_state = Pillow::HttpConnection::SendingHeaders;
 
-	// Prepare and null terminate the request fields.
-
-	if (_requestHeaders.size() != _requestHeadersRef.size())
-		setupRequestHeaders();
-
+	// Prepare and null terminate the request fields. Request headers are prepared on demand.
 	char* data = _requestBuffer.data();
 
 	if (_parser.query_string_len == 0)
@@ -288,12 +428,16 @@ inline void Pillow::HttpConnectionPrivate::transitionToSendingHeaders()
 	_requestHttp11 = _requestHttpVersion == httpSlash11Token;
 
 	setFromRawData(_requestContent, _requestBuffer.constData(), static_cast<int>(_parser.body_start), _requestContentLength);
+	clearRequestParams(); // Params are indexed from the query string and content on first access.
 
 	// Reset our known information about the response.
 	_responseContentLength = -1;   // The response content-length is initially unknown.
 	_responseContentBytesSent = 0; // No content bytes transfered yet.
 	_responseConnectionKeepAlive = true;
 	_responseChunkedTransferEncoding = false;
+	_requestTimestamps[Pillow::HttpConnection::ContentReceived] = Pillow::HttpConnection::currentTimestamp();
+	++_requestCount;
+	PILLOW_TRACE3(connection_request_ready, q_ptr, _requestContentLength, _requestCount);
 	emit q_ptr->requestReady(q_ptr);
 }
 
@@ -301,6 +445,7 @@ inline void Pillow::HttpConnectionPrivate::transitionToSendingContent()
 {
 	if (_state == Pillow::HttpConnection::SendingContent) return;
 	_state = Pillow::HttpConnection::SendingContent;
+	_requestTimestamps[Pillow::HttpConnection::ResponseStarted] = Pillow::HttpConnection::currentTimestamp();
 
 	if (_responseHeadersBuffer.capacity() > 4096)
 		_responseHeadersBuffer.clear();
@@ -325,6 +470,9 @@ inline void Pillow::HttpConnectionPrivate::transitionToCompleted()
 		qWarning() << "HttpConnection::transitionToCompleted called while the request is in the closed state.";
 	}
 	_state = Pillow::HttpConnection::Completed;
+	_requestTimestamps[Pillow::HttpConnection::ResponseCompleted] = Pillow::HttpConnection::currentTimestamp();
+	PILLOW_TRACE4(connection_completed, q_ptr, _responseStatusCode, _responseContentBytesSent,
+				  _requestTimestamps[Pillow::HttpConnection::ResponseCompleted] - _requestTimestamps[Pillow::HttpConnection::RequestStarted]);
 	emit q_ptr->requestCompleted(q_ptr);
 
 	// Preserve any existing data in the request buffer that did not belong to the completed request.
@@ -336,16 +484,21 @@ inline void Pillow::HttpConnectionPrivate::transitionToCompleted()
 
 	_requestHeadersRef.clear();
 
-	if (_requestParams.capacity() > 16) _requestParams.clear();
-	else while(!_requestParams.isEmpty()) _requestParams.pop_back();
+	clearRequestParams();
 
 	if (_requestContent.size() > 0)	_requestContent.data_ptr()->size = 0;
 
-	if (_responseConnectionKeepAlive)
+	if (_responseConnectionKeepAlive && !_closeWhenIdle)
 	{
 		flush(); // Done writing for this request, make sure the data is pushed right away to the client.
+		if (_outputDevice != 0 && _outputDevice->bytesToWrite() == 0)
+			_requestTimestamps[Pillow::HttpConnection::ResponseFlushed] = Pillow::HttpConnection::currentTimestamp();
 		transitionToReceivingHeaders();
 		processInput();
+
+		// Idle keep-alive connection: hold on to no memory until the next request arrives.
+		if (_state == Pillow::HttpConnection::ReceivingHeaders && _requestBuffer.isEmpty())
+			releaseBuffers();
 	}
 	else
 	{
@@ -368,7 +521,11 @@ inline void Pillow::HttpConnectionPrivate::drain()
 {
 	if (_state != Pillow::HttpConnection::Flushing) return;
 	flush();
-	if (_outputDevice != 0 && _outputDevice->bytesToWrite() == 0) transitionToClosed();
+	if (_outputDevice != 0 && _outputDevice->bytesToWrite() == 0)
+	{
+		_requestTimestamps[Pillow::HttpConnection::ResponseFlushed] = Pillow::HttpConnection::currentTimestamp();
+		transitionToClosed();
+	}
 }
 
 inline void Pillow::HttpConnectionPrivate::transitionToFlushing()
@@ -387,6 +544,7 @@ inline void Pillow::HttpConnectionPrivate::transitionToClosed()
 {
 	if (_state == Pillow::HttpConnection::Closed) return;
 	_state = Pillow::HttpConnection::Closed;
+	PILLOW_TRACE2(connection_closed, q_ptr, _requestCount);
 
 	if (_inputDevice && _inputDevice->isOpen()) _inputDevice->close();
 	if (_outputDevice && (_inputDevice != _outputDevice) && _outputDevice->isOpen()) _outputDevice->close();
@@ -396,6 +554,35 @@ inline void Pillow::HttpConnectionPrivate::transitionToClosed()
 	if (_inputDevice != _outputDevice) QObject::disconnect(_outputDevice, 0, q_ptr, 0);
 	_inputDevice = 0;
 	_outputDevice = 0;
+	releaseBuffers();
+}
+
+inline void Pillow::HttpConnectionPrivate::detachRequestFields()
+{
+	// The request fields are views into the request buffer, which other connections may use once it is pooled.
+	// Keep copies of the small request line fields so they stay readable until the next request (e.g. from closed() handlers),
+	// and drop the content and headers.
+	detachFromBuffer(_requestMethod);
+	detachFromBuffer(_requestHttpVersion);
+	detachFromBuffer(_requestUri);
+	detachFromBuffer(_requestFragment);
+	detachFromBuffer(_requestPath);
+	detachFromBuffer(_requestQueryString);
+	setFromRawData(_requestContent, "", 0, 0);
+
+	_requestHeadersRef.clear();
+	memset(_requestKnownHeaders, -1, sizeof(_requestKnownHeaders));
+	invalidateRequestHeaders();
+	clearRequestParams();
+}
+
+inline void Pillow::HttpConnectionPrivate::releaseBuffers()
+{
+	// Any request data left in the buffer is discarded. Buffers too large to be pooled are freed.
+	HttpBufferPool* pool = HttpBufferPool::instance();
+	detachRequestFields();
+	if (_requestBuffer.capacity() > 0) pool->give(_requestBuffer);
+	if (_responseHeadersBuffer.capacity() > 0) pool->give(_responseHeadersBuffer);
 }
 
 void Pillow::HttpConnectionPrivate::writeRequestErrorResponse(int statusCode)
@@ -407,6 +594,7 @@ void Pillow::HttpConnectionPrivate::writeRequestErrorResponse(int statusCode)
 	}
 
 	qDebug() << "HttpConnection: request error. Sending http status" << statusCode << "and closing connection.";
+	PILLOW_TRACE2(connection_request_error, q_ptr, statusCode);
 
 	ByteArray _responseHeadersBuffer; _responseHeadersBuffer.reserve(1024);
 	const char* status = HttpProtocol::StatusCodes::getStatusCodeAndMessage(statusCode);
@@ -417,13 +605,159 @@ void Pillow::HttpConnectionPrivate::writeRequestErrorResponse(int statusCode)
 	transitionToFlushing();
 }
 
+inline void Pillow::HttpConnectionPrivate::clearRequestParams()
+{
+	_requestParamsRef.clear();
+	_requestParamsIndexed = _requestParamsDecoded = false;
+	if (_requestParams.capacity() > 16) _requestParams.clear();
+	else while(!_requestParams.isEmpty()) _requestParams.pop_back();
+}
+
+void Pillow::HttpConnectionPrivate::indexRequestParams()
+{
+	if (_requestParamsIndexed) return;
+	_requestParamsIndexed = true;
+
+	appendRequestParamRefs(_requestQueryString.constData(), _requestQueryString.size(), false);
+
+	const QByteArray& contentType = requestHeaderValue(HttpKnownHeaders::ContentType);
+	if (!_requestContent.isEmpty() && contentType.size() >= formUrlEncodedToken.size()
+			&& asciiEqualsCaseInsensitive(contentType.constData(), formUrlEncodedToken.data(), formUrlEncodedToken.size())
+			&& (contentType.size() == formUrlEncodedToken.size() || contentType.at(formUrlEncodedToken.size()) == ';' || contentType.at(formUrlEncodedToken.size()) == ' '))
+	{
+		appendRequestParamRefs(_requestContent.constData(), _requestContent.size(), true);
+	}
+
+	// Keep the table at most half full so probe sequences stay short.
+	int bucketCount = 8;
+	while (bucketCount < _requestParamsRef.size() * 2) bucketCount *= 2;
+	_requestParamBuckets.resize(bucketCount);
+	memset(_requestParamBuckets.data(), 0, bucketCount * sizeof(int));
+
+	// Params are inserted in order, so a lookup meets the first occurrence of a repeated key first.
+	for (int i = 0, iE = _requestParamsRef.size(); i < iE; ++i)
+	{
+		int bucket = _requestParamsRef.at(i).keyHash & (bucketCount - 1);
+		while (_requestParamBuckets.at(bucket) != 0) bucket = (bucket + 1) & (bucketCount - 1);
+		_requestParamBuckets[bucket] = i + 1;
+	}
+}
+
+void Pillow::HttpConnectionPrivate::appendRequestParamRefs(const char* data, int size, bool fromContent)
+{
+	const char paramDelimiter = '&', keyValueDelimiter = '=';
+	for (const char* c = data, *cE = data + size; c < cE;)
+	{
+		const char *paramEnd, *keyEnd;
+		int delimiter = indexOfEither(c, cE - c, paramDelimiter, keyValueDelimiter);
+		if (delimiter == -1) keyEnd = paramEnd = cE; // Last param, without value.
+		else if (c[delimiter] == paramDelimiter) keyEnd = paramEnd = c + delimiter; // Param without value.
+		else
+		{
+			// Find the param delimiter after the key value delimiter, or the end of string.
+			keyEnd = c + delimiter;
+			int paramDelimiterIndex = indexOf(keyEnd + 1, cE - (keyEnd + 1), paramDelimiter);
+			paramEnd = paramDelimiterIndex == -1 ? cE : keyEnd + 1 + paramDelimiterIndex;
+		}
+
+		HttpParamRef ref;
+		ref.keyPos = c - data;
+		ref.keyLength = keyEnd - c;
+		ref.hasValue = keyEnd < paramEnd;
+		ref.valuePos = ref.hasValue ? ref.keyPos + ref.keyLength + 1 : ref.keyPos + ref.keyLength;
+		ref.valueLength = ref.hasValue ? paramEnd - (keyEnd + 1) : 0;
+		ref.fromContent = fromContent;
+		ref.keyEncoded = containsPercent(c, ref.keyLength) || (fromContent && indexOf(c, ref.keyLength, '+') != -1);
+		if (ref.keyEncoded)
+		{
+			QVarLengthArray<char, 256> key(ref.keyLength);
+			memcpy(key.data(), c, ref.keyLength);
+			ref.keyHash = hashParamKey(key.constData(), decodeParamInPlace(key.data(), ref.keyLength, fromContent));
+		}
+		else
+		{
+			ref.keyHash = hashParamKey(c, ref.keyLength);
+		}
+		_requestParamsRef.append(ref);
+
+		c = paramEnd + 1;
+	}
+}
+
+int Pillow::HttpConnectionPrivate::findRequestParam(const QString& name) const
+{
+	const QByteArray key = name.toUtf8();
+	const quint32 keyHash = hashParamKey(key.constData(), key.size());
+	const int mask = _requestParamBuckets.size() - 1;
+
+	for (int bucket = keyHash & mask; _requestParamBuckets.at(bucket) != 0; bucket = (bucket + 1) & mask)
+	{
+		const int index = _requestParamBuckets.at(bucket) - 1;
+		const HttpParamRef& ref = _requestParamsRef.at(index);
+		if (ref.keyHash != keyHash) continue;
+
+		const char* data = (ref.fromContent ? _requestContent.constData() : _requestQueryString.constData()) + ref.keyPos;
+		if (!ref.keyEncoded)
+		{
+			if (asciiEqualsCaseInsensitive(data, ref.keyLength, key.constData(), key.size())) return index;
+		}
+		else
+		{
+			QVarLengthArray<char, 256> decoded(ref.keyLength);
+			memcpy(decoded.data(), data, ref.keyLength);
+			if (asciiEqualsCaseInsensitive(decoded.constData(), decodeParamInPlace(decoded.data(), ref.keyLength, ref.fromContent), key.constData(), key.size())) return index;
+		}
+	}
+	return -1;
+}
+
+const Pillow::HttpParamCollection& Pillow::HttpConnectionPrivate::requestParams()
+{
+	if (!_requestParamsDecoded)
+	{
+		_requestParamsDecoded = true;
+		indexRequestParams();
+		for (const HttpParamRef* ref = _requestParamsRef.constData(), *refE = ref + _requestParamsRef.size(); ref < refE; ++ref)
+		{
+			const char* data = ref->fromContent ? _requestContent.constData() : _requestQueryString.constData();
+			_requestParams << HttpParam(decodeParam(data + ref->keyPos, ref->keyLength, ref->fromContent),
+										ref->hasValue ? decodeParam(data + ref->valuePos, ref->valueLength, ref->fromContent) : QString());
+		}
+	}
+	return _requestParams;
+}
+
+QString Pillow::HttpConnectionPrivate::requestParamValue(const QString& name)
+{
+	if (_requestParamsDecoded)
+	{
+		// Params may have been altered through setRequestParam.
+		for (int i = 0, iE = _requestParams.size(); i < iE; ++i)
+		{
+			const HttpParam& param = _requestParams.at(i);
+			if (param.first.compare(name, Qt::CaseInsensitive) == 0)
+				return param.second;
+		}
+		return QString();
+	}
+
+	indexRequestParams();
+	const int index = findRequestParam(name);
+	if (index < 0) return QString();
+	const HttpParamRef& ref = _requestParamsRef.at(index);
+	if (!ref.hasValue) return QString();
+	const char* data = ref.fromContent ? _requestContent.constData() : _requestQueryString.constData();
+	return decodeParam(data + ref.valuePos, ref.valueLength, ref.fromContent);
+}
+
 inline void Pillow::HttpConnectionPrivate::parser_http_field(void *data, const char *field, size_t flen, const char *value, size_t vlen)
 {
 	Pillow::HttpConnectionPrivate* request = reinterpret_cast<Pillow::HttpConnectionPrivate*>(data);
 
-	// Find the one request header that interest us, fast.
-	if (flen == 14 && asciiEqualsCaseInsensitive(field, 14, "content-length", 14))
-		request->_requestContentLengthHeaderIndex = request->_requestHeadersRef.size();
+	// Index well known headers so they can be found without scanning them all.
+	HttpKnownHeaders::Field knownField = HttpKnownHeaders::classify(field, static_cast<int>(flen));
+	if (knownField != HttpKnownHeaders::Unknown && request->_requestKnownHeaders[knownField] < 0)
+		request->_requestKnownHeaders[knownField] = request->_requestHeadersRef.size();
 
 	const char* begin = request->_requestBuffer.constData();
 	request->_requestHeadersRef.append(HttpHeaderRef(field - begin, static_cast<int>(flen), value - begin, static_cast<int>(vlen)));
@@ -461,7 +795,7 @@ inline void Pillow::HttpConnectionPrivate::writeHeaders(int statusCode, const Ht
 	_responseStatusCode = statusCode;
 
 	if (_responseHeadersBuffer.capacity() == 0)
-		_responseHeadersBuffer.reserve(1024);
+		_responseHeadersBuffer = HttpBufferPool::instance()->take(1024);
 
 	_responseHeadersBuffer.append(_requestHttpVersion).append(' ').append(statusCodeAndMessage, qstrlen(statusCodeAndMessage)).append(crLfToken);
 
@@ -518,12 +852,12 @@ inline void Pillow::HttpConnectionPrivate::writeHeaders(int statusCode, const Ht
 	if (_requestHttp11)
 	{
 		// Keep-Alive by default, unless "close" is specified.
-		clientWantsKeepAlive = !asciiEqualsCaseInsensitive(_requestHeaders.getFieldValue(connectionToken), closeToken);
+		clientWantsKeepAlive = !requestHeaderEquals(HttpKnownHeaders::Connection, closeToken);
 	}
 	else
 	{
 		// Close by default, unless "keep-alive" is specified.
-		clientWantsKeepAlive = asciiEqualsCaseInsensitive(_requestHeaders.getFieldValue(connectionToken), keepAliveToken);
+		clientWantsKeepAlive = requestHeaderEquals(HttpKnownHeaders::Connection, keepAliveToken);
 	}
 
 	if (clientWantsKeepAlive)
@@ -542,6 +876,9 @@ inline void Pillow::HttpConnectionPrivate::writeHeaders(int statusCode, const Ht
 	else
 		_responseConnectionKeepAlive = false;
 
+	if (_closeWhenIdle)
+		_responseConnectionKeepAlive = false; // We were asked to close once this response is sent.
+
 	// Automatically add essential headers.
 	if (_responseContentLength != -1) { _responseHeadersBuffer.append(contentLengthOutToken); appendNumber<int, 10>(_responseHeadersBuffer, _responseContentLength); _responseHeadersBuffer.append(crLfToken); }
 	if (contentTypeHeader) { _responseHeadersBuffer.append(*contentTypeHeader); } else if (_responseContentLength > 0) { _responseHeadersBuffer.append(contentTypeTextPlainTokenHeaderToken); }
@@ -615,6 +952,28 @@ inline void Pillow::HttpConnectionPrivate::close()
 	transitionToClosed();
 }
 
+inline void Pillow::HttpConnectionPrivate::closeGracefully()
+{
+	switch (_state)
+	{
+	case Pillow::HttpConnection::Uninitialized:
+	case Pillow::HttpConnection::Flushing:
+	case Pillow::HttpConnection::Closed:
+		break; // Nothing in progress, or already on its way out.
+
+	case Pillow::HttpConnection::ReceivingHeaders:
+		if (_requestBuffer.isEmpty())
+		{
+			transitionToClosed(); // Idle keep-alive connection.
+			break;
+		}
+		// Else a request has started arriving; let it complete.
+
+	default:
+		_closeWhenIdle = true;
+	}
+}
+
 //
 // HttpConnection
 //
@@ -714,6 +1073,11 @@ void Pillow::HttpConnection::close()
 	d_ptr->close();
 }
 
+void Pillow::HttpConnection::closeGracefully()
+{
+	d_ptr->closeGracefully();
+}
+
 int Pillow::HttpConnection::responseStatusCode() const
 {
 	return d_ptr->_responseStatusCode;
@@ -724,54 +1088,57 @@ qint64 Pillow::HttpConnection::responseContentLength() const
 	return d_ptr->_responseContentLength;
 }
 
-const QByteArray & Pillow::HttpConnection::requestHeaderValue(const QByteArray &field)
+qint64 Pillow::HttpConnection::timestamp(Pillow::HttpConnection::Timestamp timestamp) const
 {
-	return d_ptr->_requestHeaders.getFieldValue(field);
+	return timestamp >= 0 && timestamp < TimestampCount ? d_ptr->_requestTimestamps[timestamp] : 0;
 }
 
-const Pillow::HttpParamCollection& Pillow::HttpConnection::requestParams()
+namespace
 {
-	if (d_ptr->_requestParams.isEmpty() && !d_ptr->_requestQueryString.isEmpty())
+	struct MonotonicClock
 	{
-		// The params have not yet been initialized. Parse them.
-		const char paramDelimiter = '&', keyValueDelimiter = '=';
-		for (const char* c = d_ptr->_requestQueryString.constBegin(), *cE = d_ptr->_requestQueryString.constEnd(); c < cE;)
-		{
-			const char *paramEnd, *keyEnd;
-			for (paramEnd = c; paramEnd < cE; ++paramEnd) if (*paramEnd == paramDelimiter) break; // Find the param delimiter, or the end of string.
-			for (keyEnd = c; keyEnd < paramEnd; ++keyEnd) if (*keyEnd == keyValueDelimiter) break; // Find the key value delimiter, or the end of the param.
+		QElapsedTimer timer;
+		MonotonicClock() { timer.start(); }
+	};
+}
 
-			if (keyEnd < paramEnd)
-			{
-				// Key-value pair.
-				d_ptr->_requestParams << HttpParam(percentDecode(c, keyEnd - c), percentDecode(keyEnd + 1, paramEnd - (keyEnd + 1)));
-			}
-			else
-			{
-				// Key without value.
-				d_ptr->_requestParams << HttpParam(percentDecode(c, paramEnd - c), QString());
-			}
-			c = paramEnd + 1;
-		}
-	}
-	return d_ptr->_requestParams;
+qint64 Pillow::HttpConnection::currentTimestamp()
+{
+	static const MonotonicClock clock;
+	return clock.timer.nsecsElapsed() + 1; // Never 0, which stands for "not reached yet".
+}
+
+int Pillow::HttpConnection::requestCount() const
+{
+	return d_ptr->_requestCount;
+}
+
+const QByteArray & Pillow::HttpConnection::requestHeaderValue(const QByteArray &field)
+{
+	HttpKnownHeaders::Field knownField = HttpKnownHeaders::classify(field);
+	if (knownField != HttpKnownHeaders::Unknown)
+		return d_ptr->requestHeaderValue(knownField);
+	return d_ptr->requestHeaders().getFieldValue(field);
+}
+
+const QByteArray & Pillow::HttpConnection::requestHeaderValue(Pillow::HttpKnownHeaders::Field field)
+{
+	return d_ptr->requestHeaderValue(field);
+}
+
+const Pillow::HttpParamCollection& Pillow::HttpConnection::requestParams()
+{
+	return d_ptr->requestParams();
 }
 
 QString Pillow::HttpConnection::requestParamValue(const QString &name)
 {
-	requestParams();
-	for (int i = 0, iE = d_ptr->_requestParams.size(); i < iE; ++i)
-	{
-		const HttpParam& param = d_ptr->_requestParams.at(i);
-		if (param.first.compare(name, Qt::CaseInsensitive) == 0)
-			return param.second;
-	}
-	return QString();
+	return d_ptr->requestParamValue(name);
 }
 
 void Pillow::HttpConnection::setRequestParam(const QString &name, const QString &value)
 {
-	requestParams();
+	d_ptr->requestParams(); // From now on, the decoded collection is authoritative.
 	for (int i = 0, iE = d_ptr->_requestParams.size(); i < iE; ++i)
 	{
 		const HttpParam& param = d_ptr->_requestParams.at(i);
@@ -811,5 +1178,5 @@ const QByteArray &Pillow::HttpConnection::requestContent() const
 
 const Pillow::HttpHeaderCollection &Pillow::HttpConnection::requestHeaders() const
 {
-	return d_ptr->_requestHeaders;
+	return d_ptr->requestHeaders();
 }
@@ -45,6 +45,7 @@ namespace Pillow
 		enum State { Uninitialized, ReceivingHeaders, ReceivingContent, SendingHeaders, SendingContent, Completed, Flushing, Closed };
 		enum { MaximumRequestHeaderLength = 32 * 1024 };
 		enum { MaximumRequestContentLength = 128 * 1024 * 1024 };
+		enum Timestamp { RequestStarted, HeadersReceived, ContentReceived, ResponseStarted, ResponseCompleted, ResponseFlushed, TimestampCount };
 		Q_ENUMS(State);
 
 	public:
@@ -80,8 +81,10 @@ namespace Pillow
 		// or closed() signals are emitted.
 		Q_INVOKABLE const Pillow::HttpHeaderCollection& requestHeaders() const;
 		Q_INVOKABLE const QByteArray & requestHeaderValue(const QByteArray& field);
+		const QByteArray & requestHeaderValue(Pillow::HttpKnownHeaders::Field field); // Constant time lookup.
 
-		// Request params.
+		// Request params, from the query string followed by the content of application/x-www-form-urlencoded requests.
+		// requestParamValue() looks names up in a hash index and only decodes the value it returns; requestParams() decodes them all.
 		const Pillow::HttpParamCollection& requestParams();
 		Q_INVOKABLE QString requestParamValue(const QString& name);
 		Q_INVOKABLE void setRequestParam(const QString& name, const QString& value);
@@ -96,12 +99,25 @@ namespace Pillow
 
 		void flush();
 		void close(); // Close communication channels right away, no matter if a response was sent or not.
+		void closeGracefully(); // Close right away if idle, else close after the current response (which is sent with "Connection: close").
 
 		// Information about the currentlly outgoing response. Valid between a call to writeHeaders until
 		// the requestCompleted signal is emitted.
 		int responseStatusCode() const;
 		qint64 responseContentLength() const;
 
+		// Timing of the current request, in nanoseconds on the monotonic clock of currentTimestamp(): when its first
+		// byte was received, its headers parsed, its content received (requestReady), its response headers
+		// written, its response completed (requestCompleted) and the last response byte handed to the operating
+		// system. 0 for the points not reached yet. They stay valid after requestCompleted and closed, until the
+		// next request on the connection starts arriving. ResponseFlushed stays 0 on kept-alive connections whose
+		// response was still being written out when the connection moved on to the next request.
+		qint64 timestamp(Pillow::HttpConnection::Timestamp timestamp) const;
+		static qint64 currentTimestamp();
+
+		// Number of requests received since initialize(): above 1 when the connection was kept alive.
+		int requestCount() const;
+
 	signals:
 		void requestReady(Pillow::HttpConnection* self);     // The request is ready to be processed, all request headers and content have been received.
 		void requestCompleted(Pillow::HttpConnection* self); // The response is completed, all response headers and content have been sent.
@@ -0,0 +1,303 @@
+#ifndef PILLOW_HTTPCOROUTINE_H
+#define PILLOW_HTTPCOROUTINE_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef PILLOW_HTTPHANDLER_H
+#include "HttpHandler.h"
+#endif // PILLOW_HTTPHANDLER_H
+#ifndef PILLOW_HTTPCONNECTION_H
+#include "HttpConnection.h"
+#endif // PILLOW_HTTPCONNECTION_H
+#ifndef PILLOW_HTTPCLIENT_H
+#include "HttpClient.h"
+#endif // PILLOW_HTTPCLIENT_H
+
+// Coroutine handlers need a C++20 compiler and the Qt 5 functor based connect(). The rest of Pillow does not
+// depend on them: this header is empty unless both are available. Build with CONFIG += pillow_coroutines (see
+// config.pri) to compile in C++20 mode.
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L && QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+#define PILLOW_COROUTINES
+
+#include <coroutine>
+#include <functional>
+#include <new>
+#ifndef QIODEVICE_H
+#include <QtCore/QIODevice>
+#endif // QIODEVICE_H
+#ifndef QDEBUG_H
+#include <QtCore/QDebug>
+#endif // QDEBUG_H
+#ifndef QPOINTER_H
+#include <QtCore/QPointer>
+#endif // QPOINTER_H
+
+namespace Pillow
+{
+	//
+	// HttpCoroutineFramePool: per thread free lists of coroutine frames, in 64 bytes size classes up to 4 KiB.
+	//
+	// A handler coroutine allocates its frame once per request; reusing frames keeps that off the general allocator.
+	// Frames released on another thread than the one that allocated them simply join that other thread's lists.
+	//
+
+	class HttpCoroutineFramePool
+	{
+	public:
+		enum { Granularity = 64, ClassCount = 64, MaximumPooledPerClass = 64 };
+
+		static void* allocate(std::size_t size)
+		{
+			const std::size_t sizeClass = (size + Granularity - 1) / Granularity;
+			if (sizeClass >= ClassCount) return ::operator new(size);
+
+			Lists& l = lists();
+			if (Node* node = l.heads[sizeClass])
+			{
+				l.heads[sizeClass] = node->next;
+				--l.counts[sizeClass];
+				return node;
+			}
+			return ::operator new(sizeClass * Granularity);
+		}
+
+		static void deallocate(void* frame, std::size_t size)
+		{
+			const std::size_t sizeClass = (size + Granularity - 1) / Granularity;
+			Lists& l = lists();
+			if (sizeClass >= ClassCount || l.counts[sizeClass] >= MaximumPooledPerClass)
+			{
+				::operator delete(frame);
+				return;
+			}
+
+			Node* node = static_cast<Node*>(frame);
+			node->next = l.heads[sizeClass];
+			l.heads[sizeClass] = node;
+			++l.counts[sizeClass];
+		}
+
+	private:
+		struct Node { Node* next; };
+		struct Lists
+		{
+			Node* heads[ClassCount] = {};
+			int counts[ClassCount] = {};
+
+			~Lists()
+			{
+				for (int i = 0; i < ClassCount; ++i)
+					while (Node* node = heads[i]) { heads[i] = node->next; ::operator delete(node); }
+			}
+		};
+
+		static Lists& lists() { static thread_local Lists l; return l; }
+	};
+
+	//
+	// HttpTask: the return type of handler coroutines.
+	//
+	// The coroutine starts right away, runs on the thread that invoked it, and is resumed from that thread's
+	// event loop as its awaited operations complete. Its frame is released when it returns. Nothing waits on
+	// a HttpTask: the coroutine owns its own lifetime, the same way a QObject state machine would delete itself.
+	//
+
+	class HttpTask
+	{
+	public:
+		struct promise_type
+		{
+			HttpTask get_return_object() noexcept { return HttpTask(); }
+			std::suspend_never initial_suspend() noexcept { return {}; }
+			std::suspend_never final_suspend() noexcept { return {}; }
+			void return_void() noexcept {}
+			void unhandled_exception() noexcept { qWarning() << "Pillow::HttpTask: unhandled exception in a handler coroutine."; }
+
+			static void* operator new(std::size_t size) { return HttpCoroutineFramePool::allocate(size); }
+			static void operator delete(void* frame, std::size_t size) { HttpCoroutineFramePool::deallocate(frame, size); }
+		};
+	};
+
+	//
+	// HttpAwait: awaitable operations for handler coroutines.
+	//
+
+	namespace HttpAwait
+	{
+		// co_await HttpAwait::readBody(connection): the request content. Connections only emit requestReady()
+		// once the whole content has arrived, so this never actually suspends; it is there so that handlers
+		// read naturally and keep working should bodies ever be streamed.
+		class BodyAwaiter
+		{
+			Pillow::HttpConnection* _connection;
+
+		public:
+			explicit BodyAwaiter(Pillow::HttpConnection* connection) : _connection(connection) {}
+			bool await_ready() const noexcept { return true; }
+			void await_suspend(std::coroutine_handle<>) const noexcept {}
+			QByteArray await_resume() const { return _connection->requestContent(); }
+		};
+
+		inline BodyAwaiter readBody(Pillow::HttpConnection* connection) { return BodyAwaiter(connection); }
+
+		// co_await HttpAwait::write(connection, data): writes response content, and suspends while more than
+		// "highWatermark" bytes are waiting in the output device. Returns false if the connection has closed
+		// or was destroyed, or if its device was destroyed, in which case the handler should simply return.
+		class WriteAwaiter
+		{
+			QPointer<Pillow::HttpConnection> _connection;
+			QByteArray _data;
+			qint64 _highWatermark;
+			QMetaObject::Connection _bytesWrittenConnection, _closedConnection, _deviceDestroyedConnection, _connectionDestroyedConnection;
+			bool _writable;
+
+		public:
+			WriteAwaiter(Pillow::HttpConnection* connection, const QByteArray& data, qint64 highWatermark)
+				: _connection(connection), _data(data), _highWatermark(highWatermark), _writable(false)
+			{}
+
+			bool await_ready()
+			{
+				if (_connection.isNull() || _connection->state() == Pillow::HttpConnection::Closed) return true;
+				_connection->writeContent(_data);
+				_data = QByteArray();
+				QIODevice* device = _connection->outputDevice();
+				_writable = device != 0;
+				return device == 0 || device->bytesToWrite() <= _highWatermark;
+			}
+
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				QIODevice* device = _connection->outputDevice();
+				_bytesWrittenConnection = QObject::connect(device, &QIODevice::bytesWritten, [this, device, handle]()
+				{
+					if (device->bytesToWrite() <= _highWatermark) resume(handle, true);
+				});
+				_closedConnection = QObject::connect(_connection.data(), &Pillow::HttpConnection::closed, [this, handle]()
+				{
+					resume(handle, false);
+				});
+
+				// Neither would come if the device or connection goes away first, leaving the coroutine suspended forever.
+				_deviceDestroyedConnection = QObject::connect(device, &QObject::destroyed, [this, handle]()
+				{
+					resume(handle, false);
+				});
+				_connectionDestroyedConnection = QObject::connect(_connection.data(), &QObject::destroyed, [this, handle]()
+				{
+					resume(handle, false);
+				});
+			}
+
+			bool await_resume() const { return _writable && !_connection.isNull() && _connection->state() != Pillow::HttpConnection::Closed; }
+
+		private:
+			void resume(std::coroutine_handle<> handle, bool writable)
+			{
+				QObject::disconnect(_bytesWrittenConnection);
+				QObject::disconnect(_closedConnection);
+				QObject::disconnect(_deviceDestroyedConnection);
+				QObject::disconnect(_connectionDestroyedConnection);
+				_writable = writable;
+				handle.resume();
+			}
+		};
+
+		enum { DefaultWriteHighWatermark = 256 * 1024 };
+
+		inline WriteAwaiter write(Pillow::HttpConnection* connection, const QByteArray& data, qint64 highWatermark = DefaultWriteHighWatermark)
+		{
+			return WriteAwaiter(connection, data, highWatermark);
+		}
+
+		// co_await HttpAwait::get(client, url): sends a request and suspends until the client emits finished().
+		// Returns the client's error(); the response is then available on the client as usual. Returns
+		// HttpClient::AbortedError if the client is destroyed first, in which case it must not be used anymore.
+		class ClientAwaiter
+		{
+			QPointer<Pillow::HttpClient> _client;
+			QMetaObject::Connection _finishedConnection, _destroyedConnection;
+
+		public:
+			explicit ClientAwaiter(Pillow::HttpClient* client) : _client(client) {}
+
+			bool await_ready() const { return _client.isNull() || !_client->responsePending(); }
+
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				_finishedConnection = QObject::connect(_client.data(), &Pillow::HttpClient::finished, [this, handle]()
+				{
+					resume(handle);
+				});
+				_destroyedConnection = QObject::connect(_client.data(), &QObject::destroyed, [this, handle]()
+				{
+					resume(handle);
+				});
+			}
+
+			Pillow::HttpClient::Error await_resume() const { return _client.isNull() ? Pillow::HttpClient::AbortedError : _client->error(); }
+
+		private:
+			void resume(std::coroutine_handle<> handle)
+			{
+				QObject::disconnect(_finishedConnection);
+				QObject::disconnect(_destroyedConnection);
+				handle.resume();
+			}
+		};
+
+		inline ClientAwaiter request(Pillow::HttpClient* client, const QByteArray& method, const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection(), const QByteArray& data = QByteArray())
+		{
+			client->request(method, url, headers, data);
+			return ClientAwaiter(client);
+		}
+
+		inline ClientAwaiter get(Pillow::HttpClient* client, const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection())
+		{
+			client->get(url, headers);
+			return ClientAwaiter(client);
+		}
+
+		inline ClientAwaiter post(Pillow::HttpClient* client, const QUrl& url, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection(), const QByteArray& data = QByteArray())
+		{
+			client->post(url, headers, data);
+			return ClientAwaiter(client);
+		}
+	}
+
+	//
+	// HttpHandlerCoroutine: a handler that starts a coroutine for each request. Add it to an HttpHandlerStack
+	// or to a route of HttpHandlerSimpleRouter like any other handler.
+	//
+	// Note: this class has no meta object, moc does not see past the C++20 guard above.
+	//
+
+	class HttpHandlerCoroutine : public HttpHandler
+	{
+		std::function<Pillow::HttpTask(Pillow::HttpConnection*)> _function;
+
+	public:
+		HttpHandlerCoroutine(QObject* parent = 0) : HttpHandler(parent) {}
+		HttpHandlerCoroutine(const std::function<Pillow::HttpTask(Pillow::HttpConnection*)>& function, QObject* parent = 0)
+			: HttpHandler(parent), _function(function)
+		{}
+
+		inline const std::function<Pillow::HttpTask(Pillow::HttpConnection*)>& function() const { return _function; }
+		void setFunction(const std::function<Pillow::HttpTask(Pillow::HttpConnection*)>& function) { _function = function; }
+
+	public:
+		virtual bool handleRequest(Pillow::HttpConnection* connection)
+		{
+			if (!_function) return false;
+			_function(connection);
+			return true;
+		}
+	};
+}
+
+#elif defined(PILLOW_ENABLE_COROUTINES)
+#error "CONFIG += pillow_coroutines needs a compiler with C++20 coroutines and Qt 5.12 or later."
+#endif // __cpp_impl_coroutine
+
+#endif // PILLOW_HTTPCOROUTINE_H
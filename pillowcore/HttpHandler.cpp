@@ -4,9 +4,9 @@
 #include <QtCore/QFile>
 #include <QtCore/QFileInfo>
 #include <QtCore/QCryptographicHash>
-#include <QtCore/QElapsedTimer>
 #include <QtCore/QDateTime>
 #include <QtCore/QStringBuilder>
+#include <QtCore/QChildEvent>
 #include <QtNetwork/QTcpSocket>
 using namespace Pillow;
 
@@ -24,18 +24,67 @@ HttpHandler::HttpHandler(QObject *parent)
 //
 
 HttpHandlerStack::HttpHandlerStack(QObject *parent)
-	: HttpHandler(parent)
+	: HttpHandler(parent), _handlersDirty(true), _hitCountingEnabled(false)
 {
 }
 
-bool HttpHandlerStack::handleRequest(Pillow::HttpConnection *connection)
+void HttpHandlerStack::childEvent(QChildEvent *event)
+{
+	// Children are still plain QObjects when ChildAdded is sent from their constructor, so qobject_cast
+	// would not recognize handlers yet: only mark the list as stale here.
+	if (event->type() == QEvent::ChildAdded || event->type() == QEvent::ChildRemoved)
+		_handlersDirty = true;
+	HttpHandler::childEvent(event);
+}
+
+void HttpHandlerStack::updateHandlers()
 {
+	QVector<HttpHandler*> handlers;
+	QVector<quint64> hitCounts;
 	foreach (QObject* object, children())
 	{
-		HttpHandler* handler = qobject_cast<HttpHandler*>(object);
+		if (HttpHandler* handler = qobject_cast<HttpHandler*>(object))
+		{
+			handlers << handler;
+			if (_hitCountingEnabled) hitCounts << hitCount(handler);
+		}
+	}
+	_handlers.swap(handlers);
+	_hitCounts.swap(hitCounts);
+	_handlersDirty = false;
+}
+
+void HttpHandlerStack::setHitCountingEnabled(bool enabled)
+{
+	if (_hitCountingEnabled == enabled) return;
+	_hitCountingEnabled = enabled;
+	_hitCounts = enabled ? QVector<quint64>(_handlers.size(), 0) : QVector<quint64>();
+}
+
+quint64 HttpHandlerStack::hitCount(HttpHandler *handler) const
+{
+	const int index = _handlers.indexOf(handler);
+	return index >= 0 && index < _hitCounts.size() ? _hitCounts.at(index) : 0;
+}
+
+void HttpHandlerStack::resetHitCounts()
+{
+	_hitCounts.fill(0);
+}
 
-		if (handler && handler->handleRequest(connection))
+bool HttpHandlerStack::handleRequest(Pillow::HttpConnection *connection)
+{
+	if (_handlersDirty) updateHandlers();
+
+	// A shallow copy: a handler may add or remove children of the stack while it runs.
+	const QVector<HttpHandler*> handlers = _handlers;
+	for (int i = 0, count = handlers.size(); i < count; ++i)
+	{
+		if (handlers.at(i)->handleRequest(connection))
+		{
+			if (_hitCountingEnabled && !_handlersDirty) ++_hitCounts[i];
 			return true;
+		}
 	}
 
 	return false;
@@ -133,21 +182,17 @@ HttpHandlerLog::HttpHandlerLog(QIODevice *device, QObject *parent)
 
 HttpHandlerLog::~HttpHandlerLog()
 {
-	foreach (QElapsedTimer* timer, _requestTimerMap)
-		delete timer;
 }
 
 bool HttpHandlerLog::handleRequest(Pillow::HttpConnection *connection)
 {
-	QElapsedTimer* timer = _requestTimerMap.value(connection, NULL);
-	if (timer == NULL)
+	if (!_connections.contains(connection))
 	{
-		timer = _requestTimerMap[connection] = new QElapsedTimer();
+		_connections.insert(connection);
 		connect(connection, SIGNAL(requestCompleted(Pillow::HttpConnection*)), this, SLOT(requestCompleted(Pillow::HttpConnection*)));
 		connect(connection, SIGNAL(closed(Pillow::HttpConnection*)), this, SLOT(requestClosed(Pillow::HttpConnection*)));
 		connect(connection, SIGNAL(destroyed(QObject*)), this, SLOT(requestDestroyed(QObject*)));
 	}
-	timer->start();
 
 	if (_mode == LogCompletedRequests)
 	{
@@ -166,14 +211,25 @@ bool HttpHandlerLog::handleRequest(Pillow::HttpConnection *connection)
 	return false;
 }
 
+namespace
+{
+	// Milliseconds since the request was ready to be handled.
+	inline qint64 requestElapsed(Pillow::HttpConnection* connection, Pillow::HttpConnection::Timestamp until)
+	{
+		const qint64 start = connection->timestamp(Pillow::HttpConnection::ContentReceived);
+		qint64 end = connection->timestamp(until);
+		if (end == 0) end = Pillow::HttpConnection::currentTimestamp();
+		return start == 0 ? 0 : (end - start) / 1000000;
+	}
+}
+
 void HttpHandlerLog::requestCompleted(Pillow::HttpConnection *connection)
 {
-	QElapsedTimer* timer = _requestTimerMap.value(connection, NULL);
-	if (timer)
+	if (_connections.contains(connection))
 	{
 		const char* formatString = (_mode == LogCompletedRequests) ? "%1 - - [%2] \"%3 %4 %5\" %6 %7 %8" : "[ END ] %1 - - [%2] \"%3 %4 %5\" %6 %7 %8";
 
-		qint64 elapsed = timer->elapsed();
+		qint64 elapsed = requestElapsed(connection, HttpConnection::ResponseCompleted);
 		QString logEntry = QString(formatString)
 				.arg(connection->remoteAddress().toString())
 				.arg(QDateTime::currentDateTime().toString("dd/MMM/yyyy hh:mm:ss"))
@@ -187,12 +243,11 @@ void HttpHandlerLog::requestCompleted(Pillow::HttpConnection *connection)
 
 void HttpHandlerLog::requestClosed(HttpConnection *connection)
 {
-	QElapsedTimer* timer = _requestTimerMap.value(connection, NULL);
-	if (timer && _mode == TraceRequests)
+	if (_mode == TraceRequests && _connections.contains(connection))
 	{
 		const char* formatString = "[CLOSE] %1 - - [%2] \"%3 %4 %5\" %6 %7 %8";
 
-		qint64 elapsed = timer->elapsed();
+		qint64 elapsed = requestElapsed(connection, HttpConnection::ResponseCompleted);
 		QString logEntry = QString(formatString)
 				.arg(connection->remoteAddress().toString())
 				.arg(QDateTime::currentDateTime().toString("dd/MMM/yyyy hh:mm:ss"))
@@ -206,9 +261,7 @@ void HttpHandlerLog::requestClosed(HttpConnection *connection)
 
 void HttpHandlerLog::requestDestroyed(QObject *r)
 {
-	HttpConnection* connection = static_cast<HttpConnection*>(r);
-	delete _requestTimerMap.value(connection, NULL);
-	_requestTimerMap.remove(connection);
+	_connections.remove(static_cast<HttpConnection*>(r));
 }
 
 void HttpHandlerLog::log(const QString &entry)
@@ -239,16 +292,99 @@ void Pillow::HttpHandlerLog::setDevice(QIODevice *device)
 	_device = device;
 }
 
+//
+// HttpHandlerFileMapping
+//
+
+namespace Pillow
+{
+	class HttpHandlerFileMapping
+	{
+	public:
+		QFile file;
+		const char* data;
+		qint64 size;
+		QDateTime lastModified;
+		QByteArray lastModifiedHeader;
+		QByteArray etag;
+
+		HttpHandlerFileMapping(const QString& path) : file(path), data(NULL), size(0) {}
+	};
+
+	class HttpHandlerFileMappingCache
+	{
+	public:
+		int capacity;
+		QHash<QString, QSharedPointer<HttpHandlerFileMapping> > mappings;
+		QList<QString> recentlyUsed; // Least recently used first.
+
+		HttpHandlerFileMappingCache(int capacity) : capacity(capacity) {}
+
+		void trim()
+		{
+			while (mappings.size() > capacity && !recentlyUsed.isEmpty())
+				mappings.remove(recentlyUsed.takeFirst()); // Transfers still in progress keep their own reference.
+		}
+
+		QSharedPointer<HttpHandlerFileMapping> mappingFor(const QFileInfo& fileInfo, int etagSizeLimit)
+		{
+			const QString path = fileInfo.filePath();
+			QHash<QString, QSharedPointer<HttpHandlerFileMapping> >::iterator it = mappings.find(path);
+			if (it != mappings.end())
+			{
+				const QSharedPointer<HttpHandlerFileMapping>& mapping = it.value();
+				if (mapping->size == fileInfo.size() && mapping->lastModified == fileInfo.lastModified())
+				{
+					recentlyUsed.removeOne(path);
+					recentlyUsed.append(path);
+					return mapping;
+				}
+
+				// The file changed on disk: release the stale mapping.
+				mappings.erase(it);
+				recentlyUsed.removeOne(path);
+			}
+
+			if (fileInfo.size() <= 0) return QSharedPointer<HttpHandlerFileMapping>(); // Empty files can't be mapped.
+
+			QSharedPointer<HttpHandlerFileMapping> mapping(new HttpHandlerFileMapping(path));
+			if (!mapping->file.open(QIODevice::ReadOnly)) return QSharedPointer<HttpHandlerFileMapping>();
+			mapping->size = mapping->file.size();
+			mapping->data = reinterpret_cast<const char*>(mapping->file.map(0, mapping->size));
+			if (mapping->data == NULL) return QSharedPointer<HttpHandlerFileMapping>();
+			mapping->lastModified = fileInfo.lastModified();
+			mapping->lastModifiedHeader = HttpProtocol::Dates::getHttpDate(mapping->lastModified);
+
+			if (mapping->size <= etagSizeLimit)
+			{
+				// Calculated once per mapping rather than once per request.
+				QCryptographicHash md5sum(QCryptographicHash::Md5); md5sum.addData(mapping->data, mapping->size);
+				mapping->etag = md5sum.result().toHex();
+			}
+
+			mappings.insert(path, mapping);
+			recentlyUsed.append(path);
+			trim();
+			return mapping;
+		}
+	};
+}
+
 //
 // HttpHandlerFile
 //
 
 HttpHandlerFile::HttpHandlerFile(const QString &publicPath, QObject *parent)
-	: HttpHandler(parent), _bufferSize(DefaultBufferSize)
+	: HttpHandler(parent), _bufferSize(DefaultBufferSize), _mappingCacheSize(0), _mappingCache(NULL)
 {
 	setPublicPath(publicPath);
 }
 
+HttpHandlerFile::~HttpHandlerFile()
+{
+	delete _mappingCache;
+}
+
 void HttpHandlerFile::setPublicPath(const QString &publicPath)
 {
 	if (_publicPath == publicPath) return;
@@ -272,6 +408,47 @@ void HttpHandlerFile::setBufferSize(int bytes)
 	_bufferSize = bytes;
 }
 
+void HttpHandlerFile::setMemoryMappingEnabled(bool enabled)
+{
+	if (enabled == memoryMappingEnabled()) return;
+	setMappingCacheSize(enabled ? DefaultMappingCacheSize : 0);
+}
+
+void HttpHandlerFile::setMappingCacheSize(int count)
+{
+	if (count < 0) count = 0;
+	if (_mappingCacheSize == count) return;
+	_mappingCacheSize = count;
+
+	if (_mappingCacheSize == 0)
+	{
+		delete _mappingCache;
+		_mappingCache = NULL;
+	}
+	else if (_mappingCache == NULL)
+		_mappingCache = new HttpHandlerFileMappingCache(_mappingCacheSize);
+	else
+	{
+		_mappingCache->capacity = _mappingCacheSize;
+		_mappingCache->trim();
+	}
+}
+
+static bool ifRangeMatches(const QByteArray& ifRange, const QByteArray& etag, const QByteArray& lastModified)
+{
+	// A missing If-Range always matches. Otherwise, it must hold either our current ETag or our Last-Modified date.
+	if (ifRange.isEmpty()) return true;
+	if (!etag.isEmpty() && ifRange == etag) return true;
+	return ifRange == lastModified;
+}
+
+static QByteArray contentRange(const HttpProtocol::Ranges::ByteRange& range, qint64 size)
+{
+	QByteArray value; value.reserve(48);
+	value.append("bytes ").append(QByteArray::number(range.first)).append('-').append(QByteArray::number(range.second)).append('/').append(QByteArray::number(size));
+	return value;
+}
+
 bool HttpHandlerFile::handleRequest(Pillow::HttpConnection *connection)
 {
 	if (_publicPath.isEmpty()) { return false; } // Just don't allow access to the root filesystem unless really configured for it.
@@ -293,48 +470,149 @@ bool HttpHandlerFile::handleRequest(Pillow::HttpConnection *connection)
 		return false; // This class does not serve anything else than files... No directory listings!
 	}
 
-	QFile* file = new QFile(resultPathInfo.filePath());
+	QSharedPointer<HttpHandlerFileMapping> mapping;
+	if (_mappingCache != NULL)
+		mapping = _mappingCache->mappingFor(resultPathInfo, bufferSize());
 
-	if (!file->open(QIODevice::ReadOnly))
+	QFile* file = NULL;
+	const QByteArray mimeType = HttpMimeHelper::getMimeTypeForFilename(requestPath);
+	QByteArray lastModified, content, etag;
+	qint64 fileSize;
+
+	if (mapping)
 	{
-		// Could not read the file?
-		connection->writeResponse(403, HttpHeaderCollection(), QString("The requested resource '%1' is not accessible").arg(requestPath).toUtf8());
-		delete file;
+		// Serve straight out of the mapped region, no copies involved until the data hits the output device.
+		lastModified = mapping->lastModifiedHeader;
+		fileSize = mapping->size;
+		etag = mapping->etag;
+		if (fileSize <= bufferSize())
+			content = QByteArray::fromRawData(mapping->data, fileSize);
 	}
 	else
 	{
-		HttpHeaderCollection headers; headers.reserve(2);
-		headers << HttpHeader("Content-Type", HttpMimeHelper::getMimeTypeForFilename(requestPath));
+		file = new QFile(resultPathInfo.filePath());
 
-		if (file->size() <= bufferSize())
+		if (!file->open(QIODevice::ReadOnly))
+		{
+			// Could not read the file?
+			connection->writeResponse(403, HttpHeaderCollection(), QString("The requested resource '%1' is not accessible").arg(requestPath).toUtf8());
+			delete file;
+			return true;
+		}
+
+		lastModified = HttpProtocol::Dates::getHttpDate(resultPathInfo.lastModified());
+		fileSize = file->size();
+
+		if (fileSize <= bufferSize())
 		{
 			// The file fully fits in the supported buffer size. Read it and calculate an ETag for caching.
-			QByteArray content = file->readAll();
+			content = file->readAll();
 			QCryptographicHash md5sum(QCryptographicHash::Md5); md5sum.addData(content);
-			QByteArray etag = md5sum.result().toHex();
-			headers << HttpHeader("ETag", etag);
+			etag = md5sum.result().toHex();
+		}
+	}
+
+	if (!etag.isEmpty() && connection->requestHeaderValue("If-None-Match") == etag)
+	{
+		connection->writeResponse(304); // The client's cached file was not modified.
+		delete file;
+		return true;
+	}
+
+	HttpHeaderCollection headers; headers.reserve(6);
+	headers << HttpHeader("Accept-Ranges", "bytes") << HttpHeader("Last-Modified", lastModified);
+	if (!etag.isEmpty()) headers << HttpHeader("ETag", etag);
+
+	// Range requests are honored only when the Range header is valid and the If-Range precondition (if any) holds.
+	// Otherwise, the full file is sent as usual.
+	QVector<HttpProtocol::Ranges::ByteRange> ranges;
+	const QByteArray& rangeHeader = connection->requestHeaderValue("Range");
+	bool partial = !rangeHeader.isEmpty()
+			&& ifRangeMatches(connection->requestHeaderValue("If-Range"), etag, lastModified)
+			&& HttpProtocol::Ranges::parseByteRanges(rangeHeader, fileSize, &ranges);
+
+	if (partial && ranges.isEmpty())
+	{
+		// None of the requested ranges overlap the file.
+		headers << HttpHeader("Content-Range", QByteArray("bytes */").append(QByteArray::number(fileSize)));
+		connection->writeResponse(416, headers);
+		delete file;
+		return true;
+	}
 
-			if (connection->requestHeaderValue("If-None-Match") == etag)
-				connection->writeResponse(304); // The client's cached file was not modified.
-			else
-				connection->writeResponse(200, headers, content);
+	QList<HttpHandlerFileTransfer::Segment> segments;
+	int statusCode = 200;
 
+	if (!partial)
+	{
+		headers << HttpHeader("Content-Type", mimeType);
+		if (!content.isNull())
+		{
+			connection->writeResponse(200, headers, content);
 			delete file;
+			return true;
 		}
-		else
+		segments << HttpHandlerFileTransfer::Segment::range(0, fileSize);
+	}
+	else if (ranges.size() == 1)
+	{
+		const HttpProtocol::Ranges::ByteRange& range = ranges.first();
+		headers << HttpHeader("Content-Type", mimeType) << HttpHeader("Content-Range", contentRange(range, fileSize));
+		segments << HttpHandlerFileTransfer::Segment::range(range.first, range.second - range.first + 1);
+		statusCode = 206;
+	}
+	else
+	{
+		// Multiple ranges are sent as a multipart/byteranges body, each part carrying its own Content-Range.
+		const QByteArray boundary = QByteArray("pillow-byteranges-").append(QByteArray::number(QDateTime::currentMSecsSinceEpoch(), 16));
+		headers << HttpHeader("Content-Type", QByteArray("multipart/byteranges; boundary=").append(boundary));
+
+		for (int i = 0; i < ranges.size(); ++i)
 		{
-			// The file exceeds the buffer size and must be sent incrementally. Do send the headers right away.
-			headers << HttpHeader("Content-Length", QByteArray::number(file->size()));
-			connection->writeHeaders(200, headers);
-
-			HttpHandlerFileTransfer* transfer = new HttpHandlerFileTransfer(file, connection, bufferSize());
-			file->setParent(transfer);
-			//transfer->setParent(this);
-			connect(transfer, SIGNAL(finished()), transfer, SLOT(deleteLater()));
-			transfer->writeNextPayload();
+			const HttpProtocol::Ranges::ByteRange& range = ranges.at(i);
+			QByteArray partHeaders; partHeaders.reserve(128);
+			if (i > 0) partHeaders.append("\r\n");
+			partHeaders.append("--").append(boundary).append("\r\nContent-Type: ").append(mimeType)
+					.append("\r\nContent-Range: ").append(contentRange(range, fileSize)).append("\r\n\r\n");
+			segments << HttpHandlerFileTransfer::Segment::literal(partHeaders)
+					 << HttpHandlerFileTransfer::Segment::range(range.first, range.second - range.first + 1);
 		}
+		segments << HttpHandlerFileTransfer::Segment::literal(QByteArray("\r\n--").append(boundary).append("--\r\n"));
+		statusCode = 206;
 	}
 
+	if (!content.isNull())
+	{
+		// Small file already in memory: assemble the body right away.
+		QByteArray body;
+		foreach (const HttpHandlerFileTransfer::Segment& segment, segments)
+			body.append(segment.data.isNull() ? QByteArray::fromRawData(content.constData() + segment.position, segment.length) : segment.data);
+		connection->writeResponse(statusCode, headers, body);
+		delete file;
+		return true;
+	}
+
+	// The file exceeds the buffer size and must be sent incrementally. Do send the headers right away.
+	qint64 contentLength = 0;
+	foreach (const HttpHandlerFileTransfer::Segment& segment, segments)
+		contentLength += segment.length;
+	headers << HttpHeader("Content-Length", QByteArray::number(contentLength));
+	connection->writeHeaders(statusCode, headers);
+
+	if (connection->state() != HttpConnection::SendingContent)
+	{
+		// Nothing more to send, as for HEAD requests.
+		delete file;
+		return true;
+	}
+
+	HttpHandlerFileTransfer* transfer = mapping
+			? new HttpHandlerFileTransfer(mapping, connection, segments, bufferSize())
+			: new HttpHandlerFileTransfer(file, connection, segments, bufferSize());
+	if (file) file->setParent(transfer);
+	connect(transfer, SIGNAL(finished()), transfer, SLOT(deleteLater()));
+	transfer->writeNextPayload();
+
 	return true;
 }
 
@@ -345,13 +623,35 @@ bool HttpHandlerFile::handleRequest(Pillow::HttpConnection *connection)
 HttpHandlerFileTransfer::HttpHandlerFileTransfer(QIODevice *sourceDevice, HttpConnection *connection, int bufferSize)
 	: _sourceDevice(sourceDevice), _connection(connection), _bufferSize(bufferSize)
 {
-	if (bufferSize < 512)
+	_segments << Segment::range(sourceDevice->pos(), sourceDevice->size() - sourceDevice->pos());
+	init();
+}
+
+HttpHandlerFileTransfer::HttpHandlerFileTransfer(QIODevice *sourceDevice, HttpConnection *connection, const QList<Segment>& segments, int bufferSize)
+	: _sourceDevice(sourceDevice), _connection(connection), _bufferSize(bufferSize), _segments(segments)
+{
+	init();
+}
+
+HttpHandlerFileTransfer::HttpHandlerFileTransfer(const QSharedPointer<HttpHandlerFileMapping>& mapping, HttpConnection *connection, const QList<Segment>& segments, int bufferSize)
+	: _mapping(mapping), _connection(connection), _bufferSize(bufferSize), _segments(segments)
+{
+	init();
+}
+
+HttpHandlerFileTransfer::~HttpHandlerFileTransfer()
+{
+}
+
+void HttpHandlerFileTransfer::init()
+{
+	if (_bufferSize < 512)
 	{
+		qWarning() << "HttpHandlerFileTransfer::HttpHandlerFileTransfer: requesting a buffer size of" << _bufferSize << "bytes. Correcting to" << 512 << "bytes.";
 		_bufferSize = 512;
-		qWarning() << "HttpHandlerFileTransfer::HttpHandlerFileTransfer: requesting a buffer size of" << bufferSize << "bytes. Correcting to" << _bufferSize << "bytes.";
 	}
 
-	connect(sourceDevice, SIGNAL(destroyed()), this, SLOT(deleteLater()));
+	if (_sourceDevice) connect(_sourceDevice, SIGNAL(destroyed()), this, SLOT(deleteLater()));
 	connect(_connection, SIGNAL(requestCompleted(Pillow::HttpConnection*)), this, SLOT(deleteLater()));
 	connect(_connection, SIGNAL(closed(Pillow::HttpConnection*)), this, SLOT(deleteLater()));
 	connect(_connection, SIGNAL(destroyed()), this, SLOT(deleteLater()));
@@ -360,18 +660,58 @@ HttpHandlerFileTransfer::HttpHandlerFileTransfer(QIODevice *sourceDevice, HttpCo
 
 void HttpHandlerFileTransfer::writeNextPayload()
 {
-	if (_sourceDevice == NULL || _connection == NULL || _connection->outputDevice() == NULL) return;
+	if ((_sourceDevice == NULL && _mapping.isNull()) || _connection == NULL || _connection->outputDevice() == NULL) return;
 
-	qint64 bytesToRead = _bufferSize - _connection->outputDevice()->bytesToWrite();
-	if (bytesToRead <= 0) return;
-	qint64 bytesAvailable = _sourceDevice->size() - _sourceDevice->pos();
-	if (bytesToRead > bytesAvailable) bytesToRead = bytesAvailable;
+	qint64 budget = _bufferSize - _connection->outputDevice()->bytesToWrite();
 
-	if (bytesToRead > 0)
+	while (budget > 0 && !_segments.isEmpty())
 	{
-		_connection->writeContent(_sourceDevice->read(bytesToRead));
+		Segment& segment = _segments.first();
+		if (segment.length <= 0) { _segments.removeFirst(); continue; }
+
+		QByteArray payload;
+		qint64 payloadSize = qMin(budget, segment.length);
+
+		if (!segment.data.isNull())
+		{
+			// Literal data. Note that segment.position is the offset of what remains to send.
+			payload = QByteArray::fromRawData(segment.data.constData() + segment.position, payloadSize);
+		}
+		else if (_mapping)
+		{
+			payload = QByteArray::fromRawData(_mapping->data + segment.position, payloadSize);
+		}
+		else
+		{
+			if (_sourceDevice->pos() == segment.position || _sourceDevice->seek(segment.position))
+				payload = _sourceDevice->read(payloadSize);
+
+			if (payload.isEmpty())
+			{
+				// The file shrunk or became unreadable while being sent: the announced content length can't be honored.
+				qWarning() << "HttpHandlerFileTransfer::writeNextPayload: failed to read from the source device, closing the connection.";
+				_segments.clear();
+				_connection->close();
+				emit finished();
+				return;
+			}
+			payloadSize = payload.size();
+		}
 
-		if (_sourceDevice->atEnd())
-			emit finished();
+		// Write before advancing: raw data payloads point into the segment or mapping.
+		_connection->writeContent(payload);
+		budget -= payloadSize;
+		segment.position += payloadSize;
+		segment.length -= payloadSize;
+		if (segment.length == 0) _segments.removeFirst();
+
+		if (_connection == NULL || _connection->state() != HttpConnection::SendingContent)
+		{
+			_segments.clear(); // Completed or closed.
+			break;
+		}
 	}
+
+	if (_segments.isEmpty())
+		emit finished();
 }
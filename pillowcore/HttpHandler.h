@@ -13,16 +13,32 @@
 #ifndef QHASH_H
 #include <QtCore/QHash>
 #endif // QHASH_H
+#ifndef QSET_H
+#include <QtCore/QSet>
+#endif // QSET_H
+#ifndef QLIST_H
+#include <QtCore/QList>
+#endif // QLIST_H
+#ifndef QVECTOR_H
+#include <QtCore/QVector>
+#endif // QVECTOR_H
+#ifndef QBYTEARRAY_H
+#include <QtCore/QByteArray>
+#endif // QBYTEARRAY_H
+#ifndef QSHAREDPOINTER_H
+#include <QtCore/QSharedPointer>
+#endif // QSHAREDPOINTER_H
 #ifdef Q_COMPILER_LAMBDA
 #include <functional>
 #endif // Q_COMPILER_LAMBDA
 
 class QIODevice;
-class QElapsedTimer;
 
 namespace Pillow
 {
 	class HttpConnection;
+	class HttpHandlerFileMapping;
+	class HttpHandlerFileMappingCache;
 
 	//
 	// HttpHandler: abstract handler interface. Does nothing.
@@ -46,12 +62,30 @@ namespace Pillow
 	class PILLOWCORE_EXPORT HttpHandlerStack : public HttpHandler
 	{
 		Q_OBJECT
+		Q_PROPERTY(bool hitCountingEnabled READ hitCountingEnabled WRITE setHitCountingEnabled)
+
+		QVector<HttpHandler*> _handlers; // The HttpHandler children, in order. Rebuilt on the first request after children change.
+		QVector<quint64> _hitCounts;     // Requests handled by each of _handlers, when hit counting is enabled.
+		bool _handlersDirty;
+		bool _hitCountingEnabled;
 
 	public:
 		HttpHandlerStack(QObject* parent = 0);
 
+		// Hit counting: count the requests handled by each child, to check that the most used handlers come first.
+		bool hitCountingEnabled() const { return _hitCountingEnabled; }
+		void setHitCountingEnabled(bool enabled);
+		quint64 hitCount(Pillow::HttpHandler* handler) const;
+		void resetHitCounts();
+
 	public:
 		virtual bool handleRequest(Pillow::HttpConnection *connection);
+
+	protected:
+		void childEvent(QChildEvent* event);
+
+	private:
+		void updateHandlers();
 	};
 
 	//
@@ -163,7 +197,7 @@ namespace Pillow
 		void log(const QString& entry);
 
 	private:
-		QHash<Pillow::HttpConnection*, QElapsedTimer*> _requestTimerMap;
+		QSet<Pillow::HttpConnection*> _connections; // Timing comes from the connections' own timestamps.
 		Mode _mode;
 		QPointer<QIODevice> _device;
 	};
@@ -179,18 +213,31 @@ namespace Pillow
 
 		QString _publicPath;
 		int _bufferSize;
+		int _mappingCacheSize;
+		Pillow::HttpHandlerFileMappingCache* _mappingCache;
 
 	public:
 		HttpHandlerFile(const QString& publicPath = QString(), QObject* parent = 0);
+		~HttpHandlerFile();
 
 		const QString& publicPath() const { return _publicPath; }
 		int bufferSize() const { return _bufferSize; }
 
+		// Memory mapping mode: files are served straight from memory mapped regions instead of being read
+		// for each request. Up to mappingCacheSize() mappings are kept open and reused (least recently used
+		// are released first); a mapping is dropped as soon as its file's size or modification time changes.
+		// Note that files must be replaced rather than truncated in place while they are being served.
+		bool memoryMappingEnabled() const { return _mappingCacheSize > 0; }
+		int mappingCacheSize() const { return _mappingCacheSize; }
+
 		enum { DefaultBufferSize = 512 * 1024 };
+		enum { DefaultMappingCacheSize = 32 };
 
 	public:
 		void setPublicPath(const QString& publicPath);
 		void setBufferSize(int bytes);
+		void setMemoryMappingEnabled(bool enabled);
+		void setMappingCacheSize(int count); // 0 disables memory mapping.
 
 		virtual bool handleRequest(Pillow::HttpConnection* connection);
 
@@ -201,13 +248,39 @@ namespace Pillow
 	class PILLOWCORE_EXPORT HttpHandlerFileTransfer : public QObject
 	{
 		Q_OBJECT
+
+	public:
+		// A part of the transferred content: either a range of the source device, or literal data when not null.
+		struct Segment
+		{
+			qint64 position, length;
+			QByteArray data;
+
+			static Segment range(qint64 position, qint64 length) { Segment s; s.position = position; s.length = length; return s; }
+			static Segment literal(const QByteArray& data) { Segment s; s.position = 0; s.length = data.size(); s.data = data; return s; }
+		};
+
+	private:
 		QPointer<QIODevice> _sourceDevice;
+		QSharedPointer<Pillow::HttpHandlerFileMapping> _mapping;
 		QPointer<HttpConnection> _connection;
 		int _bufferSize;
+		QList<Segment> _segments;
 
 	public:
+		// Transfers the source device content from its current position up to its end.
 		HttpHandlerFileTransfer(QIODevice* sourceDevice, Pillow::HttpConnection* connection, int bufferSize = HttpHandlerFile::DefaultBufferSize);
 
+		// Transfers the specified segments, in order. Used to send byte ranges of the source device.
+		HttpHandlerFileTransfer(QIODevice* sourceDevice, Pillow::HttpConnection* connection, const QList<Segment>& segments, int bufferSize = HttpHandlerFile::DefaultBufferSize);
+
+		// Transfers the specified segments, with ranges sent straight out of a memory mapped file.
+		HttpHandlerFileTransfer(const QSharedPointer<Pillow::HttpHandlerFileMapping>& mapping, Pillow::HttpConnection* connection, const QList<Segment>& segments, int bufferSize = HttpHandlerFile::DefaultBufferSize);
+		~HttpHandlerFileTransfer();
+
+	private:
+		void init();
+
 	public slots:
 		void writeNextPayload();
 
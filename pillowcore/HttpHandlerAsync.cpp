@@ -0,0 +1,345 @@
+#include "HttpHandlerAsync.h"
+#include "HttpConnection.h"
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QPointer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QVector>
+#include <QtCore/QDebug>
+using namespace Pillow;
+
+namespace Pillow
+{
+	//
+	// HttpAsyncChannel: the queue of response calls between the handle and the connection's thread.
+	//
+
+	struct HttpAsyncOperation
+	{
+		enum Type { Response, Headers, Content, End };
+		Type type;
+		int statusCode;
+		HttpHeaderCollection headers;
+		QByteArray content;
+	};
+
+	class HttpAsyncChannel
+	{
+	public:
+		QMutex mutex;
+		QObject* receiver; // Lives in the connection's thread. Null once the connection is gone.
+		QVector<HttpAsyncOperation> operations;
+		bool headersWritten, ended;
+
+	public:
+		HttpAsyncChannel(QObject* receiver) : receiver(receiver), headersWritten(false), ended(false) {}
+
+		bool isCancelled()
+		{
+			QMutexLocker locker(&mutex);
+			return receiver == 0;
+		}
+
+		void post(HttpAsyncOperation::Type type, int statusCode = 0, const HttpHeaderCollection& headers = HttpHeaderCollection(), const QByteArray& content = QByteArray())
+		{
+			QMutexLocker locker(&mutex);
+			if (receiver == 0 || ended) return;
+
+			if (type == HttpAsyncOperation::Response || type == HttpAsyncOperation::Headers) headersWritten = true;
+			if (type == HttpAsyncOperation::Response || type == HttpAsyncOperation::End) ended = true;
+
+			operations.append(HttpAsyncOperation());
+			HttpAsyncOperation& operation = operations.last();
+			operation.type = type;
+			operation.statusCode = statusCode;
+			operation.headers = headers;
+			operation.content = content;
+
+			// A single queued call processes everything that was posted until it runs.
+			if (operations.size() == 1)
+				QMetaObject::invokeMethod(receiver, "processOperations", Qt::QueuedConnection);
+		}
+
+		void finish()
+		{
+			mutex.lock();
+			const bool respond = !headersWritten;
+			mutex.unlock();
+			if (respond)
+				post(HttpAsyncOperation::Response, 500);
+			else
+				post(HttpAsyncOperation::End);
+		}
+
+		QVector<HttpAsyncOperation> takeOperations()
+		{
+			QMutexLocker locker(&mutex);
+			QVector<HttpAsyncOperation> result;
+			result.swap(operations);
+			return result;
+		}
+
+		void detach()
+		{
+			QMutexLocker locker(&mutex);
+			receiver = 0;
+			operations.clear();
+		}
+	};
+
+	//
+	// HttpAsyncResponsePrivate
+	//
+
+	class HttpAsyncResponsePrivate
+	{
+	public:
+		QByteArray method, uri, path, queryString, httpVersion, content;
+		HttpHeaderCollection headers;
+		QHostAddress remoteAddress;
+		QSharedPointer<HttpAsyncChannel> channel;
+
+	public:
+		~HttpAsyncResponsePrivate()
+		{
+			if (channel) channel->finish();
+		}
+	};
+
+	//
+	// HttpAsyncRequest: the connection's side of an asynchronous request.
+	//
+
+	class HttpAsyncRequest : public QObject
+	{
+		Q_OBJECT
+		QPointer<HttpConnection> _connection;
+		QSharedPointer<HttpAsyncChannel> _channel;
+
+	public:
+		HttpAsyncRequest(HttpConnection* connection)
+			: QObject(connection), _connection(connection), _channel(new HttpAsyncChannel(this))
+		{
+			connect(connection, SIGNAL(requestCompleted(Pillow::HttpConnection*)), this, SLOT(connection_requestCompleted()));
+			connect(connection, SIGNAL(closed(Pillow::HttpConnection*)), this, SLOT(connection_closed()));
+		}
+
+		~HttpAsyncRequest()
+		{
+			_channel->detach();
+		}
+
+		const QSharedPointer<HttpAsyncChannel>& channel() const { return _channel; }
+
+	private slots:
+		void processOperations()
+		{
+			foreach (const HttpAsyncOperation& operation, _channel->takeOperations())
+			{
+				if (_connection == 0) return;
+				switch (operation.type)
+				{
+				case HttpAsyncOperation::Response: _connection->writeResponse(operation.statusCode, operation.headers, operation.content); break;
+				case HttpAsyncOperation::Headers: _connection->writeHeaders(operation.statusCode, operation.headers); break;
+				case HttpAsyncOperation::Content: _connection->writeContent(operation.content); break;
+				case HttpAsyncOperation::End: _connection->endContent(); break;
+				}
+
+				// The operation may have completed the response (e.g. the last byte of a Content-Length response, or
+				// the headers of a HEAD response), detaching us: the rest would go to the connection's next request.
+				if (_channel->isCancelled()) return;
+			}
+		}
+
+		void connection_requestCompleted()
+		{
+			// The connection moves on to its next request, we are done with it.
+			_channel->detach();
+			disconnect(_connection, 0, this, 0);
+			deleteLater();
+		}
+
+		void connection_closed()
+		{
+			_channel->detach(); // Cancels the request: the function sees isCancelled() and its calls are ignored.
+			deleteLater();
+		}
+	};
+
+	//
+	// HttpAsyncRunnable
+	//
+
+#ifdef Q_COMPILER_LAMBDA
+	class HttpAsyncRunnable : public QRunnable
+	{
+		std::function<void(Pillow::HttpAsyncResponse)> _function;
+		HttpAsyncResponse _response;
+
+	public:
+		HttpAsyncRunnable(const std::function<void(Pillow::HttpAsyncResponse)>& function, const HttpAsyncResponse& response)
+			: _function(function), _response(response)
+		{}
+
+		void run()
+		{
+			if (!_response.isCancelled())
+				_function(_response);
+		}
+	};
+#endif // Q_COMPILER_LAMBDA
+}
+
+//
+// HttpAsyncResponse
+//
+
+HttpAsyncResponse::HttpAsyncResponse()
+	: d(new HttpAsyncResponsePrivate())
+{
+}
+
+HttpAsyncResponse::HttpAsyncResponse(const QSharedPointer<HttpAsyncResponsePrivate> &d)
+	: d(d)
+{
+}
+
+const QByteArray &HttpAsyncResponse::requestMethod() const
+{
+	return d->method;
+}
+
+const QByteArray &HttpAsyncResponse::requestUri() const
+{
+	return d->uri;
+}
+
+const QByteArray &HttpAsyncResponse::requestPath() const
+{
+	return d->path;
+}
+
+const QByteArray &HttpAsyncResponse::requestQueryString() const
+{
+	return d->queryString;
+}
+
+const QByteArray &HttpAsyncResponse::requestHttpVersion() const
+{
+	return d->httpVersion;
+}
+
+const QByteArray &HttpAsyncResponse::requestContent() const
+{
+	return d->content;
+}
+
+const HttpHeaderCollection &HttpAsyncResponse::requestHeaders() const
+{
+	return d->headers;
+}
+
+QByteArray HttpAsyncResponse::requestHeaderValue(const QByteArray &field) const
+{
+	return d->headers.getFieldValue(field);
+}
+
+QHostAddress HttpAsyncResponse::remoteAddress() const
+{
+	return d->remoteAddress;
+}
+
+bool HttpAsyncResponse::isCancelled() const
+{
+	return d->channel.isNull() || d->channel->isCancelled();
+}
+
+void HttpAsyncResponse::writeResponse(int statusCode, const HttpHeaderCollection &headers, const QByteArray &content)
+{
+	if (d->channel) d->channel->post(HttpAsyncOperation::Response, statusCode, headers, content);
+}
+
+void HttpAsyncResponse::writeHeaders(int statusCode, const HttpHeaderCollection &headers)
+{
+	if (d->channel) d->channel->post(HttpAsyncOperation::Headers, statusCode, headers);
+}
+
+void HttpAsyncResponse::writeContent(const QByteArray &content)
+{
+	if (d->channel) d->channel->post(HttpAsyncOperation::Content, 0, HttpHeaderCollection(), content);
+}
+
+void HttpAsyncResponse::endContent()
+{
+	if (d->channel) d->channel->post(HttpAsyncOperation::End);
+}
+
+//
+// HttpHandlerAsync
+//
+
+#ifdef Q_COMPILER_LAMBDA
+
+namespace
+{
+	// The connection's request data is only valid until the response completes and its buffer may be
+	// reused on the connection's thread meanwhile: the worker gets its own copies.
+	inline QByteArray deepCopy(const QByteArray& data)
+	{
+		return data.isEmpty() ? QByteArray() : QByteArray(data.constData(), data.size());
+	}
+}
+
+HttpHandlerAsync::HttpHandlerAsync(QObject *parent)
+	: HttpHandler(parent), _function()
+{
+}
+
+HttpHandlerAsync::HttpHandlerAsync(const std::function<void (HttpAsyncResponse)> &function, QObject *parent)
+	: HttpHandler(parent), _function(function)
+{
+}
+
+HttpHandlerAsync::HttpHandlerAsync(const std::function<void (HttpAsyncResponse)> &function, QThreadPool *threadPool, QObject *parent)
+	: HttpHandler(parent), _function(function), _threadPool(threadPool)
+{
+}
+
+QThreadPool *HttpHandlerAsync::threadPool() const
+{
+	return _threadPool ? _threadPool.data() : QThreadPool::globalInstance();
+}
+
+void HttpHandlerAsync::setThreadPool(QThreadPool *threadPool)
+{
+	_threadPool = threadPool;
+}
+
+bool HttpHandlerAsync::handleRequest(HttpConnection *connection)
+{
+	if (!_function) return false;
+
+	HttpAsyncRequest* request = new HttpAsyncRequest(connection);
+
+	QSharedPointer<HttpAsyncResponsePrivate> d(new HttpAsyncResponsePrivate());
+	d->method = deepCopy(connection->requestMethod());
+	d->uri = deepCopy(connection->requestUri());
+	d->path = deepCopy(connection->requestPath());
+	d->queryString = deepCopy(connection->requestQueryString());
+	d->httpVersion = deepCopy(connection->requestHttpVersion());
+	d->content = deepCopy(connection->requestContent());
+	const HttpHeaderCollection& headers = connection->requestHeaders();
+	d->headers.reserve(headers.size());
+	foreach (const HttpHeader& header, headers)
+		d->headers << HttpHeader(deepCopy(header.first), deepCopy(header.second));
+	d->remoteAddress = connection->remoteAddress();
+	d->channel = request->channel();
+
+	threadPool()->start(new HttpAsyncRunnable(_function, HttpAsyncResponse(d)));
+	return true;
+}
+
+#endif // Q_COMPILER_LAMBDA
+
+#include "HttpHandlerAsync.moc"
@@ -0,0 +1,96 @@
+#ifndef PILLOW_HTTPHANDLERASYNC_H
+#define PILLOW_HTTPHANDLERASYNC_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef PILLOW_HTTPHANDLER_H
+#include "HttpHandler.h"
+#endif // PILLOW_HTTPHANDLER_H
+#ifndef PILLOW_HTTPHEADER_H
+#include "HttpHeader.h"
+#endif // PILLOW_HTTPHEADER_H
+#ifndef QHOSTADDRESS_H
+#include <QtNetwork/QHostAddress>
+#endif // QHOSTADDRESS_H
+
+class QThreadPool;
+
+namespace Pillow
+{
+	class HttpAsyncResponsePrivate;
+
+	//
+	// HttpAsyncResponse: a thread safe handle on a request handled by HttpHandlerAsync.
+	//
+	// The request members are a private copy of the request, they can be read from any thread. The response
+	// members can also be called from any thread: they queue their arguments (QByteArrays are implicitly shared,
+	// not copied) and the connection's thread writes them out in order. Once the connection closes, isCancelled()
+	// returns true and further response calls are ignored.
+	//
+	// The response is ended when the last copy of the handle goes away, with a "500 Internal Server Error"
+	// if nothing at all was written. Keep a copy to finish the response later from somewhere else.
+	//
+
+	class PILLOWCORE_EXPORT HttpAsyncResponse
+	{
+	public:
+		HttpAsyncResponse();
+		HttpAsyncResponse(const QSharedPointer<Pillow::HttpAsyncResponsePrivate>& d);
+
+		// Request members.
+		const QByteArray& requestMethod() const;
+		const QByteArray& requestUri() const;
+		const QByteArray& requestPath() const;
+		const QByteArray& requestQueryString() const;
+		const QByteArray& requestHttpVersion() const;
+		const QByteArray& requestContent() const;
+		const Pillow::HttpHeaderCollection& requestHeaders() const;
+		QByteArray requestHeaderValue(const QByteArray& field) const;
+		QHostAddress remoteAddress() const;
+
+		bool isCancelled() const; // The connection was closed, there is no one left to respond to.
+
+		// Response members.
+		void writeResponse(int statusCode = 200, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection(), const QByteArray& content = QByteArray());
+		void writeHeaders(int statusCode = 200, const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection());
+		void writeContent(const QByteArray& content);
+		void endContent();
+
+	private:
+		QSharedPointer<Pillow::HttpAsyncResponsePrivate> d;
+	};
+
+	//
+	// HttpHandlerAsync: a handler that invokes a function on a thread pool rather than on the connection's thread.
+	//
+	// Use it for CPU heavy or blocking endpoints, so that they do not stall the other connections served by the
+	// same thread. The function receives an HttpAsyncResponse and must not touch the HttpConnection itself.
+	//
+
+	class PILLOWCORE_EXPORT HttpHandlerAsync : public HttpHandler
+	{
+		Q_OBJECT
+#ifdef Q_COMPILER_LAMBDA
+		std::function<void(Pillow::HttpAsyncResponse)> _function;
+		QPointer<QThreadPool> _threadPool;
+
+	public:
+		HttpHandlerAsync(QObject* parent = 0);
+		HttpHandlerAsync(const std::function<void(Pillow::HttpAsyncResponse)>& function, QObject* parent = 0);
+		HttpHandlerAsync(const std::function<void(Pillow::HttpAsyncResponse)>& function, QThreadPool* threadPool, QObject* parent = 0);
+
+		inline const std::function<void(Pillow::HttpAsyncResponse)>& function() const { return _function; }
+		void setFunction(const std::function<void(Pillow::HttpAsyncResponse)>& function) { _function = function; }
+
+		// The pool the function runs on. Defaults to QThreadPool::globalInstance().
+		QThreadPool* threadPool() const;
+		void setThreadPool(QThreadPool* threadPool);
+
+	public:
+		virtual bool handleRequest(Pillow::HttpConnection* connection);
+#endif // Q_COMPILER_LAMBDA
+	};
+}
+
+#endif // PILLOW_HTTPHANDLERASYNC_H
@@ -0,0 +1,530 @@
+#include "HttpHandlerAsyncLog.h"
+#include "HttpConnection.h"
+#include <QtCore/QDateTime>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QWaitCondition>
+#include <QtCore/QDebug>
+#include <QtNetwork/QHostAddress>
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+using namespace Pillow;
+
+namespace Pillow
+{
+	//
+	// HttpLogRecord: everything needed to format one log line, copied out of the connection as is.
+	//
+
+	struct HttpLogRecord
+	{
+		enum { MaximumMethodLength = 16, MaximumVersionLength = 8, MaximumUriLength = 400 };
+
+		enum { PhaseCount = 4 };
+
+		qint64 timestamp;       // Milliseconds since the epoch, when the request completed.
+		qint64 elapsed;         // Microseconds from requestReady to requestCompleted.
+		qint64 contentLength;
+		qint64 phases[PhaseCount]; // Microseconds receiving headers, receiving content, in handlers and sending. -1 when unknown.
+		Q_IPV6ADDR ipv6Address;
+		quint32 ipv4Address;
+		quint32 requestCount;   // Requests served on the connection, this one included.
+		quint16 statusCode;
+		quint16 uriLength;
+		quint8 format;          // HttpHandlerAsyncLog::Format.
+		quint8 protocol;        // 0 (unknown), 4 or 6.
+		quint8 methodLength, versionLength;
+		char method[MaximumMethodLength];
+		char version[MaximumVersionLength];
+		char uri[MaximumUriLength]; // Longer URIs are truncated.
+	};
+
+	class HttpAsyncLogWriter;
+
+	//
+	// HttpHandlerAsyncLogPrivate
+	//
+
+	class HttpHandlerAsyncLogPrivate
+	{
+	public:
+		enum { BatchSize = 64 * 1024 };
+
+		// Bounded multiple producers ring (D. Vyukov): each slot carries a sequence number telling whether it
+		// is free for the producer at a given position, or filled for the consumer at that position.
+		struct Slot
+		{
+			std::atomic<size_t> sequence;
+			HttpLogRecord record;
+		};
+
+	public:
+		Slot* slots;
+		size_t mask;
+		std::atomic<size_t> enqueuePosition;
+		std::atomic<size_t> writtenPosition;
+		std::atomic<quint64> droppedCount;
+		size_t dequeuePosition;   // Writer thread only.
+		quint64 reportedDropCount; // Writer thread only.
+
+		QMutex mutex;
+		QWaitCondition writerCondition, writtenCondition;
+		bool stopping;
+		HttpAsyncLogWriter* writer;
+		QString fileName;
+
+		// Serving thread only.
+		QHash<HttpConnection*, bool> sampled; // Head-based sampling decision, made when the request reaches the handler.
+		HttpHandlerAsyncLog::Format format;
+		int sampleRate;
+		int slowRequestThreshold;
+		quint32 sampleCounter;
+
+	public:
+		HttpHandlerAsyncLogPrivate(const QString& fileName)
+			: slots(NULL), mask(0), enqueuePosition(0), writtenPosition(0), droppedCount(0), dequeuePosition(0), reportedDropCount(0),
+			  stopping(false), writer(NULL), fileName(fileName),
+			  format(HttpHandlerAsyncLog::CombinedFormat), sampleRate(1), slowRequestThreshold(HttpHandlerAsyncLog::DefaultSlowRequestThreshold), sampleCounter(0)
+		{
+			allocate(HttpHandlerAsyncLog::DefaultCapacity);
+		}
+
+		~HttpHandlerAsyncLogPrivate()
+		{
+			stopWriter();
+			delete[] slots;
+		}
+
+		void allocate(int capacity)
+		{
+			size_t size = 2;
+			while (size < static_cast<size_t>(capacity)) size <<= 1;
+
+			delete[] slots;
+			slots = new Slot[size];
+			mask = size - 1;
+			for (size_t i = 0; i < size; ++i)
+				slots[i].sequence.store(i, std::memory_order_relaxed);
+			enqueuePosition.store(0);
+			writtenPosition.store(0);
+			dequeuePosition = 0;
+		}
+
+		// Producer side. Returns NULL when the ring is full.
+		HttpLogRecord* claim(size_t& position)
+		{
+			position = enqueuePosition.load(std::memory_order_relaxed);
+			for (;;)
+			{
+				Slot& slot = slots[position & mask];
+				const size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				const qptrdiff difference = static_cast<qptrdiff>(sequence) - static_cast<qptrdiff>(position);
+				if (difference == 0)
+				{
+					if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+						return &slot.record;
+				}
+				else if (difference < 0)
+				{
+					droppedCount.fetch_add(1, std::memory_order_relaxed);
+					return NULL;
+				}
+				else
+					position = enqueuePosition.load(std::memory_order_relaxed);
+			}
+		}
+
+		void publish(size_t position)
+		{
+			slots[position & mask].sequence.store(position + 1, std::memory_order_release);
+
+			// The writer wakes up on its own every DefaultFlushInterval; only hurry it when the ring fills up.
+			if (position - writtenPosition.load(std::memory_order_relaxed) == (mask + 1) / 2)
+				writerCondition.wakeOne();
+		}
+
+		// Consumer side.
+		bool hasPending() const
+		{
+			return slots[dequeuePosition & mask].sequence.load(std::memory_order_acquire) == dequeuePosition + 1;
+		}
+
+		void startWriter();
+		void stopWriter();
+		void runWriter();
+		void drain(QFile& file, QByteArray& buffer);
+		void formatCombined(const HttpLogRecord& record, QByteArray& buffer);
+		void formatJson(const HttpLogRecord& record, QByteArray& buffer);
+
+		// Formatting caches, writer thread only.
+		qint64 cachedSecond, cachedJsonSecond;
+		QByteArray cachedDate, cachedJsonDate;
+		quint32 cachedIPv4Address;
+		QByteArray cachedAddress;
+	};
+
+	class HttpAsyncLogWriter : public QThread
+	{
+		HttpHandlerAsyncLogPrivate* d;
+
+	public:
+		HttpAsyncLogWriter(HttpHandlerAsyncLogPrivate* d) : d(d) {}
+
+	protected:
+		void run() { d->runWriter(); }
+	};
+}
+
+void HttpHandlerAsyncLogPrivate::startWriter()
+{
+	stopping = false;
+	cachedSecond = cachedJsonSecond = -1;
+	cachedIPv4Address = 0;
+	writer = new HttpAsyncLogWriter(this);
+	writer->start(QThread::LowPriority);
+}
+
+void HttpHandlerAsyncLogPrivate::stopWriter()
+{
+	if (writer == NULL) return;
+	mutex.lock();
+	stopping = true;
+	writerCondition.wakeOne();
+	mutex.unlock();
+	writer->wait();
+	delete writer;
+	writer = NULL;
+}
+
+void HttpHandlerAsyncLogPrivate::runWriter()
+{
+	QFile file;
+	if (fileName.isEmpty())
+		file.open(stderr, QIODevice::WriteOnly);
+	else
+	{
+		file.setFileName(fileName);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+			qWarning() << "HttpHandlerAsyncLog::runWriter: could not open" << fileName << "for writing:" << file.errorString();
+	}
+
+	QByteArray buffer;
+	buffer.reserve(BatchSize + 1024);
+
+	forever
+	{
+		mutex.lock();
+		if (!stopping && !hasPending())
+			writerCondition.wait(&mutex, HttpHandlerAsyncLog::DefaultFlushInterval);
+		const bool stop = stopping;
+		mutex.unlock();
+
+		// Producers are done by the time "stopping" is set: this last drain gets everything.
+		drain(file, buffer);
+		if (stop) break;
+	}
+}
+
+void HttpHandlerAsyncLogPrivate::drain(QFile &file, QByteArray &buffer)
+{
+	while (hasPending())
+	{
+		Slot& slot = slots[dequeuePosition & mask];
+		if (slot.record.format == HttpHandlerAsyncLog::JsonFormat)
+			formatJson(slot.record, buffer);
+		else
+			formatCombined(slot.record, buffer);
+		slot.sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+		++dequeuePosition;
+
+		if (buffer.size() >= BatchSize)
+		{
+			if (file.isOpen()) file.write(buffer);
+			buffer.clear(); buffer.reserve(BatchSize + 1024);
+		}
+	}
+
+	const quint64 dropped = droppedCount.load(std::memory_order_relaxed);
+	if (dropped != reportedDropCount)
+	{
+		buffer.append("HttpHandlerAsyncLog: ").append(QByteArray::number(dropped - reportedDropCount)).append(" records dropped, the log could not keep up.\n");
+		reportedDropCount = dropped;
+	}
+
+	if (!buffer.isEmpty())
+	{
+		if (file.isOpen()) { file.write(buffer); file.flush(); }
+		buffer.clear(); buffer.reserve(BatchSize + 1024);
+	}
+
+	mutex.lock();
+	writtenPosition.store(dequeuePosition, std::memory_order_relaxed);
+	writtenCondition.wakeAll();
+	mutex.unlock();
+}
+
+void HttpHandlerAsyncLogPrivate::formatCombined(const HttpLogRecord &record, QByteArray &buffer)
+{
+	// Same layout as HttpHandlerLog: "%1 - - [%2] \"%3 %4 %5\" %6 %7 %8".
+	if (record.protocol == 4)
+	{
+		if (record.ipv4Address != cachedIPv4Address || cachedAddress.isEmpty())
+		{
+			cachedIPv4Address = record.ipv4Address;
+			cachedAddress = QHostAddress(record.ipv4Address).toString().toLatin1();
+		}
+		buffer.append(cachedAddress);
+	}
+	else if (record.protocol == 6)
+		buffer.append(QHostAddress(record.ipv6Address).toString().toLatin1());
+
+	const qint64 second = record.timestamp / 1000;
+	if (second != cachedSecond)
+	{
+		cachedSecond = second;
+		cachedDate = QDateTime::fromMSecsSinceEpoch(second * 1000).toString("dd/MMM/yyyy hh:mm:ss").toLatin1();
+	}
+	buffer.append(" - - [").append(cachedDate).append("] \"");
+	buffer.append(record.method, record.methodLength).append(' ');
+	buffer.append(record.uri, record.uriLength).append(' ');
+	buffer.append(record.version, record.versionLength).append("\" ");
+	buffer.append(QByteArray::number(record.statusCode)).append(' ');
+	buffer.append(QByteArray::number(record.contentLength)).append(' ');
+
+	const qint64 milliseconds = (record.elapsed + 500) / 1000;
+	char fraction[8]; qsnprintf(fraction, sizeof(fraction), ".%03d\n", static_cast<int>(milliseconds % 1000));
+	buffer.append(QByteArray::number(milliseconds / 1000)).append(fraction);
+}
+
+namespace
+{
+	// Request lines are bytes, not text: anything but printable ASCII is escaped so that the output stays valid JSON.
+	void appendJsonString(QByteArray& buffer, const char* data, int size)
+	{
+		static const char hexDigits[] = "0123456789abcdef";
+		buffer.append('"');
+		for (const char* c = data, *cE = data + size; c < cE; ++c)
+		{
+			const uchar u = static_cast<uchar>(*c);
+			if (u == '"' || u == '\\')
+				buffer.append('\\').append(*c);
+			else if (u >= 0x20 && u < 0x7f)
+				buffer.append(*c);
+			else
+				buffer.append("\\u00").append(hexDigits[u >> 4]).append(hexDigits[u & 0xf]);
+		}
+		buffer.append('"');
+	}
+}
+
+void HttpHandlerAsyncLogPrivate::formatJson(const HttpLogRecord &record, QByteArray &buffer)
+{
+	const qint64 second = record.timestamp / 1000;
+	if (second != cachedJsonSecond)
+	{
+		cachedJsonSecond = second;
+		cachedJsonDate = QDateTime::fromMSecsSinceEpoch(second * 1000).toUTC().toString("yyyy-MM-ddThh:mm:ss").toLatin1();
+	}
+	char milliseconds[8]; qsnprintf(milliseconds, sizeof(milliseconds), ".%03dZ\"", static_cast<int>(record.timestamp % 1000));
+	buffer.append("{\"time\":\"").append(cachedJsonDate).append(milliseconds);
+
+	buffer.append(",\"remote\":\"");
+	if (record.protocol == 4)
+		buffer.append(QHostAddress(record.ipv4Address).toString().toLatin1());
+	else if (record.protocol == 6)
+		buffer.append(QHostAddress(record.ipv6Address).toString().toLatin1());
+	buffer.append('"');
+
+	int pathLength = 0;
+	while (pathLength < record.uriLength && record.uri[pathLength] != '?' && record.uri[pathLength] != '#') ++pathLength;
+
+	buffer.append(",\"method\":"); appendJsonString(buffer, record.method, record.methodLength);
+	buffer.append(",\"path\":"); appendJsonString(buffer, record.uri, pathLength);
+	buffer.append(",\"version\":"); appendJsonString(buffer, record.version, record.versionLength);
+	buffer.append(",\"status\":").append(QByteArray::number(record.statusCode));
+	buffer.append(",\"bytes\":").append(QByteArray::number(record.contentLength));
+	buffer.append(",\"requests\":").append(QByteArray::number(record.requestCount));
+	buffer.append(",\"duration_us\":").append(QByteArray::number(record.elapsed));
+
+	// Phases the connection could not time (e.g. the handler wrote its response before the content arrived) are left out.
+	static const char* const phaseFields[HttpLogRecord::PhaseCount] = { ",\"headers_us\":", ",\"content_us\":", ",\"handler_us\":", ",\"send_us\":" };
+	for (int i = 0; i < HttpLogRecord::PhaseCount; ++i)
+	{
+		if (record.phases[i] >= 0)
+			buffer.append(phaseFields[i]).append(QByteArray::number(record.phases[i]));
+	}
+	buffer.append("}\n");
+}
+
+//
+// HttpHandlerAsyncLog
+//
+
+HttpHandlerAsyncLog::HttpHandlerAsyncLog(QObject *parent)
+	: HttpHandler(parent), d_ptr(new HttpHandlerAsyncLogPrivate(QString()))
+{
+	d_ptr->startWriter();
+}
+
+HttpHandlerAsyncLog::HttpHandlerAsyncLog(const QString &fileName, QObject *parent)
+	: HttpHandler(parent), d_ptr(new HttpHandlerAsyncLogPrivate(fileName))
+{
+	d_ptr->startWriter();
+}
+
+HttpHandlerAsyncLog::~HttpHandlerAsyncLog()
+{
+	delete d_ptr;
+}
+
+const QString &HttpHandlerAsyncLog::fileName() const
+{
+	return d_ptr->fileName;
+}
+
+void HttpHandlerAsyncLog::setFileName(const QString &fileName)
+{
+	if (d_ptr->fileName == fileName) return;
+	d_ptr->stopWriter();
+	d_ptr->fileName = fileName;
+	d_ptr->startWriter();
+}
+
+int HttpHandlerAsyncLog::capacity() const
+{
+	return static_cast<int>(d_ptr->mask + 1);
+}
+
+void HttpHandlerAsyncLog::setCapacity(int records)
+{
+	d_ptr->stopWriter();
+	d_ptr->allocate(records);
+	d_ptr->startWriter();
+}
+
+quint64 HttpHandlerAsyncLog::droppedCount() const
+{
+	return d_ptr->droppedCount.load(std::memory_order_relaxed);
+}
+
+HttpHandlerAsyncLog::Format HttpHandlerAsyncLog::format() const
+{
+	return d_ptr->format;
+}
+
+void HttpHandlerAsyncLog::setFormat(HttpHandlerAsyncLog::Format format)
+{
+	d_ptr->format = format;
+}
+
+int HttpHandlerAsyncLog::sampleRate() const
+{
+	return d_ptr->sampleRate;
+}
+
+void HttpHandlerAsyncLog::setSampleRate(int sampleRate)
+{
+	d_ptr->sampleRate = qMax(1, sampleRate);
+	d_ptr->sampleCounter = 0;
+}
+
+int HttpHandlerAsyncLog::slowRequestThreshold() const
+{
+	return d_ptr->slowRequestThreshold;
+}
+
+void HttpHandlerAsyncLog::setSlowRequestThreshold(int milliseconds)
+{
+	d_ptr->slowRequestThreshold = milliseconds;
+}
+
+void HttpHandlerAsyncLog::flush()
+{
+	const size_t target = d_ptr->enqueuePosition.load();
+	QMutexLocker locker(&d_ptr->mutex);
+	while (static_cast<qptrdiff>(d_ptr->writtenPosition.load() - target) < 0)
+	{
+		d_ptr->writerCondition.wakeOne();
+		d_ptr->writtenCondition.wait(&d_ptr->mutex, HttpHandlerAsyncLog::DefaultFlushInterval);
+	}
+}
+
+bool HttpHandlerAsyncLog::handleRequest(Pillow::HttpConnection *connection)
+{
+	QHash<HttpConnection*, bool>::iterator it = d_ptr->sampled.find(connection);
+	if (it == d_ptr->sampled.end())
+	{
+		it = d_ptr->sampled.insert(connection, false);
+		connect(connection, SIGNAL(requestCompleted(Pillow::HttpConnection*)), this, SLOT(requestCompleted(Pillow::HttpConnection*)));
+		connect(connection, SIGNAL(destroyed(QObject*)), this, SLOT(requestDestroyed(QObject*)));
+	}
+	it.value() = d_ptr->sampleRate <= 1 || (d_ptr->sampleCounter++ % d_ptr->sampleRate) == 0;
+	return false;
+}
+
+void HttpHandlerAsyncLog::requestCompleted(Pillow::HttpConnection *connection)
+{
+	QHash<HttpConnection*, bool>::const_iterator it = d_ptr->sampled.constFind(connection);
+	if (it == d_ptr->sampled.constEnd()) return;
+
+	const qint64 elapsed = (connection->timestamp(HttpConnection::ResponseCompleted) - connection->timestamp(HttpConnection::ContentReceived)) / 1000;
+	const int statusCode = connection->responseStatusCode();
+
+	// Requests left out by sampling are still logged when they failed or were slow.
+	if (!it.value() && statusCode < 400 && (d_ptr->slowRequestThreshold <= 0 || elapsed < qint64(d_ptr->slowRequestThreshold) * 1000))
+		return;
+
+	size_t position;
+	HttpLogRecord* record = d_ptr->claim(position);
+	if (record == NULL) return;
+
+	record->timestamp = QDateTime::currentMSecsSinceEpoch();
+	record->elapsed = elapsed;
+	record->contentLength = connection->responseContentLength();
+	record->statusCode = statusCode;
+	record->format = d_ptr->format;
+	record->requestCount = connection->requestCount();
+
+	static const HttpConnection::Timestamp phaseBounds[HttpLogRecord::PhaseCount + 1] =
+		{ HttpConnection::RequestStarted, HttpConnection::HeadersReceived, HttpConnection::ContentReceived, HttpConnection::ResponseStarted, HttpConnection::ResponseCompleted };
+	for (int i = 0; i < HttpLogRecord::PhaseCount; ++i)
+	{
+		const qint64 start = connection->timestamp(phaseBounds[i]), end = connection->timestamp(phaseBounds[i + 1]);
+		record->phases[i] = (start > 0 && end >= start) ? (end - start) / 1000 : -1;
+	}
+
+	const QHostAddress address = connection->remoteAddress();
+	if (address.protocol() == QAbstractSocket::IPv4Protocol)
+	{
+		record->protocol = 4;
+		record->ipv4Address = address.toIPv4Address();
+	}
+	else if (address.protocol() == QAbstractSocket::IPv6Protocol)
+	{
+		record->protocol = 6;
+		record->ipv6Address = address.toIPv6Address();
+	}
+	else
+		record->protocol = 0;
+
+	const QByteArray& method = connection->requestMethod();
+	const QByteArray& uri = connection->requestUri();
+	const QByteArray& version = connection->requestHttpVersion();
+	record->methodLength = qMin<int>(method.size(), HttpLogRecord::MaximumMethodLength);
+	record->uriLength = qMin<int>(uri.size(), HttpLogRecord::MaximumUriLength);
+	record->versionLength = qMin<int>(version.size(), HttpLogRecord::MaximumVersionLength);
+	memcpy(record->method, method.constData(), record->methodLength);
+	memcpy(record->uri, uri.constData(), record->uriLength);
+	memcpy(record->version, version.constData(), record->versionLength);
+
+	d_ptr->publish(position);
+}
+
+void HttpHandlerAsyncLog::requestDestroyed(QObject *connection)
+{
+	d_ptr->sampled.remove(static_cast<HttpConnection*>(connection));
+}
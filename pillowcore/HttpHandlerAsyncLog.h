@@ -0,0 +1,85 @@
+#ifndef PILLOW_HTTPHANDLERASYNCLOG_H
+#define PILLOW_HTTPHANDLERASYNCLOG_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef PILLOW_HTTPHANDLER_H
+#include "HttpHandler.h"
+#endif // PILLOW_HTTPHANDLER_H
+#ifndef QSTRING_H
+#include <QtCore/QString>
+#endif // QSTRING_H
+
+namespace Pillow
+{
+	class HttpHandlerAsyncLogPrivate;
+
+	//
+	// HttpHandlerAsyncLog: a handler that logs completed requests from a background thread.
+	//
+	// Logs the same lines as HttpHandlerLog in LogCompletedRequests mode, but the serving thread only copies a fixed
+	// size record into a lock-free ring buffer. A writer thread formats the records in batches and appends them to
+	// the log file in large writes. When the ring is full, records are dropped and counted rather than blocking
+	// the serving thread; the writer logs how many were lost.
+	//
+	// In JsonFormat, each line is a JSON object with the method, path, status, response bytes, remote address,
+	// the number of requests served on the connection so far and the time spent in each phase of the request.
+	// With a sampleRate of N, only 1 in N requests is logged; requests that fail (status 400 and up) or take
+	// longer than slowRequestThreshold are always logged.
+	//
+
+	class PILLOWCORE_EXPORT HttpHandlerAsyncLog : public HttpHandler
+	{
+		Q_OBJECT
+		Q_PROPERTY(QString fileName READ fileName WRITE setFileName)
+		Q_PROPERTY(Format format READ format WRITE setFormat)
+		Q_PROPERTY(int sampleRate READ sampleRate WRITE setSampleRate)
+		Q_PROPERTY(int slowRequestThreshold READ slowRequestThreshold WRITE setSlowRequestThreshold)
+		Q_ENUMS(Format)
+
+	public:
+		enum { DefaultCapacity = 8192 };     // Records in the ring buffer.
+		enum { DefaultFlushInterval = 100 }; // Milliseconds between writer wake-ups when the log is quiet.
+		enum { DefaultSlowRequestThreshold = 1000 }; // Milliseconds.
+		enum Format { CombinedFormat, JsonFormat };
+
+	public:
+		HttpHandlerAsyncLog(QObject* parent = 0);
+		HttpHandlerAsyncLog(const QString& fileName, QObject* parent = 0);
+		~HttpHandlerAsyncLog(); // Writes out the pending records.
+
+		// The log file, opened in append mode by the writer thread. Logs to stderr when empty.
+		const QString& fileName() const;
+		void setFileName(const QString& fileName);
+
+		int capacity() const;
+		void setCapacity(int records); // Rounded up to a power of two. Pending records are written out first.
+
+		Format format() const;
+		void setFormat(Format format);
+
+		int sampleRate() const; // Log 1 in "sampleRate" successful requests. Defaults to 1, logging all of them.
+		void setSampleRate(int sampleRate);
+
+		int slowRequestThreshold() const; // Milliseconds. Requests at least this slow bypass sampling; 0 disables.
+		void setSlowRequestThreshold(int milliseconds);
+
+		quint64 droppedCount() const;
+
+		void flush(); // Blocks until the records logged so far are written to the file.
+
+	public:
+		virtual bool handleRequest(Pillow::HttpConnection* connection);
+
+	private slots:
+		void requestCompleted(Pillow::HttpConnection* connection);
+		void requestDestroyed(QObject* connection);
+
+	private:
+		Q_DECLARE_PRIVATE(HttpHandlerAsyncLog)
+		HttpHandlerAsyncLogPrivate* d_ptr;
+	};
+}
+
+#endif // PILLOW_HTTPHANDLERASYNCLOG_H
@@ -0,0 +1,404 @@
+#include "HttpHandlerBundle.h"
+#include "HttpConnection.h"
+#include "HttpHelpers.h"
+#include <QtCore/QFile>
+#include <QtCore/QDir>
+#include <QtCore/QDirIterator>
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QVector>
+#include <QtCore/QtEndian>
+#include <QtCore/QDebug>
+#include <string.h>
+#ifdef PILLOW_ZLIB
+#include "private/zlib.h"
+#endif // PILLOW_ZLIB
+using namespace Pillow;
+
+namespace
+{
+	const char bundleMagic[] = "PILLOWBN";
+	enum { HeaderSize = 24, BucketSize = 4, EntrySize = 64 };
+
+	// Entry field offsets.
+	enum
+	{
+		EntryPathHash = 0, EntryPathOffset = 4, EntryPathLength = 8, EntryMimeOffset = 12, EntryMimeLength = 16,
+		EntryEtagOffset = 20, EntryEtagLength = 24, EntryDataOffset = 32, EntryDataLength = 40, EntryGzipOffset = 48, EntryGzipLength = 56
+	};
+
+	inline quint32 hashPath(const char* path, int length)
+	{
+		// 32 bits FNV-1a.
+		quint32 hash = 2166136261u;
+		for (const char* c = path, *cE = path + length; c < cE; ++c)
+		{
+			hash ^= static_cast<uchar>(*c);
+			hash *= 16777619u;
+		}
+		return hash;
+	}
+
+	inline quint32 readUInt32(const uchar* data) { return qFromLittleEndian<quint32>(data); }
+	inline quint64 readUInt64(const uchar* data) { return qFromLittleEndian<quint64>(data); }
+
+	inline void appendUInt32(QByteArray& buffer, quint32 value)
+	{
+		uchar bytes[4]; qToLittleEndian<quint32>(value, bytes);
+		buffer.append(reinterpret_cast<const char*>(bytes), 4);
+	}
+
+	inline void appendUInt64(QByteArray& buffer, quint64 value)
+	{
+		uchar bytes[8]; qToLittleEndian<quint64>(value, bytes);
+		buffer.append(reinterpret_cast<const char*>(bytes), 8);
+	}
+
+	bool acceptsGzip(const QByteArray& acceptEncoding)
+	{
+		int index = acceptEncoding.indexOf("gzip");
+		if (index == -1) return false;
+
+		// Honor an explicit refusal such as "gzip;q=0".
+		int end = acceptEncoding.indexOf(',', index);
+		if (end == -1) end = acceptEncoding.size();
+		QByteArray params = acceptEncoding.mid(index + 4, end - index - 4);
+		params.replace(' ', QByteArray());
+		if (!params.startsWith(";q=0")) return true;
+		for (int i = 4; i < params.size(); ++i)
+			if (params.at(i) != '0' && params.at(i) != '.') return true;
+		return false;
+	}
+
+#ifdef PILLOW_ZLIB
+	QByteArray gzip(const QByteArray& content)
+	{
+		z_stream stream; memset(&stream, 0, sizeof(z_stream));
+		if (deflateInit2(&stream, Z_BEST_COMPRESSION, Z_DEFLATED, 31, 9, Z_DEFAULT_STRATEGY) != Z_OK) // 31: gzip wrapper.
+			return QByteArray();
+
+		QByteArray output; output.resize(deflateBound(&stream, content.size()) + 32);
+		stream.next_in = const_cast<Bytef*>(reinterpret_cast<const Bytef*>(content.constData()));
+		stream.avail_in = content.size();
+		stream.next_out = reinterpret_cast<Bytef*>(output.data());
+		stream.avail_out = output.size();
+
+		int result = deflate(&stream, Z_FINISH);
+		output.resize(stream.total_out);
+		deflateEnd(&stream);
+
+		return result == Z_STREAM_END ? output : QByteArray();
+	}
+#endif // PILLOW_ZLIB
+}
+
+//
+// HttpHandlerBundle
+//
+
+HttpHandlerBundle::HttpHandlerBundle(const QString &bundlePath, QObject *parent)
+	: HttpHandler(parent), _file(NULL), _data(NULL), _size(0), _entryCount(0), _bucketCount(0)
+{
+	setBundlePath(bundlePath);
+}
+
+HttpHandlerBundle::~HttpHandlerBundle()
+{
+	unload();
+}
+
+void HttpHandlerBundle::setBundlePath(const QString &bundlePath)
+{
+	if (_bundlePath == bundlePath) return;
+	_bundlePath = bundlePath;
+	reload();
+	emit changed();
+}
+
+void HttpHandlerBundle::unload()
+{
+	delete _file; // Also unmaps.
+	_file = NULL;
+	_data = NULL;
+	_size = 0;
+	_entryCount = 0;
+	_bucketCount = 0;
+}
+
+bool HttpHandlerBundle::reload()
+{
+	unload();
+	if (_bundlePath.isEmpty()) return false;
+
+	_file = new QFile(_bundlePath);
+	if (!_file->open(QIODevice::ReadOnly))
+	{
+		qWarning() << "HttpHandlerBundle::reload:" << _bundlePath << "could not be opened.";
+		unload();
+		return false;
+	}
+
+	const qint64 size = _file->size();
+	const uchar* data = size >= HeaderSize ? _file->map(0, size) : NULL;
+	bool valid = data != NULL && memcmp(data, bundleMagic, 8) == 0 && readUInt32(data + 8) == HttpBundleWriter::Version;
+
+	const quint32 entryCount = valid ? readUInt32(data + 12) : 0;
+	const quint32 bucketCount = valid ? readUInt32(data + 16) : 0;
+	const quint64 tablesEnd = HeaderSize + quint64(bucketCount) * BucketSize + quint64(entryCount) * EntrySize;
+	valid = valid && bucketCount > entryCount && (bucketCount & (bucketCount - 1)) == 0 && tablesEnd <= quint64(size);
+
+	// Validate all offsets once, so that lookups can trust them.
+	for (quint32 i = 0; valid && i < bucketCount; ++i)
+		valid = readUInt32(data + HeaderSize + i * BucketSize) <= entryCount;
+
+	const uchar* entries = data + HeaderSize + quint64(bucketCount) * BucketSize;
+	for (quint32 i = 0; valid && i < entryCount; ++i)
+	{
+		const uchar* entry = entries + i * EntrySize;
+		const quint64 ranges[][2] =
+		{
+			{ readUInt32(entry + EntryPathOffset), readUInt32(entry + EntryPathLength) },
+			{ readUInt32(entry + EntryMimeOffset), readUInt32(entry + EntryMimeLength) },
+			{ readUInt32(entry + EntryEtagOffset), readUInt32(entry + EntryEtagLength) },
+			{ readUInt64(entry + EntryDataOffset), readUInt64(entry + EntryDataLength) },
+			{ readUInt64(entry + EntryGzipOffset), readUInt64(entry + EntryGzipLength) }
+		};
+		for (int r = 0; valid && r < 5; ++r)
+			valid = ranges[r][0] <= quint64(size) && ranges[r][1] <= quint64(size) - ranges[r][0] && ranges[r][1] < 0x7fffffff;
+	}
+
+	if (!valid)
+	{
+		qWarning() << "HttpHandlerBundle::reload:" << _bundlePath << "is not a valid bundle.";
+		unload();
+		return false;
+	}
+
+	_data = data;
+	_size = size;
+	_entryCount = entryCount;
+	_bucketCount = bucketCount;
+	return true;
+}
+
+const uchar* HttpHandlerBundle::findEntry(const char *path, int pathLength) const
+{
+	const quint32 hash = hashPath(path, pathLength);
+	const quint32 mask = _bucketCount - 1;
+	const uchar* buckets = _data + HeaderSize;
+	const uchar* entries = buckets + _bucketCount * BucketSize;
+
+	for (quint32 bucket = hash & mask, probes = 0; probes < _bucketCount; bucket = (bucket + 1) & mask, ++probes)
+	{
+		const quint32 index = readUInt32(buckets + bucket * BucketSize);
+		if (index == 0) return NULL;
+
+		const uchar* entry = entries + (index - 1) * EntrySize;
+		if (readUInt32(entry + EntryPathHash) == hash && readUInt32(entry + EntryPathLength) == quint32(pathLength)
+				&& memcmp(_data + readUInt32(entry + EntryPathOffset), path, pathLength) == 0)
+			return entry;
+	}
+
+	return NULL;
+}
+
+bool HttpHandlerBundle::handleRequest(Pillow::HttpConnection *connection)
+{
+	if (_data == NULL) return false;
+
+	// Bundled files are read only: other methods are left to the next handlers.
+	const QByteArray& method = connection->requestMethod();
+	if (method != "GET" && method != "HEAD") return false;
+
+	const QByteArray& requestPath = connection->requestPath();
+	const uchar* entry;
+	if (requestPath.indexOf('%') == -1)
+		entry = findEntry(requestPath.constData(), requestPath.size());
+	else
+	{
+		const QByteArray decodedPath = QByteArray::fromPercentEncoding(requestPath);
+		entry = findEntry(decodedPath.constData(), decodedPath.size());
+	}
+	if (entry == NULL) return false;
+
+	QByteArray etag = QByteArray::fromRawData(reinterpret_cast<const char*>(_data + readUInt32(entry + EntryEtagOffset)), readUInt32(entry + EntryEtagLength));
+	quint64 dataOffset = readUInt64(entry + EntryDataOffset);
+	quint64 dataLength = readUInt64(entry + EntryDataLength);
+	const quint64 gzipLength = readUInt64(entry + EntryGzipLength);
+	const bool sendGzip = gzipLength > 0 && acceptsGzip(connection->requestHeaderValue("Accept-Encoding"));
+
+	if (sendGzip)
+	{
+		// Each representation has its own ETag.
+		etag = etag + "-gzip";
+		dataOffset = readUInt64(entry + EntryGzipOffset);
+		dataLength = gzipLength;
+	}
+
+	if (connection->requestHeaderValue("If-None-Match") == etag)
+	{
+		connection->writeResponse(304); // The client's cached file was not modified.
+		return true;
+	}
+
+	HttpHeaderCollection headers; headers.reserve(5);
+	headers << HttpHeader("Content-Type", QByteArray::fromRawData(reinterpret_cast<const char*>(_data + readUInt32(entry + EntryMimeOffset)), readUInt32(entry + EntryMimeLength)));
+	headers << HttpHeader("ETag", etag);
+	if (gzipLength > 0) headers << HttpHeader("Vary", "Accept-Encoding");
+	if (sendGzip) headers << HttpHeader("Content-Encoding", "gzip");
+
+	// For HEAD requests, writeResponse() sends the Content-Length of the content but not the content itself.
+	connection->writeResponse(200, headers, QByteArray::fromRawData(reinterpret_cast<const char*>(_data + dataOffset), dataLength));
+	return true;
+}
+
+//
+// HttpBundleWriter
+//
+
+HttpBundleWriter::HttpBundleWriter()
+	: _gzipEnabled(true)
+{
+}
+
+void HttpBundleWriter::addFile(const QByteArray &path, const QByteArray &content, const QByteArray &mimeType)
+{
+	Entry& entry = _entries[path];
+	entry.content = content;
+	entry.mimeType = mimeType.isEmpty() ? QByteArray(HttpMimeHelper::getMimeTypeForFilename(QString::fromUtf8(path))) : mimeType;
+}
+
+bool HttpBundleWriter::addDirectory(const QString &directory, const QByteArray &pathPrefix)
+{
+	QDir dir(directory);
+	if (!dir.exists())
+	{
+		qWarning() << "HttpBundleWriter::addDirectory:" << directory << "does not exist.";
+		return false;
+	}
+
+	QByteArray prefix = pathPrefix;
+	if (!prefix.endsWith('/')) prefix.append('/');
+
+	QDirIterator it(dir.absolutePath(), QDir::Files | QDir::Readable, QDirIterator::Subdirectories | QDirIterator::FollowSymlinks);
+	while (it.hasNext())
+	{
+		const QString filePath = it.next();
+		QFile file(filePath);
+		if (!file.open(QIODevice::ReadOnly))
+		{
+			qWarning() << "HttpBundleWriter::addDirectory: could not read" << filePath;
+			return false;
+		}
+		addFile(prefix + dir.relativeFilePath(filePath).toUtf8(), file.readAll());
+	}
+
+	return true;
+}
+
+bool HttpBundleWriter::write(const QString &fileName) const
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+	{
+		qWarning() << "HttpBundleWriter::write: could not open" << fileName << "for writing.";
+		return false;
+	}
+	return write(&file);
+}
+
+bool HttpBundleWriter::write(QIODevice *device) const
+{
+	const quint32 entryCount = _entries.size();
+	quint32 bucketCount = 8;
+	while (bucketCount < entryCount * 2) bucketCount *= 2; // Keep the load factor at or under 50%.
+
+	const quint64 stringsOffset = HeaderSize + quint64(bucketCount) * BucketSize + quint64(entryCount) * EntrySize;
+	QByteArray strings;
+	QVector<QByteArray> gzipVariants; gzipVariants.reserve(entryCount);
+	QVector<quint32> hashes; hashes.reserve(entryCount);
+	QVector<quint32> buckets(bucketCount, 0);
+
+	// First pass: hash table, strings and gzip variants.
+	quint32 index = 0;
+	for (QMap<QByteArray, Entry>::const_iterator it = _entries.constBegin(); it != _entries.constEnd(); ++it, ++index)
+	{
+		const quint32 hash = hashPath(it.key().constData(), it.key().size());
+		hashes << hash;
+		quint32 bucket = hash & (bucketCount - 1);
+		while (buckets[bucket] != 0) bucket = (bucket + 1) & (bucketCount - 1);
+		buckets[bucket] = index + 1;
+
+		QByteArray gzipped;
+#ifdef PILLOW_ZLIB
+		if (_gzipEnabled && !it.value().content.isEmpty())
+		{
+			gzipped = gzip(it.value().content);
+			if (gzipped.size() >= it.value().content.size() * 9 / 10) gzipped.clear(); // Not worth it.
+		}
+#endif // PILLOW_ZLIB
+		gzipVariants << gzipped;
+	}
+
+	QByteArray buffer; buffer.reserve(stringsOffset);
+	buffer.append(bundleMagic, 8);
+	appendUInt32(buffer, Version);
+	appendUInt32(buffer, entryCount);
+	appendUInt32(buffer, bucketCount);
+	appendUInt32(buffer, 0);
+	for (quint32 i = 0; i < bucketCount; ++i)
+		appendUInt32(buffer, buckets.at(i));
+
+	// Second pass: entries. Strings come right after them, followed by all the data.
+	index = 0;
+	quint64 stringsSize = 0;
+	for (QMap<QByteArray, Entry>::const_iterator it = _entries.constBegin(); it != _entries.constEnd(); ++it)
+		stringsSize += it.key().size() + it.value().mimeType.size() + 32; // 32: MD5 hex digest.
+
+	quint64 dataOffset = stringsOffset + stringsSize;
+	if (stringsOffset + stringsSize > 0x7fffffff)
+	{
+		qWarning() << "HttpBundleWriter::write: too many entries.";
+		return false;
+	}
+
+	for (QMap<QByteArray, Entry>::const_iterator it = _entries.constBegin(); it != _entries.constEnd(); ++it, ++index)
+	{
+		const Entry& entry = it.value();
+		QCryptographicHash md5sum(QCryptographicHash::Md5); md5sum.addData(entry.content);
+		const QByteArray etag = md5sum.result().toHex();
+		const QByteArray& gzipped = gzipVariants.at(index);
+
+		appendUInt32(buffer, hashes.at(index));
+		appendUInt32(buffer, stringsOffset + strings.size()); appendUInt32(buffer, it.key().size());
+		strings.append(it.key());
+		appendUInt32(buffer, stringsOffset + strings.size()); appendUInt32(buffer, entry.mimeType.size());
+		strings.append(entry.mimeType);
+		appendUInt32(buffer, stringsOffset + strings.size()); appendUInt32(buffer, etag.size());
+		strings.append(etag);
+		appendUInt32(buffer, 0);
+
+		appendUInt64(buffer, dataOffset); appendUInt64(buffer, entry.content.size());
+		dataOffset += entry.content.size();
+		appendUInt64(buffer, gzipped.isEmpty() ? 0 : dataOffset); appendUInt64(buffer, gzipped.size());
+		dataOffset += gzipped.size();
+	}
+
+	if (device->write(buffer) != buffer.size() || device->write(strings) != strings.size())
+	{
+		qWarning() << "HttpBundleWriter::write: failed to write bundle:" << device->errorString();
+		return false;
+	}
+
+	index = 0;
+	for (QMap<QByteArray, Entry>::const_iterator it = _entries.constBegin(); it != _entries.constEnd(); ++it, ++index)
+	{
+		const QByteArray& gzipped = gzipVariants.at(index);
+		if (device->write(it.value().content) != it.value().content.size() || device->write(gzipped) != gzipped.size())
+		{
+			qWarning() << "HttpBundleWriter::write: failed to write bundle:" << device->errorString();
+			return false;
+		}
+	}
+
+	return true;
+}
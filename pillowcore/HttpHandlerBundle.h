@@ -0,0 +1,100 @@
+#ifndef PILLOW_HTTPHANDLERBUNDLE_H
+#define PILLOW_HTTPHANDLERBUNDLE_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef PILLOW_HTTPHANDLER_H
+#include "HttpHandler.h"
+#endif // PILLOW_HTTPHANDLER_H
+#ifndef QMAP_H
+#include <QtCore/QMap>
+#endif // QMAP_H
+
+class QFile;
+class QIODevice;
+
+namespace Pillow
+{
+	//
+	// HttpHandlerBundle: a handler that serves static files packed in a single bundle file (see HttpBundleWriter).
+	//
+	// The bundle is memory mapped once, and each request is answered with a hash table probe and a write
+	// straight out of the mapped region; ETags, MIME types and optional gzip variants are precomputed.
+	// Bundles are meant for many small assets: each response is written out in one go.
+	//
+
+	class PILLOWCORE_EXPORT HttpHandlerBundle : public HttpHandler
+	{
+		Q_OBJECT
+		Q_PROPERTY(QString bundlePath READ bundlePath WRITE setBundlePath NOTIFY changed)
+
+		QString _bundlePath;
+		QFile* _file;
+		const uchar* _data;
+		qint64 _size;
+		quint32 _entryCount;
+		quint32 _bucketCount;
+
+	public:
+		HttpHandlerBundle(const QString& bundlePath = QString(), QObject* parent = 0);
+		~HttpHandlerBundle();
+
+		const QString& bundlePath() const { return _bundlePath; }
+		bool isLoaded() const { return _data != NULL; }
+		int entryCount() const { return _entryCount; }
+
+	public:
+		void setBundlePath(const QString& bundlePath);
+		bool reload(); // Maps the bundle again, for example after it was replaced on disk.
+
+		virtual bool handleRequest(Pillow::HttpConnection* connection);
+
+	signals:
+		void changed();
+
+	private:
+		void unload();
+		const uchar* findEntry(const char* path, int pathLength) const;
+	};
+
+	//
+	// HttpBundleWriter: builds bundle files for HttpHandlerBundle.
+	//
+	// Bundle layout (all integers little endian):
+	//   header:  "PILLOWBN", quint32 version, quint32 entry count, quint32 bucket count, quint32 reserved
+	//   buckets: bucket count x quint32, entry index + 1 (0 for empty buckets), open addressing on the FNV-1a path hash
+	//   entries: entry count x 64 bytes: quint32 path hash, path offset, path length, MIME offset, MIME length,
+	//            ETag offset, ETag length, reserved; quint64 data offset, data length, gzip offset, gzip length
+	//   strings and file data, referenced by the offsets above (relative to the start of the bundle).
+	//
+
+	class PILLOWCORE_EXPORT HttpBundleWriter
+	{
+	public:
+		HttpBundleWriter();
+
+		enum { Version = 1 };
+
+		// Gzip variants are only produced when Pillow is built with zlib support, and only kept when they are smaller.
+		bool gzipEnabled() const { return _gzipEnabled; }
+		void setGzipEnabled(bool enabled) { _gzipEnabled = enabled; }
+
+		int count() const { return _entries.size(); }
+
+		// Paths are matched against the percent-decoded request path, such as "/css/site.css".
+		// The MIME type is guessed from the path when not specified.
+		void addFile(const QByteArray& path, const QByteArray& content, const QByteArray& mimeType = QByteArray());
+		bool addDirectory(const QString& directory, const QByteArray& pathPrefix = "/");
+
+		bool write(QIODevice* device) const;
+		bool write(const QString& fileName) const;
+
+	private:
+		struct Entry { QByteArray mimeType, content; };
+		QMap<QByteArray, Entry> _entries;
+		bool _gzipEnabled;
+	};
+}
+
+#endif // PILLOW_HTTPHANDLERBUNDLE_H
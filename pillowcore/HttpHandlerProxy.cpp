@@ -1,5 +1,7 @@
 #include "HttpHandlerProxy.h"
 #include "HttpConnection.h"
+#include "HttpClient.h"
+#include "HttpClientPool.h"
 #include <QtCore/QBuffer>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkCookieJar>
@@ -9,13 +11,13 @@
 //
 
 Pillow::HttpHandlerProxy::HttpHandlerProxy(QObject *parent)
-	: Pillow::HttpHandler(parent)
+	: Pillow::HttpHandler(parent), _pooledNetworkAccessManager(0)
 {
 	_networkAccessManager = new ElasticNetworkAccessManager(this);
 }
 
 Pillow::HttpHandlerProxy::HttpHandlerProxy(const QUrl& proxiedUrl, QObject *parent)
-	: Pillow::HttpHandler(parent), _proxiedUrl(proxiedUrl)
+	: Pillow::HttpHandler(parent), _proxiedUrl(proxiedUrl), _pooledNetworkAccessManager(0)
 {
 	_networkAccessManager = new ElasticNetworkAccessManager(this);
 }
@@ -26,6 +28,25 @@ void Pillow::HttpHandlerProxy::setProxiedUrl(const QUrl &proxiedUrl)
 	_proxiedUrl = proxiedUrl;
 }
 
+Pillow::HttpClientPool *Pillow::HttpHandlerProxy::clientPool() const
+{
+	return _pooledNetworkAccessManager ? _pooledNetworkAccessManager->clientPool() : 0;
+}
+
+void Pillow::HttpHandlerProxy::setClientPool(Pillow::HttpClientPool *pool)
+{
+	if (pool == 0)
+	{
+		delete _pooledNetworkAccessManager;
+		_pooledNetworkAccessManager = 0;
+		return;
+	}
+
+	if (_pooledNetworkAccessManager == 0)
+		_pooledNetworkAccessManager = new Pillow::NetworkAccessManager(this);
+	_pooledNetworkAccessManager->setClientPool(pool);
+}
+
 bool Pillow::HttpHandlerProxy::handleRequest(Pillow::HttpConnection *request)
 {
 	if (_proxiedUrl.isEmpty()) return false;
@@ -49,11 +70,17 @@ QNetworkReply * Pillow::HttpHandlerProxy::createProxiedReply(Pillow::HttpConnect
 	QBuffer* requestContentBuffer = NULL;
 	if (request->requestContent().size() > 0)
 	{
-		requestContentBuffer = new QBuffer(&(const_cast<QByteArray&>(request->requestContent())));
+		// The request content points into the connection's request buffer, which is reused once the request completes,
+		// while the proxied request reads it as it uploads: give it a copy.
+		const QByteArray& requestContent = request->requestContent();
+		requestContentBuffer = new QBuffer();
+		requestContentBuffer->setData(requestContent.constData(), requestContent.size());
 		requestContentBuffer->open(QIODevice::ReadOnly);
 	}
 
-	QNetworkReply* proxiedReply = _networkAccessManager->sendCustomRequest(proxiedRequest, request->requestMethod(), requestContentBuffer);
+	QNetworkAccessManager* networkAccessManager = _networkAccessManager;
+	if (_pooledNetworkAccessManager) networkAccessManager = _pooledNetworkAccessManager;
+	QNetworkReply* proxiedReply = networkAccessManager->sendCustomRequest(proxiedRequest, request->requestMethod(), requestContentBuffer);
 
 	if (requestContentBuffer) requestContentBuffer->setParent(proxiedReply);
 
@@ -99,7 +126,10 @@ void Pillow::HttpHandlerProxyPipe::teardown()
 	{
 		disconnect(_proxiedReply, NULL, this, NULL);
 		if (qobject_cast<QNetworkReply*>(_proxiedReply))
+		{
+			_proxiedReply->abort(); // Stop uploading and downloading now rather than when the reply gets deleted.
 			_proxiedReply->deleteLater();
+		}
 		_proxiedReply = NULL;
 	}
 
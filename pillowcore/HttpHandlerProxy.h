@@ -21,6 +21,8 @@ namespace Pillow
 {
 	class ElasticNetworkAccessManager;
 	class HttpHandlerProxyPipe;
+	class HttpClientPool;
+	class NetworkAccessManager;
 
 	class PILLOWCORE_EXPORT HttpHandlerProxy : public Pillow::HttpHandler
 	{
@@ -29,6 +31,7 @@ namespace Pillow
 
 	protected:
 		ElasticNetworkAccessManager* _networkAccessManager;
+		Pillow::NetworkAccessManager* _pooledNetworkAccessManager;
 
 	public:
 		HttpHandlerProxy(QObject *parent = 0);
@@ -39,6 +42,11 @@ namespace Pillow
 
 		inline ElasticNetworkAccessManager *networkAccessManager() const { return _networkAccessManager; }
 
+		// When set, http requests are proxied with Pillow::HttpClient instances leased from "pool" instead of
+		// networkAccessManager(). Not owned. Set to 0 to go back to networkAccessManager().
+		Pillow::HttpClientPool* clientPool() const;
+		void setClientPool(Pillow::HttpClientPool* pool);
+
 	protected:
 		virtual QNetworkReply* createProxiedReply(Pillow::HttpConnection* request, QNetworkRequest proxiedRequest);
 		virtual Pillow::HttpHandlerProxyPipe* createPipe(Pillow::HttpConnection* request, QNetworkReply* proxiedReply);
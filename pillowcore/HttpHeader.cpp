@@ -1,5 +1,6 @@
 #include "HttpHeader.h"
 #include "ByteArrayHelpers.h"
+#include <string.h>
 
 namespace
 {
@@ -8,6 +9,63 @@ namespace
 		static QByteArray null;
 		return null;
 	}
+
+	// Must follow the order of Pillow::HttpKnownHeaders::Field.
+	const char* const knownHeaderNames[Pillow::HttpKnownHeaders::Count] =
+	{
+		"accept", "accept-charset", "accept-encoding", "accept-language", "authorization", "cache-control", "connection",
+		"content-encoding", "content-length", "content-type", "cookie", "expect", "host", "if-match", "if-modified-since", "if-none-match",
+		"if-range", "if-unmodified-since", "origin", "pragma", "range", "referer", "transfer-encoding", "upgrade", "user-agent",
+		"x-forwarded-for", "x-real-ip", "x-requested-with"
+	};
+
+	enum { KnownHeaderMinLength = 4, KnownHeaderMaxLength = 19, KnownHeaderSlotCount = 64 };
+
+	// Perfect hash over the known header names: the length and the lowercased first and last characters
+	// are enough to tell them all apart. The constants were picked by search; the table construction below
+	// asserts that they remain collision free when names are added.
+	inline uint knownHeaderSlot(const char* fieldName, int fieldNameLength)
+	{
+		return (uint(fieldNameLength) * 25 + uint(uchar(fieldName[0]) | 0x20) * 14 + uint(uchar(fieldName[fieldNameLength - 1]) | 0x20) * 4) & (KnownHeaderSlotCount - 1);
+	}
+
+	struct KnownHeaderTable
+	{
+		signed char fields[KnownHeaderSlotCount];
+		signed char lengths[Pillow::HttpKnownHeaders::Count];
+
+		KnownHeaderTable()
+		{
+			memset(fields, -1, sizeof(fields));
+			for (int i = 0; i < Pillow::HttpKnownHeaders::Count; ++i)
+			{
+				lengths[i] = qstrlen(knownHeaderNames[i]);
+				Q_ASSERT(lengths[i] >= KnownHeaderMinLength && lengths[i] <= KnownHeaderMaxLength);
+				uint slot = knownHeaderSlot(knownHeaderNames[i], lengths[i]);
+				Q_ASSERT_X(fields[slot] == -1, "KnownHeaderTable", "known header names hash collision");
+				fields[slot] = i;
+			}
+		}
+	};
+
+	const KnownHeaderTable knownHeaderTable;
+}
+
+Pillow::HttpKnownHeaders::Field Pillow::HttpKnownHeaders::classify(const char *fieldName, int fieldNameLength)
+{
+	if (fieldNameLength < KnownHeaderMinLength || fieldNameLength > KnownHeaderMaxLength) return Unknown;
+
+	int field = knownHeaderTable.fields[knownHeaderSlot(fieldName, fieldNameLength)];
+	if (field < 0 || knownHeaderTable.lengths[field] != fieldNameLength) return Unknown;
+
+	if (!Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(fieldName, fieldNameLength, knownHeaderNames[field], fieldNameLength)) return Unknown;
+	return static_cast<Field>(field);
+}
+
+const char* Pillow::HttpKnownHeaders::fieldName(Field field)
+{
+	if (field < 0 || field >= Count) return NULL;
+	return knownHeaderNames[field];
 }
 
 void Pillow::HttpHeader::setFromRawHeader(const char *rawHeader, int len)
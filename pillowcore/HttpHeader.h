@@ -98,6 +98,32 @@ namespace Pillow
 		inline operator const QVector<QPair<QByteArray, QByteArray> > &() const { return *reinterpret_cast<const QVector<QPair<QByteArray, QByteArray> >*>(this); }
 	};
 
+	//
+	// Pillow::HttpKnownHeaders
+	//
+	// Well known header field names. The request parser classifies each incoming header once, so that
+	// looking up a well known header is a constant time operation instead of a scan of all headers.
+	//
+	namespace HttpKnownHeaders
+	{
+		enum Field
+		{
+			Unknown = -1,
+			Accept, AcceptCharset, AcceptEncoding, AcceptLanguage, Authorization, CacheControl, Connection,
+			ContentEncoding, ContentLength, ContentType, Cookie, Expect, Host, IfMatch, IfModifiedSince, IfNoneMatch,
+			IfRange, IfUnmodifiedSince, Origin, Pragma, Range, Referer, TransferEncoding, Upgrade, UserAgent,
+			XForwardedFor, XRealIp, XRequestedWith,
+			Count
+		};
+
+		// Returns the field matching the (case insensitive) field name, or Unknown.
+		PILLOWCORE_EXPORT Field classify(const char* fieldName, int fieldNameLength);
+		inline Field classify(const QByteArray& fieldName) { return classify(fieldName.constData(), fieldName.size()); }
+
+		// Returns the lowercase field name of a known field.
+		PILLOWCORE_EXPORT const char* fieldName(Field field);
+	}
+
 	inline bool operator==(const Pillow::HttpHeader &p1, const QPair<QByteArray, QByteArray> &p2) { return p1.first == p2.first && p1.second == p2.second; }
 	inline bool operator==(const Pillow::HttpHeader &p1, const Pillow::HttpHeader &p2) { return p1.first == p2.first && p1.second == p2.second; }
 
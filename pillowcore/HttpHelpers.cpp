@@ -101,5 +101,82 @@ namespace Pillow
 				return httpDate;
 			}
 		}
+
+		namespace Ranges
+		{
+			static inline const char* skipSpaces(const char* c, const char* end)
+			{
+				while (c < end && (*c == ' ' || *c == '\t')) ++c;
+				return c;
+			}
+
+			static inline const char* parsePosition(const char* c, const char* end, qint64* position)
+			{
+				const char* start = c;
+				qint64 value = 0;
+				while (c < end && *c >= '0' && *c <= '9' && c - start < 18)
+					value = value * 10 + (*c++ - '0');
+				if (c == start || (c < end && *c >= '0' && *c <= '9')) return NULL; // No digits or too many digits.
+				*position = value;
+				return c;
+			}
+
+			bool parseByteRanges(const QByteArray& rangeHeader, qint64 entitySize, QVector<ByteRange>* ranges)
+			{
+				ranges->clear();
+
+				const char* c = rangeHeader.constData();
+				const char* end = c + rangeHeader.size();
+
+				c = skipSpaces(c, end);
+				if (end - c < 5 || !Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(c, 5, "bytes", 5)) return false;
+				c = skipSpaces(c + 5, end);
+				if (c == end || *c != '=') return false;
+				++c;
+
+				int specCount = 0;
+				while (c < end)
+				{
+					c = skipSpaces(c, end);
+					if (c == end) break;
+					if (*c == ',') { ++c; continue; } // Empty list elements are allowed.
+					if (++specCount > MaximumRangeCount) return false;
+
+					qint64 first = -1, last = -1;
+					if (*c == '-')
+					{
+						// Suffix range: the last N bytes of the entity.
+						qint64 suffixLength;
+						if ((c = parsePosition(c + 1, end, &suffixLength)) == NULL) return false;
+						if (suffixLength > 0 && entitySize > 0)
+						{
+							first = qMax(Q_INT64_C(0), entitySize - suffixLength);
+							last = entitySize - 1;
+						}
+					}
+					else
+					{
+						if ((c = parsePosition(c, end, &first)) == NULL) return false;
+						if (c == end || *c != '-') return false;
+						++c;
+						if (c < end && *c >= '0' && *c <= '9')
+						{
+							if ((c = parsePosition(c, end, &last)) == NULL) return false;
+							if (last < first) return false;
+						}
+						if (first >= entitySize) first = -1; // Unsatisfiable.
+						else if (last < 0 || last >= entitySize) last = entitySize - 1;
+					}
+
+					if (first >= 0)
+						ranges->append(ByteRange(first, last));
+
+					c = skipSpaces(c, end);
+					if (c < end && *c++ != ',') return false;
+				}
+
+				return specCount > 0;
+			}
+		}
 	}
 }
@@ -13,6 +13,12 @@
 #ifndef QDATETIME_H
 #include <QDateTime>
 #endif // QDATETIME_H
+#ifndef QVECTOR_H
+#include <QVector>
+#endif // QVECTOR_H
+#ifndef QPAIR_H
+#include <QPair>
+#endif // QPAIR_H
 
 namespace Pillow
 {
@@ -33,6 +39,17 @@ namespace Pillow
 		{
 			PILLOWCORE_EXPORT QByteArray getHttpDate(const QDateTime& dateTime = QDateTime::currentDateTime());
 		}
+
+		namespace Ranges
+		{
+			typedef QPair<qint64, qint64> ByteRange; // First and last byte positions, inclusive.
+			enum { MaximumRangeCount = 16 };
+
+			// Parses a "bytes=..." Range header value against an entity of the given size. Returns false if the
+			// header is malformed or otherwise not worth honoring (it should then be ignored and the full entity sent).
+			// Unsatisfiable ranges are dropped, so returning true with no ranges means a 416 response is in order.
+			PILLOWCORE_EXPORT bool parseByteRanges(const QByteArray& rangeHeader, qint64 entitySize, QVector<ByteRange>* ranges);
+		}
 	}
 }
 
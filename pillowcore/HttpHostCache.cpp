@@ -0,0 +1,267 @@
+#include "HttpHostCache.h"
+#include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QThread>
+#include <QtCore/QDebug>
+#include <QtNetwork/QHostInfo>
+using namespace Pillow;
+
+namespace Pillow
+{
+	//
+	// HttpHostCachePrivate
+	//
+
+	struct HttpHostEntry
+	{
+		QList<QHostAddress> addresses; // Empty for names that did not resolve.
+		qint64 expiresAt;              // On the cache's clock.
+		qint64 refreshAt;
+		uint next;                     // The address the next lookup starts with.
+		bool lookingUp;
+
+		HttpHostEntry() : expiresAt(0), refreshAt(0), next(0), lookingUp(false) {}
+
+		QList<QHostAddress> rotatedAddresses()
+		{
+			const int first = int(next++ % uint(addresses.size()));
+			if (first == 0) return addresses;
+			return addresses.mid(first) + addresses.mid(0, first);
+		}
+	};
+
+	class HttpHostCachePrivate
+	{
+	public:
+		HttpHostCache* q_ptr;
+		mutable QMutex mutex;
+		QElapsedTimer clock;
+		int timeToLive, negativeTimeToLive;
+		QHash<QString, HttpHostEntry> entries;
+		QHash<QString, HttpHostEntry> overrides;
+		quint64 lookupCount;
+
+	public:
+		HttpHostCachePrivate(HttpHostCache* q)
+			: q_ptr(q), timeToLive(HttpHostCache::DefaultTimeToLive), negativeTimeToLive(HttpHostCache::DefaultNegativeTimeToLive), lookupCount(0)
+		{
+			clock.start();
+		}
+
+		// Called with the mutex locked. The lookup itself starts from the cache's thread.
+		void scheduleLookup(const QString& hostName, HttpHostEntry& entry)
+		{
+			entry.lookingUp = true;
+			++lookupCount;
+			QMetaObject::invokeMethod(q_ptr, "startLookup", Qt::QueuedConnection, Q_ARG(QString, hostName));
+		}
+
+		void pruneExpiredEntries(qint64 now)
+		{
+			QHash<QString, HttpHostEntry>::Iterator it = entries.begin();
+			while (it != entries.end())
+			{
+				if (it.value().expiresAt <= now && !it.value().lookingUp)
+					it = entries.erase(it);
+				else
+					++it;
+			}
+		}
+	};
+}
+
+//
+// Pillow::HttpHostCache
+//
+
+namespace
+{
+	class GlobalHostCache : public Pillow::HttpHostCache
+	{
+	public:
+		GlobalHostCache()
+		{
+			// Lookups need an event loop that outlives the threads using the cache.
+			if (QCoreApplication::instance() && thread() != QCoreApplication::instance()->thread())
+				moveToThread(QCoreApplication::instance()->thread());
+		}
+	};
+
+	Q_GLOBAL_STATIC(GlobalHostCache, globalHostCache)
+}
+
+HttpHostCache::HttpHostCache(QObject *parent)
+	: QObject(parent), d_ptr(new HttpHostCachePrivate(this))
+{
+}
+
+HttpHostCache::~HttpHostCache()
+{
+	delete d_ptr;
+}
+
+HttpHostCache *HttpHostCache::instance()
+{
+	return globalHostCache();
+}
+
+int HttpHostCache::timeToLive() const
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	return d_ptr->timeToLive;
+}
+
+void HttpHostCache::setTimeToLive(int milliseconds)
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	d_ptr->timeToLive = qMax(0, milliseconds);
+}
+
+int HttpHostCache::negativeTimeToLive() const
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	return d_ptr->negativeTimeToLive;
+}
+
+void HttpHostCache::setNegativeTimeToLive(int milliseconds)
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	d_ptr->negativeTimeToLive = qMax(0, milliseconds);
+}
+
+HttpHostCache::Status HttpHostCache::lookup(const QString &hostName, QList<QHostAddress> *addresses)
+{
+	Q_D(HttpHostCache);
+	const QString name = hostName.toLower();
+	QMutexLocker locker(&d->mutex);
+
+	QHash<QString, HttpHostEntry>::Iterator overrideIt = d->overrides.find(name);
+	if (overrideIt != d->overrides.end())
+	{
+		if (overrideIt.value().addresses.isEmpty()) return NotFound;
+		if (addresses) *addresses = overrideIt.value().rotatedAddresses();
+		return Resolved;
+	}
+
+	HttpHostEntry& entry = d->entries[name];
+	const qint64 now = d->clock.elapsed();
+
+	if (entry.expiresAt > now)
+	{
+		if (entry.addresses.isEmpty()) return NotFound;
+		if (now >= entry.refreshAt && !entry.lookingUp)
+			d->scheduleLookup(name, entry); // Keep serving the cached addresses meanwhile.
+		if (addresses) *addresses = entry.rotatedAddresses();
+		return Resolved;
+	}
+
+	// Expired or never resolved: everybody asking waits on the same lookup.
+	if (!entry.lookingUp)
+		d->scheduleLookup(name, entry);
+	return LookupPending;
+}
+
+void HttpHostCache::setOverride(const QString &hostName, const QList<QHostAddress> &addresses)
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	d_ptr->overrides[hostName.toLower()].addresses = addresses;
+}
+
+void HttpHostCache::removeOverride(const QString &hostName)
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	d_ptr->overrides.remove(hostName.toLower());
+}
+
+void HttpHostCache::clearOverrides()
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	d_ptr->overrides.clear();
+}
+
+bool HttpHostCache::loadHostsFile(const QString &fileName)
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly))
+	{
+		qWarning() << "Pillow::HttpHostCache::loadHostsFile: could not open" << fileName << ":" << file.errorString();
+		return false;
+	}
+
+	QHash<QString, QList<QHostAddress> > loaded;
+	while (!file.atEnd())
+	{
+		QByteArray line = file.readLine();
+		const int commentIndex = line.indexOf('#');
+		if (commentIndex >= 0) line.truncate(commentIndex);
+
+		// "address name [aliases...]"
+		const QList<QByteArray> fields = line.simplified().split(' ');
+		if (fields.size() < 2) continue;
+
+		QHostAddress address;
+		if (!address.setAddress(QString::fromLatin1(fields.first()))) continue;
+		for (int i = 1; i < fields.size(); ++i)
+			loaded[QString::fromLatin1(fields.at(i)).toLower()] << address;
+	}
+
+	QMutexLocker locker(&d_ptr->mutex);
+	for (QHash<QString, QList<QHostAddress> >::ConstIterator it = loaded.constBegin(), itE = loaded.constEnd(); it != itE; ++it)
+		d_ptr->overrides[it.key()].addresses = it.value();
+	return true;
+}
+
+void HttpHostCache::clear()
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	d_ptr->entries.clear();
+}
+
+quint64 HttpHostCache::lookupCount() const
+{
+	QMutexLocker locker(&d_ptr->mutex);
+	return d_ptr->lookupCount;
+}
+
+void HttpHostCache::startLookup(const QString &hostName)
+{
+	QHostInfo::lookupHost(hostName, this, SLOT(hostInfo_lookedUp(QHostInfo)));
+}
+
+void HttpHostCache::hostInfo_lookedUp(const QHostInfo &hostInfo)
+{
+	Q_D(HttpHostCache);
+	const QString name = hostInfo.hostName().toLower();
+	{
+		QMutexLocker locker(&d->mutex);
+		const qint64 now = d->clock.elapsed();
+		HttpHostEntry& entry = d->entries[name];
+		entry.lookingUp = false;
+
+		if (hostInfo.error() == QHostInfo::NoError && !hostInfo.addresses().isEmpty())
+		{
+			entry.addresses = hostInfo.addresses();
+			entry.expiresAt = now + d->timeToLive;
+			entry.refreshAt = now + d->timeToLive - d->timeToLive / 4;
+		}
+		else if (hostInfo.error() != QHostInfo::HostNotFound && !entry.addresses.isEmpty())
+		{
+			// The resolver is having trouble: better the addresses we had than none at all.
+			entry.expiresAt = entry.refreshAt = now + d->negativeTimeToLive;
+		}
+		else
+		{
+			entry.addresses.clear();
+			entry.expiresAt = entry.refreshAt = now + d->negativeTimeToLive;
+		}
+
+		if (d->entries.size() > MaximumEntries)
+			d->pruneExpiredEntries(now);
+	}
+
+	emit hostResolved(name);
+}
@@ -0,0 +1,95 @@
+#ifndef PILLOW_HTTPHOSTCACHE_H
+#define PILLOW_HTTPHOSTCACHE_H
+
+#ifndef PILLOW_PILLOWCORE_H
+#include "PillowCore.h"
+#endif // PILLOW_PILLOWCORE_H
+#ifndef QOBJECT_H
+#include <QtCore/QObject>
+#endif // QOBJECT_H
+#ifndef QLIST_H
+#include <QtCore/QList>
+#endif // QLIST_H
+#ifndef QHOSTADDRESS_H
+#include <QtNetwork/QHostAddress>
+#endif // QHOSTADDRESS_H
+
+class QHostInfo;
+
+namespace Pillow
+{
+	class HttpHostCachePrivate;
+
+	//
+	// Pillow::HttpHostCache
+	//
+	// Host name resolutions shared by HttpClients, so that reconnecting clients do not each go back to the resolver.
+	// Resolved names are kept for timeToLive milliseconds (QHostInfo does not tell the records' real TTL), and names
+	// that failed to resolve for negativeTimeToLive. An entry used during the last quarter of its life is refreshed
+	// in the background while the cached addresses keep being served; when the refresh fails for another reason than
+	// the name not existing, the stale addresses are kept a little longer. Lookups return all the A and AAAA records
+	// of a name, rotated so that successive lookups start with a different one.
+	//
+	// Overrides, set one by one or loaded from a file in the /etc/hosts format, take precedence over the resolver
+	// and never expire.
+	//
+	// Thread safe. The resolver lookups run from the event loop of the cache's thread: the main thread for instance().
+	//
+
+	class PILLOWCORE_EXPORT HttpHostCache : public QObject
+	{
+		Q_OBJECT
+		Q_PROPERTY(int timeToLive READ timeToLive WRITE setTimeToLive)
+		Q_PROPERTY(int negativeTimeToLive READ negativeTimeToLive WRITE setNegativeTimeToLive)
+
+	public:
+		enum { DefaultTimeToLive = 60000, DefaultNegativeTimeToLive = 5000 }; // Milliseconds.
+		enum { MaximumEntries = 1024 }; // Expired entries are dropped past this many.
+
+		enum Status
+		{
+			Resolved,     // The addresses were set.
+			NotFound,     // The name does not resolve, or did not recently.
+			LookupPending // A lookup is under way: wait for hostResolved() and look the name up again.
+		};
+
+	public:
+		HttpHostCache(QObject* parent = 0);
+		~HttpHostCache();
+
+		static HttpHostCache* instance(); // The cache HttpClients use by default.
+
+		int timeToLive() const;
+		void setTimeToLive(int milliseconds);
+
+		int negativeTimeToLive() const;
+		void setNegativeTimeToLive(int milliseconds);
+
+	public:
+		// The addresses of "hostName", starting a lookup when the name is not cached or due for a refresh.
+		Status lookup(const QString& hostName, QList<QHostAddress>* addresses);
+
+		// An empty address list makes the name not found.
+		void setOverride(const QString& hostName, const QList<QHostAddress>& addresses);
+		void removeOverride(const QString& hostName);
+		void clearOverrides();
+		bool loadHostsFile(const QString& fileName); // Adds the file's entries to the overrides.
+
+		void clear(); // Forget the resolved names. Overrides stay.
+
+		quint64 lookupCount() const; // Resolver lookups started so far.
+
+	signals:
+		void hostResolved(const QString& hostName); // Emitted when a lookup completes, successful or not.
+
+	private slots:
+		void startLookup(const QString& hostName);
+		void hostInfo_lookedUp(const QHostInfo& hostInfo);
+
+	private:
+		Q_DECLARE_PRIVATE(HttpHostCache)
+		HttpHostCachePrivate* d_ptr;
+	};
+}
+
+#endif // PILLOW_HTTPHOSTCACHE_H
@@ -2,6 +2,16 @@
 #include "HttpConnection.h"
 #include <QtNetwork/QTcpSocket>
 #include <QtNetwork/QLocalSocket>
+#include <QtCore/QSet>
+#include <QtCore/QTimer>
+#ifdef Q_OS_UNIX
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#endif // Q_OS_UNIX
 using namespace Pillow;
 
 //
@@ -13,24 +23,40 @@ namespace Pillow
 	class HttpServerPrivate
 	{
 	public:
-		enum { MaximumReserveCount = 25 };
+		// The reserve of idle connections (and, for HttpServer, of idle sockets) follows recent connection churn:
+		// it grows up to the peak number of concurrent connections seen in the last two decay intervals, bounded by
+		// the low and high watermarks, and shrinks back towards the low watermark once the churn goes away.
+		enum { DefaultMinimumReserveCount = 25, DefaultMaximumReserveCount = 1024, DefaultReserveDecayInterval = 10000 };
 
 	public:
 		QObject* q_ptr;
 		QList<HttpConnection*> reservedConnections;
+		QList<QTcpSocket*> reservedSockets;
+		QSet<HttpConnection*> activeConnections;
+		int pendingHandshakeCount; // Accepted connections that have no HttpConnection yet.
+		bool shuttingDown;
+		int minimumReserveCount, maximumReserveCount;
+		int recentPeakCount, previousPeakCount;
+		QTimer* decayTimer;
 
 	public:
 		HttpServerPrivate(QObject* server)
-			: q_ptr(server)
+			: q_ptr(server), pendingHandshakeCount(0), shuttingDown(false),
+			  minimumReserveCount(DefaultMinimumReserveCount), maximumReserveCount(DefaultMaximumReserveCount),
+			  recentPeakCount(0), previousPeakCount(0)
 		{
-			for (int i = 0; i < MaximumReserveCount; ++i)
-				reservedConnections << createConnection();
+			// Connections are created lazily: a server that never sees more than a few clients never holds more than a few.
+			decayTimer = new QTimer(q_ptr);
+			decayTimer->setInterval(DefaultReserveDecayInterval);
+			QObject::connect(decayTimer, SIGNAL(timeout()), q_ptr, SLOT(reserve_decay()));
 		}
 
 		~HttpServerPrivate()
 		{
 			while (!reservedConnections.isEmpty())
 				delete reservedConnections.takeLast();
+			while (!reservedSockets.isEmpty())
+				delete reservedSockets.takeLast();
 		}
 
 		HttpConnection* createConnection()
@@ -43,18 +69,124 @@ namespace Pillow
 
 		HttpConnection* takeConnection()
 		{
-			if (reservedConnections.isEmpty())
-				return createConnection();
-			else
-				return reservedConnections.takeLast();
+			HttpConnection* connection = reservedConnections.isEmpty() ? createConnection() : reservedConnections.takeLast();
+			activeConnections.insert(connection);
+			if (activeConnections.size() > recentPeakCount) recentPeakCount = activeConnections.size();
+			return connection;
 		}
 
 		void putConnection(HttpConnection* connection)
 		{
-			while (reservedConnections.size() >= MaximumReserveCount)
+			activeConnections.remove(connection);
+
+			const int target = targetReserveCount();
+			while (!reservedConnections.isEmpty() && reservedConnections.size() >= target)
 				delete reservedConnections.takeLast();
 
 			reservedConnections.append(connection);
+
+			if (reservedConnections.size() > effectiveMinimumReserveCount() && !decayTimer->isActive())
+				decayTimer->start();
+
+			checkDrained();
+		}
+
+		void checkDrained()
+		{
+			if (shuttingDown && activeConnections.isEmpty() && pendingHandshakeCount == 0)
+				QMetaObject::invokeMethod(q_ptr, "drained", Qt::QueuedConnection);
+		}
+
+		QTcpSocket* takeSocket()
+		{
+			while (!reservedSockets.isEmpty())
+			{
+				QTcpSocket* socket = reservedSockets.takeLast();
+				if (socket->state() == QAbstractSocket::UnconnectedState) return socket;
+				delete socket;
+			}
+			return NULL;
+		}
+
+		void putSocket(QTcpSocket* socket)
+		{
+			// Only plain QTcpSockets are recycled: subclasses such as QSslSocket carry per connection state that
+			// setSocketDescriptor() does not reset.
+			if (socket->metaObject() != &QTcpSocket::staticMetaObject || reservedSockets.size() >= targetReserveCount())
+			{
+				socket->deleteLater();
+				return;
+			}
+			socket->abort(); // Releases the descriptor and drops anything left in the buffers.
+			reservedSockets.append(socket);
+		}
+
+		// The bounds are stored as set, so that the order of the setters does not matter; the maximum wins when they cross.
+		int effectiveMinimumReserveCount() const
+		{
+			return qMin(minimumReserveCount, maximumReserveCount);
+		}
+
+		int targetReserveCount() const
+		{
+			return qBound(effectiveMinimumReserveCount(), qMax(recentPeakCount, previousPeakCount), maximumReserveCount);
+		}
+
+		void decayReserve()
+		{
+			previousPeakCount = recentPeakCount;
+			recentPeakCount = activeConnections.size();
+
+			// Shrink by half of the excess on each interval, so that a burst that comes back soon still finds most of its objects.
+			const int target = targetReserveCount();
+			if (reservedConnections.size() > target)
+			{
+				const int count = reservedConnections.size() - qMax(1, (reservedConnections.size() - target) / 2);
+				while (reservedConnections.size() > count)
+					delete reservedConnections.takeLast();
+			}
+			if (reservedSockets.size() > target)
+			{
+				const int count = reservedSockets.size() - qMax(1, (reservedSockets.size() - target) / 2);
+				while (reservedSockets.size() > count)
+					delete reservedSockets.takeLast();
+			}
+
+			if (reservedConnections.size() <= effectiveMinimumReserveCount() && reservedSockets.size() <= effectiveMinimumReserveCount())
+				decayTimer->stop();
+		}
+
+		void setReserveBounds(int minimum, int maximum)
+		{
+			minimumReserveCount = qMax(0, minimum);
+			maximumReserveCount = qMax(0, maximum);
+			while (reservedConnections.size() > maximumReserveCount)
+				delete reservedConnections.takeLast();
+			while (reservedSockets.size() > maximumReserveCount)
+				delete reservedSockets.takeLast();
+		}
+
+		void shutdown(int timeout)
+		{
+			if (shuttingDown) return;
+			shuttingDown = true;
+
+			// Closing a connection gracefully can close it right away, which modifies activeConnections. Work on a copy.
+			const QList<HttpConnection*> connections = activeConnections.toList();
+			foreach (HttpConnection* connection, connections)
+				connection->closeGracefully();
+
+			if (activeConnections.isEmpty() && pendingHandshakeCount == 0)
+				QMetaObject::invokeMethod(q_ptr, "drained", Qt::QueuedConnection);
+			else if (timeout >= 0)
+				QTimer::singleShot(timeout, q_ptr, SLOT(shutdown_timeout()));
+		}
+
+		void shutdownTimeout()
+		{
+			const QList<HttpConnection*> connections = activeConnections.toList();
+			foreach (HttpConnection* connection, connections)
+				connection->close();
 		}
 	};
 }
@@ -84,7 +216,8 @@ void HttpServer::incomingConnection(int socketDescriptor)
 void HttpServer::incomingConnection(qintptr socketDescriptor)
 #endif
 {
-	QTcpSocket* socket = new QTcpSocket(this);
+	QTcpSocket* socket = d_ptr->takeSocket();
+	if (socket == NULL) socket = new QTcpSocket(this);
 	if (socket->setSocketDescriptor(socketDescriptor))
 	{
 		addPendingConnection(socket);
@@ -100,10 +233,187 @@ void HttpServer::incomingConnection(qintptr socketDescriptor)
 
 void HttpServer::connection_closed(Pillow::HttpConnection *connection)
 {
-	connection->inputDevice()->deleteLater();
+	QTcpSocket* socket = qobject_cast<QTcpSocket*>(connection->inputDevice());
+	if (socket)
+		d_ptr->putSocket(socket);
+	else
+		connection->inputDevice()->deleteLater();
 	d_ptr->putConnection(connection);
 }
 
+void HttpServer::reserve_decay()
+{
+	d_ptr->decayReserve();
+}
+
+void HttpServer::beginHandshake()
+{
+	++d_ptr->pendingHandshakeCount;
+}
+
+void HttpServer::endHandshake()
+{
+	--d_ptr->pendingHandshakeCount;
+	d_ptr->checkDrained();
+}
+
+void HttpServer::shutdown(int timeout)
+{
+	close(); // Stop listening. Pending connections that were not accepted yet are dropped by the OS.
+	d_ptr->shutdown(timeout);
+}
+
+void HttpServer::shutdown_timeout()
+{
+	d_ptr->shutdownTimeout();
+}
+
+int HttpServer::activeConnectionCount() const
+{
+	return d_ptr->activeConnections.size();
+}
+
+bool HttpServer::isShuttingDown() const
+{
+	return d_ptr->shuttingDown;
+}
+
+int HttpServer::reservedConnectionCount() const
+{
+	return d_ptr->reservedConnections.size();
+}
+
+int HttpServer::reservedSocketCount() const
+{
+	return d_ptr->reservedSockets.size();
+}
+
+int HttpServer::minimumReservedConnections() const
+{
+	return d_ptr->minimumReserveCount;
+}
+
+void HttpServer::setMinimumReservedConnections(int count)
+{
+	d_ptr->setReserveBounds(count, d_ptr->maximumReserveCount);
+}
+
+int HttpServer::maximumReservedConnections() const
+{
+	return d_ptr->maximumReserveCount;
+}
+
+void HttpServer::setMaximumReservedConnections(int count)
+{
+	d_ptr->setReserveBounds(d_ptr->minimumReserveCount, count);
+}
+
+int HttpServer::reserveDecayInterval() const
+{
+	return d_ptr->decayTimer->interval();
+}
+
+void HttpServer::setReserveDecayInterval(int interval)
+{
+	d_ptr->decayTimer->setInterval(interval);
+}
+
+bool HttpServer::sendListeningSocket(int channelDescriptor)
+{
+#ifdef Q_OS_UNIX
+	if (!isListening())
+	{
+		qWarning() << "HttpServer::sendListeningSocket: the server is not listening, there is no socket to send.";
+		return false;
+	}
+
+	int listeningDescriptor = static_cast<int>(socketDescriptor());
+	char payload = 'P'; // At least one byte of regular data must accompany the ancillary data.
+	struct iovec iov; iov.iov_base = &payload; iov.iov_len = 1;
+	char control[CMSG_SPACE(sizeof(int))]; memset(control, 0, sizeof(control));
+
+	struct msghdr message; memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov; message.msg_iovlen = 1;
+	message.msg_control = control; message.msg_controllen = sizeof(control);
+
+	struct cmsghdr* controlHeader = CMSG_FIRSTHDR(&message);
+	controlHeader->cmsg_level = SOL_SOCKET;
+	controlHeader->cmsg_type = SCM_RIGHTS;
+	controlHeader->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(controlHeader), &listeningDescriptor, sizeof(int));
+
+	ssize_t result;
+	do { result = ::sendmsg(channelDescriptor, &message, 0); } while (result < 0 && errno == EINTR);
+	if (result != 1)
+	{
+		qWarning() << "HttpServer::sendListeningSocket: could not send the listening socket:" << strerror(errno);
+		return false;
+	}
+	return true;
+#else
+	Q_UNUSED(channelDescriptor);
+	qWarning() << "HttpServer::sendListeningSocket: listening socket handover is not supported on this platform.";
+	return false;
+#endif // Q_OS_UNIX
+}
+
+bool HttpServer::adoptListeningSocket(int channelDescriptor, int timeout)
+{
+#ifdef Q_OS_UNIX
+	if (isListening())
+	{
+		qWarning() << "HttpServer::adoptListeningSocket: the server is already listening.";
+		return false;
+	}
+
+	// The channel may be non-blocking (e.g. it belongs to a QLocalSocket). Wait for the message to arrive.
+	struct pollfd pollDescriptor; pollDescriptor.fd = channelDescriptor; pollDescriptor.events = POLLIN; pollDescriptor.revents = 0;
+	int pollResult;
+	do { pollResult = ::poll(&pollDescriptor, 1, timeout); } while (pollResult < 0 && errno == EINTR);
+	if (pollResult <= 0)
+	{
+		qWarning() << "HttpServer::adoptListeningSocket: timed out or failed waiting for the listening socket.";
+		return false;
+	}
+
+	char payload = 0;
+	struct iovec iov; iov.iov_base = &payload; iov.iov_len = 1;
+	char control[CMSG_SPACE(sizeof(int))]; memset(control, 0, sizeof(control));
+
+	struct msghdr message; memset(&message, 0, sizeof(message));
+	message.msg_iov = &iov; message.msg_iovlen = 1;
+	message.msg_control = control; message.msg_controllen = sizeof(control);
+
+	int flags = 0;
+#ifdef MSG_CMSG_CLOEXEC
+	flags |= MSG_CMSG_CLOEXEC;
+#endif
+	ssize_t result;
+	do { result = ::recvmsg(channelDescriptor, &message, flags); } while (result < 0 && errno == EINTR);
+
+	struct cmsghdr* controlHeader = result == 1 ? CMSG_FIRSTHDR(&message) : NULL;
+	if (controlHeader == NULL || controlHeader->cmsg_level != SOL_SOCKET || controlHeader->cmsg_type != SCM_RIGHTS)
+	{
+		qWarning() << "HttpServer::adoptListeningSocket: did not receive a socket descriptor on the channel.";
+		return false;
+	}
+
+	int listeningDescriptor;
+	memcpy(&listeningDescriptor, CMSG_DATA(controlHeader), sizeof(int));
+	if (!setSocketDescriptor(listeningDescriptor))
+	{
+		qWarning() << "HttpServer::adoptListeningSocket: the received descriptor is not a usable listening socket:" << errorString();
+		::close(listeningDescriptor);
+		return false;
+	}
+	return true;
+#else
+	Q_UNUSED(channelDescriptor); Q_UNUSED(timeout);
+	qWarning() << "HttpServer::adoptListeningSocket: listening socket handover is not supported on this platform.";
+	return false;
+#endif // Q_OS_UNIX
+}
+
 HttpConnection* Pillow::HttpServer::createHttpConnection()
 {
 	return d_ptr->takeConnection();
@@ -130,6 +440,11 @@ HttpLocalServer::HttpLocalServer(const QString& serverName, QObject *parent /*=
 		qWarning() << QString("HttpLocalServer::HttpLocalServer: could not bind to %1 for listening: %2").arg(serverName).arg(errorString());
 }
 
+HttpLocalServer::~HttpLocalServer()
+{
+	delete d_ptr;
+}
+
 void HttpLocalServer::this_newConnection()
 {
 	QIODevice* device = nextPendingConnection();
@@ -141,3 +456,64 @@ void HttpLocalServer::connection_closed(Pillow::HttpConnection *connection)
 	connection->inputDevice()->deleteLater();
 	d_ptr->putConnection(connection);
 }
+
+void HttpLocalServer::reserve_decay()
+{
+	d_ptr->decayReserve();
+}
+
+void HttpLocalServer::shutdown(int timeout)
+{
+	close();
+	d_ptr->shutdown(timeout);
+}
+
+void HttpLocalServer::shutdown_timeout()
+{
+	d_ptr->shutdownTimeout();
+}
+
+int HttpLocalServer::activeConnectionCount() const
+{
+	return d_ptr->activeConnections.size();
+}
+
+bool HttpLocalServer::isShuttingDown() const
+{
+	return d_ptr->shuttingDown;
+}
+
+int HttpLocalServer::reservedConnectionCount() const
+{
+	return d_ptr->reservedConnections.size();
+}
+
+int HttpLocalServer::minimumReservedConnections() const
+{
+	return d_ptr->minimumReserveCount;
+}
+
+void HttpLocalServer::setMinimumReservedConnections(int count)
+{
+	d_ptr->setReserveBounds(count, d_ptr->maximumReserveCount);
+}
+
+int HttpLocalServer::maximumReservedConnections() const
+{
+	return d_ptr->maximumReserveCount;
+}
+
+void HttpLocalServer::setMaximumReservedConnections(int count)
+{
+	d_ptr->setReserveBounds(d_ptr->minimumReserveCount, count);
+}
+
+int HttpLocalServer::reserveDecayInterval() const
+{
+	return d_ptr->decayTimer->interval();
+}
+
+void HttpLocalServer::setReserveDecayInterval(int interval)
+{
+	d_ptr->decayTimer->setInterval(interval);
+}
@@ -27,11 +27,16 @@ namespace Pillow
 		Q_PROPERTY(QHostAddress serverAddress READ serverAddress)
 		Q_PROPERTY(int serverPort READ serverPort)
 		Q_PROPERTY(bool listening READ isListening)
+		Q_PROPERTY(int minimumReservedConnections READ minimumReservedConnections WRITE setMinimumReservedConnections)
+		Q_PROPERTY(int maximumReservedConnections READ maximumReservedConnections WRITE setMaximumReservedConnections)
+		Q_PROPERTY(int reserveDecayInterval READ reserveDecayInterval WRITE setReserveDecayInterval)
 		Q_DECLARE_PRIVATE(HttpServer)
 		HttpServerPrivate* d_ptr;
 
 	private slots:
 		void connection_closed(Pillow::HttpConnection* request);
+		void shutdown_timeout();
+		void reserve_decay();
 
 	protected:
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
@@ -41,13 +46,50 @@ namespace Pillow
 #endif
 		HttpConnection* createHttpConnection();
 
+		// For subclasses that accept connections before handing them over to an HttpConnection, such as HttpsServer
+		// with handshake threads: after shutdown(), drained() waits for every handshake begun to end.
+		void beginHandshake();
+		void endHandshake();
+
 	public:
 		HttpServer(QObject* parent = 0);
 		HttpServer(const QHostAddress& serverAddress, quint16 serverPort, QObject *parent = 0);
 		~HttpServer();
 
+		// Number of connections currently handed out to clients (not counting the reserved ones).
+		int activeConnectionCount() const;
+		bool isShuttingDown() const;
+
+		// Closed connections and their sockets are kept in reserve and reused for the next clients. The reserve follows
+		// the peak number of concurrent connections seen recently, bounded by the minimum and maximum reserved
+		// connection counts, and shrinks back towards the minimum every "reserveDecayInterval" milliseconds once
+		// the load goes down. Nothing is allocated up front. A minimum above the maximum is capped by the maximum.
+		int reservedConnectionCount() const;
+		int reservedSocketCount() const;
+		int minimumReservedConnections() const;
+		void setMinimumReservedConnections(int count);
+		int maximumReservedConnections() const;
+		void setMaximumReservedConnections(int count);
+		int reserveDecayInterval() const;
+		void setReserveDecayInterval(int interval);
+
+		// Listening socket handover (Unix only). The running process sends its listening socket over a connected
+		// Unix domain socket (such as one end of a socketpair(), or QLocalSocket::socketDescriptor()) and then calls
+		// shutdown(). The successor process receives it with adoptListeningSocket(), which blocks for at most
+		// "timeout" milliseconds. A listening descriptor inherited in any other way (e.g. socket activation) can be
+		// adopted directly with QTcpServer::setSocketDescriptor().
+		bool sendListeningSocket(int channelDescriptor);
+		bool adoptListeningSocket(int channelDescriptor, int timeout = 30000);
+
+	public slots:
+		// Graceful shutdown: stop accepting new connections, close idle keep-alive connections right away and
+		// let in-flight requests complete with a "Connection: close" response. Emits drained() once the
+		// last connection has closed. Connections still open after "timeout" milliseconds are forcibly closed.
+		void shutdown(int timeout = -1);
+
 	signals:
 		void requestReady(Pillow::HttpConnection* connection); // There is a request ready to be handled on this connection.
+		void drained(); // Emitted after shutdown(), when all connections have closed.
 	};
 
 	//
@@ -57,19 +99,41 @@ namespace Pillow
 	class PILLOWCORE_EXPORT HttpLocalServer : public QLocalServer
 	{
 		Q_OBJECT
+		Q_PROPERTY(int minimumReservedConnections READ minimumReservedConnections WRITE setMinimumReservedConnections)
+		Q_PROPERTY(int maximumReservedConnections READ maximumReservedConnections WRITE setMaximumReservedConnections)
+		Q_PROPERTY(int reserveDecayInterval READ reserveDecayInterval WRITE setReserveDecayInterval)
 		Q_DECLARE_PRIVATE(HttpServer)
 		HttpServerPrivate* d_ptr;
 
 	private slots:
 		void this_newConnection();
 		void connection_closed(Pillow::HttpConnection* request);
+		void shutdown_timeout();
+		void reserve_decay();
 
 	public:
 		HttpLocalServer(QObject* parent = 0);
 		HttpLocalServer(const QString& serverName, QObject *parent = 0);
+		~HttpLocalServer();
+
+		int activeConnectionCount() const;
+		bool isShuttingDown() const;
+
+		// See HttpServer. Local sockets are not recycled.
+		int reservedConnectionCount() const;
+		int minimumReservedConnections() const;
+		void setMinimumReservedConnections(int count);
+		int maximumReservedConnections() const;
+		void setMaximumReservedConnections(int count);
+		int reserveDecayInterval() const;
+		void setReserveDecayInterval(int interval);
+
+	public slots:
+		void shutdown(int timeout = -1); // See HttpServer::shutdown().
 
 	signals:
 		void requestReady(Pillow::HttpConnection* connection); // There is a request ready to be handled on this connection.
+		void drained(); // Emitted after shutdown(), when all connections have closed.
 	};
 }
 
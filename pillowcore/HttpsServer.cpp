@@ -1,33 +1,565 @@
 #include "HttpsServer.h"
 #include "HttpConnection.h"
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QQueue>
+#include <QtCore/QSet>
+#include <QtCore/QThread>
+#include <QtCore/QTimer>
 #include <QtNetwork/QSslSocket>
+#ifdef Q_OS_WIN
+#include <winsock2.h>
+#else
+#include <unistd.h>
+#endif // Q_OS_WIN
 
 #if !defined(PILLOW_NO_SSL) && !defined(QT_NO_SSL)
 
+#ifdef PILLOW_OPENSSL
+#if QT_VERSION < QT_VERSION_CHECK(5, 0, 0) || QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+#error PILLOW_OPENSSL needs the OpenSSL backend of Qt 5.
+#endif
+#include <QtCore/private/qobject_p.h>
+#include <QtNetwork/private/qsslsocket_openssl_p.h>
+#include <openssl/rand.h>
+#include <openssl/ssl.h>
+#endif // PILLOW_OPENSSL
+
 using namespace Pillow;
 
+namespace Pillow
+{
+	//
+	// HttpsSessionCache: the TLS sessions and session ticket keys shared by all connections of a server.
+	//
+	// Qt gives every socket its own SSL_CTX, whose session cache and ticket keys die with the connection. With
+	// PILLOW_OPENSSL, prepare() points the SSL_CTX of each new socket to this cache and hands it the server's
+	// ticket keys. The cache is reference counted, as each SSL_CTX may outlive the server for a while.
+	//
+
+	class HttpsSessionCache
+	{
+	public:
+		QMutex mutex; // Guards everything below, as sockets on the handshake worker threads use the cache too.
+		int maximumSize;
+		int timeout;
+		bool ticketsEnabled;
+
+	public:
+		HttpsSessionCache()
+			: maximumSize(HttpsServer::DefaultSessionCacheSize), timeout(HttpsServer::DefaultSessionTimeout), ticketsEnabled(true), _refCount(1)
+		{
+#ifdef PILLOW_OPENSSL
+			_hasTicketKeys = RAND_bytes(_ticketKeys, sizeof(_ticketKeys)) == 1;
+			if (!_hasTicketKeys)
+				qWarning() << "Pillow::HttpsSessionCache: failed to generate the session ticket keys, session tickets are disabled.";
+			_clock.start();
+#endif
+		}
+
+		void ref() { _refCount.ref(); }
+		void deref() { if (!_refCount.deref()) delete this; }
+
+#ifdef PILLOW_OPENSSL
+		// Call right after QSslSocket::startServerEncryption(): the client's hello has not been read yet.
+		void prepare(QSslSocket* socket)
+		{
+			SSL* ssl = sslHandle(socket);
+			if (ssl == 0) return; // The handshake could not start, e.g. without a private key.
+			SSL_CTX* context = SSL_get_SSL_CTX(ssl);
+
+			static const unsigned char sessionIdContext[] = "Pillow::HttpsServer";
+			SSL_set_session_id_context(ssl, sessionIdContext, sizeof(sessionIdContext) - 1);
+
+			QMutexLocker locker(&mutex);
+			if (SSL_CTX_get_ex_data(context, exDataIndex()) != this)
+			{
+				ref(); // Released by freeExData() along with the SSL_CTX.
+				SSL_CTX_set_ex_data(context, exDataIndex(), this);
+			}
+			SSL_CTX_set_timeout(context, timeout);
+			if (maximumSize > 0)
+			{
+				SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+				SSL_CTX_sess_set_new_cb(context, &HttpsSessionCache::newSession);
+				SSL_CTX_sess_set_get_cb(context, &HttpsSessionCache::getSession);
+				// No remove callback: OpenSSL removes the session of every connection freed without sending close_notify,
+				// as when the client hangs up first. Sessions leave the cache when they expire or when it is full.
+			}
+			else
+				SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_OFF);
+
+			if (ticketsEnabled && _hasTicketKeys)
+				SSL_CTX_set_tlsext_ticket_keys(context, _ticketKeys, sizeof(_ticketKeys));
+			else
+				SSL_set_options(ssl, SSL_OP_NO_TICKET);
+		}
+
+		static bool isResumed(QSslSocket* socket)
+		{
+			SSL* ssl = sslHandle(socket);
+			return ssl != 0 && SSL_session_reused(ssl);
+		}
+
+	private:
+		struct Session
+		{
+			QByteArray data; // As serialized by i2d_SSL_SESSION.
+			qint64 expiry;
+		};
+
+		// Name, HMAC secret and AES key, whose sizes grew with OpenSSL 1.1.
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+		unsigned char _ticketKeys[48];
+#else
+		unsigned char _ticketKeys[80];
+#endif
+		bool _hasTicketKeys;
+		QHash<QByteArray, Session> _sessions;
+		QQueue<QByteArray> _sessionIds; // Oldest first. May still hold the ids of sessions removed since.
+		QElapsedTimer _clock;
+
+		static SSL* sslHandle(QSslSocket* socket)
+		{
+			return static_cast<QSslSocketBackendPrivate*>(QObjectPrivate::get(socket))->ssl;
+		}
+
+		static int exDataIndex()
+		{
+			static const int index = SSL_CTX_get_ex_new_index(0, 0, 0, 0, &HttpsSessionCache::freeExData);
+			return index;
+		}
+
+		static HttpsSessionCache* fromContext(SSL_CTX* context)
+		{
+			return static_cast<HttpsSessionCache*>(SSL_CTX_get_ex_data(context, exDataIndex()));
+		}
+
+		static void freeExData(void*, void* ptr, CRYPTO_EX_DATA*, int, long, void*)
+		{
+			if (ptr != 0) static_cast<HttpsSessionCache*>(ptr)->deref();
+		}
+
+		static int newSession(SSL* ssl, SSL_SESSION* session)
+		{
+			HttpsSessionCache* cache = fromContext(SSL_get_SSL_CTX(ssl));
+			unsigned int idLength = 0;
+			const unsigned char* id = SSL_SESSION_get_id(session, &idLength);
+			Session entry;
+			entry.data.resize(i2d_SSL_SESSION(session, 0));
+			if (entry.data.isEmpty()) return 0;
+			unsigned char* p = reinterpret_cast<unsigned char*>(entry.data.data());
+			i2d_SSL_SESSION(session, &p);
+
+			QMutexLocker locker(&cache->mutex);
+			const qint64 now = cache->_clock.elapsed();
+			entry.expiry = now + qint64(cache->timeout) * 1000;
+			const QByteArray key(reinterpret_cast<const char*>(id), idLength);
+			cache->_sessions.insert(key, entry);
+			cache->_sessionIds.enqueue(key);
+
+			// Drop the expired sessions, then the oldest ones while the cache is full.
+			while (!cache->_sessionIds.isEmpty())
+			{
+				QHash<QByteArray, Session>::iterator it = cache->_sessions.find(cache->_sessionIds.head());
+				if (it != cache->_sessions.end())
+				{
+					if (it.value().expiry > now && cache->_sessions.size() <= cache->maximumSize) break;
+					cache->_sessions.erase(it);
+				}
+				cache->_sessionIds.dequeue();
+			}
+			return 0; // The cache keeps its own serialized copy, not a reference to the session.
+		}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+		static SSL_SESSION* getSession(SSL* ssl, unsigned char* id, int idLength, int* copy)
+#else
+		static SSL_SESSION* getSession(SSL* ssl, const unsigned char* id, int idLength, int* copy)
+#endif
+		{
+			HttpsSessionCache* cache = fromContext(SSL_get_SSL_CTX(ssl));
+			*copy = 0; // The session returned is a new one: OpenSSL owns its only reference.
+
+			QByteArray data;
+			{
+				QMutexLocker locker(&cache->mutex);
+				QHash<QByteArray, Session>::iterator it = cache->_sessions.find(QByteArray::fromRawData(reinterpret_cast<const char*>(id), idLength));
+				if (it == cache->_sessions.end()) return 0;
+				if (it.value().expiry <= cache->_clock.elapsed()) { cache->_sessions.erase(it); return 0; }
+				data = it.value().data;
+			}
+			const unsigned char* p = reinterpret_cast<const unsigned char*>(data.constData());
+			return d2i_SSL_SESSION(0, &p, data.size());
+		}
+#else
+		void prepare(QSslSocket*) {}
+		static bool isResumed(QSslSocket*) { return false; }
+#endif // PILLOW_OPENSSL
+
+	private:
+		QAtomicInt _refCount;
+	};
+
+	//
+	// HttpsHandedOverSockets: encrypted sockets on their way from the worker threads to the server. Those still
+	// queued when the server goes away are deleted along with it.
+	//
+
+	class HttpsHandedOverSockets
+	{
+		QMutex _mutex;
+		QSet<QSslSocket*> _sockets;
+
+	public:
+		void insert(QSslSocket* socket)
+		{
+			QMutexLocker locker(&_mutex);
+			_sockets.insert(socket);
+		}
+
+		void remove(QSslSocket* socket)
+		{
+			QMutexLocker locker(&_mutex);
+			_sockets.remove(socket);
+		}
+
+		void deleteAll()
+		{
+			QMutexLocker locker(&_mutex);
+			qDeleteAll(_sockets);
+			_sockets.clear();
+		}
+	};
+
+	//
+	// HttpsHandshakeWorker: runs server handshakes in its thread and hands encrypted sockets over to the server.
+	//
+
+	class HttpsHandshakeWorker : public QObject
+	{
+		Q_OBJECT
+		QObject* _server;
+		QThread* _serverThread;
+		HttpsSessionCache* _sessionCache;
+		HttpsHandedOverSockets* _handedOver;
+		QHash<QSslSocket*, QTimer*> _handshakes; // Handshakes in progress and their timeout timers.
+
+	public:
+		QMutex mutex; // Guards "configuration" and "timeout", set from the server's thread.
+		QSslConfiguration configuration;
+		int timeout;
+
+	public:
+		HttpsHandshakeWorker(QObject* server, HttpsSessionCache* sessionCache, HttpsHandedOverSockets* handedOver)
+			: _server(server), _serverThread(server->thread()), _sessionCache(sessionCache), _handedOver(handedOver),
+			  timeout(HttpsServer::DefaultHandshakeTimeout)
+		{}
+
+	public slots:
+		int abortHandshakes()
+		{
+			const int count = _handshakes.size();
+			for (QHash<QSslSocket*, QTimer*>::const_iterator it = _handshakes.constBegin(), itE = _handshakes.constEnd(); it != itE; ++it)
+				delete it.key(); // Also deletes the timer, its child.
+			_handshakes.clear();
+			return count;
+		}
+
+		void startHandshake(qlonglong socketDescriptor)
+		{
+			QSslSocket* socket = new QSslSocket();
+			if (!socket->setSocketDescriptor(socketDescriptor))
+			{
+				qWarning() << "HttpsServer::incomingConnection: failed to set socket descriptor '" << socketDescriptor << "' on ssl socket.";
+				delete socket;
+				QMetaObject::invokeMethod(_server, "handshake_finished", Qt::QueuedConnection, Q_ARG(QObject*, 0));
+				return;
+			}
+
+			QTimer* timer = new QTimer(socket);
+			timer->setSingleShot(true);
+			{
+				QMutexLocker locker(&mutex);
+				socket->setSslConfiguration(configuration);
+				timer->start(timeout);
+			}
+			_handshakes.insert(socket, timer);
+
+			connect(socket, SIGNAL(encrypted()), this, SLOT(socket_encrypted()));
+			connect(socket, SIGNAL(disconnected()), this, SLOT(socket_failed()));
+			connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(socket_failed()));
+			connect(timer, SIGNAL(timeout()), this, SLOT(timer_timeout()));
+			socket->startServerEncryption();
+			_sessionCache->prepare(socket);
+		}
+
+	private slots:
+		void socket_encrypted()
+		{
+			finish(static_cast<QSslSocket*>(sender()), true);
+		}
+
+		void socket_failed()
+		{
+			finish(static_cast<QSslSocket*>(sender()), false);
+		}
+
+		void timer_timeout()
+		{
+			finish(static_cast<QSslSocket*>(sender()->parent()), false);
+		}
+
+	private:
+		void finish(QSslSocket* socket, bool encrypted)
+		{
+			QTimer* timer = _handshakes.take(socket);
+			if (timer == 0) return; // Already finished, e.g. an error followed by a disconnection.
+			delete timer;
+			disconnect(socket, 0, this, 0);
+
+			if (encrypted)
+			{
+				// The server adopts the socket: from now on, its events are processed in the server's thread.
+				socket->moveToThread(_serverThread);
+				_handedOver->insert(socket);
+				QMetaObject::invokeMethod(_server, "handshake_finished", Qt::QueuedConnection, Q_ARG(QObject*, socket));
+			}
+			else
+			{
+				socket->abort();
+				socket->deleteLater();
+				QMetaObject::invokeMethod(_server, "handshake_finished", Qt::QueuedConnection, Q_ARG(QObject*, 0));
+			}
+		}
+	};
+
+	//
+	// HttpsHandshakePool
+	//
+
+	class HttpsHandshakePool
+	{
+	public:
+		QList<QThread*> threads;
+		QList<HttpsHandshakeWorker*> workers;
+		int nextWorker;
+		int pendingCount, maximumPendingCount;
+		int timeout;
+		quint64 refusedCount;
+		HttpsHandedOverSockets handedOver;
+
+	public:
+		HttpsHandshakePool()
+			: nextWorker(0), pendingCount(0), maximumPendingCount(HttpsServer::DefaultMaximumPendingHandshakes),
+			  timeout(HttpsServer::DefaultHandshakeTimeout), refusedCount(0)
+		{}
+
+		~HttpsHandshakePool()
+		{
+			stop();
+			handedOver.deleteAll(); // Their handshake_finished() calls went away with the server.
+		}
+
+		void start(QObject* server, int threadCount, const QSslConfiguration& configuration, HttpsSessionCache* sessionCache)
+		{
+			for (int i = 0; i < threadCount; ++i)
+			{
+				HttpsHandshakeWorker* worker = new HttpsHandshakeWorker(server, sessionCache, &handedOver);
+				worker->configuration = configuration;
+				worker->timeout = timeout;
+				QThread* thread = new QThread();
+				worker->moveToThread(thread);
+				thread->start();
+				workers << worker;
+				threads << thread;
+			}
+		}
+
+		int stop() // Returns the number of handshakes aborted.
+		{
+			int droppedCount = 0;
+			for (int i = 0; i < threads.size(); ++i)
+			{
+				// Sockets are deleted in the thread they live in. Their results already posted to the server still arrive.
+				int dropped = 0;
+				QMetaObject::invokeMethod(workers.at(i), "abortHandshakes", Qt::BlockingQueuedConnection, Q_RETURN_ARG(int, dropped));
+				pendingCount -= dropped;
+				droppedCount += dropped;
+				threads.at(i)->quit();
+				threads.at(i)->wait();
+				delete workers.at(i);
+				delete threads.at(i);
+			}
+			workers.clear();
+			threads.clear();
+			nextWorker = 0;
+			return droppedCount;
+		}
+
+		void configure(const QSslConfiguration& configuration)
+		{
+			foreach (HttpsHandshakeWorker* worker, workers)
+			{
+				QMutexLocker locker(&worker->mutex);
+				worker->configuration = configuration;
+				worker->timeout = timeout;
+			}
+		}
+
+		HttpsHandshakeWorker* takeWorker()
+		{
+			if (nextWorker >= workers.size()) nextWorker = 0;
+			return workers.at(nextWorker++);
+		}
+	};
+}
+
 //
 // HttpsServer
 //
 
 HttpsServer::HttpsServer(QObject *parent)
-	: HttpServer(parent)
+	: HttpServer(parent), _sslConfiguration(QSslConfiguration::defaultConfiguration()), _encryptedCount(0), _failedHandshakeCount(0),
+	  _sessionHitCount(0), _sessionMissCount(0), _handshakePool(new HttpsHandshakePool()), _sessionCache(new HttpsSessionCache())
 {
 }
 
 HttpsServer::HttpsServer(const QSslCertificate& certificate, const QSslKey& privateKey, const QHostAddress &serverAddress, quint16 serverPort, QObject *parent)
-	: HttpServer(serverAddress, serverPort, parent), _certificate(certificate), _privateKey(privateKey)
+	: HttpServer(serverAddress, serverPort, parent), _certificate(certificate), _privateKey(privateKey),
+	  _sslConfiguration(QSslConfiguration::defaultConfiguration()), _encryptedCount(0), _failedHandshakeCount(0),
+	  _sessionHitCount(0), _sessionMissCount(0), _handshakePool(new HttpsHandshakePool()), _sessionCache(new HttpsSessionCache())
 {
+	_sslConfiguration.setLocalCertificate(_certificate);
+	_sslConfiguration.setPrivateKey(_privateKey);
+}
+
+HttpsServer::~HttpsServer()
+{
+	delete _handshakePool;
+	_sessionCache->deref();
 }
 
 void HttpsServer::setCertificate(const QSslCertificate &certificate)
 {
 	_certificate = certificate;
+	_sslConfiguration.setLocalCertificate(certificate);
+	_handshakePool->configure(_sslConfiguration);
 }
 
 void HttpsServer::setPrivateKey(const QSslKey &privateKey)
 {
 	_privateKey = privateKey;
+	_sslConfiguration.setPrivateKey(privateKey);
+	_handshakePool->configure(_sslConfiguration);
+}
+
+void HttpsServer::setSslConfiguration(const QSslConfiguration &configuration)
+{
+	_sslConfiguration = configuration;
+	if (!_certificate.isNull()) _sslConfiguration.setLocalCertificate(_certificate);
+	if (!_privateKey.isNull()) _sslConfiguration.setPrivateKey(_privateKey);
+	_handshakePool->configure(_sslConfiguration);
+}
+
+int HttpsServer::handshakeThreadCount() const
+{
+	return _handshakePool->threads.size();
+}
+
+void HttpsServer::setHandshakeThreadCount(int threadCount)
+{
+	if (threadCount < 0) threadCount = 0;
+	if (threadCount == _handshakePool->threads.size()) return;
+	for (int dropped = _handshakePool->stop(); dropped > 0; --dropped)
+		endHandshake();
+	_handshakePool->start(this, threadCount, _sslConfiguration, _sessionCache);
+}
+
+int HttpsServer::maximumPendingHandshakes() const
+{
+	return _handshakePool->maximumPendingCount;
+}
+
+void HttpsServer::setMaximumPendingHandshakes(int maximum)
+{
+	_handshakePool->maximumPendingCount = maximum;
+}
+
+int HttpsServer::handshakeTimeout() const
+{
+	return _handshakePool->timeout;
+}
+
+void HttpsServer::setHandshakeTimeout(int timeout)
+{
+	_handshakePool->timeout = timeout;
+	_handshakePool->configure(_sslConfiguration);
+}
+
+int HttpsServer::pendingHandshakeCount() const
+{
+	return _handshakePool->pendingCount;
+}
+
+quint64 HttpsServer::refusedHandshakeCount() const
+{
+	return _handshakePool->refusedCount;
+}
+
+bool HttpsServer::isSessionResumptionSupported()
+{
+#ifdef PILLOW_OPENSSL
+	return true;
+#else
+	return false;
+#endif
+}
+
+int HttpsServer::sessionCacheSize() const
+{
+	QMutexLocker locker(&_sessionCache->mutex);
+	return _sessionCache->maximumSize;
+}
+
+void HttpsServer::setSessionCacheSize(int size)
+{
+	QMutexLocker locker(&_sessionCache->mutex);
+	_sessionCache->maximumSize = qMax(0, size); // Sessions beyond the new size go as new ones come in.
+}
+
+int HttpsServer::sessionTimeout() const
+{
+	QMutexLocker locker(&_sessionCache->mutex);
+	return _sessionCache->timeout;
+}
+
+void HttpsServer::setSessionTimeout(int timeout)
+{
+	QMutexLocker locker(&_sessionCache->mutex);
+	_sessionCache->timeout = timeout;
+}
+
+bool HttpsServer::sessionTicketsEnabled() const
+{
+	QMutexLocker locker(&_sessionCache->mutex);
+	return _sessionCache->ticketsEnabled;
+}
+
+void HttpsServer::setSessionTicketsEnabled(bool enabled)
+{
+	QMutexLocker locker(&_sessionCache->mutex);
+	_sessionCache->ticketsEnabled = enabled;
+}
+
+void HttpsServer::resetCounters()
+{
+	_encryptedCount = _failedHandshakeCount = 0;
+	_sessionHitCount = _sessionMissCount = 0;
+	_handshakePool->refusedCount = 0;
 }
 
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
@@ -36,14 +568,36 @@ void HttpsServer::incomingConnection(int socketDescriptor)
 void HttpsServer::incomingConnection(qintptr socketDescriptor)
 #endif
 {
+	if (!_handshakePool->workers.isEmpty())
+	{
+		if (_handshakePool->maximumPendingCount > 0 && _handshakePool->pendingCount >= _handshakePool->maximumPendingCount)
+		{
+			// Handshake flood: drop the newcomer rather than queue yet more asymmetric crypto work.
+			++_handshakePool->refusedCount;
+#ifdef Q_OS_WIN
+			::closesocket(SOCKET(socketDescriptor));
+#else
+			::close(int(socketDescriptor));
+#endif // Q_OS_WIN
+			return;
+		}
+
+		++_handshakePool->pendingCount;
+		beginHandshake();
+		QMetaObject::invokeMethod(_handshakePool->takeWorker(), "startHandshake", Qt::QueuedConnection, Q_ARG(qlonglong, socketDescriptor));
+		return;
+	}
+
 	QSslSocket* sslSocket = new QSslSocket(this);
 	if (sslSocket->setSocketDescriptor(socketDescriptor))
 	{
-		sslSocket->setPrivateKey(privateKey());
-		sslSocket->setLocalCertificate(certificate());
+		// Shares the server's configuration rather than detaching a copy per connection to set the key and certificate.
+		sslSocket->setSslConfiguration(_sslConfiguration);
 		sslSocket->startServerEncryption();
+		_sessionCache->prepare(sslSocket);
 		connect(sslSocket, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslSocket_sslErrors(QList<QSslError>)));
 		connect(sslSocket, SIGNAL(encrypted()), this, SLOT(sslSocket_encrypted()));
+		connect(sslSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(sslSocket_error()));
 		addPendingConnection(sslSocket);
 		nextPendingConnection();
 		createHttpConnection()->initialize(sslSocket, sslSocket);
@@ -57,10 +611,70 @@ void HttpsServer::incomingConnection(qintptr socketDescriptor)
 
 void HttpsServer::sslSocket_sslErrors(const QList<QSslError>&)
 {
+	// Unless ignored, the errors make the handshake fail: counted by sslSocket_error().
 }
 
 void HttpsServer::sslSocket_encrypted()
 {
+	++_encryptedCount;
+	QSslSocket* sslSocket = qobject_cast<QSslSocket*>(sender());
+	if (sslSocket == 0) return;
+	disconnect(sslSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(sslSocket_error()));
+	countSession(sslSocket);
 }
 
+void HttpsServer::sslSocket_error()
+{
+	// Connected until the handshake completes: later errors belong to the connection, not to its handshake.
+	QSslSocket* sslSocket = static_cast<QSslSocket*>(sender());
+	disconnect(sslSocket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(sslSocket_error()));
+	++_failedHandshakeCount;
+}
+
+void HttpsServer::countSession(QSslSocket *sslSocket)
+{
+	if (!isSessionResumptionSupported()) return;
+	if (HttpsSessionCache::isResumed(sslSocket))
+		++_sessionHitCount;
+	else
+		++_sessionMissCount;
+}
+
+void HttpsServer::handshake_finished(QObject *socket)
+{
+	--_handshakePool->pendingCount;
+	QSslSocket* sslSocket = static_cast<QSslSocket*>(socket);
+	if (sslSocket == 0)
+	{
+		++_failedHandshakeCount;
+		endHandshake();
+		return;
+	}
+	_handshakePool->handedOver.remove(sslSocket);
+
+	++_encryptedCount;
+	countSession(sslSocket);
+	if (isShuttingDown())
+	{
+		// Too late to serve anything on it.
+		sslSocket->abort();
+		delete sslSocket;
+		endHandshake();
+		return;
+	}
+
+	sslSocket->setParent(this);
+	addPendingConnection(sslSocket);
+	nextPendingConnection();
+	HttpConnection* connection = createHttpConnection();
+	connection->initialize(sslSocket, sslSocket);
+	endHandshake(); // Now counted as an active connection.
+
+	// The client may have sent its request while the socket was being handed over: no readyRead() will come for it.
+	if (sslSocket->bytesAvailable() > 0)
+		QMetaObject::invokeMethod(connection, "processInput", Qt::QueuedConnection);
+}
+
+#include "HttpsServer.moc"
+
 #endif // !defined(PILLOW_NO_SSL) && !defined(QT_NO_SSL)
@@ -16,25 +16,65 @@
 #ifndef QSSLERROR_H
 #include <QtNetwork/QSslError>
 #endif // QSSLERROR_H
+#ifndef QSSLCONFIGURATION_H
+#include <QtNetwork/QSslConfiguration>
+#endif // QSSLCONFIGURATION_H
 
 #if !defined(PILLOW_NO_SSL) && !defined(QT_NO_SSL)
 
+class QSslSocket;
+
 namespace Pillow
 {
+	class HttpsHandshakePool;
+	class HttpsSessionCache;
+
 	//
 	// HttpsServer
 	//
+	// All connections share a single QSslConfiguration, holding the certificate and private key along with
+	// the protocol and cipher settings of sslConfiguration(). The handshake counters tell how many connections
+	// were encrypted and how many handshakes failed.
+	//
+	// When built with CONFIG += pillow_openssl (Qt 5 only, see config.pri), returning clients can resume their
+	// TLS session and skip the full handshake: the server keeps up to sessionCacheSize() sessions for
+	// sessionTimeout() seconds, and issues session tickets that it can decrypt for as long as it lives. The
+	// session counters tell how many handshakes resumed a session. Without it, the session settings are kept
+	// but every handshake is a full one.
+	//
+	// By default, handshakes run on the server's thread, so a burst of new clients delays the requests of the
+	// connections already established. With a handshakeThreadCount above 0, handshakes run on that many worker
+	// threads instead, and only encrypted sockets are handed back to the server. In that mode, at most
+	// maximumPendingHandshakes may be in progress at once: further connections are refused until some complete,
+	// and handshakes that take longer than handshakeTimeout milliseconds are aborted. After shutdown(), drained()
+	// also waits for the handshakes in progress, whose connections are closed as soon as they complete.
+	//
 
 	class PILLOWCORE_EXPORT HttpsServer : public Pillow::HttpServer
 	{
 		Q_OBJECT
+		Q_PROPERTY(int handshakeThreadCount READ handshakeThreadCount WRITE setHandshakeThreadCount)
+		Q_PROPERTY(int maximumPendingHandshakes READ maximumPendingHandshakes WRITE setMaximumPendingHandshakes)
+		Q_PROPERTY(int handshakeTimeout READ handshakeTimeout WRITE setHandshakeTimeout)
 		QSslCertificate _certificate;
 		QSslKey _privateKey;
+		QSslConfiguration _sslConfiguration;
+		quint64 _encryptedCount, _failedHandshakeCount;
+		quint64 _sessionHitCount, _sessionMissCount;
+		HttpsHandshakePool* _handshakePool;
+		HttpsSessionCache* _sessionCache;
 
 	public slots:
 		void sslSocket_encrypted();
 		void sslSocket_sslErrors(const QList<QSslError>& sslErrors);
 
+	private slots:
+		void sslSocket_error();
+		void handshake_finished(QObject* socket); // Null if the handshake failed.
+
+	private:
+		void countSession(QSslSocket* sslSocket);
+
 	protected:
 #if QT_VERSION < QT_VERSION_CHECK(5, 0, 0)
 		void incomingConnection(int socketDescriptor);
@@ -42,16 +82,57 @@ namespace Pillow
 		void incomingConnection(qintptr socketDescriptor) Q_DECL_OVERRIDE;
 #endif
 
+	public:
+		enum { DefaultMaximumPendingHandshakes = 512 };
+		enum { DefaultHandshakeTimeout = 10000 }; // Milliseconds.
+		enum { DefaultSessionCacheSize = 20480 };
+		enum { DefaultSessionTimeout = 300 }; // Seconds.
+
 	public:
 		HttpsServer(QObject* parent = 0);
 		HttpsServer(const QSslCertificate& certificate, const QSslKey& privateKey, const QHostAddress& serverAddress, quint16 serverPort, QObject *parent = 0);
+		~HttpsServer();
 
 		const QSslCertificate& certificate() const { return _certificate; }
 		const QSslKey& privateKey() const { return _privateKey; }
 
+		// The configuration applied to incoming connections. The certificate and private key set on the server
+		// take precedence over those of a configuration given to setSslConfiguration().
+		const QSslConfiguration& sslConfiguration() const { return _sslConfiguration; }
+
+		quint64 encryptedCount() const { return _encryptedCount; } // Handshakes completed.
+		quint64 failedHandshakeCount() const { return _failedHandshakeCount; } // On SSL errors, socket errors or timeouts.
+		quint64 sessionHitCount() const { return _sessionHitCount; }   // Handshakes that resumed a session.
+		quint64 sessionMissCount() const { return _sessionMissCount; } // Full handshakes, when sessions can be resumed at all.
+		void resetCounters();
+
+		static bool isSessionResumptionSupported();
+
+		int sessionCacheSize() const;
+		void setSessionCacheSize(int size); // 0 to disable the session cache. Session tickets do not need it.
+
+		int sessionTimeout() const;
+		void setSessionTimeout(int timeout);
+
+		bool sessionTicketsEnabled() const; // True by default. QSsl::SslOptionDisableSessionTickets also disables them.
+		void setSessionTicketsEnabled(bool enabled);
+
+		int handshakeThreadCount() const; // 0 (the default) to run handshakes on the server's thread.
+		void setHandshakeThreadCount(int threadCount); // Handshakes in progress on the previous threads are aborted.
+
+		int maximumPendingHandshakes() const; // 0 for no limit.
+		void setMaximumPendingHandshakes(int maximum);
+
+		int handshakeTimeout() const;
+		void setHandshakeTimeout(int timeout);
+
+		int pendingHandshakeCount() const;      // Handshakes in progress on the worker threads.
+		quint64 refusedHandshakeCount() const;  // Connections refused because maximumPendingHandshakes was reached.
+
 	public slots:
 		void setCertificate(const QSslCertificate& certificate);
 		void setPrivateKey(const QSslKey& privateKey);
+		void setSslConfiguration(const QSslConfiguration& configuration);
 	};
 }
 
@@ -0,0 +1,319 @@
+/**
+ * Line oriented HTTP/1.x request header parser.
+ *
+ * Accepts the same grammar as the thin parser (see common.rl), but instead of running a state machine
+ * over every byte it first locates each CRLF terminated line with memchr, then validates the complete
+ * line in one pass using character class tables. The request URI, which is usually the longest part of
+ * the request line, is scanned 16 bytes at a time when SSE2 is available. Incomplete lines are left alone
+ * until more data arrives; only the position of the CRLF search is remembered between calls.
+ */
+#include "fastparser.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FAST_PARSER_SSE2
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+enum {
+  fast_parser_request_line = 1,
+  fast_parser_headers = 2,
+  fast_parser_done = 3,
+  fast_parser_error = 0
+};
+
+/** Character classes **/
+
+enum {
+  C_METHOD = 0x01, /* upper | digit | safe */
+  C_TOKEN = 0x02,  /* ascii -- (CTL | tspecials) */
+  C_URI = 0x04,    /* uchar | reserved, without escapes and the "?" and "#" delimiters */
+  C_SCHEME = 0x08, /* alpha | digit | "+" | "-" | "." */
+  C_XDIGIT = 0x10,
+  C_DIGIT = 0x20
+};
+
+/* C_METHOD, C_TOKEN, C_URI, C_SCHEME, C_XDIGIT and C_DIGIT bits of each byte, as defined above.
+ * A constant table rather than one computed on first use, which threads could race on. */
+static const unsigned char char_classes[256] = {
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x00 */
+  0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, /* 0x10 */
+  0x00, 0x06, 0x04, 0x02, 0x07, 0x02, 0x06, 0x06, 0x04, 0x04, 0x06, 0x0e, 0x04, 0x0f, 0x0f, 0x04, /* 0x20 */
+  0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x3f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, /* 0x30 */
+  0x04, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x1f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, /* 0x40 */
+  0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x0f, 0x04, 0x04, 0x04, 0x06, 0x07, /* 0x50 */
+  0x06, 0x1e, 0x1e, 0x1e, 0x1e, 0x1e, 0x1e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, /* 0x60 */
+  0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x0e, 0x04, 0x06, 0x04, 0x06, 0x00, /* 0x70 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0x80 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0x90 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0xa0 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0xb0 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0xc0 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0xd0 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0xe0 */
+  0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, /* 0xf0 */
+};
+
+#define IS(CLASS, C) (char_classes[(unsigned char)(C)] & (CLASS))
+
+/** Scanning **/
+
+#ifdef FAST_PARSER_SSE2
+static int lowest_bit(unsigned int mask)
+{
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (int)index;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+/* Returns the first byte in [p, end) that is not a plain URI character. */
+static const char *skip_uri_chars(const char *p, const char *end)
+{
+#ifdef FAST_PARSER_SSE2
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i del = _mm_set1_epi8(127);
+  const __m128i hash = _mm_set1_epi8('#');
+  const __m128i question = _mm_set1_epi8('?');
+  const __m128i percent = _mm_set1_epi8('%');
+
+  while (end - p >= 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+    int mask;
+    __m128i stop = _mm_cmpeq_epi8(_mm_max_epu8(chunk, space), space); /* chunk <= ' ' */
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chunk, del));
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chunk, hash));
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chunk, question));
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(chunk, percent));
+    mask = _mm_movemask_epi8(stop);
+    if (mask != 0)
+      return p + lowest_bit((unsigned int)mask);
+    p += 16;
+  }
+#endif
+
+  while (p < end && IS(C_URI, *p))
+    ++p;
+  return p;
+}
+
+/* Skips URI characters and escapes; "?" is accepted when allow_question is set. Returns NULL on a bad escape. */
+static const char *skip_uri(const char *p, const char *end, int allow_question)
+{
+  for (;;) {
+    p = skip_uri_chars(p, end);
+    if (p == end)
+      return p;
+    if (*p == '%') {
+      ++p;
+      if (p < end && *p == 'u')
+        ++p;
+      if (end - p < 2 || !IS(C_XDIGIT, p[0]) || !IS(C_XDIGIT, p[1]))
+        return NULL;
+      p += 2;
+    } else if (*p == '?' && allow_question) {
+      ++p;
+    } else {
+      return p;
+    }
+  }
+}
+
+/** Lines **/
+
+static int parse_request_line(http_parser *parser, const char *buffer, const char *p, const char *end)
+{
+  const char *start = p, *uri, *version;
+
+  /* Method */
+  while (p < end && IS(C_METHOD, *p))
+    ++p;
+  if (p == start || p - start > 20 || p == end || *p != ' ')
+    return 0;
+  parser->request_method_start = (int)(start - buffer);
+  parser->request_method_len = (int)(p - start);
+
+  /* Request URI */
+  uri = ++p;
+  if (p == end)
+    return 0;
+
+  if (*p == '*') {
+    ++p;
+  } else if (*p == '/') {
+    p = skip_uri(p, end, 0);
+    if (p == NULL)
+      return 0;
+    parser->request_path_start = (int)(uri - buffer);
+    parser->request_path_len = (int)(p - uri);
+    if (p < end && *p == '?') {
+      const char *query = ++p;
+      p = skip_uri(p, end, 1);
+      if (p == NULL)
+        return 0;
+      parser->query_string_start = (int)(query - buffer);
+      parser->query_string_len = (int)(p - query);
+    }
+  } else {
+    while (p < end && IS(C_SCHEME, *p))
+      ++p;
+    if (p == end || *p != ':')
+      return 0;
+    p = skip_uri(p + 1, end, 1);
+    if (p == NULL)
+      return 0;
+  }
+  parser->request_uri_start = (int)(uri - buffer);
+  parser->request_uri_len = (int)(p - uri);
+
+  /* Fragment */
+  if (p < end && *p == '#') {
+    const char *fragment = ++p;
+    p = skip_uri(p, end, 1);
+    if (p == NULL)
+      return 0;
+    parser->fragment_start = (int)(fragment - buffer);
+    parser->fragment_len = (int)(p - fragment);
+  }
+
+  /* HTTP version */
+  if (p == end || *p != ' ')
+    return 0;
+  version = ++p;
+  if (end - p < 5 || memcmp(p, "HTTP/", 5) != 0)
+    return 0;
+  p += 5;
+  start = p;
+  while (p < end && IS(C_DIGIT, *p))
+    ++p;
+  if (p == start || p == end || *p != '.')
+    return 0;
+  start = ++p;
+  while (p < end && IS(C_DIGIT, *p))
+    ++p;
+  if (p == start || p != end)
+    return 0;
+  parser->http_version_start = (int)(version - buffer);
+  parser->http_version_len = (int)(p - version);
+
+  return 1;
+}
+
+static int parse_header_line(http_parser *parser, const char *buffer, const char *p, const char *end)
+{
+  const char *field = p;
+
+  while (p < end && IS(C_TOKEN, *p))
+    ++p;
+  if (p == field || p == end || *p != ':')
+    return 0;
+  parser->field_start = field - buffer;
+  parser->field_len = p - field;
+
+  ++p;
+  while (p < end && *p == ' ')
+    ++p;
+  parser->mark = p - buffer;
+
+  if (parser->http_field != NULL)
+    parser->http_field(parser->data, field, parser->field_len, p, end - p);
+  return 1;
+}
+
+/** Interface **/
+
+int fast_http_parser_init(http_parser *parser)
+{
+
+  parser->cs = fast_parser_request_line;
+  parser->body_start = 0;
+  parser->content_len = 0;
+  parser->mark = 0;
+  parser->nread = 0;
+  parser->field_len = 0;
+  parser->field_start = 0;
+  parser->query_start = 0;
+
+  parser->request_method_start = 0;
+  parser->request_uri_start = 0;
+  parser->fragment_start = 0;
+  parser->request_path_start = 0;
+  parser->query_string_start = 0;
+  parser->http_version_start = 0;
+
+  parser->request_method_len = 0;
+  parser->request_uri_len = 0;
+  parser->fragment_len = 0;
+  parser->request_path_len = 0;
+  parser->query_string_len = 0;
+  parser->http_version_len = 0;
+
+  return 1;
+}
+
+/* As with the thin parser, "off" must be the value of nread returned by the previous call. Bytes that were
+   already scanned are not looked at again, except for the start of a line that was incomplete. */
+size_t fast_http_parser_execute(http_parser *parser, const char *buffer, size_t len, size_t off)
+{
+  /* The line currently being received starts at query_start; "mark" holds the header value start. */
+  size_t scan = off;
+
+  while (parser->cs == fast_parser_request_line || parser->cs == fast_parser_headers) {
+    const char *line = buffer + parser->query_start;
+    const char *cr = scan < len ? (const char *)memchr(buffer + scan, '\r', len - scan) : NULL;
+
+    if (cr == NULL) {
+      scan = len;
+      break;
+    }
+    if ((size_t)(cr - buffer) + 1 == len) {
+      scan = cr - buffer; /* Look at this CR again once the next byte has arrived. */
+      break;
+    }
+    if (cr[1] != '\n') {
+      parser->cs = fast_parser_error; /* Lone CRs are not allowed anywhere in the header. */
+      scan = cr - buffer;
+      break;
+    }
+
+    scan = cr - buffer + 2;
+    if (parser->cs == fast_parser_request_line) {
+      if (!parse_request_line(parser, buffer, line, cr)) {
+        parser->cs = fast_parser_error;
+        break;
+      }
+      parser->cs = fast_parser_headers;
+    } else if (cr == line) {
+      parser->body_start = scan;
+      parser->cs = fast_parser_done;
+      if (parser->header_done != NULL)
+        parser->header_done(parser->data, buffer + scan, len - scan);
+      break;
+    } else if (!parse_header_line(parser, buffer, line, cr)) {
+      parser->cs = fast_parser_error;
+      break;
+    }
+    parser->query_start = scan;
+  }
+
+  parser->nread = scan;
+  return parser->nread;
+}
+
+int fast_http_parser_has_error(http_parser *parser)
+{
+  return parser->cs == fast_parser_error;
+}
+
+int fast_http_parser_is_finished(http_parser *parser)
+{
+  return parser->cs == fast_parser_done;
+}
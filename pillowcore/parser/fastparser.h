@@ -0,0 +1,26 @@
+/**
+ * Line oriented HTTP/1.x request header parser.
+ *
+ * Drop-in alternative to the Ragel generated thin parser (parser.h): it fills the same http_parser
+ * structure with the same offsets and invokes the same callbacks, so either can back HttpConnection.
+ */
+
+#ifndef fast_http_parser_h
+#define fast_http_parser_h
+
+#include "parser.h"
+
+#if defined(__cplusplus)
+extern "C" {
+#endif // __cplusplus
+
+PILLOW_PARSER_EXPORT int fast_http_parser_init(http_parser *parser);
+PILLOW_PARSER_EXPORT size_t fast_http_parser_execute(http_parser *parser, const char *data, size_t len, size_t off);
+PILLOW_PARSER_EXPORT int fast_http_parser_has_error(http_parser *parser);
+PILLOW_PARSER_EXPORT int fast_http_parser_is_finished(http_parser *parser);
+
+#if defined(__cplusplus)
+}
+#endif // __cplusplus
+
+#endif
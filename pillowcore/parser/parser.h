@@ -12,6 +12,21 @@
 #include <stddef.h>
 #endif
 
+/* Same as PILLOWCORE_EXPORT (PillowCore.h), which C sources can not use. */
+#if defined(PILLOWCORE_BUILD_STATIC)
+#define PILLOW_PARSER_EXPORT
+#elif defined(_WIN32)
+#  if defined(PILLOWCORE_BUILD)
+#    define PILLOW_PARSER_EXPORT __declspec(dllexport)
+#  else
+#    define PILLOW_PARSER_EXPORT __declspec(dllimport)
+#  endif
+#elif defined(__GNUC__)
+#define PILLOW_PARSER_EXPORT __attribute__((visibility("default")))
+#else
+#define PILLOW_PARSER_EXPORT
+#endif
+
 #if defined(__cplusplus)
 extern "C" {
 #endif // __cplusplus
@@ -42,11 +57,11 @@ typedef struct http_parser {
 
 } http_parser;
 
-int thin_http_parser_init(http_parser *parser);
-int thin_http_parser_finish(http_parser *parser);
-size_t thin_http_parser_execute(http_parser *parser, const char *data, size_t len, size_t off);
-int thin_http_parser_has_error(http_parser *parser);
-int thin_http_parser_is_finished(http_parser *parser);
+PILLOW_PARSER_EXPORT int thin_http_parser_init(http_parser *parser);
+PILLOW_PARSER_EXPORT int thin_http_parser_finish(http_parser *parser);
+PILLOW_PARSER_EXPORT size_t thin_http_parser_execute(http_parser *parser, const char *data, size_t len, size_t off);
+PILLOW_PARSER_EXPORT int thin_http_parser_has_error(http_parser *parser);
+PILLOW_PARSER_EXPORT int thin_http_parser_is_finished(http_parser *parser);
 
 #define http_parser_nread(parser) (parser)->nread
 
@@ -25,11 +25,20 @@ pillow_zlib {
 	LIBS += $$PILLOW_ZLIB_LIBS
 }
 
+pillow_openssl:!pillow_no_ssl {
+	QT += core-private network-private
+	LIBS += -lssl -lcrypto
+}
+
 SOURCES += \
 	parser/parser.c \
 	parser/http_parser.c \
+	parser/fastparser.c \
 	HttpServer.cpp \
 	HttpHandler.cpp \
+	HttpHandlerBundle.cpp \
+	HttpHandlerAsync.cpp \
+	HttpHandlerAsyncLog.cpp \
 	HttpHandlerQtScript.cpp \
 	HttpHelpers.cpp \
 	HttpsServer.cpp \
@@ -37,13 +46,21 @@ SOURCES += \
 	HttpConnection.cpp \
 	HttpHandlerProxy.cpp \
 	HttpClient.cpp \
-	HttpHeader.cpp
+	HttpClientPool.cpp \
+	HttpHostCache.cpp \
+	HttpHeader.cpp \
+	HttpBufferPool.cpp
 
 HEADERS += \
 	parser/parser.h \
 	parser/http_parser.h \
+	parser/fastparser.h \
 	HttpServer.h \
 	HttpHandler.h \
+	HttpHandlerBundle.h \
+	HttpHandlerAsync.h \
+	HttpHandlerAsyncLog.h \
+	HttpCoroutine.h \
 	HttpHandlerQtScript.h \
 	HttpHelpers.h \
 	HttpsServer.h \
@@ -52,9 +69,13 @@ HEADERS += \
 	HttpHandlerProxy.h \
 	ByteArrayHelpers.h \
 	private/ByteArray.h \
+	private/Trace.h \
 	HttpClient.h \
+	HttpClientPool.h \
+	HttpHostCache.h \
 	pch.h \
 	HttpHeader.h \
+	HttpBufferPool.h \
 	PillowCore.h
 
 OTHER_FILES += \
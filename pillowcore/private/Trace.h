@@ -0,0 +1,61 @@
+#ifndef PILLOW_TRACE_H
+#define PILLOW_TRACE_H
+
+//
+// Static tracepoints (USDT), for bpftrace, perf or SystemTap. For example:
+//
+//     bpftrace -e 'usdt:/path/to/libpillowcore.so:pillow:connection_completed { @status[arg1] = count(); }'
+//
+// Each probe compiles to a nop plus an ELF note describing its arguments, guarded by a semaphore that tracers
+// increment when they attach: until then, a probe costs a load and a predicted branch, and its arguments are
+// not evaluated. They are available when <sys/sdt.h> is (install systemtap-sdt-dev or systemtap-sdt-devel),
+// and can be left out entirely with CONFIG += pillow_no_tracing. Probes of the "pillow" provider:
+//
+//     connection_receiving_headers(HttpConnection*, int requestCount)
+//     connection_request_ready(HttpConnection*, int requestContentLength, int requestCount)
+//     connection_completed(HttpConnection*, int statusCode, qint64 responseContentBytes, qint64 elapsedNanoseconds)
+//     connection_closed(HttpConnection*, int requestCount)
+//     connection_request_error(HttpConnection*, int statusCode)
+//     client_connect(HttpClient*, const char* host, int port)
+//     client_request(HttpClient*, const char* method, qint64 requestContentLength) (-1 for chunked uploads)
+//     client_finished(HttpClient*, int statusCode, int error, int responseContentLength)
+//
+// New probes must be added to PILLOW_TRACE_PROBES. Their semaphores are defined in the file that defines
+// PILLOW_TRACE_DEFINE_SEMAPHORES before including this header (HttpConnection.cpp).
+//
+
+#if !defined(PILLOW_NO_TRACING) && defined(__has_include)
+#	if __has_include(<sys/sdt.h>)
+#		define PILLOW_TRACING
+#	endif
+#endif
+
+#define PILLOW_TRACE_PROBES(X) \
+	X(connection_receiving_headers) X(connection_request_ready) X(connection_completed) X(connection_closed) \
+	X(connection_request_error) X(client_connect) X(client_request) X(client_finished)
+
+#ifdef PILLOW_TRACING
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#ifdef PILLOW_TRACE_DEFINE_SEMAPHORES
+#define PILLOW_TRACE_SEMAPHORE(name) extern "C" { __attribute__((visibility("default"))) unsigned short pillow_##name##_semaphore __attribute__((section(".probes"))) = 0; }
+#else
+#define PILLOW_TRACE_SEMAPHORE(name) extern "C" unsigned short pillow_##name##_semaphore;
+#endif // PILLOW_TRACE_DEFINE_SEMAPHORES
+PILLOW_TRACE_PROBES(PILLOW_TRACE_SEMAPHORE)
+#undef PILLOW_TRACE_SEMAPHORE
+
+#define PILLOW_TRACE_ENABLED(name) __builtin_expect(*static_cast<volatile unsigned short*>(&pillow_##name##_semaphore) != 0, 0)
+#define PILLOW_TRACE2(name, a1, a2) do { if (PILLOW_TRACE_ENABLED(name)) DTRACE_PROBE2(pillow, name, a1, a2); } while (0)
+#define PILLOW_TRACE3(name, a1, a2, a3) do { if (PILLOW_TRACE_ENABLED(name)) DTRACE_PROBE3(pillow, name, a1, a2, a3); } while (0)
+#define PILLOW_TRACE4(name, a1, a2, a3, a4) do { if (PILLOW_TRACE_ENABLED(name)) DTRACE_PROBE4(pillow, name, a1, a2, a3, a4); } while (0)
+#else
+// The arguments are still compiled, so that probes do not break in either configuration, but never evaluated.
+#define PILLOW_TRACE_ENABLED(name) false
+#define PILLOW_TRACE2(name, a1, a2) do { if (false) { (void)(a1); (void)(a2); } } while (0)
+#define PILLOW_TRACE3(name, a1, a2, a3) do { if (false) { (void)(a1); (void)(a2); (void)(a3); } } while (0)
+#define PILLOW_TRACE4(name, a1, a2, a3, a4) do { if (false) { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } } while (0)
+#endif // PILLOW_TRACING
+
+#endif // PILLOW_TRACE_H
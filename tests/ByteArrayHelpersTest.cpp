@@ -166,6 +166,119 @@ private slots:
 		QVERIFY(!Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive("hello", QLatin1Literal("hello\1")));
 	}
 
+	void test_asciiEqualsCaseInsensitive_matchesScalarVersion()
+	{
+		// Exercise the vectorized, 8 bytes and scalar paths, with characters around the letter ranges.
+		const char alphabet[] = "aAzZmM@[`{09-_\xc1\xe1\x80\xff";
+		const int alphabetSize = sizeof(alphabet) - 1;
+		qsrand(42);
+
+		for (int iteration = 0; iteration < 20000; ++iteration)
+		{
+			const int size = qrand() % 70;
+			QByteArray first(size, 0), second(size, 0);
+			for (int i = 0; i < size; ++i)
+			{
+				char c = alphabet[qrand() % alphabetSize];
+				first[i] = c;
+				if (qrand() % 3 == 0 && c >= 'a' && c <= 'z') c -= 32;
+				else if (qrand() % 3 == 0 && c >= 'A' && c <= 'Z') c += 32;
+				second[i] = c;
+			}
+			if (size > 0 && qrand() % 2 == 0)
+				second[qrand() % size] = alphabet[qrand() % alphabetSize];
+
+			QCOMPARE(Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(first.constData(), second.constData(), size),
+					 Pillow::ByteArrayHelpers::Scalar::asciiEqualsCaseInsensitive(first.constData(), second.constData(), size));
+		}
+
+		QVERIFY(Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(QByteArray("Some-Rather-Long-Header-Name-For-Vectors"), QByteArray("some-rather-long-header-name-for-vectors")));
+		QVERIFY(!Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(QByteArray("Some-Rather-Long-Header-Name-For-Vectors"), QByteArray("some-rather-long-header-name-for-vector!")));
+		QVERIFY(!Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(QByteArray("@@@@@@@@@@@@@@@@@"), QByteArray("`````````````````")));
+		QVERIFY(!Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(QByteArray("\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1\xc1"), QByteArray("\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1\xe1")));
+	}
+
+	void test_indexOf()
+	{
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOf("", 0, '&'), -1);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOf("a&b", 3, '&'), 1);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOf("a&b", 1, '&'), -1);
+
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither("", 0, '&', '='), -1);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither("key=value&other", 15, '&', '='), 3);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither("key&value=other", 15, '&', '='), 3);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither("a_rather_long_key_without_delimiters", 36, '&', '='), -1);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither("a_rather_long_key_with_a_delimiter=", 35, '&', '='), 34);
+		for (int i = 0; i < 40; ++i)
+		{
+			QByteArray data(40, 'x'); data[i] = '=';
+			QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither(data.constData(), data.size(), '&', '='), i);
+			QCOMPARE(Pillow::ByteArrayHelpers::indexOfEither(data.constData(), i, '&', '='), -1);
+		}
+
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfCrLf("", 0), -1);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfCrLf("\r", 1), -1);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfCrLf("\r\n", 2), 0);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfCrLf("ab\rc\r\nd", 7), 4);
+		QCOMPARE(Pillow::ByteArrayHelpers::indexOfCrLf("ab\n\r", 4), -1);
+
+		QVERIFY(!Pillow::ByteArrayHelpers::containsPercent("hello world", 11));
+		QVERIFY(Pillow::ByteArrayHelpers::containsPercent("hello%20world", 13));
+	}
+
+	void benchmark_asciiEqualsCaseInsensitive_data()
+	{
+		QTest::addColumn<bool>("scalar");
+		QTest::addColumn<QByteArray>("first");
+		QTest::addColumn<QByteArray>("second");
+		QTest::newRow("scalar short") << true << QByteArray("Content-Length") << QByteArray("content-length");
+		QTest::newRow("vector short") << false << QByteArray("Content-Length") << QByteArray("content-length");
+		QTest::newRow("scalar long") << true << QByteArray("Access-Control-Allow-Credentials") << QByteArray("access-control-allow-credentials");
+		QTest::newRow("vector long") << false << QByteArray("Access-Control-Allow-Credentials") << QByteArray("access-control-allow-credentials");
+	}
+
+	void benchmark_asciiEqualsCaseInsensitive()
+	{
+		QFETCH(bool, scalar);
+		QFETCH(QByteArray, first);
+		QFETCH(QByteArray, second);
+
+		qint64 dummy = 0;
+		QBENCHMARK
+		{
+			for (int i = 0; i < 1000000; ++i)
+			{
+				if (scalar) dummy += Pillow::ByteArrayHelpers::Scalar::asciiEqualsCaseInsensitive(first.constData(), second.constData(), first.size());
+				else dummy += Pillow::ByteArrayHelpers::asciiEqualsCaseInsensitive(first.constData(), second.constData(), first.size());
+			}
+		}
+		QVERIFY(dummy > 0);
+	}
+
+	void benchmark_indexOfEither_data()
+	{
+		QTest::addColumn<bool>("scalar");
+		QTest::newRow("scalar") << true;
+		QTest::newRow("vector") << false;
+	}
+
+	void benchmark_indexOfEither()
+	{
+		QFETCH(bool, scalar);
+		const QByteArray data = QByteArray(200, 'x') + "=value";
+
+		qint64 dummy = 0;
+		QBENCHMARK
+		{
+			for (int i = 0; i < 100000; ++i)
+			{
+				if (scalar) dummy += Pillow::ByteArrayHelpers::Scalar::indexOfEither(data.constData(), data.size(), '&', '=');
+				else dummy += Pillow::ByteArrayHelpers::indexOfEither(data.constData(), data.size(), '&', '=');
+			}
+		}
+		QVERIFY(dummy > 0);
+	}
+
 	void test_unhex()
 	{
 		QCOMPARE(Pillow::ByteArrayHelpers::unhex('0'), char(0));
@@ -186,6 +299,63 @@ private slots:
 		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("hello%20world%3F"), QString("hello world?"));
 		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("hello%20%20world100%25"), QString("hello  world100%"));
 		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("hello%20%20world%2f%2F!"), QString("hello  world//!"));
+		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("a+b%2"), QString("a+b%2"));
+		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("/some/rather/long/path/with%20a%20space/in/it"), QString("/some/rather/long/path/with a space/in/it"));
+		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("/caf%C3%A9/and/some/more/characters"), QString::fromUtf8("/caf\xc3\xa9/and/some/more/characters"));
+		QCOMPARE(Pillow::ByteArrayHelpers::percentDecode("/caf\xc3\xa9%20/and/some/more/characters"), QString::fromUtf8("/caf\xc3\xa9 /and/some/more/characters"));
+	}
+
+	void test_formDecode()
+	{
+		QCOMPARE(Pillow::ByteArrayHelpers::formDecode("", 0), QString());
+		QCOMPARE(Pillow::ByteArrayHelpers::formDecode("hello", 5), QString("hello"));
+		QCOMPARE(Pillow::ByteArrayHelpers::formDecode("hello+world%21", 14), QString("hello world!"));
+		QCOMPARE(Pillow::ByteArrayHelpers::formDecode("a%2Bb+c", 7), QString("a+b c"));
+	}
+
+	void test_percentDecode_matchesScalarVersion()
+	{
+		// Exercise the vectorized and scalar paths, with escapes decoding to ASCII and non-ASCII characters.
+		const char alphabet[] = "ab/%+2F0e9\xc3\xa9%C3%A9 Z";
+		const int alphabetSize = sizeof(alphabet) - 1;
+		qsrand(42);
+
+		for (int iteration = 0; iteration < 20000; ++iteration)
+		{
+			const int size = qrand() % 70;
+			QByteArray data(size, 0);
+			for (int i = 0; i < size; ++i) data[i] = alphabet[qrand() % alphabetSize];
+
+			QCOMPARE(Pillow::ByteArrayHelpers::percentDecode(data.constData(), size), Pillow::ByteArrayHelpers::Scalar::percentDecode(data.constData(), size));
+			QCOMPARE(Pillow::ByteArrayHelpers::formDecode(data.constData(), size), Pillow::ByteArrayHelpers::Scalar::percentDecode(data.constData(), size, true));
+		}
+	}
+
+	void benchmark_percentDecode_data()
+	{
+		QTest::addColumn<bool>("scalar");
+		QTest::addColumn<QByteArray>("data");
+		QTest::newRow("scalar clean") << true << QByteArray("/app/assets/javascripts/application-5f2d1c7e8a.js");
+		QTest::newRow("vector clean") << false << QByteArray("/app/assets/javascripts/application-5f2d1c7e8a.js");
+		QTest::newRow("scalar escaped") << true << QByteArray("/app/some%20assets/javascripts/application%2D5f2d1c7e8a.js");
+		QTest::newRow("vector escaped") << false << QByteArray("/app/some%20assets/javascripts/application%2D5f2d1c7e8a.js");
+	}
+
+	void benchmark_percentDecode()
+	{
+		QFETCH(bool, scalar);
+		QFETCH(QByteArray, data);
+
+		qint64 dummy = 0;
+		QBENCHMARK
+		{
+			for (int i = 0; i < 100000; ++i)
+			{
+				if (scalar) dummy += Pillow::ByteArrayHelpers::Scalar::percentDecode(data.constData(), data.size()).size();
+				else dummy += Pillow::ByteArrayHelpers::percentDecode(data.constData(), data.size()).size();
+			}
+		}
+		QVERIFY(dummy > 0);
 	}
 
 	void test_byteArray_equals_latin1Literal()
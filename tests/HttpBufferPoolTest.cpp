@@ -0,0 +1,114 @@
+#include <QtTest/QTest>
+#include <QtCore/QThread>
+#include "Helpers.h"
+#include <HttpBufferPool.h>
+
+namespace
+{
+	class PoolThread : public QThread
+	{
+	public:
+		Pillow::HttpBufferPool* pool;
+		int pooledCount;
+
+		PoolThread() : pool(0), pooledCount(-1) {}
+
+	protected:
+		void run()
+		{
+			pool = Pillow::HttpBufferPool::instance();
+			QByteArray buffer = pool->take(100);
+			pool->give(buffer);
+			pooledCount = pool->pooledCount();
+		}
+	};
+}
+
+class HttpBufferPoolTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void should_round_capacities_up_to_size_classes()
+	{
+		Pillow::HttpBufferPool pool;
+		pool.setSizeClasses(QList<int>() << 1024 << 4096);
+		QCOMPARE(pool.sizeClasses(), QList<int>() << 1024 << 4096);
+
+		QByteArray buffer = pool.take(10);
+		QVERIFY(buffer.isEmpty());
+		QVERIFY(buffer.capacity() >= 1024 && buffer.capacity() < 4096);
+		buffer = pool.take(1025);
+		QVERIFY(buffer.capacity() >= 4096);
+		buffer = pool.take(10000); // Larger than any class.
+		QVERIFY(buffer.capacity() >= 10000);
+	}
+
+	void should_reuse_given_buffers()
+	{
+		Pillow::HttpBufferPool pool;
+		QByteArray buffer = pool.take(100);
+		buffer.append("some data");
+		const char* storage = buffer.constData();
+
+		pool.give(buffer);
+		QVERIFY(buffer.isNull());
+		QCOMPARE(pool.pooledCount(), 1);
+		QVERIFY(pool.pooledBytes() >= 1024);
+
+		QByteArray again = pool.take(200);
+		QVERIFY(again.constData() == storage);
+		QVERIFY(again.isEmpty());
+		QCOMPARE(pool.pooledCount(), 0);
+		QCOMPARE(pool.pooledBytes(), qint64(0));
+	}
+
+	void should_not_pool_shared_or_oversized_buffers()
+	{
+		Pillow::HttpBufferPool pool;
+		QByteArray buffer = pool.take(100);
+		QByteArray copy = buffer;
+		pool.give(buffer);
+		QCOMPARE(pool.pooledCount(), 0);
+
+		QByteArray huge; huge.reserve(1024 * 1024);
+		pool.give(huge);
+		QCOMPARE(pool.pooledCount(), 0);
+
+		QByteArray tiny; tiny.reserve(16);
+		pool.give(tiny);
+		QCOMPARE(pool.pooledCount(), 0);
+	}
+
+	void should_respect_the_pooled_bytes_limit()
+	{
+		Pillow::HttpBufferPool pool;
+		pool.setMaximumPooledBytes(3000);
+		QList<QByteArray> buffers;
+		for (int i = 0; i < 4; ++i) buffers << pool.take(1000);
+		for (int i = 0; i < 4; ++i) pool.give(buffers[i]);
+		QCOMPARE(pool.pooledCount(), 2);
+
+		pool.setMaximumPooledBytes(1000);
+		QCOMPARE(pool.pooledCount(), 0);
+	}
+
+	void should_be_per_thread()
+	{
+		Pillow::HttpBufferPool* mainPool = Pillow::HttpBufferPool::instance();
+		QVERIFY(mainPool != 0);
+		QCOMPARE(Pillow::HttpBufferPool::instance(), mainPool);
+		const int mainPooledCount = mainPool->pooledCount();
+
+		PoolThread thread;
+		thread.start();
+		QVERIFY(thread.wait(5000));
+		QVERIFY(thread.pool != 0);
+		QVERIFY(thread.pool != mainPool);
+		QCOMPARE(thread.pooledCount, 1);
+		QCOMPARE(mainPool->pooledCount(), mainPooledCount); // Buffers given on the other thread stayed there.
+	}
+};
+PILLOW_TEST_DECLARE(HttpBufferPoolTest)
+
+#include "HttpBufferPoolTest.moc"
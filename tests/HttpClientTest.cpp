@@ -1,10 +1,14 @@
 #include <QtCore/QObject>
 #include <QtTest/QtTest>
 #include <QtNetwork/QTcpSocket>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QNetworkProxy>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkCookie>
 #include <QtNetwork/QNetworkCookieJar>
 #include <HttpClient.h>
+#include <HttpClientPool.h>
+#include <HttpHostCache.h>
 #include <HttpConnection.h>
 #include <HttpServer.h>
 #include <HttpHandlerSimpleRouter.h>
@@ -20,6 +24,34 @@ Q_DECLARE_METATYPE(QAbstractSocket::SocketState)
 Q_DECLARE_METATYPE(QNetworkReply::NetworkError)
 #endif
 
+// A pipe-like device: what is written to it can be read once, and it has no size.
+class SequentialDevice : public QIODevice
+{
+	QByteArray _pending;
+
+public:
+	SequentialDevice() { open(QIODevice::ReadWrite); }
+
+	bool isSequential() const { return true; }
+	qint64 bytesAvailable() const { return _pending.size() + QIODevice::bytesAvailable(); }
+
+protected:
+	qint64 readData(char *data, qint64 maxSize)
+	{
+		const int size = int(qMin(maxSize, qint64(_pending.size())));
+		memcpy(data, _pending.constData(), size);
+		_pending.remove(0, size);
+		return size;
+	}
+
+	qint64 writeData(const char *data, qint64 size)
+	{
+		_pending.append(data, int(size));
+		emit readyRead();
+		return size;
+	}
+};
+
 //
 // HttpRequestWriter test class
 //
@@ -116,6 +148,36 @@ private slots:
 			  Pillow::HttpHeader("X-And-Another", "Is-Better"));
 		QCOMPARE(readAll(), QByteArray("DELETE /other/cool%20path HTTP/1.1\r\nMy-Header: Is-Cool\r\nX-And-Another: Is-Better\r\n\r\n"));
 	}
+
+	void test_write_streamed_content()
+	{
+		Pillow::HttpRequestWriter w; w.setDevice(buffer);
+
+		w.writeHeaders("PUT", "/some/path.txt", Pillow::HttpHeaderCollection() << Pillow::HttpHeader("One", "Header"), 9);
+		QCOMPARE(readAll(), QByteArray("PUT /some/path.txt HTTP/1.1\r\nOne: Header\r\nContent-Length: 9\r\n\r\n"));
+		w.writeContent("Some ");
+		w.writeContent("Data");
+		w.endContent();
+		QCOMPARE(readAll(), QByteArray("Some Data"));
+	}
+
+	void test_write_chunked_content()
+	{
+		Pillow::HttpRequestWriter w; w.setDevice(buffer);
+
+		w.writeHeaders("POST", "/some/path.txt", Pillow::HttpHeaderCollection(), -1);
+		QCOMPARE(readAll(), QByteArray("POST /some/path.txt HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"));
+		w.writeContent("Hello");
+		w.writeContent(QByteArray());
+		w.writeContent(QByteArray(26, '*'));
+		QCOMPARE(readAll(), QByteArray("5\r\nHello\r\n1a\r\n**************************\r\n"));
+		w.endContent();
+		QCOMPARE(readAll(), QByteArray("0\r\n\r\n"));
+
+		// The next request is not chunked.
+		w.put("/other/path.txt", Pillow::HttpHeaderCollection(), QByteArray("Data"));
+		QCOMPARE(readAll(), QByteArray("PUT /other/path.txt HTTP/1.1\r\nContent-Length: 4\r\n\r\nData"));
+	}
 };
 PILLOW_TEST_DECLARE(HttpRequestWriterTest)
 
@@ -1296,6 +1358,10 @@ private:
 protected slots:
 	void abortSender() { static_cast<Pillow::HttpClient*>(sender())->abort(); }
 	void sendRequest() { client->get(testUrl()); }
+	void recordFinished() { finishedContents << (client->error() == Pillow::HttpClient::NoError ? client->content() : QByteArray("error")); }
+
+private:
+	QList<QByteArray> finishedContents;
 
 private slots:
 	void should_be_initially_blank()
@@ -2378,9 +2444,578 @@ private slots:
 		QCOMPARE(client->content(), QByteArray("1234"));
 		QVERIFY(waitFor([&]{ return s == 0; }));
 	}
+
+	void should_resolve_host_names_through_its_host_cache()
+	{
+		Pillow::HttpHostCache cache;
+		cache.setOverride("pillow.test", QList<QHostAddress>() << QHostAddress("127.0.0.1"));
+		cache.setOverride("nowhere.test", QList<QHostAddress>());
+		client->setHostCache(&cache);
+
+		client->get(QUrl("http://pillow.test:4569/test"));
+		QVERIFY(server.waitForRequest());
+		QCOMPARE(server.receivedRequests.last()._headers.getFieldValue("Host"), QByteArray("pillow.test:4569"));
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+
+		client->get(QUrl("http://nowhere.test:4569/test"));
+		QVERIFY(client->responsePending());
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NetworkError);
+		QCOMPARE(cache.lookupCount(), quint64(0));
+
+		client->setHostCache(0);
+	}
+
+	void should_leave_name_resolution_to_the_proxy()
+	{
+		// A plain server standing in for the proxy, to see what it is asked to connect to.
+		QTcpServer proxyServer;
+		QVERIFY(proxyServer.listen(QHostAddress::LocalHost));
+		struct ApplicationProxyRestorer
+		{
+			QNetworkProxy previous;
+			ApplicationProxyRestorer() : previous(QNetworkProxy::applicationProxy()) {}
+			~ApplicationProxyRestorer() { QNetworkProxy::setApplicationProxy(previous); }
+		} restorer;
+		QNetworkProxy::setApplicationProxy(QNetworkProxy(QNetworkProxy::HttpProxy, "127.0.0.1", proxyServer.serverPort()));
+
+		Pillow::HttpHostCache cache;
+		cache.setOverride("pillow.test", QList<QHostAddress>() << QHostAddress("10.255.255.1"));
+		client->setHostCache(&cache);
+
+		client->get(QUrl("http://pillow.test:4569/test"));
+		QVERIFY(waitFor([&]{ return proxyServer.hasPendingConnections(); }));
+		QTcpSocket* socket = proxyServer.nextPendingConnection();
+		QByteArray received;
+		QVERIFY(waitFor([&]{ received.append(socket->readAll()); return received.contains("\r\n\r\n"); }));
+		QVERIFY(received.startsWith("CONNECT pillow.test:4569 HTTP/1.")); // The name, not the address from the cache.
+
+		client->abort();
+		client->setHostCache(0);
+	}
+
+	void should_forget_a_destroyed_host_cache()
+	{
+		Pillow::HttpHostCache* cache = new Pillow::HttpHostCache();
+		client->setHostCache(cache);
+		QCOMPARE(client->hostCache(), cache);
+		delete cache;
+		QVERIFY(client->hostCache() == 0);
+
+		client->get(QUrl("http://127.0.0.1:4569/test"));
+		QVERIFY(server.waitForRequest());
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+	}
+
+	void should_try_the_next_address_when_connecting_fails()
+	{
+		Pillow::HttpHostCache cache;
+		cache.setOverride("pillow.test", QList<QHostAddress>() << QHostAddress("127.0.0.2") << QHostAddress("127.0.0.1"));
+		client->setHostCache(&cache);
+
+		// Nothing listens on 127.0.0.2: the connection is refused and the client moves on to 127.0.0.1.
+		client->get(QUrl("http://pillow.test:4569/test"));
+		QVERIFY(server.waitForRequest(2000));
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+
+		client->setHostCache(0);
+	}
+
+	void should_pipeline_idempotent_requests_when_asked_to()
+	{
+		finishedContents.clear();
+		client->setMaximumPipelinedRequests(3);
+		connect(client, SIGNAL(finished()), this, SLOT(recordFinished()));
+
+		client->get(QUrl("http://127.0.0.1:4569/first"));
+		client->get(QUrl("http://127.0.0.1:4569/second"));
+		client->get(QUrl("http://127.0.0.1:4569/third"));
+		client->post(QUrl("http://127.0.0.1:4569/fourth"), Pillow::HttpHeaderCollection(), "not idempotent");
+		QCOMPARE(client->queuedRequestCount(), 3);
+
+		QVERIFY(server.waitForRequest());
+		QTest::qWait(50);
+		QCOMPARE(server.receivedRequests.size(), 1);
+		QCOMPARE(server.receivedRequests.last()._path, QByteArray("/first"));
+
+		// The second and third requests are already in the server's buffer: each response brings up the next request right away.
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "1");
+		QCOMPARE(server.receivedRequests.size(), 2);
+		QCOMPARE(server.receivedRequests.last()._path, QByteArray("/second"));
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "2");
+		QCOMPARE(server.receivedRequests.size(), 3);
+		QCOMPARE(server.receivedRequests.last()._path, QByteArray("/third"));
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "3");
+
+		// The POST waits for the responses to the requests before it.
+		QCOMPARE(server.receivedRequests.size(), 3);
+		QVERIFY(server.waitForRequest());
+		QCOMPARE(server.receivedRequests.last()._method, QByteArray("POST"));
+		QCOMPARE(server.receivedRequests.last()._content, QByteArray("not idempotent"));
+		QCOMPARE(finishedContents, QList<QByteArray>() << "1" << "2" << "3");
+		QCOMPARE(client->queuedRequestCount(), 0);
+
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "4");
+		QVERIFY(waitForResponse());
+		QCOMPARE(finishedContents, QList<QByteArray>() << "1" << "2" << "3" << "4");
+		QCOMPARE(server.receivedSockets.count(server.receivedSockets.first()), 4); // All on the same connection.
+	}
+
+	void should_send_pipelined_requests_again_if_server_closes_connection()
+	{
+		finishedContents.clear();
+		client->setMaximumPipelinedRequests(3);
+		connect(client, SIGNAL(finished()), this, SLOT(recordFinished()));
+
+		client->get(QUrl("http://127.0.0.1:4569/first"));
+		client->get(QUrl("http://127.0.0.1:4569/second"));
+		client->get(QUrl("http://127.0.0.1:4569/third"));
+		QVERIFY(server.waitForRequest());
+		QTest::qWait(50);
+
+		server.receivedSockets.last()->write("HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 1\r\n\r\n1");
+		server.receivedSockets.last()->flush();
+		server.receivedSockets.last()->close();
+
+		// The requests written after the first one are sent again, in order, on a new connection.
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 2; }));
+		QCOMPARE(server.receivedRequests.last()._path, QByteArray("/second"));
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "2");
+		QCOMPARE(server.receivedRequests.size(), 3);
+		QCOMPARE(server.receivedRequests.last()._path, QByteArray("/third"));
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "3");
+		QVERIFY(waitFor([&]{ return finishedContents.size() == 3; }));
+		QCOMPARE(finishedContents, QList<QByteArray>() << "1" << "2" << "3");
+	}
+
+	void should_stream_request_content_from_a_file()
+	{
+		QByteArray content;
+		for (int i = 0; i < 20000; ++i) content.append(QByteArray::number(i)).append(' ');
+		QTemporaryFile file;
+		QVERIFY(file.open());
+		file.write("skipped ");
+		file.write(content);
+		QVERIFY(file.seek(8)); // The content starts at the device's current position.
+
+		client->put(testUrl(), Pillow::HttpHeaderCollection() << Pillow::HttpHeader("X-Some", "Header"), &file);
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 1; }));
+		QCOMPARE(server.receivedRequests.last()._method, QByteArray("PUT"));
+		QCOMPARE(server.receivedRequests.last()._content, content);
+		QVERIFY(server.receivedRequests.last()._headers.contains(Pillow::HttpHeader("Content-Length", QByteArray::number(content.size()))));
+		QCOMPARE(file.pos(), file.size());
+
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "Stored");
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+		QCOMPARE(client->content(), QByteArray("Stored"));
+	}
+
+	void should_stream_request_content_from_a_sequential_device()
+	{
+		SequentialDevice source;
+		source.write("first part, ");
+
+		client->post(testUrl(), Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", "24"), &source);
+		QTest::qWait(50);
+		QVERIFY(server.receivedRequests.isEmpty());
+
+		// More content gets sent as the device has it.
+		source.write("second part!");
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 1; }));
+		QCOMPARE(server.receivedRequests.last()._content, QByteArray("first part, second part!"));
+		QVERIFY(server.receivedRequests.last()._headers.contains(Pillow::HttpHeader("Content-Length", "24")));
+
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "Got it");
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->content(), QByteArray("Got it"));
+	}
+
+	void should_fail_if_a_streamed_device_ends_early()
+	{
+		SequentialDevice source;
+		source.write("short");
+
+		QTest::ignoreMessage(QtWarningMsg, "Pillow::HttpClient: the request content device ended before the announced content length, closing the connection.");
+		client->post(testUrl(), Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", "24"), &source);
+		QTest::qWait(50);
+		source.close();
+		QVERIFY(waitForResponse());
+		QVERIFY(client->error() != Pillow::HttpClient::NoError);
+		QVERIFY(server.receivedRequests.isEmpty());
+	}
+
+	void should_send_content_of_unknown_length_chunked()
+	{
+		// HttpConnection does not parse chunked request content: look at what goes on the wire instead.
+		QTcpServer rawServer;
+		QVERIFY(rawServer.listen(QHostAddress::LocalHost));
+		SequentialDevice source;
+
+		client->post(QUrl(QString("http://127.0.0.1:%1/upload").arg(rawServer.serverPort())), Pillow::HttpHeaderCollection(), &source);
+		QVERIFY(waitFor([&]{ return rawServer.hasPendingConnections(); }));
+		QTcpSocket* socket = rawServer.nextPendingConnection();
+
+		QByteArray received;
+		source.write("hello, ");
+		QVERIFY(waitFor([&]{ received.append(socket->readAll()); return received.endsWith("hello, \r\n"); }));
+		source.write("world");
+		source.close();
+		QVERIFY(waitFor([&]{ received.append(socket->readAll()); return received.endsWith("0\r\n\r\n"); }));
+
+		QVERIFY(received.startsWith("POST /upload HTTP/1.1\r\n"));
+		QVERIFY(received.contains("\r\nTransfer-Encoding: chunked\r\n"));
+		QVERIFY(!received.contains("Content-Length"));
+		QVERIFY(received.endsWith("\r\n\r\n7\r\nhello, \r\n5\r\nworld\r\n0\r\n\r\n"));
+
+		socket->write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nOK");
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+		QCOMPARE(client->content(), QByteArray("OK"));
+	}
+
+	void should_stop_streaming_content_when_the_server_answers_early()
+	{
+		QTcpServer rawServer;
+		QVERIFY(rawServer.listen(QHostAddress::LocalHost));
+		SequentialDevice source;
+		source.write("first part, ");
+
+		client->post(QUrl(QString("http://127.0.0.1:%1/upload").arg(rawServer.serverPort())), Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", "24"), &source);
+		QVERIFY(waitFor([&]{ return rawServer.hasPendingConnections(); }));
+		QTcpSocket* socket = rawServer.nextPendingConnection();
+		QByteArray received;
+		QVERIFY(waitFor([&]{ received.append(socket->readAll()); return received.endsWith("first part, "); }));
+
+		socket->write("HTTP/1.1 413 Request Entity Too Large\r\nContent-Length: 0\r\n\r\n");
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+		QCOMPARE(client->statusCode(), 413);
+
+		// The rest of the content is not sent, and the connection, which can't carry another request, gets closed.
+		source.write("second part!");
+		QVERIFY(waitFor([&]{ received.append(socket->readAll()); return socket->state() == QAbstractSocket::UnconnectedState; }));
+		QVERIFY(received.endsWith("first part, "));
+	}
+
+	void should_send_streamed_content_again_when_following_a_redirection()
+	{
+		QTemporaryFile file;
+		QVERIFY(file.open());
+		file.write("skipped stored content");
+		QVERIFY(file.seek(8));
+
+		client->put(testUrl(), Pillow::HttpHeaderCollection(), &file);
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 1; }));
+		QCOMPARE(server.receivedRequests.last()._content, QByteArray("stored content"));
+		server.receivedConnections.last()->writeResponse(302, Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Location", "http://127.0.0.1:4569/other/path"));
+		QVERIFY(waitForResponse());
+
+		// The device is rewound to where the content started.
+		client->followRedirection();
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 2; }));
+		QCOMPARE(server.receivedRequests.last()._method, QByteArray("PUT"));
+		QCOMPARE(server.receivedRequests.last()._path, QByteArray("/other/path"));
+		QCOMPARE(server.receivedRequests.last()._content, QByteArray("stored content"));
+		server.receivedConnections.last()->writeResponse(201);
+		QVERIFY(waitForResponse());
+		QCOMPARE(client->statusCode(), 201);
+
+		// Sequential devices can't be read again.
+		SequentialDevice source;
+		source.write("once");
+		client->post(testUrl(), Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", "4"), &source);
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 3; }));
+		server.receivedConnections.last()->writeResponse(302, Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Location", "http://127.0.0.1:4569/other/path"));
+		QVERIFY(waitForResponse());
+
+		QTest::ignoreMessage(QtWarningMsg, "Pillow::HttpClient::followRedirection(): the request content device can not be read again.");
+		client->followRedirection();
+		QVERIFY(!client->responsePending());
+		QTest::qWait(50);
+		QCOMPARE(server.receivedRequests.size(), 3);
+	}
 };
 PILLOW_TEST_DECLARE(HttpClientTest)
 
+//
+// HttpClientPool test class
+//
+
+class HttpClientPoolTest : public QObject
+{
+	Q_OBJECT
+	Pillow::HttpClientPool *pool;
+	TestServer server;
+	QList<Pillow::HttpClient*> acquiredClients;
+
+private slots:
+	void initTestCase()
+	{
+		QVERIFY(server.listen(QHostAddress::LocalHost, 4572));
+	}
+
+	void init()
+	{
+		pool = new Pillow::HttpClientPool();
+		acquiredClients.clear();
+	}
+
+	void cleanup()
+	{
+		delete pool; pool = 0;
+		server.receivedRequests.clear();
+		server.receivedConnections.clear();
+		server.receivedSockets.clear();
+	}
+
+protected slots:
+	void acquired(Pillow::HttpClient* client) { acquiredClients << client; }
+	void clientFinished() {}
+
+private:
+	QUrl testUrl() const { return QUrl("http://127.0.0.1:4572/test"); }
+
+private slots:
+	void should_reuse_the_most_recently_released_client()
+	{
+		Pillow::HttpClient* first = pool->tryAcquire(testUrl());
+		Pillow::HttpClient* second = pool->tryAcquire(testUrl());
+		QVERIFY(first != 0 && second != 0 && first != second);
+		QCOMPARE(pool->connectionCount(testUrl()), 2);
+
+		pool->release(first);
+		pool->release(second);
+		QCOMPARE(pool->idleConnectionCount(testUrl()), 2);
+		QCOMPARE(pool->tryAcquire(testUrl()), second);
+		QCOMPARE(pool->tryAcquire(testUrl()), first);
+		QCOMPARE(pool->createdCount(), quint64(2));
+		QCOMPARE(pool->reusedCount(), quint64(2));
+
+		// Other servers get clients of their own.
+		QVERIFY(pool->tryAcquire(QUrl("http://127.0.0.1:4573/")) != first);
+		QCOMPARE(pool->connectionCount(QUrl("http://127.0.0.1:4573/other")), 1);
+		QCOMPARE(pool->connectionCount(testUrl()), 2);
+	}
+
+	void should_keep_the_connection_of_released_clients_open()
+	{
+		Pillow::HttpClient* client = pool->tryAcquire(testUrl());
+		client->get(testUrl());
+		QVERIFY(server.waitForRequest());
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForSignal(client, SIGNAL(finished())));
+		pool->release(client);
+
+		client = pool->tryAcquire(testUrl());
+		client->get(testUrl());
+		QVERIFY(server.waitForRequest());
+		QVERIFY(server.receivedSockets.at(0) == server.receivedSockets.at(1));
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForSignal(client, SIGNAL(finished())));
+	}
+
+	void should_make_acquirers_wait_in_line_at_the_limit()
+	{
+		pool->setMaximumConnectionsPerHost(2);
+		pool->acquire(testUrl(), this, "acquired");
+		pool->acquire(testUrl(), this, "acquired");
+		QCOMPARE(acquiredClients.size(), 2);
+		QVERIFY(pool->tryAcquire(testUrl()) == 0);
+
+		QObject* gone = new QObject();
+		pool->acquire(testUrl(), gone, "acquired");
+		pool->acquire(testUrl(), this, "acquired");
+		pool->acquire(testUrl(), this, "acquired");
+		QCOMPARE(pool->waitingCount(testUrl()), 3);
+		delete gone;
+
+		// Released clients go to the next waiter still around, deleted ones make room for a new client.
+		QVERIFY(connect(acquiredClients.at(0), SIGNAL(finished()), this, SLOT(clientFinished())));
+		QSignalSpy finishedSpy(acquiredClients.at(0), SIGNAL(finished()));
+		pool->release(acquiredClients.at(0));
+		QCOMPARE(acquiredClients.size(), 3);
+		QVERIFY(acquiredClients.at(2) == acquiredClients.at(0));
+		QVERIFY(!disconnect(acquiredClients.at(2), SIGNAL(finished()), this, SLOT(clientFinished()))); // The lessee's, dropped by the pool.
+		QVERIFY(QObject::disconnect(acquiredClients.at(2), SIGNAL(finished()), &finishedSpy, 0)); // Someone else's, left alone.
+
+		delete acquiredClients.at(1);
+		QCOMPARE(acquiredClients.size(), 4);
+		QCOMPARE(pool->waitingCount(testUrl()), 0);
+		QCOMPARE(pool->connectionCount(testUrl()), 2);
+		QCOMPARE(pool->createdCount(), quint64(3));
+	}
+
+	void should_only_disconnect_the_lessee_on_release()
+	{
+		Pillow::HttpClient* client = pool->tryAcquire(testUrl(), this);
+		QVERIFY(connect(client, SIGNAL(finished()), this, SLOT(clientFinished())));
+		QSignalSpy observer(client, SIGNAL(finished()));
+		pool->release(client);
+		QVERIFY(!disconnect(client, SIGNAL(finished()), this, SLOT(clientFinished())));
+		QVERIFY(QObject::disconnect(client, SIGNAL(finished()), &observer, 0));
+
+		// Without a lessee, nothing is disconnected.
+		client = pool->tryAcquire(testUrl());
+		QVERIFY(connect(client, SIGNAL(finished()), this, SLOT(clientFinished())));
+		pool->release(client);
+		QVERIFY(disconnect(client, SIGNAL(finished()), this, SLOT(clientFinished())));
+	}
+
+	void should_delete_clients_idle_for_longer_than_idle_timeout()
+	{
+		pool->setIdleTimeout(200);
+		QPointer<Pillow::HttpClient> client = pool->tryAcquire(testUrl());
+		pool->release(client);
+		QCOMPARE(pool->idleConnectionCount(testUrl()), 1);
+		QVERIFY(waitFor([&]{ return client.isNull(); }, 1000));
+		QCOMPARE(pool->connectionCount(testUrl()), 0);
+
+		pool->setIdleTimeout(0);
+		client = pool->tryAcquire(testUrl());
+		pool->release(client);
+		QCOMPARE(pool->idleConnectionCount(testUrl()), 0);
+		QVERIFY(waitFor([&]{ return client.isNull(); }));
+	}
+
+	void should_prewarm_connections()
+	{
+		pool->setMaximumConnectionsPerHost(3);
+		pool->prewarm(testUrl(), 5);
+		QCOMPARE(pool->idleConnectionCount(testUrl()), 3);
+		QCOMPARE(pool->createdCount(), quint64(3));
+		QTest::qWait(50);
+
+		Pillow::HttpClient* client = pool->tryAcquire(testUrl());
+		client->get(testUrl());
+		QVERIFY(server.waitForRequest());
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForSignal(client, SIGNAL(finished())));
+		QCOMPARE(client->error(), Pillow::HttpClient::NoError);
+		QCOMPARE(pool->createdCount(), quint64(3));
+		QCOMPARE(pool->reusedCount(), quint64(1));
+	}
+};
+PILLOW_TEST_DECLARE(HttpClientPoolTest)
+
+//
+// HttpHostCache test class
+//
+
+class HttpHostCacheTest : public QObject
+{
+	Q_OBJECT
+	Pillow::HttpHostCache *cache;
+
+private slots:
+	void init()
+	{
+		cache = new Pillow::HttpHostCache();
+	}
+
+	void cleanup()
+	{
+		delete cache; cache = 0;
+	}
+
+	void should_rotate_through_the_addresses_of_overrides()
+	{
+		const QHostAddress a("10.0.0.1"), b("10.0.0.2"), c("::1");
+		cache->setOverride("Pillow.Test", QList<QHostAddress>() << a << b << c);
+
+		QList<QHostAddress> addresses;
+		QCOMPARE(cache->lookup("pillow.test", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(addresses, QList<QHostAddress>() << a << b << c);
+		QCOMPARE(cache->lookup("PILLOW.TEST", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(addresses, QList<QHostAddress>() << b << c << a);
+		QCOMPARE(cache->lookup("pillow.test", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(addresses, QList<QHostAddress>() << c << a << b);
+
+		cache->setOverride("nowhere.test", QList<QHostAddress>());
+		QCOMPARE(cache->lookup("nowhere.test", &addresses), Pillow::HttpHostCache::NotFound);
+		QCOMPARE(cache->lookupCount(), quint64(0));
+
+		cache->removeOverride("pillow.test");
+		QCOMPARE(cache->lookup("pillow.test", &addresses), Pillow::HttpHostCache::LookupPending);
+	}
+
+	void should_load_overrides_from_a_hosts_file()
+	{
+		QTemporaryFile file;
+		QVERIFY(file.open());
+		file.write("# Comment line\n"
+				   "127.0.0.1\tlocalhost pillow.test\n"
+				   "\n"
+				   "10.1.2.3  other.test   # Trailing comment\n"
+				   "not-an-address bad.test\n"
+				   "::1 pillow.test\n");
+		file.close();
+
+		QVERIFY(cache->loadHostsFile(file.fileName()));
+		QList<QHostAddress> addresses;
+		QCOMPARE(cache->lookup("pillow.test", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(addresses, QList<QHostAddress>() << QHostAddress("127.0.0.1") << QHostAddress("::1"));
+		QCOMPARE(cache->lookup("other.test", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(addresses, QList<QHostAddress>() << QHostAddress("10.1.2.3"));
+		QCOMPARE(cache->lookup("bad.test", &addresses), Pillow::HttpHostCache::LookupPending);
+
+		cache->clearOverrides();
+		QCOMPARE(cache->lookup("other.test", &addresses), Pillow::HttpHostCache::LookupPending);
+	}
+
+	void should_share_one_lookup_between_callers_and_cache_its_result()
+	{
+		QSignalSpy resolvedSpy(cache, SIGNAL(hostResolved(QString)));
+		QList<QHostAddress> addresses;
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::LookupPending);
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::LookupPending);
+		QCOMPARE(cache->lookupCount(), quint64(1));
+
+		QVERIFY(waitFor([&]{ return resolvedSpy.size() > 0; }, 5000));
+		QCOMPARE(resolvedSpy.size(), 1);
+		QCOMPARE(resolvedSpy.last().first().toString(), QString("localhost"));
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::Resolved);
+		QVERIFY(!addresses.isEmpty());
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(cache->lookupCount(), quint64(1));
+	}
+
+	void should_remember_names_that_do_not_resolve()
+	{
+		QSignalSpy resolvedSpy(cache, SIGNAL(hostResolved(QString)));
+		QList<QHostAddress> addresses;
+		QCOMPARE(cache->lookup("does-not-exist.invalid", &addresses), Pillow::HttpHostCache::LookupPending);
+		QVERIFY(waitFor([&]{ return resolvedSpy.size() > 0; }, 10000));
+
+		QCOMPARE(cache->lookup("does-not-exist.invalid", &addresses), Pillow::HttpHostCache::NotFound);
+		QCOMPARE(cache->lookup("does-not-exist.invalid", &addresses), Pillow::HttpHostCache::NotFound);
+		QCOMPARE(cache->lookupCount(), quint64(1));
+	}
+
+	void should_refresh_entries_in_the_background_before_they_expire()
+	{
+		cache->setTimeToLive(400);
+		QSignalSpy resolvedSpy(cache, SIGNAL(hostResolved(QString)));
+		QList<QHostAddress> addresses;
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::LookupPending);
+		QVERIFY(waitFor([&]{ return resolvedSpy.size() == 1; }, 5000));
+
+		QTest::qWait(320);
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::Resolved); // Still served while refreshing.
+		QCOMPARE(cache->lookupCount(), quint64(2));
+		QVERIFY(waitFor([&]{ return resolvedSpy.size() == 2; }, 5000));
+		QCOMPARE(cache->lookup("localhost", &addresses), Pillow::HttpHostCache::Resolved);
+		QCOMPARE(cache->lookupCount(), quint64(2));
+	}
+};
+PILLOW_TEST_DECLARE(HttpHostCacheTest)
+
 //
 // NetworkAccessManager test class
 //
@@ -2509,6 +3144,43 @@ private slots:
 		QCOMPARE(server.receivedRequests.first(), expectedRequestData);
 	}
 
+	void should_stream_posted_and_put_content_from_devices()
+	{
+		QByteArray content;
+		for (int i = 0; i < 20000; ++i) content.append(QByteArray::number(i)).append(' ');
+		QTemporaryFile file;
+		QVERIFY(file.open());
+		file.write(content);
+		QVERIFY(file.seek(0));
+
+		QNetworkRequest request(testUrl());
+		request.setHeader(QNetworkRequest::ContentTypeHeader, "text/plain");
+		QNetworkReply *r = nam->post(request, &file);
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 1; }));
+		QCOMPARE(server.receivedRequests.last()._method, QByteArray("POST"));
+		QCOMPARE(server.receivedRequests.last()._content, content);
+		QVERIFY(server.receivedRequests.last()._headers.contains(Pillow::HttpHeader("Content-Length", QByteArray::number(content.size()))));
+		server.receivedConnections.last()->writeResponse(200, Pillow::HttpHeaderCollection(), "Posted");
+		QVERIFY(waitForSignal(r, SIGNAL(finished())));
+		QCOMPARE(r->error(), QNetworkReply::NoError);
+		QCOMPARE(r->readAll(), QByteArray("Posted"));
+
+		// Sequential devices are read as they get data.
+		SequentialDevice source;
+		source.write("put ");
+		request.setRawHeader("Content-Length", "11");
+		r = nam->put(request, &source);
+		QTest::qWait(50);
+		QCOMPARE(server.receivedRequests.size(), 1);
+		source.write("content");
+		QVERIFY(waitFor([&]{ return server.receivedRequests.size() == 2; }));
+		QCOMPARE(server.receivedRequests.last()._method, QByteArray("PUT"));
+		QCOMPARE(server.receivedRequests.last()._content, QByteArray("put content"));
+		server.receivedConnections.last()->writeResponse(201);
+		QVERIFY(waitForSignal(r, SIGNAL(finished())));
+		QCOMPARE(r->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 201);
+	}
+
 	void should_receive_response()
 	{
 		QNetworkReply *r = nam->get(QNetworkRequest(testUrl()));
@@ -2769,6 +3441,38 @@ private slots:
 
 		QVERIFY(waitFor([&]{ return !r->isRunning() && !r4->isRunning() && !r5->isRunning(); }));
 	}
+
+	void should_wait_for_a_client_when_the_shared_pool_is_at_its_limit()
+	{
+		Pillow::HttpClientPool pool;
+		pool.setMaximumConnectionsPerHost(1);
+		nam->setClientPool(&pool);
+
+		QNetworkReply *r1 = nam->get(QNetworkRequest(testUrl()));
+		QNetworkReply *r2 = nam->get(QNetworkRequest(testUrl()));
+		QNetworkReply *r3 = nam->get(QNetworkRequest(testUrl()));
+		QCOMPARE(pool.waitingCount(testUrl()), 2);
+		r3->abort();
+		QVERIFY(r3->isFinished());
+		QCOMPARE(r3->error(), QNetworkReply::OperationCanceledError);
+		QCOMPARE(pool.waitingCount(testUrl()), 1);
+
+		QVERIFY(server.waitForRequest());
+		QTest::qWait(50);
+		QCOMPARE(server.receivedRequests.size(), 1);
+		server.receivedConnections.last()->writeResponse(200);
+		QVERIFY(waitForSignal(r1, SIGNAL(finished())));
+
+		QVERIFY(server.waitForRequest());
+		QVERIFY(server.receivedSockets.at(0) == server.receivedSockets.at(1));
+		server.receivedConnections.last()->writeResponse(201);
+		QVERIFY(waitForSignal(r2, SIGNAL(finished())));
+		QCOMPARE(r2->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt(), 201);
+		QCOMPARE(pool.connectionCount(testUrl()), 1);
+		QCOMPARE(pool.idleConnectionCount(testUrl()), 1);
+
+		delete nam; nam = 0; // Before the pool goes away.
+	}
 };
 PILLOW_TEST_DECLARE(NetworkAccessManagerTest)
 
@@ -1,5 +1,6 @@
 #include "HttpConnectionTest.h"
 #include "HttpConnection.h"
+#include "HttpBufferPool.h"
 #include <QtTest/QTest>
 #include <QtTest/QSignalSpy>
 #include <QtNetwork/QTcpServer>
@@ -80,6 +81,9 @@ void HttpConnectionTest::testSimpleGet()
 	QCOMPARE(connection->requestHeaders().at(2).second, QByteArray("DummyValue"));
 	QCOMPARE(connection->requestHeaderValue("x-DUmmY"), QByteArray("DummyValue"));
 	QCOMPARE(connection->requestHeaderValue("missing"), QByteArray());
+	QCOMPARE(connection->requestHeaderValue("HOST"), QByteArray("example.org"));
+	QCOMPARE(connection->requestHeaderValue(HttpKnownHeaders::Host), QByteArray("example.org"));
+	QCOMPARE(connection->requestHeaderValue(HttpKnownHeaders::UserAgent), QByteArray());
 	QCOMPARE(connection->requestContent(), QByteArray());
 	QCOMPARE(readySpy->size(), 1);
 	QCOMPARE(completedSpy->size(), 0);
@@ -180,6 +184,7 @@ void HttpConnectionTest::testHugePost()
 	QByteArray clientRequest;
 	clientRequest.append("POST /test HTTP/1.1\r\n")
 				 .append("Content-Length: ").append(QByteArray::number(postData.size())).append("\r\n")
+				 .append("X-Dummy: DummyValue\r\n")
 				 .append("\r\n").append(postData);
 
 
@@ -196,6 +201,13 @@ void HttpConnectionTest::testHugePost()
 	QCOMPARE(closedSpy->size(), 0);
 	QVERIFY(isClientConnected());
 
+	// The request buffer was reallocated to hold the content; headers must still point to valid data.
+	QCOMPARE(connection->requestHeaderValue(HttpKnownHeaders::ContentLength), QByteArray::number(postData.size()));
+	QCOMPARE(connection->requestHeaderValue("x-dummy"), QByteArray("DummyValue"));
+	QCOMPARE(connection->requestHeaders().size(), 2);
+	QCOMPARE(connection->requestHeaders().at(0).first, QByteArray("Content-Length"));
+	QVERIFY(qstrcmp(connection->requestHeaders().at(1).second.constData(), "DummyValue") == 0);
+
 	connection->writeResponse(200, Pillow::HttpHeaderCollection(), "Thank you");
 	QByteArray data = clientReadAll();
 	QVERIFY(data.startsWith("HTTP/1.1 200 OK"));
@@ -390,6 +402,56 @@ void HttpConnectionTest::testConnectionKeepAlive()
 	QCOMPARE(closedSpy->size(), 1);
 }
 
+void HttpConnectionTest::testIdleConnectionDetachesFromPooledBuffer()
+{
+	clientWrite("POST /first/request?hello=world HTTP/1.1\r\n");
+	clientWrite("Host: example.org\r\n");
+	clientWrite("Content-Length: 4\r\n");
+	clientWrite("\r\n");
+	clientWrite("data"); clientFlush();
+	QCOMPARE(readySpy->size(), 1);
+
+	connection->writeResponse(200);
+	QVERIFY(clientReadAll().startsWith("HTTP/1.1 200"));
+	QCOMPARE(connection->state(), HttpConnection::ReceivingHeaders);
+
+	// The idle connection gave its request buffer back to the pool: overwrite every pooled buffer, as other connections would.
+	HttpBufferPool* pool = HttpBufferPool::instance();
+	QList<QByteArray> pooledBuffers;
+	foreach (int capacity, pool->sizeClasses())
+	{
+		for (int count = pool->pooledCount(); count > 0; count = pool->pooledCount())
+		{
+			QByteArray buffer = pool->take(capacity);
+			if (pool->pooledCount() == count) break; // Freshly allocated, this size class is drained.
+			buffer.fill('x', buffer.capacity());
+			pooledBuffers << buffer;
+		}
+	}
+
+	// The request line stays readable until the next request; the content and headers are gone.
+	QCOMPARE(connection->requestMethod(), QByteArray("POST"));
+	QCOMPARE(connection->requestUri(), QByteArray("/first/request?hello=world"));
+	QCOMPARE(connection->requestPath(), QByteArray("/first/request"));
+	QCOMPARE(connection->requestQueryString(), QByteArray("hello=world"));
+	QCOMPARE(connection->requestHttpVersion(), QByteArray("HTTP/1.1"));
+	QCOMPARE(connection->requestParamValue("hello"), QString("world"));
+	QCOMPARE(connection->requestContent(), QByteArray());
+	QVERIFY(connection->requestHeaders().isEmpty());
+	QCOMPARE(connection->requestHeaderValue(HttpKnownHeaders::Host), QByteArray());
+
+	for (int i = 0; i < pooledBuffers.size(); ++i) pool->give(pooledBuffers[i]);
+
+	// And the next request is parsed as usual.
+	clientWrite("GET /second HTTP/1.1\r\n");
+	clientWrite("Host: example.org\r\n");
+	clientWrite("\r\n"); clientFlush();
+	QCOMPARE(readySpy->size(), 2);
+	QCOMPARE(connection->requestMethod(), QByteArray("GET"));
+	QCOMPARE(connection->requestPath(), QByteArray("/second"));
+	QCOMPARE(connection->requestHeaderValue(HttpKnownHeaders::Host), QByteArray("example.org"));
+}
+
 void HttpConnectionTest::testConnectionClose()
 {
 	// The server should close the connection if the client specifies Connection: close for any protocol version.
@@ -830,6 +892,36 @@ void HttpConnectionTest::testReadsRequestParams()
 	QCOMPARE(connection->requestParams().size(), 1);
 	QCOMPARE(connection->requestParamValue(""), QString("valueonly"));
 
+	// Form content params follow the query string params.
+	connection->writeResponse(200);
+	QVERIFY(clientReadAll().startsWith("HTTP/1.1 200"));
+	QCOMPARE(connection->state(), HttpConnection::ReceivingHeaders);
+	clientWrite("POST /form?first=query&plus=a+b HTTP/1.1\r\n");
+	clientWrite("Content-Type: application/x-www-form-urlencoded; charset=utf-8\r\n");
+	clientWrite("Content-Length: 51\r\n");
+	clientWrite("\r\n");
+	clientWrite("first=content&greeting=hello+world%21&caf%C3%A9=yes"); clientFlush();
+	QCOMPARE(connection->requestParamValue("FIRST"), QString("query"));
+	QCOMPARE(connection->requestParamValue("plus"), QString("a+b"));
+	QCOMPARE(connection->requestParamValue("greeting"), QString("hello world!"));
+	QCOMPARE(connection->requestParamValue(QString::fromUtf8("caf\xc3\xa9")), QString("yes"));
+	QCOMPARE(connection->requestParamValue("missing"), QString());
+	QCOMPARE(connection->requestParams().size(), 5);
+	QCOMPARE(connection->requestParams().at(2).first, QString("first"));
+	QCOMPARE(connection->requestParams().at(2).second, QString("content"));
+	QCOMPARE(connection->requestParams().at(3).second, QString("hello world!"));
+
+	// Other content types are left alone.
+	connection->writeResponse(200);
+	QVERIFY(clientReadAll().startsWith("HTTP/1.1 200"));
+	QCOMPARE(connection->state(), HttpConnection::ReceivingHeaders);
+	clientWrite("POST /form HTTP/1.1\r\n");
+	clientWrite("Content-Type: text/plain\r\n");
+	clientWrite("Content-Length: 3\r\n");
+	clientWrite("\r\n");
+	clientWrite("a=b"); clientFlush();
+	QCOMPARE(connection->requestParamValue("a"), QString());
+	QCOMPARE(connection->requestParams().size(), 0);
 }
 
 void HttpConnectionTest::testReuseRequest()
@@ -885,6 +977,58 @@ void HttpConnectionTest::testReuseRequest()
 	QVERIFY(connection == firstRequest);
 }
 
+void HttpConnectionTest::testRecordsTimestamps()
+{
+	QCOMPARE(connection->requestCount(), 0);
+	for (int i = HttpConnection::RequestStarted; i < HttpConnection::TimestampCount; ++i)
+		QCOMPARE(connection->timestamp(HttpConnection::Timestamp(i)), qint64(0));
+
+	const qint64 before = HttpConnection::currentTimestamp();
+	clientWrite("POST /first HTTP/1.1\r\n"); clientFlush();
+	QVERIFY(connection->timestamp(HttpConnection::RequestStarted) >= before);
+	QCOMPARE(connection->timestamp(HttpConnection::HeadersReceived), qint64(0));
+
+	clientWrite("Content-Length: 4\r\n\r\n"); clientFlush();
+	QVERIFY(connection->timestamp(HttpConnection::HeadersReceived) >= connection->timestamp(HttpConnection::RequestStarted));
+	QCOMPARE(connection->timestamp(HttpConnection::ContentReceived), qint64(0));
+
+	clientWrite("data"); clientFlush();
+	QCOMPARE(readySpy->size(), 1);
+	QCOMPARE(connection->requestCount(), 1);
+	QVERIFY(connection->timestamp(HttpConnection::ContentReceived) >= connection->timestamp(HttpConnection::HeadersReceived));
+	QCOMPARE(connection->timestamp(HttpConnection::ResponseStarted), qint64(0));
+
+	connection->writeHeaders(200, HttpHeaderCollection() << HttpHeader("Content-Length", "5"));
+	QVERIFY(connection->timestamp(HttpConnection::ResponseStarted) >= connection->timestamp(HttpConnection::ContentReceived));
+	QCOMPARE(connection->timestamp(HttpConnection::ResponseCompleted), qint64(0));
+
+	connection->writeContent("hello");
+	QCOMPARE(completedSpy->size(), 1);
+	QVERIFY(clientReadAll().startsWith("HTTP/1.1 200"));
+	QCOMPARE(connection->state(), HttpConnection::ReceivingHeaders);
+
+	// Still readable once the connection waits for the next request.
+	const qint64 firstStarted = connection->timestamp(HttpConnection::RequestStarted);
+	const qint64 firstCompleted = connection->timestamp(HttpConnection::ResponseCompleted);
+	QVERIFY(firstCompleted >= connection->timestamp(HttpConnection::ResponseStarted));
+	QVERIFY(firstCompleted <= HttpConnection::currentTimestamp());
+
+	// The next request on a kept-alive connection starts over.
+	clientWrite("GET /second HTTP/1.1\r\n"); clientFlush();
+	QVERIFY(connection->timestamp(HttpConnection::RequestStarted) >= firstCompleted);
+	QVERIFY(connection->timestamp(HttpConnection::RequestStarted) > firstStarted);
+	QCOMPARE(connection->timestamp(HttpConnection::ResponseCompleted), qint64(0));
+	QCOMPARE(connection->timestamp(HttpConnection::ResponseFlushed), qint64(0));
+
+	clientWrite("Connection: close\r\n\r\n"); clientFlush();
+	QCOMPARE(connection->requestCount(), 2);
+	connection->writeResponse(200);
+	QVERIFY(clientReadAll().startsWith("HTTP/1.1 200"));
+	QCOMPARE(connection->state(), HttpConnection::Closed);
+	QVERIFY(connection->timestamp(HttpConnection::ResponseFlushed) >= connection->timestamp(HttpConnection::ResponseCompleted));
+	QVERIFY(connection->timestamp(HttpConnection::ResponseCompleted) >= connection->timestamp(HttpConnection::ResponseStarted));
+}
+
 void HttpConnectionTest::benchmarkSimpleGetClose()
 {
 	cleanup();
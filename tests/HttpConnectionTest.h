@@ -46,6 +46,7 @@ protected slots: // Test methods.
 	void testWriteSimpleResponse();
 	void testWriteSimpleResponseString();
 	void testConnectionKeepAlive();
+	void testIdleConnectionDetachesFromPooledBuffer();
 	void testConnectionClose();
 	void testPipelinedRequests();
 	void testClientClosesConnectionEarly();
@@ -57,6 +58,7 @@ protected slots: // Test methods.
 	void testMultipacketResponse();
 	void testReadsRequestParams();
 	void testReuseRequest();
+	void testRecordsTimestamps();
 
 	void benchmarkSimpleGetClose();
 	void benchmarkSimpleGetKeepAlive();
@@ -99,6 +101,7 @@ private slots: // Test methods.
 	void testWriteSimpleResponse() { HttpConnectionTest::testWriteSimpleResponse(); }
 	void testWriteSimpleResponseString() { HttpConnectionTest::testWriteSimpleResponseString(); }
 	void testConnectionKeepAlive() { HttpConnectionTest::testConnectionKeepAlive(); }
+	void testIdleConnectionDetachesFromPooledBuffer() { HttpConnectionTest::testIdleConnectionDetachesFromPooledBuffer(); }
 	void testConnectionClose() { HttpConnectionTest::testConnectionClose(); }
 	void testPipelinedRequests() { HttpConnectionTest::testPipelinedRequests(); }
 	void testClientClosesConnectionEarly() { HttpConnectionTest::testClientClosesConnectionEarly(); }
@@ -158,6 +161,7 @@ private slots: // Test methods.
 	void testWriteSimpleResponse() { HttpConnectionTest::testWriteSimpleResponse(); }
 	void testWriteSimpleResponseString() { HttpConnectionTest::testWriteSimpleResponseString(); }
 	void testConnectionKeepAlive() { HttpConnectionTest::testConnectionKeepAlive(); }
+	void testIdleConnectionDetachesFromPooledBuffer() { HttpConnectionTest::testIdleConnectionDetachesFromPooledBuffer(); }
 	void testConnectionClose() { HttpConnectionTest::testConnectionClose(); }
 	void testPipelinedRequests() { HttpConnectionTest::testPipelinedRequests(); }
 	void testClientClosesConnectionEarly() { HttpConnectionTest::testClientClosesConnectionEarly(); }
@@ -218,6 +222,7 @@ private slots: // Test methods.
 	void testWriteSimpleResponse() { HttpConnectionTest::testWriteSimpleResponse(); }
 	void testWriteSimpleResponseString() { HttpConnectionTest::testWriteSimpleResponseString(); }
 	void testConnectionKeepAlive() { HttpConnectionTest::testConnectionKeepAlive(); }
+	void testIdleConnectionDetachesFromPooledBuffer() { HttpConnectionTest::testIdleConnectionDetachesFromPooledBuffer(); }
 	void testConnectionClose() { HttpConnectionTest::testConnectionClose(); }
 	void testPipelinedRequests() { HttpConnectionTest::testPipelinedRequests(); }
 	void testClientClosesConnectionEarly() { HttpConnectionTest::testClientClosesConnectionEarly(); }
@@ -266,6 +271,7 @@ private slots: // Test methods.
 	void testWriteSimpleResponse() { HttpConnectionTest::testWriteSimpleResponse(); }
 	void testWriteSimpleResponseString() { HttpConnectionTest::testWriteSimpleResponseString(); }
 	void testConnectionKeepAlive() { HttpConnectionTest::testConnectionKeepAlive(); }
+	void testIdleConnectionDetachesFromPooledBuffer() { HttpConnectionTest::testIdleConnectionDetachesFromPooledBuffer(); }
 	void testConnectionClose() { HttpConnectionTest::testConnectionClose(); }
 	void testPipelinedRequests() { HttpConnectionTest::testPipelinedRequests(); }
 	void testClientClosesConnectionEarly() { HttpConnectionTest::testClientClosesConnectionEarly(); }
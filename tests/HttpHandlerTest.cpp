@@ -3,10 +3,20 @@
 #include "HttpHandlerTest.h"
 #include "HttpHandler.h"
 #include "HttpHandlerSimpleRouter.h"
+#include "HttpHandlerBundle.h"
+#include "HttpHandlerAsync.h"
+#include "HttpHandlerAsyncLog.h"
+#include "HttpCoroutine.h"
 #include "HttpConnection.h"
+#include "Helpers.h"
 #include <QtCore/QDir>
+#include <QtCore/QFileInfo>
 #include <QtCore/QBuffer>
+#include <QtCore/QCryptographicHash>
 #include <QtCore/QCoreApplication>
+#include <QtCore/QSemaphore>
+#include <QtCore/QThread>
+#include <QtCore/QThreadPool>
 using namespace Pillow;
 
 Pillow::HttpConnection * HttpHandlerTestBase::createGetRequest(const QByteArray &path, const QByteArray& httpVersion)
@@ -19,9 +29,11 @@ Pillow::HttpConnection * HttpHandlerTestBase::createPostRequest(const QByteArray
 	return createRequest("POST", path, content, httpVersion);
 }
 
-Pillow::HttpConnection * HttpHandlerTestBase::createRequest(const QByteArray &method, const QByteArray &path, const QByteArray &content, const QByteArray &httpVersion)
+Pillow::HttpConnection * HttpHandlerTestBase::createRequest(const QByteArray &method, const QByteArray &path, const QByteArray &content, const QByteArray &httpVersion, const Pillow::HttpHeaderCollection& headers)
 {
 	QByteArray data = QByteArray().append(method).append(" ").append(path).append(" HTTP/").append(httpVersion).append("\r\n");
+	foreach (const Pillow::HttpHeader& header, headers)
+		data.append(header.first).append(": ").append(header.second).append("\r\n");
 	if (content.size() > 0)
 	{
 		data.append("Content-Length: ").append(QByteArray::number(content.size())).append("\r\n");
@@ -116,6 +128,37 @@ void HttpHandlerTest::testHandlerStack()
 	QCOMPARE(mock4->handleRequestCount, 0);
 }
 
+void HttpHandlerTest::testHandlerStackUpdatesHandlers()
+{
+	HttpHandlerStack handler;
+	handler.setHitCountingEnabled(true);
+	MockHandler* mock1 = new MockHandler("/1", 200, &handler);
+	MockHandler* mock2 = new MockHandler("/2", 302, &handler);
+
+	QVERIFY(handler.handleRequest(createGetRequest("/2")));
+	QVERIFY(handler.handleRequest(createGetRequest("/2")));
+	QVERIFY(handler.handleRequest(createGetRequest("/1")));
+	QVERIFY(!handler.handleRequest(createGetRequest("/3")));
+	QCOMPARE(handler.hitCount(mock1), quint64(1));
+	QCOMPARE(handler.hitCount(mock2), quint64(2));
+
+	// Handlers added or removed after the first request are picked up, and counts are kept for the others.
+	MockHandler* mock3 = new MockHandler("/3", 404, &handler);
+	QVERIFY(handler.handleRequest(createGetRequest("/3")));
+	QVERIFY(response.startsWith("HTTP/1.0 404"));
+	QCOMPARE(mock3->handleRequestCount, 1);
+	QCOMPARE(handler.hitCount(mock3), quint64(1));
+	QCOMPARE(handler.hitCount(mock2), quint64(2));
+
+	delete mock2;
+	QVERIFY(!handler.handleRequest(createGetRequest("/2")));
+	QCOMPARE(mock1->handleRequestCount, 6);
+
+	handler.resetHitCounts();
+	QCOMPARE(handler.hitCount(mock1), quint64(0));
+	QCOMPARE(handler.hitCount(mock3), quint64(0));
+}
+
 void HttpHandlerTest::testHandlerFixed()
 {
 	bool handled = HttpHandlerFixed(403, "Fixed test").handleRequest(createGetRequest());
@@ -148,6 +191,154 @@ void HttpHandlerTest::testHandlerFunction()
 #endif
 }
 
+void HttpHandlerTest::testHandlerAsync()
+{
+#ifdef Q_COMPILER_LAMBDA
+	QThread* workerThread = NULL;
+	HttpHandlerAsync handler([&](Pillow::HttpAsyncResponse response)
+	{
+		workerThread = QThread::currentThread();
+		response.writeHeaders(200, Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", "18"));
+		response.writeContent("hello from ");
+		response.writeContent(response.requestPath());
+		// The response is ended when the handle goes away.
+	});
+
+	QVERIFY(handler.handleRequest(createGetRequest("/worker")));
+	QVERIFY(waitFor([&]{ return !response.isEmpty(); }, 2000));
+	QVERIFY(workerThread != NULL && workerThread != QThread::currentThread());
+	QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+	QVERIFY(response.endsWith("\r\n\r\nhello from /worker"));
+
+	// A function that does not respond at all yields an internal server error.
+	response = QByteArray();
+	handler.setFunction([](Pillow::HttpAsyncResponse) {});
+	QVERIFY(handler.handleRequest(createGetRequest("/nothing")));
+	QVERIFY(waitFor([&]{ return !response.isEmpty(); }, 2000));
+	QVERIFY(response.startsWith("HTTP/1.0 500"));
+#else
+	QSKIP("Compiler does not support lambdas or C++0x support is not enabled.", SkipSingle);
+#endif
+}
+
+void HttpHandlerTest::testHandlerAsyncKeepAlive()
+{
+#ifdef Q_COMPILER_LAMBDA
+	Pillow::HttpAsyncResponse keptResponse;
+	HttpHandlerAsync handler([&](Pillow::HttpAsyncResponse response)
+	{
+		keptResponse = response; // Dropped later, once the connection has moved on.
+		response.writeHeaders(200, Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", "5"));
+		response.writeContent("first");
+	});
+
+	// A second request is pipelined behind the first one.
+	response = QByteArray();
+	Pillow::HttpConnection* connection = createGetRequest("/first", "1.1");
+	QBuffer* input = static_cast<QBuffer*>(connection->inputDevice());
+	const qint64 position = input->pos();
+	input->write("GET /second HTTP/1.1\r\n\r\n");
+	input->seek(position);
+
+	QVERIFY(handler.handleRequest(connection));
+	QVERIFY(waitFor([&]{ return !response.isEmpty(); }, 2000));
+	QVERIFY(response.startsWith("HTTP/1.1 200 OK"));
+	QVERIFY(response.endsWith("\r\n\r\nfirst"));
+	QVERIFY(waitFor([&]{ return connection->state() == Pillow::HttpConnection::SendingHeaders; }));
+	QCOMPARE(connection->requestPath(), QByteArray("/second"));
+
+	// Ending the first response must not touch the second one.
+	connection->writeHeaders(200);
+	connection->writeContent("second");
+	keptResponse = Pillow::HttpAsyncResponse();
+	QCoreApplication::processEvents();
+	QCoreApplication::processEvents();
+	QCOMPARE(connection->state(), Pillow::HttpConnection::SendingContent);
+	QCOMPARE(connection->requestPath(), QByteArray("/second"));
+#else
+	QSKIP("Compiler does not support lambdas or C++0x support is not enabled.", SkipSingle);
+#endif
+}
+
+void HttpHandlerTest::testHandlerAsyncCancellation()
+{
+#ifdef Q_COMPILER_LAMBDA
+	QSemaphore started, proceed;
+	bool cancelled = false;
+	QThreadPool pool;
+	HttpHandlerAsync handler([&](Pillow::HttpAsyncResponse response)
+	{
+		started.release();
+		proceed.acquire();
+		cancelled = response.isCancelled();
+		response.writeResponse(200, Pillow::HttpHeaderCollection(), "too late");
+	}, &pool);
+
+	response = QByteArray();
+	Pillow::HttpConnection* connection = createGetRequest("/cancelled");
+	QVERIFY(handler.handleRequest(connection));
+	started.acquire();
+	connection->close();
+	proceed.release();
+	pool.waitForDone();
+
+	QVERIFY(cancelled);
+	QCoreApplication::processEvents();
+	QCOMPARE(connection->state(), Pillow::HttpConnection::Closed);
+	QVERIFY(response.isEmpty());
+#else
+	QSKIP("Compiler does not support lambdas or C++0x support is not enabled.", SkipSingle);
+#endif
+}
+
+void HttpHandlerTest::testHandlerCoroutine()
+{
+#ifdef PILLOW_COROUTINES
+	HttpHandlerCoroutine handler([](Pillow::HttpConnection* connection) -> Pillow::HttpTask
+	{
+		QByteArray body = co_await HttpAwait::readBody(connection);
+		connection->writeHeaders(200, Pillow::HttpHeaderCollection() << Pillow::HttpHeader("Content-Length", QByteArray::number(body.size() + 6)));
+		if (!co_await HttpAwait::write(connection, "echo: ")) co_return;
+		if (!co_await HttpAwait::write(connection, body)) co_return;
+		connection->endContent();
+	});
+
+	QVERIFY(handler.handleRequest(createPostRequest("/", "hello")));
+	QVERIFY(waitFor([&]{ return !response.isEmpty(); }));
+	QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+	QVERIFY(response.endsWith("\r\n\r\necho: hello"));
+#else
+	QSKIP("Coroutine handlers need a C++20 compiler and Qt 5.", SkipSingle);
+#endif
+}
+
+void HttpHandlerTest::testHandlerCoroutineOutlivesItsClient()
+{
+#ifdef PILLOW_COROUTINES
+	Pillow::HttpClient* client = new Pillow::HttpClient();
+	bool resumed = false;
+	Pillow::HttpClient::Error error = Pillow::HttpClient::NoError;
+	HttpHandlerCoroutine handler([&](Pillow::HttpConnection* connection) -> Pillow::HttpTask
+	{
+		error = co_await HttpAwait::get(client, QUrl("http://127.0.0.1:4567/never/answered"));
+		resumed = true;
+		connection->writeResponse(502);
+	});
+
+	QVERIFY(handler.handleRequest(createGetRequest("/")));
+	QVERIFY(!resumed);
+
+	// The coroutine gets resumed, rather than left suspended forever, when the client it waits on is destroyed.
+	delete client;
+	QVERIFY(resumed);
+	QCOMPARE(error, Pillow::HttpClient::AbortedError);
+	QVERIFY(waitFor([&]{ return !response.isEmpty(); }));
+	QVERIFY(response.startsWith("HTTP/1.0 502"));
+#else
+	QSKIP("Coroutine handlers need a C++20 compiler and Qt 5.", SkipSingle);
+#endif
+}
+
 void HttpHandlerTest::testHandlerLog()
 {
 	QBuffer buffer; buffer.open(QIODevice::ReadWrite);
@@ -207,6 +398,84 @@ void HttpHandlerTest::testHandlerLogTrace()
 	QVERIFY(buffer.readLine().isEmpty());
 }
 
+void HttpHandlerTest::testHandlerAsyncLog()
+{
+	const QString logPath = QDir::tempPath() + "/HttpHandlerAsyncLogTest.log";
+	QFile::remove(logPath);
+
+	Pillow::HttpConnection* request1 = createGetRequest("/first");
+	Pillow::HttpConnection* request2 = createGetRequest("/second");
+	Pillow::HttpConnection* request3 = createGetRequest("/third");
+
+	{
+		HttpHandlerAsyncLog handler(logPath);
+		QVERIFY(!handler.handleRequest(request1));
+		QVERIFY(!handler.handleRequest(request2));
+		QVERIFY(!handler.handleRequest(request3));
+		handler.flush();
+		QCOMPARE(QFileInfo(logPath).size(), qint64(0));
+
+		request3->writeResponse(302);
+		request1->writeResponse(200, HttpHeaderCollection(), "Hello");
+		handler.flush();
+		QFile log(logPath); QVERIFY(log.open(QIODevice::ReadOnly));
+		QVERIFY(log.readLine().contains("\"GET /third HTTP/1.0\" 302 0 "));
+		QVERIFY(log.readLine().contains("\"GET /first HTTP/1.0\" 200 5 "));
+		QVERIFY(log.readLine().isEmpty());
+
+		request2->writeResponse(500);
+		QCOMPARE(handler.droppedCount(), quint64(0));
+	}
+
+	// Destroying the handler writes out the pending records.
+	QFile log(logPath); QVERIFY(log.open(QIODevice::ReadOnly));
+	QList<QByteArray> lines = log.readAll().split('\n');
+	QCOMPARE(lines.size(), 4);
+	QVERIFY(lines.at(2).contains("\"GET /second HTTP/1.0\" 500 "));
+	QVERIFY(lines.at(3).isEmpty());
+	log.close();
+	QFile::remove(logPath);
+}
+
+void HttpHandlerTest::testHandlerAsyncLogJson()
+{
+	const QString logPath = QDir::tempPath() + "/HttpHandlerAsyncLogJsonTest.log";
+	QFile::remove(logPath);
+
+	{
+		HttpHandlerAsyncLog handler(logPath);
+		handler.setFormat(HttpHandlerAsyncLog::JsonFormat);
+		handler.setSampleRate(3);
+
+		for (int i = 0; i < 6; ++i)
+		{
+			Pillow::HttpConnection* request = createGetRequest("/ok?index=" + QByteArray::number(i));
+			QVERIFY(!handler.handleRequest(request));
+			request->writeResponse(200, HttpHeaderCollection(), "Hello");
+		}
+
+		// Errors bypass sampling.
+		Pillow::HttpConnection* request = createGetRequest("/missing\"path");
+		QVERIFY(!handler.handleRequest(request));
+		request->writeResponse(404);
+	}
+
+	QFile log(logPath); QVERIFY(log.open(QIODevice::ReadOnly));
+	QList<QByteArray> lines = log.readAll().split('\n');
+	QCOMPARE(lines.size(), 4);
+	QVERIFY(lines.at(0).startsWith("{\"time\":\""));
+	QVERIFY(lines.at(0).endsWith("}"));
+	QVERIFY(lines.at(0).contains("\"method\":\"GET\",\"path\":\"/ok\",\"version\":\"HTTP/1.0\",\"status\":200,\"bytes\":5,\"requests\":1,"));
+	QVERIFY(lines.at(0).contains("\"duration_us\":"));
+	QVERIFY(lines.at(0).contains("\"handler_us\":"));
+	QVERIFY(lines.at(0).contains("\"send_us\":"));
+	QVERIFY(lines.at(1).contains("\"path\":\"/ok\",") && lines.at(1).contains("\"status\":200,"));
+	QVERIFY(lines.at(2).contains("\"path\":\"/missing\\\"path\",") && lines.at(2).contains("\"status\":404,"));
+	QVERIFY(lines.at(3).isEmpty());
+	log.close();
+	QFile::remove(logPath);
+}
+
 void HttpHandlerFileTest::initTestCase()
 {
 	testPath = QDir::tempPath() + "/HttpHandlerFileTest";
@@ -247,6 +516,273 @@ void HttpHandlerFileTest::testServesFiles()
 	QVERIFY(response.endsWith(QByteArray(16 * 1024 * 1024, '-')));
 }
 
+void HttpHandlerFileTest::testServesRanges()
+{
+	HttpHandlerFile handler(testPath);
+
+	// Single range.
+	Pillow::HttpConnection* request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=0-4"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 206 Partial Content"));
+	QVERIFY(response.contains("Content-Range: bytes 0-4/13"));
+	QVERIFY(response.contains("Accept-Ranges: bytes"));
+	QVERIFY(response.endsWith("\r\n\r\nfirst"));
+	response.clear();
+
+	// Suffix and open-ended ranges.
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=-7"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.contains("Content-Range: bytes 6-12/13"));
+	QVERIFY(response.endsWith("\r\n\r\ncontent"));
+	response.clear();
+
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=6-"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.endsWith("\r\n\r\ncontent"));
+	response.clear();
+
+	// Multiple ranges.
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=0-4, 6-12"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.contains("Content-Type: multipart/byteranges; boundary="));
+	QVERIFY(response.contains("Content-Range: bytes 0-4/13\r\n\r\nfirst\r\n--"));
+	QVERIFY(response.contains("Content-Range: bytes 6-12/13\r\n\r\ncontent\r\n--"));
+	QVERIFY(response.endsWith("--\r\n"));
+	response.clear();
+
+	// Unsatisfiable range.
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=100-200"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 416"));
+	QVERIFY(response.contains("Content-Range: bytes */13"));
+	response.clear();
+
+	// Malformed ranges are ignored.
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=4-2"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 200"));
+	QVERIFY(response.endsWith("first content"));
+	response.clear();
+
+	// If-Range with a stale validator gets the full file, a matching one gets the range.
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=0-4") << HttpHeader("If-Range", "stale"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 200"));
+	QVERIFY(response.endsWith("first content"));
+	response.clear();
+
+	QCryptographicHash md5sum(QCryptographicHash::Md5); md5sum.addData("first content");
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=0-4") << HttpHeader("If-Range", md5sum.result().toHex()));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.endsWith("\r\n\r\nfirst"));
+	response.clear();
+}
+
+void HttpHandlerFileTest::testServesRangesOfLargeFiles()
+{
+	HttpHandlerFile handler(testPath);
+
+	Pillow::HttpConnection* request = createRequest("GET", "/large", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=1048576-3145727"));
+	QVERIFY(handler.handleRequest(request));
+	while (response.isEmpty())
+		QCoreApplication::processEvents();
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.contains("Content-Range: bytes 1048576-3145727/16777216"));
+	QVERIFY(response.contains("Content-Length: 2097152"));
+	QVERIFY(response.endsWith("\r\n\r\n" + QByteArray(2 * 1024 * 1024, '-')));
+	response.clear();
+
+	request = createRequest("GET", "/large", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=0-9,-10"));
+	QVERIFY(handler.handleRequest(request));
+	while (response.isEmpty())
+		QCoreApplication::processEvents();
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.contains("Content-Range: bytes 0-9/16777216\r\n\r\n----------\r\n--"));
+	QVERIFY(response.contains("Content-Range: bytes 16777206-16777215/16777216\r\n\r\n----------\r\n--"));
+	QVERIFY(response.endsWith("--\r\n"));
+}
+
+void HttpHandlerFileTest::testServesMappedFiles()
+{
+	HttpHandlerFile handler(testPath);
+	handler.setMemoryMappingEnabled(true);
+	QVERIFY(handler.memoryMappingEnabled());
+	QCOMPARE(handler.mappingCacheSize(), int(HttpHandlerFile::DefaultMappingCacheSize));
+
+	Pillow::HttpConnection* request = createGetRequest("/first");
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+	QVERIFY(response.contains("ETag: "));
+	QVERIFY(response.endsWith("first content"));
+	response.clear();
+
+	request = createRequest("GET", "/first", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Range", "bytes=6-"));
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.startsWith("HTTP/1.0 206"));
+	QVERIFY(response.endsWith("\r\n\r\ncontent"));
+	response.clear();
+
+	request = createGetRequest("/large");
+	QVERIFY(handler.handleRequest(request));
+	while (response.isEmpty())
+		QCoreApplication::processEvents();
+	QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+	QVERIFY(response.endsWith(QByteArray(16 * 1024 * 1024, '-')));
+	response.clear();
+
+	// A changed file gets remapped.
+	QTest::qWait(1100); // Let the modification time move forward.
+	{ QFile f(testPath + "/mapped"); f.open(QIODevice::WriteOnly); f.write("before"); }
+	request = createGetRequest("/mapped");
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.endsWith("before"));
+	response.clear();
+
+	QTest::qWait(1100);
+	{ QFile f(testPath + "/mapped.tmp"); f.open(QIODevice::WriteOnly); f.write("after the change"); }
+	QFile::remove(testPath + "/mapped");
+	QFile::rename(testPath + "/mapped.tmp", testPath + "/mapped");
+	request = createGetRequest("/mapped");
+	QVERIFY(handler.handleRequest(request));
+	QVERIFY(response.endsWith("after the change"));
+	response.clear();
+
+	QFile::remove(testPath + "/mapped");
+	handler.setMemoryMappingEnabled(false);
+	QVERIFY(!handler.memoryMappingEnabled());
+}
+
+void HttpHandlerBundleTest::initTestCase()
+{
+	bundlePath = QDir::tempPath() + "/HttpHandlerBundleTest.bundle";
+
+	HttpBundleWriter writer;
+	writer.addFile("/index.html", "<html>Hello</html>");
+	writer.addFile("/css/site.css", "body { color: black; }");
+	writer.addFile("/with space.txt", "spaced out", "text/plain");
+	writer.addFile("/repetitive.js", QByteArray(4096, 'a'));
+	QCOMPARE(writer.count(), 4);
+	QVERIFY(writer.write(bundlePath));
+}
+
+void HttpHandlerBundleTest::cleanupTestCase()
+{
+	QFile::remove(bundlePath);
+}
+
+void HttpHandlerBundleTest::testServesBundledFiles()
+{
+	HttpHandlerBundle handler(bundlePath);
+	QVERIFY(handler.isLoaded());
+	QCOMPARE(handler.entryCount(), 4);
+
+	QVERIFY(!handler.handleRequest(createGetRequest("/")));
+	QVERIFY(!handler.handleRequest(createGetRequest("/missing.html")));
+	QVERIFY(!handler.handleRequest(createGetRequest("/css")));
+
+	QVERIFY(handler.handleRequest(createGetRequest("/index.html")));
+	QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+	QVERIFY(response.contains("Content-Type: text/html"));
+	QVERIFY(response.endsWith("<html>Hello</html>"));
+	response.clear();
+
+	QVERIFY(handler.handleRequest(createGetRequest("/css/site.css")));
+	QVERIFY(response.contains("Content-Type: text/css"));
+	QVERIFY(response.endsWith("body { color: black; }"));
+	response.clear();
+
+	QVERIFY(handler.handleRequest(createGetRequest("/with%20space.txt")));
+	QVERIFY(response.contains("Content-Type: text/plain"));
+	QVERIFY(response.endsWith("spaced out"));
+	response.clear();
+
+	QCryptographicHash md5sum(QCryptographicHash::Md5); md5sum.addData("<html>Hello</html>");
+	QVERIFY(handler.handleRequest(createRequest("GET", "/index.html", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("If-None-Match", md5sum.result().toHex()))));
+	QVERIFY(response.startsWith("HTTP/1.0 304"));
+	response.clear();
+}
+
+void HttpHandlerBundleTest::testServesOnlyGetAndHead()
+{
+	HttpHandlerBundle handler(bundlePath);
+
+	QVERIFY(!handler.handleRequest(createPostRequest("/index.html", "data")));
+	QVERIFY(!handler.handleRequest(createRequest("PUT", "/index.html", "data")));
+	QVERIFY(!handler.handleRequest(createRequest("DELETE", "/index.html")));
+	QVERIFY(response.isEmpty());
+
+	QVERIFY(handler.handleRequest(createRequest("HEAD", "/index.html")));
+	QVERIFY(response.startsWith("HTTP/1.0 200 OK"));
+	QVERIFY(response.contains("Content-Length: 18"));
+	QVERIFY(response.endsWith("\r\n\r\n"));
+	QVERIFY(!response.contains("<html>"));
+	response.clear();
+}
+
+void HttpHandlerBundleTest::testServesGzipVariants()
+{
+#ifndef PILLOW_ZLIB
+	QSKIP("Pillow was built without zlib support, bundles have no gzip variants.", SkipSingle);
+#endif
+	HttpHandlerBundle handler(bundlePath);
+
+	QVERIFY(handler.handleRequest(createGetRequest("/repetitive.js")));
+	QVERIFY(response.contains("Vary: Accept-Encoding"));
+	QVERIFY(!response.contains("Content-Encoding"));
+	QVERIFY(response.endsWith(QByteArray(4096, 'a')));
+	response.clear();
+
+	QVERIFY(handler.handleRequest(createRequest("GET", "/repetitive.js", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Accept-Encoding", "deflate, gzip"))));
+	QVERIFY(response.contains("Content-Encoding: gzip"));
+	QVERIFY(response.size() < 1024);
+	response.clear();
+
+	// The variants have distinct ETags, each only matching itself.
+	QCryptographicHash md5sum(QCryptographicHash::Md5); md5sum.addData(QByteArray(4096, 'a'));
+	const QByteArray etag = md5sum.result().toHex();
+	QVERIFY(handler.handleRequest(createRequest("GET", "/repetitive.js", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Accept-Encoding", "gzip"))));
+	QVERIFY(response.contains("ETag: " + etag + "-gzip"));
+	response.clear();
+	QVERIFY(handler.handleRequest(createRequest("GET", "/repetitive.js", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Accept-Encoding", "gzip") << HttpHeader("If-None-Match", etag))));
+	QVERIFY(response.startsWith("HTTP/1.0 200"));
+	response.clear();
+	QVERIFY(handler.handleRequest(createRequest("GET", "/repetitive.js", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Accept-Encoding", "gzip") << HttpHeader("If-None-Match", etag + "-gzip"))));
+	QVERIFY(response.startsWith("HTTP/1.0 304"));
+	response.clear();
+	QVERIFY(handler.handleRequest(createRequest("GET", "/repetitive.js", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("If-None-Match", etag + "-gzip"))));
+	QVERIFY(response.startsWith("HTTP/1.0 200"));
+	QVERIFY(response.contains("ETag: " + etag + "\r\n"));
+	response.clear();
+
+	QVERIFY(handler.handleRequest(createRequest("GET", "/repetitive.js", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Accept-Encoding", "gzip;q=0"))));
+	QVERIFY(!response.contains("Content-Encoding"));
+	response.clear();
+
+	// Not worth compressing.
+	QVERIFY(handler.handleRequest(createRequest("GET", "/with%20space.txt", QByteArray(), "1.0", HttpHeaderCollection() << HttpHeader("Accept-Encoding", "gzip"))));
+	QVERIFY(!response.contains("Content-Encoding"));
+	response.clear();
+}
+
+void HttpHandlerBundleTest::testRejectsInvalidBundles()
+{
+	const QString invalidPath = QDir::tempPath() + "/HttpHandlerBundleTest.invalid";
+	{ QFile f(invalidPath); f.open(QIODevice::WriteOnly); f.write("PILLOWBN but not really a bundle"); }
+
+	HttpHandlerBundle handler(invalidPath);
+	QVERIFY(!handler.isLoaded());
+	QVERIFY(!handler.handleRequest(createGetRequest("/index.html")));
+
+	handler.setBundlePath(bundlePath);
+	QVERIFY(handler.isLoaded());
+
+	QFile::remove(invalidPath);
+}
+
 void HttpHandlerSimpleRouterTest::testHandlerRoute()
 {
 	HttpHandlerSimpleRouter handler;
@@ -22,7 +22,7 @@ protected:
 protected:
 	Pillow::HttpConnection* createGetRequest(const QByteArray& path = "/", const QByteArray& httpVersion = "1.0");
 	Pillow::HttpConnection* createPostRequest(const QByteArray& path = "/", const QByteArray& content = QByteArray(), const QByteArray& httpVersion = "1.0");
-	Pillow::HttpConnection* createRequest(const QByteArray& method, const QByteArray& path = "/", const QByteArray& content = QByteArray(), const QByteArray& httpVersion = "1.0");
+	Pillow::HttpConnection* createRequest(const QByteArray& method, const QByteArray& path = "/", const QByteArray& content = QByteArray(), const QByteArray& httpVersion = "1.0", const Pillow::HttpHeaderCollection& headers = Pillow::HttpHeaderCollection());
 
 };
 
@@ -32,11 +32,19 @@ class HttpHandlerTest : public HttpHandlerTestBase
 
 private slots:
 	void testHandlerStack();
+	void testHandlerStackUpdatesHandlers();
 	void testHandlerFixed();
 	void testHandler404();
 	void testHandlerFunction();
+	void testHandlerAsync();
+	void testHandlerAsyncKeepAlive();
+	void testHandlerAsyncCancellation();
+	void testHandlerCoroutine();
+	void testHandlerCoroutineOutlivesItsClient();
 	void testHandlerLog();
 	void testHandlerLogTrace();
+	void testHandlerAsyncLog();
+	void testHandlerAsyncLogJson();
 };
 
 class HttpHandlerFileTest : public HttpHandlerTestBase
@@ -47,6 +55,23 @@ class HttpHandlerFileTest : public HttpHandlerTestBase
 private slots:
 	void initTestCase();
 	void testServesFiles();
+	void testServesRanges();
+	void testServesRangesOfLargeFiles();
+	void testServesMappedFiles();
+};
+
+class HttpHandlerBundleTest : public HttpHandlerTestBase
+{
+	Q_OBJECT
+	QString bundlePath;
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+	void testServesBundledFiles();
+	void testServesOnlyGetAndHead();
+	void testServesGzipVariants();
+	void testRejectsInvalidBundles();
 };
 
 class HttpHandlerSimpleRouterTest : public HttpHandlerTestBase
@@ -114,6 +114,50 @@ private slots:
 		QCOMPARE(h2.first, QByteArray("a"));
 		QCOMPARE(h2.second, QByteArray("b"));
 	}
+
+	void should_classify_known_header_names_case_insensitively()
+	{
+		using namespace Pillow::HttpKnownHeaders;
+		for (int i = 0; i < Count; ++i)
+		{
+			const QByteArray name = fieldName(static_cast<Field>(i));
+			QVERIFY(!name.isEmpty());
+			QCOMPARE(int(classify(name)), i);
+			QCOMPARE(int(classify(name.toUpper())), i);
+		}
+
+		QCOMPARE(classify("Content-Length"), ContentLength);
+		QCOMPARE(classify(QByteArray("If-None-Match")), IfNoneMatch);
+		QCOMPARE(classify("X-Forwarded-For"), XForwardedFor);
+		QVERIFY(fieldName(Unknown) == 0);
+		QVERIFY(fieldName(Count) == 0);
+	}
+
+	void should_not_classify_unknown_header_names()
+	{
+		using namespace Pillow::HttpKnownHeaders;
+		QCOMPARE(classify(""), Unknown);
+		QCOMPARE(classify(QByteArray()), Unknown);
+		QCOMPARE(classify("X-Dummy"), Unknown);
+		QCOMPARE(classify("Content-Lengths"), Unknown);
+		QCOMPARE(classify("Content_Length"), Unknown);
+		QCOMPARE(classify("hosT-"), Unknown);
+		QCOMPARE(classify("an-unreasonably-long-header-name"), Unknown);
+	}
+
+	void benchmark_classify()
+	{
+		const QByteArray names[] = { "Host", "User-Agent", "Accept-Encoding", "X-Custom-Header", "Connection" };
+
+		qint64 dummy = 0;
+		QBENCHMARK
+		{
+			for (int i = 0; i < 1000000; ++i)
+				dummy += Pillow::HttpKnownHeaders::classify(names[i % 5]);
+		}
+
+		QVERIFY(dummy != 0);
+	}
 };
 PILLOW_TEST_DECLARE(HttpHeaderTest)
 
@@ -5,6 +5,11 @@
 #include <QtTest/QSignalSpy>
 #include <QtNetwork/QTcpSocket>
 #include <QtNetwork/QLocalSocket>
+#include "Helpers.h"
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <unistd.h>
+#endif // Q_OS_UNIX
 
 uint qHash(const QPointer<Pillow::HttpConnection>& ptr)
 {
@@ -114,6 +119,7 @@ void HttpServerTestBase::testHandlesConcurrentConnections()
 
 void HttpServerTestBase::testReusesRequests()
 {
+	server->setProperty("maximumReservedConnections", 25);
 	const int iterations = 3;
 	const int clientCount = 25;
 	for (int i = 0; i < iterations; ++i) sendConcurrentRequests(clientCount);
@@ -132,6 +138,7 @@ void HttpServerTestBase::testReusesRequests()
 
 void HttpServerTestBase::testDestroysRequests()
 {
+	server->setProperty("maximumReservedConnections", 25);
 	const int iterations = 2;
 	const int clientCount = 27;
 	for (int i = 0; i < iterations; ++i) sendConcurrentRequests(clientCount);
@@ -144,10 +151,129 @@ void HttpServerTestBase::testDestroysRequests()
 	QCOMPARE(guardedHandledRequests.toSet().size(), 1); // All requests should now have been destroyed. Only NULL is remaining.
 }
 
+void HttpServerTestBase::testAdaptsReserveToLoad()
+{
+	server->setProperty("minimumReservedConnections", 10);
+	server->setProperty("reserveDecayInterval", 100);
+
+	// A burst above the low watermark keeps all its connections in reserve.
+	sendConcurrentRequests(30);
+	QCOMPARE(handledRequests.toSet().size(), 30);
+	QVERIFY(!guardedHandledRequests.contains(NULL));
+
+	// Once the load goes away, the reserve decays back to the low watermark.
+	QVERIFY(waitFor([&]{ return guardedHandledRequests.toSet().size() == 11; }, 5000));  // + 1 for the NULL pointer.
+}
+
+void HttpServerTestBase::testReserveBoundsDoNotDependOnSetterOrder()
+{
+	server->setProperty("maximumReservedConnections", 5);
+	server->setProperty("minimumReservedConnections", 10);
+	QCOMPARE(server->property("minimumReservedConnections").toInt(), 10);
+	QCOMPARE(server->property("maximumReservedConnections").toInt(), 5);
+
+	// While the bounds cross, the maximum wins.
+	sendConcurrentRequests(8);
+	QCOMPARE(guardedHandledRequests.toSet().size(), 6); // + 1 for the NULL pointer.
+
+	// Raising the maximum again leaves the minimum as it was set.
+	server->setProperty("maximumReservedConnections", 20);
+	QCOMPARE(server->property("minimumReservedConnections").toInt(), 10);
+	QCOMPARE(server->property("maximumReservedConnections").toInt(), 20);
+}
+
+void HttpServerTestBase::testShutdownDrainsConnections()
+{
+	// An idle keep-alive connection.
+	QIODevice* idleClient = createClientConnection();
+	idleClient->write("GET /idle HTTP/1.1\r\n\r\n");
+	QVERIFY(waitFor([&]{ return handledRequests.size() == 1; }));
+	sendResponses();
+	QVERIFY(waitFor([&]{ return idleClient->bytesAvailable() > 0; }));
+	QVERIFY(idleClient->readAll().startsWith("HTTP/1.1 200 OK"));
+	Pillow::HttpConnection* idleConnection = handledRequests.at(0);
+	QCOMPARE(idleConnection->state(), Pillow::HttpConnection::ReceivingHeaders);
+
+	// A connection with a request in flight.
+	QIODevice* busyClient = createClientConnection();
+	busyClient->write("GET /busy HTTP/1.1\r\n\r\n");
+	QVERIFY(waitFor([&]{ return handledRequests.size() == 2; }));
+	Pillow::HttpConnection* busyConnection = handledRequests.at(1);
+
+	QSignalSpy drainedSpy(server, SIGNAL(drained()));
+	QVERIFY(QMetaObject::invokeMethod(server, "shutdown"));
+
+	// Idle connections close right away, the busy one waits for its response.
+	QCOMPARE(idleConnection->state(), Pillow::HttpConnection::Closed);
+	QCOMPARE(busyConnection->state(), Pillow::HttpConnection::SendingHeaders);
+	QCoreApplication::processEvents();
+	QVERIFY(drainedSpy.isEmpty());
+
+	sendResponses();
+	QVERIFY(waitFor([&]{ return busyClient->bytesAvailable() > 0; }));
+	QByteArray response = busyClient->readAll();
+	QVERIFY(response.startsWith("HTTP/1.1 200 OK"));
+	QVERIFY(response.contains("Connection: close"));
+	QVERIFY(waitFor([&]{ return drainedSpy.size() == 1; }));
+}
+
 //
 // HttpServerTest
 //
 
+void HttpServerTest::testListeningSocketHandover()
+{
+#ifdef Q_OS_UNIX
+	int channel[2];
+	QVERIFY(::socketpair(AF_UNIX, SOCK_STREAM, 0, channel) == 0);
+
+	Pillow::HttpServer* oldServer = static_cast<Pillow::HttpServer*>(server);
+	Pillow::HttpServer* newServer = new Pillow::HttpServer(this);
+	connect(newServer, SIGNAL(requestReady(Pillow::HttpConnection*)), this, SLOT(requestReady(Pillow::HttpConnection*)));
+
+	QVERIFY(oldServer->sendListeningSocket(channel[0]));
+	QVERIFY(newServer->adoptListeningSocket(channel[1], 1000));
+	::close(channel[0]); ::close(channel[1]);
+	QVERIFY(newServer->isListening());
+	QCOMPARE(newServer->serverPort(), oldServer->serverPort());
+
+	oldServer->shutdown();
+	QVERIFY(!oldServer->isListening());
+
+	// The successor keeps accepting connections on the same port.
+	QIODevice* client = createClientConnection();
+	sendRequest(client, "Hello");
+	QCOMPARE(handledRequests.size(), 1);
+	QVERIFY(handledRequests.first()->parent() == newServer);
+	sendResponses();
+	QVERIFY(waitFor([&]{ return client->bytesAvailable() > 0; }));
+	QVERIFY(client->readAll().endsWith("Hello"));
+
+	delete newServer;
+#else
+	QSKIP("Listening socket handover is only supported on Unix.", SkipSingle);
+#endif // Q_OS_UNIX
+}
+
+void HttpServerTest::testRecyclesSockets()
+{
+	Pillow::HttpServer* httpServer = static_cast<Pillow::HttpServer*>(server);
+	QCOMPARE(httpServer->reservedSocketCount(), 0);
+
+	sendConcurrentRequests(5);
+	QVERIFY(waitFor([&]{ return httpServer->reservedSocketCount() == 5; }));
+
+	// New clients are served on the reserved sockets.
+	QIODevice* client = createClientConnection();
+	sendRequest(client, "Hello");
+	QCOMPARE(httpServer->reservedSocketCount(), 4);
+	sendResponses();
+	QVERIFY(waitFor([&]{ return client->bytesAvailable() > 0; }));
+	QVERIFY(client->readAll().endsWith("Hello"));
+	delete client;
+	QVERIFY(waitFor([&]{ return httpServer->reservedSocketCount() == 5; }));
+}
+
 QObject* HttpServerTest::createServer()
 {
 	return new Pillow::HttpServer(QHostAddress::Any, 4577);
@@ -26,6 +26,9 @@ protected slots: // Test slots.
 	void testHandlesConcurrentConnections();
 	void testReusesRequests();
 	void testDestroysRequests();
+	void testAdaptsReserveToLoad();
+	void testReserveBoundsDoNotDependOnSetterOrder();
+	void testShutdownDrainsConnections();
 	
 protected:
 	QObject* server;
@@ -57,6 +60,11 @@ private slots: // Test slots.
 	void testHandlesConcurrentConnections() { HttpServerTestBase::testHandlesConcurrentConnections(); }
 	void testReusesRequests() { HttpServerTestBase::testReusesRequests(); }
 	void testDestroysRequests() { HttpServerTestBase::testDestroysRequests(); }
+	void testAdaptsReserveToLoad() { HttpServerTestBase::testAdaptsReserveToLoad(); }
+	void testReserveBoundsDoNotDependOnSetterOrder() { HttpServerTestBase::testReserveBoundsDoNotDependOnSetterOrder(); }
+	void testShutdownDrainsConnections() { HttpServerTestBase::testShutdownDrainsConnections(); }
+	void testListeningSocketHandover();
+	void testRecyclesSockets();
 
 protected:
 	virtual QObject* createServer();
@@ -76,6 +84,9 @@ private slots: // Test slots.
 	void testHandlesConcurrentConnections() { HttpServerTestBase::testHandlesConcurrentConnections(); }
 	void testReusesRequests() { HttpServerTestBase::testReusesRequests(); }
 	void testDestroysRequests() { HttpServerTestBase::testDestroysRequests(); }
+	void testAdaptsReserveToLoad() { HttpServerTestBase::testAdaptsReserveToLoad(); }
+	void testReserveBoundsDoNotDependOnSetterOrder() { HttpServerTestBase::testReserveBoundsDoNotDependOnSetterOrder(); }
+	void testShutdownDrainsConnections() { HttpServerTestBase::testShutdownDrainsConnections(); }
 
 protected:
 	virtual QObject* createServer();
@@ -2,7 +2,11 @@
 #include <HttpsServer.h>
 #include <QtCore/QCoreApplication>
 #include <QtCore/QFile>
+#include <QtCore/QElapsedTimer>
+#include <QtTest/QTest>
+#include <QtTest/QSignalSpy>
 #include <QtNetwork/QSslSocket>
+#include <QtNetwork/QTcpSocket>
 #include <QtNetwork/QSslKey>
 #include <QtNetwork/QSslCertificate>
 
@@ -53,5 +57,187 @@ QIODevice * HttpsServerTest::createClientConnection()
 	return socket;
 }
 
+void HttpsServerTest::testSharesSslConfiguration()
+{
+	Pillow::HttpsServer* httpsServer = static_cast<Pillow::HttpsServer*>(server);
+	QCOMPARE(httpsServer->sslConfiguration().localCertificate(), sslCertificate());
+	QCOMPARE(httpsServer->sslConfiguration().privateKey(), sslPrivateKey());
+	QCOMPARE(httpsServer->encryptedCount(), quint64(0));
+
+	QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+	configuration.setPeerVerifyMode(QSslSocket::VerifyNone);
+	httpsServer->setSslConfiguration(configuration);
+	QCOMPARE(httpsServer->sslConfiguration().peerVerifyMode(), QSslSocket::VerifyNone);
+	QCOMPARE(httpsServer->sslConfiguration().localCertificate(), sslCertificate()); // Kept from the server.
+
+	QIODevice* first = createClientConnection();
+	QIODevice* second = createClientConnection();
+
+	QElapsedTimer timer; timer.start();
+	while (httpsServer->encryptedCount() < 2 && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(httpsServer->encryptedCount(), quint64(2));
+	QCOMPARE(httpsServer->failedHandshakeCount(), quint64(0));
+
+	httpsServer->resetCounters();
+	QCOMPARE(httpsServer->encryptedCount(), quint64(0));
+	delete first; delete second;
+}
+
+void HttpsServerTest::testOffloadsHandshakes()
+{
+	Pillow::HttpsServer* httpsServer = static_cast<Pillow::HttpsServer*>(server);
+	httpsServer->setHandshakeThreadCount(2);
+	QCOMPARE(httpsServer->handshakeThreadCount(), 2);
+
+	HttpServerTestBase::testHandlesConcurrentConnections();
+	QCOMPARE(httpsServer->encryptedCount(), quint64(10));
+	QCOMPARE(httpsServer->pendingHandshakeCount(), 0);
+
+	httpsServer->setHandshakeThreadCount(0);
+	QCOMPARE(httpsServer->handshakeThreadCount(), 0);
+	handledRequests.clear(); guardedHandledRequests.clear();
+	HttpServerTestBase::testHandlesConnectionsAsRequests();
+}
+
+void HttpsServerTest::testLimitsPendingHandshakes()
+{
+	Pillow::HttpsServer* httpsServer = static_cast<Pillow::HttpsServer*>(server);
+	httpsServer->setHandshakeThreadCount(1);
+	httpsServer->setMaximumPendingHandshakes(1);
+	httpsServer->setHandshakeTimeout(500);
+
+	// A client that never starts its handshake holds the only pending slot until it times out.
+	QTcpSocket stalled; stalled.connectToHost("127.0.0.1", 4588);
+	QElapsedTimer timer; timer.start();
+	while (httpsServer->pendingHandshakeCount() < 1 && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(httpsServer->pendingHandshakeCount(), 1);
+
+	QTcpSocket refused; refused.connectToHost("127.0.0.1", 4588);
+	timer.start();
+	while (httpsServer->refusedHandshakeCount() < 1 && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(httpsServer->refusedHandshakeCount(), quint64(1));
+	QCOMPARE(httpsServer->pendingHandshakeCount(), 1);
+
+	timer.start();
+	while ((httpsServer->pendingHandshakeCount() > 0 || stalled.state() != QAbstractSocket::UnconnectedState) && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(httpsServer->pendingHandshakeCount(), 0);
+	QCOMPARE(stalled.state(), QAbstractSocket::UnconnectedState);
+	QCOMPARE(httpsServer->encryptedCount(), quint64(0));
+	QCOMPARE(httpsServer->failedHandshakeCount(), quint64(1));
+
+	// Room again for regular clients.
+	HttpServerTestBase::testHandlesConnectionsAsRequests();
+	QCOMPARE(httpsServer->encryptedCount(), quint64(1));
+}
+
+void HttpsServerTest::testShutdownWaitsForHandshakes()
+{
+	Pillow::HttpsServer* httpsServer = static_cast<Pillow::HttpsServer*>(server);
+	httpsServer->setHandshakeThreadCount(1);
+	httpsServer->setHandshakeTimeout(500);
+
+	// A client that never starts its handshake, and one whose handshake needs this thread to go on.
+	QTcpSocket stalled; stalled.connectToHost("127.0.0.1", 4588);
+	QSslSocket late;
+	late.setPeerVerifyMode(QSslSocket::VerifyNone);
+	late.connectToHostEncrypted("127.0.0.1", 4588);
+	QElapsedTimer timer; timer.start();
+	while (httpsServer->pendingHandshakeCount() < 2 && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(httpsServer->pendingHandshakeCount(), 2);
+
+	QSignalSpy drainedSpy(server, SIGNAL(drained()));
+	httpsServer->shutdown();
+	QCoreApplication::processEvents();
+	QVERIFY(drainedSpy.isEmpty());
+
+	// The late client completes its handshake, but is not served; the stalled one times out.
+	timer.start();
+	while (drainedSpy.isEmpty() && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(drainedSpy.size(), 1);
+	QCOMPARE(httpsServer->pendingHandshakeCount(), 0);
+	QCOMPARE(httpsServer->activeConnectionCount(), 0);
+	QCOMPARE(httpsServer->encryptedCount(), quint64(1));
+
+	timer.start();
+	while (late.state() != QAbstractSocket::UnconnectedState && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(late.state(), QAbstractSocket::UnconnectedState);
+}
+
+void HttpsServerTest::testCountsFailedHandshakes()
+{
+	Pillow::HttpsServer* httpsServer = static_cast<Pillow::HttpsServer*>(server);
+
+	// A plain HTTP client: the server can not make sense of its "client hello".
+	QTcpSocket plain; plain.connectToHost("127.0.0.1", 4588);
+	QVERIFY(plain.waitForConnected(5000));
+	plain.write("GET / HTTP/1.1\r\n\r\n");
+	QElapsedTimer timer; timer.start();
+	while (httpsServer->failedHandshakeCount() < 1 && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	QCOMPARE(httpsServer->failedHandshakeCount(), quint64(1));
+	QCOMPARE(httpsServer->encryptedCount(), quint64(0));
+
+	// Errors on established connections are none of the handshake's.
+	QIODevice* client = createClientConnection();
+	timer.start();
+	while (httpsServer->encryptedCount() < 1 && timer.elapsed() < 5000)
+		QCoreApplication::processEvents();
+	delete client;
+	QTest::qWait(100);
+	QCOMPARE(httpsServer->failedHandshakeCount(), quint64(1));
+}
+
+void HttpsServerTest::testResumesSessions()
+{
+	Pillow::HttpsServer* httpsServer = static_cast<Pillow::HttpsServer*>(server);
+	QCOMPARE(httpsServer->sessionCacheSize(), int(Pillow::HttpsServer::DefaultSessionCacheSize));
+	QCOMPARE(httpsServer->sessionTimeout(), int(Pillow::HttpsServer::DefaultSessionTimeout));
+	QVERIFY(httpsServer->sessionTicketsEnabled());
+	if (!Pillow::HttpsServer::isSessionResumptionSupported())
+		QSKIP("Session resumption needs CONFIG += pillow_openssl.", SkipSingle);
+
+	// Qt clients only get TLS 1.3 session tickets after the handshake: stick to TLS 1.2 to keep this simple.
+	QSslConfiguration configuration = httpsServer->sslConfiguration();
+	configuration.setProtocol(QSsl::TlsV1_2);
+	httpsServer->setSslConfiguration(configuration);
+
+	QSslConfiguration clientConfiguration = QSslConfiguration::defaultConfiguration();
+	clientConfiguration.setPeerVerifyMode(QSslSocket::VerifyNone);
+	clientConfiguration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+
+	// From a session ticket, from the session cache alone, then with neither.
+	for (int mode = 0; mode < 3; ++mode)
+	{
+		httpsServer->setSessionTicketsEnabled(mode == 0);
+		httpsServer->setSessionCacheSize(mode == 2 ? 0 : int(Pillow::HttpsServer::DefaultSessionCacheSize));
+		httpsServer->resetCounters();
+
+		QSslConfiguration sessionConfiguration = clientConfiguration;
+		for (int i = 0; i < 2; ++i)
+		{
+			QSslSocket client;
+			client.setSslConfiguration(sessionConfiguration);
+			client.connectToHostEncrypted("127.0.0.1", 4588);
+			QElapsedTimer timer; timer.start();
+			while ((!client.isEncrypted() || httpsServer->encryptedCount() < quint64(i + 1)) && timer.elapsed() < 5000)
+				QCoreApplication::processEvents();
+			QVERIFY(client.isEncrypted());
+			sessionConfiguration = client.sslConfiguration();
+			QVERIFY(!sessionConfiguration.sessionTicket().isEmpty());
+			client.disconnectFromHost();
+		}
+
+		QCOMPARE(httpsServer->sessionHitCount(), quint64(mode == 2 ? 0 : 1));
+		QCOMPARE(httpsServer->sessionMissCount(), quint64(mode == 2 ? 2 : 1));
+	}
+}
+
 #endif // !defined(PILLOW_NO_SSL) && !defined(QT_NO_SSL)
 
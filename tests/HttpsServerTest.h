@@ -18,6 +18,14 @@ private slots: // Test slots.
 	void testHandlesConcurrentConnections() { HttpServerTestBase::testHandlesConcurrentConnections(); }
     void testReusesRequests() { HttpServerTestBase::testReusesRequests(); }
 	void testDestroysRequests() { HttpServerTestBase::testDestroysRequests(); }
+	void testAdaptsReserveToLoad() { HttpServerTestBase::testAdaptsReserveToLoad(); }
+	void testShutdownDrainsConnections() { HttpServerTestBase::testShutdownDrainsConnections(); }
+	void testSharesSslConfiguration();
+	void testOffloadsHandshakes();
+	void testLimitsPendingHandshakes();
+	void testShutdownWaitsForHandshakes();
+	void testCountsFailedHandshakes();
+	void testResumesSessions();
 
 protected:
 	virtual QObject* createServer();
@@ -0,0 +1,168 @@
+#include <QtTest/QTest>
+#include "Helpers.h"
+#include "parser/parser.h"
+#include "parser/fastparser.h"
+
+namespace
+{
+	struct ParseResult
+	{
+		bool error, finished;
+		QByteArray method, uri, fragment, path, queryString, httpVersion;
+		QList<QByteArray> headers;
+		size_t bodyStart;
+
+		QByteArray describe() const
+		{
+			QByteArray result;
+			if (error) return "error";
+			if (!finished) return "unfinished";
+			result.append(method).append('|').append(uri).append('|').append(fragment).append('|').append(path)
+				.append('|').append(queryString).append('|').append(httpVersion).append('|').append(QByteArray::number(int(bodyStart)));
+			foreach (const QByteArray& header, headers) result.append('|').append(header);
+			return result;
+		}
+	};
+
+	void collectField(void *data, const char *field, size_t flen, const char *value, size_t vlen)
+	{
+		static_cast<ParseResult*>(data)->headers << (QByteArray(field, int(flen)) + "=" + QByteArray(value, int(vlen)));
+	}
+
+	// Feeds the request in chunks of chunkSize bytes, the way HttpConnection does as data arrives.
+	ParseResult parse(bool fast, const QByteArray& request, int chunkSize)
+	{
+		ParseResult result;
+		http_parser parser;
+		memset(&parser, 0, sizeof(http_parser));
+		parser.data = &result;
+		parser.http_field = &collectField;
+		if (fast) fast_http_parser_init(&parser); else thin_http_parser_init(&parser);
+
+		QByteArray buffer;
+		for (int i = 0; i < request.size(); i += chunkSize)
+		{
+			buffer.append(request.mid(i, chunkSize)); // QByteArray keeps the data null terminated, as the thin parser requires.
+			if (fast) fast_http_parser_execute(&parser, buffer.constData(), buffer.size(), parser.nread);
+			else thin_http_parser_execute(&parser, buffer.constData(), buffer.size(), parser.nread);
+
+			result.error = fast ? fast_http_parser_has_error(&parser) : thin_http_parser_has_error(&parser);
+			result.finished = fast ? fast_http_parser_is_finished(&parser) : thin_http_parser_is_finished(&parser);
+			if (result.error || result.finished) break;
+		}
+
+		const char* data = buffer.constData();
+		result.method = QByteArray(data + parser.request_method_start, parser.request_method_len);
+		result.uri = QByteArray(data + parser.request_uri_start, parser.request_uri_len);
+		result.fragment = QByteArray(data + parser.fragment_start, parser.fragment_len);
+		result.path = QByteArray(data + parser.request_path_start, parser.request_path_len);
+		result.queryString = QByteArray(data + parser.query_string_start, parser.query_string_len);
+		result.httpVersion = QByteArray(data + parser.http_version_start, parser.http_version_len);
+		result.bodyStart = parser.body_start;
+		return result;
+	}
+
+	const QByteArray realisticRequest =
+			"GET /app/assets/javascripts/application-5f2d1c7e8a.js?body=1&v=20120101 HTTP/1.1\r\n"
+			"Host: www.example.org\r\n"
+			"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/24.0 Safari/537.36\r\n"
+			"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+			"Accept-Language: en-US,en;q=0.5\r\n"
+			"Accept-Encoding: gzip, deflate\r\n"
+			"Cookie: session=abcdef0123456789; theme=dark; tracking=xyz\r\n"
+			"Connection: keep-alive\r\n"
+			"\r\n";
+}
+
+class RequestParserTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void should_parse_like_the_thin_parser_data()
+	{
+		QTest::addColumn<QByteArray>("request");
+		QTest::addColumn<QByteArray>("expected");
+
+		QTest::newRow("simple") << QByteArray("GET / HTTP/1.0\r\n\r\n") << QByteArray("GET|/||/||HTTP/1.0|18");
+		QTest::newRow("query and fragment") << QByteArray("GET /a/b?c=d?e#frag HTTP/1.1\r\nHost: x\r\n\r\nbody")
+											<< QByteArray("GET|/a/b?c=d?e|frag|/a/b|c=d?e|HTTP/1.1|41|Host=x");
+		QTest::newRow("escapes") << QByteArray("GET /a%20b%u00e9 HTTP/1.1\r\n\r\n") << QByteArray("GET|/a%20b%u00e9||/a%20b%u00e9||HTTP/1.1|29");
+		QTest::newRow("params") << QByteArray("GET /a;b/c;d HTTP/1.1\r\n\r\n") << QByteArray("GET|/a;b/c;d||/a;b/c;d||HTTP/1.1|25");
+		QTest::newRow("asterisk") << QByteArray("OPTIONS * HTTP/1.1\r\n\r\n") << QByteArray("OPTIONS|*||||HTTP/1.1|22");
+		QTest::newRow("absolute uri") << QByteArray("GET http://example.org/a?b HTTP/1.1\r\n\r\n") << QByteArray("GET|http://example.org/a?b||||HTTP/1.1|39");
+		QTest::newRow("long uri") << QByteArray("GET /" + QByteArray(300, 'x') + "?" + QByteArray(100, 'y') + " HTTP/1.1\r\n\r\n")
+								  << QByteArray("GET|/" + QByteArray(300, 'x') + "?" + QByteArray(100, 'y') + "||/" + QByteArray(300, 'x') + "|" + QByteArray(100, 'y') + "|HTTP/1.1|419");
+		QTest::newRow("header values") << QByteArray("POST / HTTP/1.1\r\nA:b\r\nC:   d e \r\nEmpty:\r\nX-Y: \r\n\r\n")
+									   << QByteArray("POST|/||/||HTTP/1.1|50|A=b|C=d e |Empty=|X-Y=");
+		QTest::newRow("realistic") << realisticRequest << QByteArray();
+
+		QTest::newRow("no method") << QByteArray(" / HTTP/1.1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("lowercase method") << QByteArray("get / HTTP/1.1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("long method") << QByteArray("GETGETGETGETGETGETGET / HTTP/1.1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("bad escape") << QByteArray("GET /%zz HTTP/1.1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("control char") << QByteArray("GET /a\tb HTTP/1.1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("bad version") << QByteArray("GET / HTTP/1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("trailing junk") << QByteArray("GET / HTTP/1.1 \r\n\r\n") << QByteArray("error");
+		QTest::newRow("bare LF") << QByteArray("GET / HTTP/1.1\n\n") << QByteArray("error");
+		QTest::newRow("lone CR") << QByteArray("GET / HTTP/1.1\r\nA: b\rc\r\n\r\n") << QByteArray("error");
+		QTest::newRow("bad field name") << QByteArray("GET / HTTP/1.1\r\nBad Name: v\r\n\r\n") << QByteArray("error");
+		QTest::newRow("empty field name") << QByteArray("GET / HTTP/1.1\r\n: v\r\n\r\n") << QByteArray("error");
+		QTest::newRow("leading CRLF") << QByteArray("\r\nGET / HTTP/1.1\r\n\r\n") << QByteArray("error");
+		QTest::newRow("incomplete") << QByteArray("GET / HTTP/1.1\r\nHost: x\r\n") << QByteArray("unfinished");
+	}
+
+	void should_parse_like_the_thin_parser()
+	{
+		QFETCH(QByteArray, request);
+		QFETCH(QByteArray, expected);
+
+		const QByteArray thin = parse(false, request, request.size()).describe();
+		if (!expected.isEmpty()) QCOMPARE(thin, expected);
+
+		const int chunkSizes[] = { request.size(), 1, 2, 3, 5, 7, 16 };
+		for (size_t i = 0; i < sizeof(chunkSizes) / sizeof(chunkSizes[0]); ++i)
+		{
+			const QByteArray fast = parse(true, request, chunkSizes[i]).describe();
+			if (thin == "error") QVERIFY(fast == "error" || fast == "unfinished"); // Errors can only be detected once a line is complete.
+			else QCOMPARE(fast, thin);
+		}
+	}
+
+	void benchmark_parse_data()
+	{
+		QTest::addColumn<bool>("fast");
+		QTest::newRow("thin") << false;
+		QTest::newRow("fast") << true;
+	}
+
+	void benchmark_parse()
+	{
+		QFETCH(bool, fast);
+
+		qint64 dummy = 0;
+		QBENCHMARK
+		{
+			for (int i = 0; i < 10000; ++i)
+			{
+				http_parser parser;
+				memset(&parser, 0, sizeof(http_parser));
+				if (fast)
+				{
+					fast_http_parser_init(&parser);
+					fast_http_parser_execute(&parser, realisticRequest.constData(), realisticRequest.size(), 0);
+				}
+				else
+				{
+					thin_http_parser_init(&parser);
+					thin_http_parser_execute(&parser, realisticRequest.constData(), realisticRequest.size(), 0);
+				}
+				dummy += parser.body_start;
+			}
+		}
+		QVERIFY(dummy > 0);
+	}
+};
+PILLOW_TEST_DECLARE(RequestParserTest)
+
+#include "RequestParserTest.moc"
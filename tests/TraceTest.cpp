@@ -0,0 +1,46 @@
+#include <QtTest/QTest>
+#include "Helpers.h"
+#include "private/Trace.h"
+
+extern int traceWithoutTracing();
+
+class TraceTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void should_not_evaluate_arguments_without_a_tracer()
+	{
+		int evaluated = 0;
+		QVERIFY(!PILLOW_TRACE_ENABLED(connection_closed));
+		PILLOW_TRACE2(connection_closed, static_cast<void*>(this), ++evaluated);
+		PILLOW_TRACE3(client_connect, static_cast<void*>(this), "localhost", ++evaluated);
+		PILLOW_TRACE4(connection_completed, static_cast<void*>(this), 200, qint64(++evaluated), qint64(0));
+		QCOMPARE(evaluated, 0);
+	}
+
+	void should_evaluate_arguments_when_a_tracer_attaches()
+	{
+#ifdef PILLOW_TRACING
+		// Attaching tracers increment the probe semaphores exported by pillowcore.
+		++pillow_connection_closed_semaphore;
+		int evaluated = 0;
+		QVERIFY(PILLOW_TRACE_ENABLED(connection_closed));
+		PILLOW_TRACE2(connection_closed, static_cast<void*>(this), ++evaluated);
+		PILLOW_TRACE3(client_connect, static_cast<void*>(this), "localhost", ++evaluated);
+		--pillow_connection_closed_semaphore;
+		QCOMPARE(evaluated, 1);
+#else
+		QSKIP("Tracing is not available in this build.", SkipSingle);
+#endif
+	}
+
+	void should_compile_out_with_pillow_no_tracing()
+	{
+		QCOMPARE(traceWithoutTracing(), 0);
+	}
+};
+
+PILLOW_TEST_DECLARE(TraceTest)
+
+#include "TraceTest.moc"
@@ -0,0 +1,17 @@
+// Compiles the tracepoints with tracing left out, as CONFIG += pillow_no_tracing does, for TraceTest.
+#define PILLOW_NO_TRACING
+#include "private/Trace.h"
+
+#ifdef PILLOW_TRACING
+#error PILLOW_NO_TRACING must leave the tracepoints out.
+#endif
+
+int traceWithoutTracing()
+{
+	int evaluated = 0;
+	if (PILLOW_TRACE_ENABLED(connection_completed)) ++evaluated;
+	PILLOW_TRACE2(connection_closed, static_cast<void*>(0), ++evaluated);
+	PILLOW_TRACE3(client_connect, static_cast<void*>(0), "localhost", ++evaluated);
+	PILLOW_TRACE4(connection_completed, static_cast<void*>(0), 200, static_cast<long long>(++evaluated), 0LL);
+	return evaluated;
+}
@@ -0,0 +1,7 @@
+# Compile test for C++20 coroutines, see tests.pro.
+TEMPLATE = app
+CONFIG -= qt app_bundle
+CONFIG += console c++2a
+*-g++*:equals(QMAKE_GCC_MAJOR_VERSION, 10): QMAKE_CXXFLAGS += -fcoroutines
+
+SOURCES += main.cpp
@@ -0,0 +1,25 @@
+#include <coroutine>
+
+#if !defined(__cpp_impl_coroutine) || __cpp_impl_coroutine < 201902L
+#error "No C++20 coroutines."
+#endif
+
+struct Task
+{
+	struct promise_type
+	{
+		Task get_return_object() { return Task(); }
+		std::suspend_never initial_suspend() { return std::suspend_never(); }
+		std::suspend_never final_suspend() noexcept { return std::suspend_never(); }
+		void return_void() {}
+		void unhandled_exception() {}
+	};
+};
+
+Task task() { co_await std::suspend_never(); }
+
+int main()
+{
+	task();
+	return 0;
+}
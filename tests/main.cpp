@@ -25,6 +25,7 @@ int main(int argc, char *argv[])
 	result += execTest<HttpLocalServerTest>();
 	result += execTest<HttpHandlerTest>();
 	result += execTest<HttpHandlerFileTest>();
+	result += execTest<HttpHandlerBundleTest>();
 	result += execTest<HttpHandlerSimpleRouterTest>();
 	result += execTest<HttpHandlerProxyTest>();
 
@@ -32,9 +33,14 @@ int main(int argc, char *argv[])
 	PILLOW_TEST_RUN(HttpRequestWriterTest, result);
 	PILLOW_TEST_RUN(HttpResponseParserTest, result);
 	PILLOW_TEST_RUN(HttpClientTest, result);
+	PILLOW_TEST_RUN(HttpClientPoolTest, result);
+	PILLOW_TEST_RUN(HttpHostCacheTest, result);
 	PILLOW_TEST_RUN(NetworkAccessManagerTest, result);
 	PILLOW_TEST_RUN(HttpHeaderTest, result);
 	PILLOW_TEST_RUN(HttpHeaderCollectionTest, result);
+	PILLOW_TEST_RUN(RequestParserTest, result);
+	PILLOW_TEST_RUN(HttpBufferPoolTest, result);
+	PILLOW_TEST_RUN(TraceTest, result);
 
 	return result;
 }
@@ -1,3 +1,10 @@
+# The coroutine handler tests are built in C++20 mode when the compiler supports coroutines (see config.tests/coroutines),
+# and skipped otherwise.
+!pillow_coroutines:if(greaterThan(QT_MAJOR_VERSION, 5)|if(equals(QT_MAJOR_VERSION, 5):greaterThan(QT_MINOR_VERSION, 11))) {
+	load(configure)
+	qtCompileTest(coroutines): CONFIG += pillow_coroutines
+}
+
 include(../config.pri)
 TEMPLATE = app
 
@@ -21,7 +28,11 @@ SOURCES += main.cpp \
 	HttpHandlerProxyTest.cpp \
 	ByteArrayHelpersTest.cpp \
 	HttpClientTest.cpp \
-	HttpHeaderTest.cpp
+	HttpHeaderTest.cpp \
+	RequestParserTest.cpp \
+	HttpBufferPoolTest.cpp \
+	TraceTest.cpp \
+	TraceTestNoTracing.cpp
 
 HEADERS += \
 	HttpServerTest.h \
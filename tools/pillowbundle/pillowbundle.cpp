@@ -0,0 +1,36 @@
+#include <QtCore/QCoreApplication>
+#include <QtCore/QStringList>
+#include <QtCore/QTextStream>
+#include "HttpHandlerBundle.h"
+using namespace Pillow;
+
+//
+// pillowbundle: packs a directory of static files into a bundle served by HttpHandlerBundle.
+//
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QTextStream err(stderr);
+
+	QStringList arguments = a.arguments().mid(1);
+	bool gzipEnabled = !arguments.removeAll("--no-gzip");
+
+	if (arguments.size() < 2 || arguments.size() > 3)
+	{
+		err << "Usage: pillowbundle [--no-gzip] <directory> <bundle file> [path prefix]\n";
+		return 1;
+	}
+
+	HttpBundleWriter writer;
+	writer.setGzipEnabled(gzipEnabled);
+
+	if (!writer.addDirectory(arguments.at(0), arguments.size() > 2 ? arguments.at(2).toUtf8() : QByteArray("/")))
+		return 1;
+
+	if (!writer.write(arguments.at(1)))
+		return 1;
+
+	err << "Bundled " << writer.count() << " files into " << arguments.at(1) << "\n";
+	return 0;
+}
@@ -0,0 +1,14 @@
+include(../tools.pri)
+
+TEMPLATE = app
+
+QT       += core network
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+INCLUDEPATH += .
+DEPENDPATH += .
+
+SOURCES += pillowbundle.cpp
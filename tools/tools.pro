@@ -0,0 +1,4 @@
+include(../config.pri)
+TEMPLATE = subdirs
+
+SUBDIRS = pillowbundle